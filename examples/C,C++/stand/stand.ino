@@ -15,8 +15,9 @@ int main() {
   float err2;                    // 目標上端速度と実上端速度の偏差
   float u;                       // 制御入力  -1.0〜0〜1.0
 
-  crl.init();     // ロボットの初期化
-  crl.setDt(dt);  // サンプリング時間を設定
+  crl.init();                                                       // ロボットの初期化
+  crl.setDt(dt);                                                    // サンプリング時間を設定
+  crl.setOutputs(CRAWL_OUTPUT_THETA_Z | CRAWL_OUTPUT_HEAD_VELOCITY);  // 使う姿勢角度と上端速度だけを計算する
 
   while (1) {
     crl.realtimeLoop();                     // dt[s]ごとに以下ループを実行
@@ -8,11 +8,55 @@
 #ifndef INCLUDED_Crawl_h
 #define INCLUDED_Crawl_h
 #include <Arduino.h>
+#include "util/crawl_config.h"
+#include "util/calibration.h"
+#include "util/hal.h"
+#include "util/flight_recorder.h"
+#include "util/profiler.h"
+#include "util/scheduler.h"
+#include "util/lti_filter.h"
+#if CRAWL_KALMAN_BIAS
+#include "util/kalmanfilter_bias.h"
+#else
+#include "util/kalmanfilter_bank.h"
+#endif
+#if CRAWL_FIXED_POINT
+#include "util/fixed_point.h"
+#endif
+#if CRAWL_AHRS
+#include "util/ahrs.h"
+#endif
+
+/** 姿勢角度の軸の番号(X軸) */
+#define CRAWL_AXIS_X 0
+/** 姿勢角度の軸の番号(Y軸) */
+#define CRAWL_AXIS_Y 1
+/** 姿勢角度の軸の番号(Z軸) */
+#define CRAWL_AXIS_Z 2
+/** 軸の番号に対応するビット */
+#define CRAWL_AXIS_BIT(axis) (1 << (axis))
+
+/** updateState()で計算する出力(setOutputs()): X軸周りの姿勢角度と角速度 */
+#define CRAWL_OUTPUT_THETA_X CRAWL_AXIS_BIT(CRAWL_AXIS_X)
+/** updateState()で計算する出力(setOutputs()): Y軸周りの姿勢角度と角速度 */
+#define CRAWL_OUTPUT_THETA_Y CRAWL_AXIS_BIT(CRAWL_AXIS_Y)
+/** updateState()で計算する出力(setOutputs()): Z軸周りの姿勢角度と角速度 */
+#define CRAWL_OUTPUT_THETA_Z CRAWL_AXIS_BIT(CRAWL_AXIS_Z)
+/** updateState()で計算する出力(setOutputs()): 3軸の加速度 */
+#define CRAWL_OUTPUT_ACC 0x08
+/** updateState()で計算する出力(setOutputs()): 倒立時のクロール上端の速度(Z軸周りの姿勢角度も計算する) */
+#define CRAWL_OUTPUT_HEAD_VELOCITY 0x10
+/** updateState()で計算する出力(setOutputs()): 地磁気センサの読み出し(フライトレコーダの記録に含まれる) */
+#define CRAWL_OUTPUT_MAG 0x20
+/** updateState()で計算する出力(setOutputs()): すべて */
+#define CRAWL_OUTPUT_ALL 0x3F
 
 /**
  * @class FirstOrderFilter
  * @brief
  * 一次遅れフィルタークラス.
+ *
+ * 一次のLtiFilterとして,厳密に離散化した係数をsetDt(),setT()の際に求めておきます.
  */
 class FirstOrderFilter {
   /// @cond develop
@@ -21,8 +65,12 @@ class FirstOrderFilter {
   float dt;
   /** 時定数 */
   float T;
-  /** 出力値 */
-  float y;
+  /** 時定数の逆数 */
+  float inv_T;
+  /** 一次遅れを離散化したフィルタ */
+  LtiFilter<1> lti;
+  /** dt,Tから係数を求める */
+  void updateCoefficients();
   /// @endcond
  public:
   /**
@@ -46,6 +94,14 @@ class FirstOrderFilter {
    * @return なし
    */
   void setT(float T);
+  /**
+   * @brief 出力値を設定する
+   *
+   * 入力がyのまま十分な時間が経った状態にします.
+   * @param y 出力値
+   * @return なし
+   */
+  void setOutput(float y);
 
   /**
    * @brief 出力値を取得する
@@ -57,9 +113,9 @@ class FirstOrderFilter {
   /**
    * @brief 入力から出力を計算する
    *
-   * ルンゲクッタ法により4次の精度で一時遅れフィルターを計算します.
+   * 入力が一周期の間一定であるとして,一時遅れフィルターの厳密解 y = y + (1 - exp(-dt/T)) (x - y) を計算します.
    * @param x 入力値
-   * @return なし
+   * @return フィルタを通した値
    * @attention ループ中では一回だけ呼び出すようにしてください.
    */
   float calculate(float x);
@@ -81,9 +137,9 @@ class LaggedDerivative : public FirstOrderFilter {
   /**
    * @brief 入力から出力を計算する
    *
-   * ルンゲクッタ法により4次の精度で不完全微分を計算します.
+   * 不完全微分 s/(Ts+1) = (1 - 1/(Ts+1))/T を,一次遅れフィルターの出力を用いて計算します.
    * @param x 入力値
-   * @return なし
+   * @return 不完全微分した値
    * @attention ループ中では一回だけ呼び出すようにしてください.
    */
   float calculate(float x);
@@ -147,7 +203,7 @@ class Integral {
   /**
    * @brief 入力から出力を計算する
    *
-   * 制限付き積分を計算します.
+   * 入力にサンプリングタイムを掛けた値 y = x dt を制限して出力します.前回の出力は加算しません.
    * @param x 入力値
    * @return なし
    * @attention ループ中では一回だけ呼び出すようにしてください.
@@ -162,7 +218,7 @@ class Integral {
   float getOutput();
 
   /// @cond develop
-  /** 時定数 */
+  /** 出力値 */
   float y;
   /** 下限値 */
   float limit_low;
@@ -176,6 +232,13 @@ class Integral {
  * @class CrlRobot
  * @brief
  * クロールに対して指令を出す,クロールの持っているセンサの情報を取得するためのクラス.
+ *
+ * センサの生値やカルマンフィルタなどの状態はインスタンスが持つ.バスと時計(hal.h),連続読み出し(acquisition.h)と
+ * モータのドライバの状態はインスタンスではなく実行するスレッドに一つだけ持つため,ホスト向けではスレッドごとに1台ずつ,
+ * 独立したロボットを動かせる.同じスレッドで使えるのは,最後にinit()を呼んだ1台だけである.
+ * 同じスレッドで別のインスタンスを順に使う場合は,前のインスタンスを使い終えてから次のinit()を呼ぶこと.
+ * ホスト向けでは,後から同じスレッドで別のインスタンスのinit()が呼ばれたインスタンスのrealtimeLoop()と
+ * updateState()はassertで止まる.
  */
 class CrlRobot {
  public:
@@ -185,6 +248,8 @@ class CrlRobot {
    * クロールを使用する前に必ず呼び出してください.
    * 加速度,ジャイロセンサのキャリブレーションを行うので約1.5秒程度の時間を要します.
    * その際,クロールは水平な場所に置き,安静にしてください.
+   * CRAWL_WARM_BOOTが1の場合,キャリブレーションの結果をEEPROMに保存し,次回からは保存時と温度や
+   * ジャイロのオフセットが変わっていないことを確かめられれば,キャリブレーションを省略して約0.1秒で終わります.
    *
    * @return なし
    * @warning
@@ -199,6 +264,10 @@ class CrlRobot {
    * このメンバ関数は,前回このメンバ関数がリターンした時刻からdt秒後にリターンします.
    * このメンバ関数をループの中で呼び出すと,そのループは正確にdt秒起きに実行されます.
    * この特性はPID制御など,正確なリアルタイム性を求められる場合に非常に有効です.
+   * CRAWL_SCHEDULERが1の場合は,タイマ割り込みが作るdt秒ごとの境界でリターンします.
+   * 待つ間は,addTask()で追加したタスクとテレメトリの送出を行い,なければCPUを休止させます.
+   * CRAWL_IMU_SYNCが0の場合,センサの一組の読み出しは境界の直前に完了するよう待つ間に開始します
+   * (CRAWL_ACQUISITION_LEAD_US).
    *
    * @return なし
    * @warning
@@ -213,6 +282,9 @@ class CrlRobot {
    * ループ内の演算時間が,設定時間を超えた場合LED2が点灯し,
    * ユーザに対して,設定時間内で演算が終了しなかったことを知らせます.
    * ユーザーがこの関数を使用する場合は,LED2は使用しないでください.
+   * CRAWL_IMU_SYNCが1の場合,姿勢センサの標本化周期をdtに設定し,realtimeLoop()は標本化したサンプルの
+   * 読み出しが完了した時点で戻ります.dtは1ミリ秒単位(1〜256ミリ秒)に丸められます.
+   * 読み出せなかったサンプルや,ループ内の処理が長く処理できなかったサンプルがある場合もLED2が点灯します.
    *
    * @param dt ループ間隔 単位:秒
    * @return なし
@@ -222,17 +294,78 @@ class CrlRobot {
    * @sa realtimeLoop()
    */
   void setDt(float dt);
+#if CRAWL_SCHEDULER
+  /**
+   * @brief 周期タスクを追加する
+   *
+   * 追加したタスクは,realtimeLoop()が次の周期の境界を待つ間に,周期ごとに一回実行されます.
+   * 複数のタスクが実行を待っている場合は優先度の高いものから実行します.
+   * タスクは他のタスクやループ内の処理に割り込まないため,ループ内の処理やupdateState()の実行中に来た周期の
+   * 実行は,次にrealtimeLoop()を呼び出すまで遅れます.遅れはgetTaskStats()で確認できます.
+   * そのため周期と期限は,realtimeLoop()から次のrealtimeLoop()までの処理時間(updateState()とループ内の処理)に
+   * タスクの処理時間を加えたものより長くしてください.短い場合,その間に来た周期の実行は一回を除いて捨てられ
+   * (skipped),残った一回も期限を過ぎます(missed).
+   * 1kHzなど,それより短い周期で実行する必要があるタスクは,優先度をSCHEDULER_INTERRUPT_PRIORITY以上にしてください.
+   * タイマ割り込みの中で周期の境界ごとに実行され,ループ内の処理の実行中でも遅れません.
+   * 割り込みを禁止したまま実行されるため,数十マイクロ秒程度の短い処理にとどめ,getAttitude()などI2C通信や
+   * シリアル通信の完了を待つ関数は呼ばないでください.
+   * 周期はCRAWL_SCHEDULER_TICK_US(1ミリ秒)の整数倍に丸められます.
+   *
+   * @param task 実行する関数
+   * @param period 周期 単位:秒
+   * @param priority 優先度(大きいほど先に実行する).SCHEDULER_INTERRUPT_PRIORITY以上はタイマ割り込みの中で実行する
+   * @param deadline 期限(周期の境界から完了までの時間) 単位:秒 (0の場合は周期と同じ)
+   * @return タスクの番号.CRAWL_SCHEDULER_TASKSを超えて追加した場合はSCHEDULER_NO_TASK
+   */
+  int8_t addTask(void (*task)(), float period, uint8_t priority, float deadline = 0);
+  /**
+   * @brief タスクの実行状況を取得する
+   *
+   * 番号にSCHEDULER_LOOP_TASKを指定すると,realtimeLoop()から次のrealtimeLoop()までのループ内の処理について,
+   * 周期の境界から完了までの時間と,周期(期限)を超えた回数を取得できます.
+   * @param id タスクの番号
+   * @param stats 書き込み先
+   * @return なし
+   */
+  void getTaskStats(int8_t id, CrlTaskStats* stats);
+#endif
   /**
    * @brief センサヒュージョンの方法を設定する
    *
    * このメンバ関数は,センサのヒュージョン方法を設定します.
    * このメンバ関数を呼び出さない場合,相補フィルタによってセンサヒュージョンを行います.
    *
-   * @param enable_kalman カルマンフィルタを有効にする場合true,相補フィルタを有効にする場合false
+   * @param enable_kalman 全軸でカルマンフィルタを有効にする場合true,相補フィルタを有効にする場合false
    * @attention カルマンフィルタを用いてセンサヒュージョンを行う場合,2 [ms]の計算時間がかかります
    * @return なし
    */
   void setKalman(bool enable_kalman);
+  /**
+   * @brief 軸ごとにセンサヒュージョンの方法を設定する
+   *
+   * カルマンフィルタを有効にした軸は3軸分をまとめて更新するカルマンフィルタ(KalmanFilterBank,
+   * CRAWL_KALMAN_BIASが1の場合はジャイロのバイアスも推定するBiasKalmanFilterBank)で,
+   * それ以外の軸は相補フィルタで姿勢角度を計算します.
+   * 新たにカルマンフィルタを有効にした軸の推定値は,その時点の姿勢角度から始まります.
+   *
+   * @param enable_x X軸周りの姿勢角度にカルマンフィルタを用いる場合true
+   * @param enable_y Y軸周りの姿勢角度にカルマンフィルタを用いる場合true
+   * @param enable_z Z軸周りの姿勢角度にカルマンフィルタを用いる場合true
+   * @return なし
+   */
+  void setKalman(bool enable_x, bool enable_y, bool enable_z);
+  /**
+   * @brief updateState()で計算する出力を設定する
+   *
+   * 含まれない出力の計算(姿勢角度の軸,加速度のフィルタ,上端速度)と地磁気センサの読み出しを省き,
+   * それらを取得するメンバ関数は最後に計算した値を返します.再び含めた出力は,その時点のセンサの値から始まります.
+   * 角速度と上端速度は,updateState()の後で最初に必要になったとき(取得するメンバ関数の呼び出しなど)に一度だけ計算します.
+   * このメンバ関数を呼び出さない場合,CRAWL_OUTPUTS(初期値はCRAWL_OUTPUT_ALL)の出力を計算します.
+   *
+   * @param outputs 計算する出力(CRAWL_OUTPUT_THETA_Zなどの論理和)
+   * @return なし
+   */
+  void setOutputs(uint8_t outputs);
   /**
    * @brief X軸周りの姿勢角度を取得する
    * @return X軸周りの姿勢角度 単位:rad [-pi/2, +3pi/2]
@@ -385,6 +518,8 @@ class CrlRobot {
    *
    * このメンバ関数では,setMotorLeft(),setMotorRight()などで設定したモータ出力を実際の出力に適用します.
    * また,getEncoderLeft()など各種状態･センサ取得関数で得られる情報の更新も行われます.
+   * センサの読み出しとモータ出力の送信はバックグラウンドで行われるため,このメンバ関数はI2C通信を待ちません.
+   * センサの値には,呼び出し時点で読み出しが完了している最新の計測結果が使用されます.
    * @return なし
    * @attention
    *このメンバ関数が呼ばれない限り,モータ出力や,センサの値は更新されません.
@@ -392,22 +527,188 @@ class CrlRobot {
    *制御ループを実装する場合にはrealtimeLoop()の直下で呼び出すことを推奨します.
    */
   void updateState();
+#if CRAWL_RECORDER_RECORDS > 0
+  /**
+   * @brief フライトレコーダを設定する
+   *
+   * 有効にすると,updateState()の度にセンサの生値やモータ指令値,姿勢角度などを一周期分のレコード(CrlRecord)として
+   * RAM上のリングバッファに記録します.
+   * drainをtrueにすると,記録したレコードはrealtimeLoop()が次の周期を待つ間に,
+   * テレメトリのフレーム(telemetry.h)としてUART(TXピン)からCRAWL_TELEMETRY_BAUDの通信速度で送出されます.
+   * 送出は割り込みで駆動する送信リングバッファに空きがある分だけ行い,ループの周期を乱しません.
+   * 送出が追いつかずバッファが一杯になった場合,新しいレコードは捨てられます.
+   * 受信したデータはtools/host/telemetry_decodeでCSVに変換できます.
+   *
+   * @param enable フライトレコーダを有効にする場合true
+   * @param drain 記録したレコードをUARTへ送出する場合true,readRecord()で読み出す場合false
+   * @return なし
+   * @attention
+   *UARTへ送出する場合,Serial1は使用しないでください.
+   */
+  void setRecorder(bool enable, bool drain = true);
+  /**
+   * @brief フライトレコーダから最も古いレコードを取り出す
+   * @param record 書き込み先
+   * @return レコードがあればtrue
+   * @attention setRecorder()でdrainをfalseにした場合に使用してください
+   */
+  bool readRecord(CrlRecord* record);
+  /**
+   * @brief フライトレコーダのバッファが一杯で捨てたレコードの数を取得する
+   * @return 捨てたレコードの数
+   */
+  uint16_t getRecorderDropped();
+#endif
+#if CRAWL_PROFILER
+  /**
+   * @brief プロファイラの計測結果を取得する
+   *
+   * updateState()の各処理,バックグラウンドのI2C読み出し,ループ内の処理時間とループ周期について,
+   * 最小・最大・平均とヒストグラムを取得できます.フェーズとヒストグラムの区間はprofiler.hを参照してください.
+   * @param phase フェーズ(CRAWL_PHASE_IMU_READなど)
+   * @param profile 書き込み先
+   * @return なし
+   */
+  void getProfile(uint8_t phase, CrlProfile* profile);
+  /**
+   * @brief ループ内の処理がループ間隔を超えた回数を取得する
+   *
+   * LED2が点灯する条件と同じです.
+   * @return 回数(65535で飽和)
+   */
+  uint16_t getOverrunCount();
+  /**
+   * @brief プロファイラの計測結果を消去する
+   * @return なし
+   */
+  void resetProfile();
+  /**
+   * @brief プロファイラの計測結果をテレメトリで送出するか設定する
+   *
+   * 有効にすると,realtimeLoop()が次の周期を待つ間に,一周期あたり一つのフェーズの計測結果を
+   * テレメトリのフレーム(種類TELEMETRY_PROFILE)としてUARTへ送出します.
+   * @param enable 送出する場合true
+   * @return なし
+   * @attention
+   *Serial1は使用しないでください.
+   */
+  void setProfileTelemetry(bool enable);
+#endif
+#if CRAWL_IMU_FIFO
+  /**
+   * @brief 姿勢センサのFIFOが溢れてサンプルを失った回数を取得する
+   *
+   * I2Cの読み出しがCRAWL_IMU_FIFO_RATEの標本化に追いつかない場合に増えます.
+   * 失ったサンプルの間の角度の変化はtheta_x,theta_y,theta_zに反映されません.
+   * @return 回数(65535で飽和)
+   */
+  uint16_t getImuOverflowCount();
+#endif
+#if CRAWL_WARM_BOOT
+  /**
+   * @brief init()がEEPROMに保存されたキャリブレーションの結果を使用したか調べる
+   * @return 使用した(キャリブレーションを省略した)場合true
+   */
+  bool isWarmBoot();
+  /**
+   * @brief 現在のジャイロのオフセットをEEPROMに保存する
+   *
+   * 静止中の補正(CRAWL_GYRO_REFINE_SHIFT)で更新されたオフセットを,現在の温度とともに保存し,
+   * 次回のinit()で使用します.
+   * @return なし
+   * @attention
+   *EEPROMの書き込みに最大で0.1秒程度掛かり,書き換え回数にも上限があるため,ループの中では呼び出さないでください.
+   */
+  void saveCalibration();
+  /**
+   * @brief EEPROMに保存したキャリブレーションの結果を消去する
+   *
+   * 次回のinit()では必ずキャリブレーションを行います.
+   * @return なし
+   */
+  void eraseCalibration();
+#endif
+#if CRAWL_KALMAN_BIAS
+  /**
+   * @brief カルマンフィルタが推定したジャイロのバイアスを取得する
+   *
+   * キャリブレーションしたオフセットからの残りの分です.姿勢角度はこの分を除いて計算されています.
+   * カルマンフィルタを使用していない軸では0のままです.
+   * @param axis 軸の番号(CRAWL_AXIS_X,CRAWL_AXIS_Y,CRAWL_AXIS_Z)
+   * @return バイアス 単位:rad/s
+   */
+  float getKalmanBias(uint8_t axis);
+#endif
+#if CRAWL_AHRS
+  /**
+   * @brief 姿勢推定(CRAWL_AHRS)の四元数を取得する
+   *
+   * 機体座標から地上座標(Z軸が鉛直上向き)への回転です.地磁気を読み出していない場合,方位は起動時の向きを基準とします.
+   * @param q 書き込み先(w,x,y,zの順)
+   * @return なし
+   * @attention updateState()を呼び出さない限り,情報は更新されません
+   */
+  void getQuaternion(float q[4]);
+#endif
+#if CRAWL_IMU_SYNC
+  /**
+   * @brief 制御に使われなかった姿勢センサのサンプルの数を取得する
+   *
+   * 前のサンプルの読み出し中に次のサンプルが標本化された場合と,ループ内の処理が長く
+   * realtimeLoop()が次のサンプルの読み出しの完了までに呼ばれなかった場合に数えます.LED2が点灯する条件に含まれます.
+   * @return サンプル数(65535で飽和)
+   */
+  uint16_t getMissedSampleCount();
+#endif
 
   /// @cond develop
   /** ループ間隔 単位:秒 */
   float dt;
   /** ループ間隔 単位:マイクロ秒 */
   int dt_us;
+#if CRAWL_FIXED_POINT
+  /** Z軸周りの姿勢角度 単位:rad Q8.24 */
+  int32_t theta_z_fx;
+  /** X軸周りの姿勢角度 単位:rad Q8.24 */
+  int32_t theta_x_fx;
+  /** Y軸周りの姿勢角度 単位:rad Q8.24 */
+  int32_t theta_y_fx;
+#else
   /** Z軸周りの姿勢角度 単位:rad */
   float theta_z;
   /** X軸周りの姿勢角度 単位:rad */
   float theta_x;
   /** Y軸周りの姿勢角度 単位:rad */
   float theta_y;
+#endif
 
   /** クロール上端のX軸方向速度 単位:m/s */
   float head_velocity;
 
+#if CRAWL_FIXED_POINT
+  /** X軸方向の加速度 単位:m/s^2 Q8.24 */
+  int32_t acc_x_fx;
+  /** Y軸方向の加速度 単位:m/s^2 Q8.24 */
+  int32_t acc_y_fx;
+  /** Z軸方向の加速度 単位:m/s^2 Q8.24 */
+  int32_t acc_z_fx;
+  /** X軸周りの角速度 単位:rad/s Q16.16 */
+  int32_t theta_dot_x_fx;
+  /** Y軸周りの角速度 単位:rad/s Q16.16 */
+  int32_t theta_dot_y_fx;
+  /** Z軸周りの角速度 単位:rad/s Q16.16 */
+  int32_t theta_dot_z_fx;
+  /** X軸周りの角速度の真値との偏差 単位:生値 Q24.8 */
+  int32_t offset_gx_fx;
+  /** Y軸周りの角速度の真値との偏差 単位:生値 Q24.8 */
+  int32_t offset_gy_fx;
+  /** Z軸周りの角速度の真値との偏差 単位:生値 Q24.8 */
+  int32_t offset_gz_fx;
+  /** ループ間隔 単位:秒 */
+  FxCoef dt_fx;
+  /** 相補フィルターで加速度センサから求まる姿勢角度の寄与度(1 - rate_theta) */
+  FxCoef rate_theta_fx;
+#else
   /** X軸方向の加速度 単位:m/s^2 */
   float acc_x;
   /** Y軸方向の加速度 単位:m/s^2 */
@@ -420,6 +721,7 @@ class CrlRobot {
   float theta_dot_y;
   /** Z軸周りの角速度 単位:rad/s */
   float theta_dot_z;
+#endif
   /** X軸周りの角速度の真値との偏差 */
   float offset_gx;
   /** Y軸周りの角速度の真値との偏差 */
@@ -434,6 +736,23 @@ class CrlRobot {
   float encoder_left;
   /** 右エンコーダ累積値 */
   float encoder_right;
+  /** 姿勢センサの生値(加速度3軸,温度,ジャイロ3軸,地磁気3軸) */
+  int attitude_data[10];
+  /** 前回の取得からの左エンコーダの回転数 */
+  short int left_encoder;
+  /** 前回の取得からの右エンコーダの回転数 */
+  short int right_encoder;
+#if CRAWL_KALMAN_BIAS
+  /** 姿勢角度を求めるカルマンフィルタ(ジャイロのバイアスも推定する) */
+  BiasKalmanFilterBank kf;
+#else
+  /** 姿勢角度を求めるカルマンフィルタ */
+  KalmanFilterBank kf;
+#endif
+#if CRAWL_AHRS
+  /** カルマンフィルタを使わない軸の姿勢角度を求める姿勢推定 */
+  MahonyAhrs ahrs;
+#endif
   /** リアルタイムを実現するための時間計測用変数 */
   unsigned long t1;
   /** リアルタイムを実現するための時間計測用変数 */
@@ -442,17 +761,70 @@ class CrlRobot {
   unsigned long tt;
   /** エンコーダパルス数を移動距離に変換するための係数 */
   float kEtoMM;
-  /** センサヒュージョンの方法を判別するための変数 */
-  bool enable_kalman;
+  /** カルマンフィルタで姿勢角度を計算する軸(CRAWL_AXIS_BIT()の論理和) */
+  uint8_t kalman_axes;
+  /** updateState()で計算する出力(CRAWL_OUTPUT_THETA_Zなどの論理和) */
+  uint8_t outputs;
+  /** outputsのために姿勢角度を計算する軸(CRAWL_AXIS_BIT()の論理和) */
+  uint8_t theta_axes;
+  /** outputsのためにフィルタを計算する加速度の軸(CRAWL_AXIS_BIT()の論理和) */
+  uint8_t acc_axes;
+  /** 最後のcalcState()の後にまだ計算していない角速度の軸(CRAWL_AXIS_BIT())と上端速度(STALE_HEAD_VELOCITY) */
+  uint8_t stale;
+#if CRAWL_RECORDER_RECORDS > 0
+  /** フライトレコーダ */
+  FlightRecorder recorder;
+  /** フライトレコーダが有効ならtrue */
+  bool enable_recorder;
+  /** 記録したレコードをrealtimeLoop()の待ち時間に送出するならtrue */
+  bool drain_recorder;
+#endif
+#if CRAWL_PROFILER
+  /** プロファイラの計測結果をrealtimeLoop()の待ち時間に送出するならtrue */
+  bool send_profile;
+#endif
+#if CRAWL_SCHEDULER
+  /** realtimeLoop()の周期と追加したタスクのスケジューラ */
+  Scheduler scheduler;
+#endif
+#if CRAWL_WARM_BOOT
+  /** EEPROMに保存するキャリブレーションの結果 */
+  CalibrationData calibration;
+  /** init()で保存されたキャリブレーションの結果を使用したならtrue */
+  bool warm_boot;
+#endif
+#if CRAWL_GYRO_REFINE_SHIFT > 0
+  /** ジャイロの値がオフセットの近くに留まっているupdateState()の回数 */
+  uint8_t stationary_count;
+#endif
+#if CRAWL_IMU_SYNC
+  /** 前回のmakeTiming()の時点でのgetMissedSampleCount()の値 */
+  uint16_t missed_samples;
+#if !CRAWL_SCHEDULER
+  /** 読み出しが完了し,realtimeLoop()がまだ処理していないサンプルの数 */
+  volatile uint8_t samples_ready;
+  /** realtimeLoop()が処理できなかったサンプルの数 */
+  uint16_t skipped_samples;
+#endif
+#endif
   /**
    * 姿勢角度計算用相補フィルターの係数(角速度センサーから求まる姿勢角度と加速度センサーから求まる姿勢角度の寄与度)*/
   float rate_theta;
+#if CRAWL_FIXED_POINT
+  /** X軸方向の加速度センサ用の一次遅れフィルタ */
+  FixedFirstOrderFilter fof_acc_x;
+  /** Y軸方向の加速度センサ用の一次遅れフィルタ */
+  FixedFirstOrderFilter fof_acc_y;
+  /** Z軸方向の加速度センサ用の一次遅れフィルタ */
+  FixedFirstOrderFilter fof_acc_z;
+#else
   /** X軸方向の加速度センサ用の一次遅れフィルタ */
   FirstOrderFilter fof_acc_x;
   /** Y軸方向の加速度センサ用の一次遅れフィルタ */
   FirstOrderFilter fof_acc_y;
   /** Z軸方向の加速度センサ用の一次遅れフィルタ */
   FirstOrderFilter fof_acc_z;
+#endif
   /** オドメトリをから移動速度を計算するための不完全微分 */
   LaggedDerivative ld_odometry;
 
@@ -460,6 +832,7 @@ class CrlRobot {
    * @brief 姿勢角度計算用相補フィルター
    *
    * 角速度センサーから求まる姿勢角度と加速度センサーから求まる姿勢角度をもとに相補フィルターによって計算し姿勢角度を求めます.
+   * CRAWL_AHRSが1の場合は姿勢推定(ahrs)から求めます.kalman_axesに含まれる軸は計算しません.
    * @return なし
    * @sa rate_theta
    */
@@ -468,9 +841,27 @@ class CrlRobot {
    * @brief 姿勢角度計算用カルマンフィルター
    *
    * 角速度センサーから求まる姿勢角度と加速度センサーから求まる姿勢角度をもとにカルマンフィルターによって計算し姿勢角度を求めます.
+   * kalman_axesに含まれる軸の姿勢角度だけを更新します.
    * @return なし
    */
   void calcThetaKalmanFilter();
+#if CRAWL_AHRS
+  /**
+   * @brief calcTheta()のサブ関数
+   *
+   * 姿勢センサの生値で姿勢推定(ahrs)を一周期分更新する.
+   * @return なし
+   */
+  void updateAhrs();
+  /**
+   * @brief calcTheta(),seedOutputs()のサブ関数
+   *
+   * 姿勢推定の鉛直上向きの向きを加速度の代わりとして,axesの軸の姿勢角度を求める.
+   * @param axes 姿勢角度の軸(CRAWL_AXIS_BIT()の論理和)
+   * @return なし
+   */
+  void calcThetaAhrs(uint8_t axes);
+#endif
   /**
    * @brief realtimeLoop()のサブ関数
    *
@@ -478,6 +869,23 @@ class CrlRobot {
    * @sa realtimeLoop()
    */
   void makeTiming();
+  /**
+   * @brief makeTiming()のサブ関数
+   *
+   * 周期の残り時間に,フライトレコーダとプロファイラの内容をテレメトリで送出する.
+   * @param send_profile プロファイラの計測結果をこの周期にまだ送っていない場合true.送った場合はfalseにする
+   * @return なし
+   * @sa makeTiming()
+   */
+  void sendTelemetry(bool* send_profile);
+#if CRAWL_IMU_SYNC
+  /**
+   * @brief 姿勢センサのサンプルの読み出しが完了したときに割り込みの中で呼ばれ,realtimeLoop()を解放する
+   * @param context CrlRobotへのポインタ
+   * @return なし
+   */
+  static void onSample(void* context);
+#endif
   /**
    * @brief updateState()のサブ関数
    *
@@ -487,14 +895,34 @@ class CrlRobot {
    */
   void calcState();
 
+  /**
+   * @brief 角速度の取得のサブ関数
+   *
+   * axesのうち,最後のcalcState()の後にまだ計算していない軸の角速度を計算する.
+   * @param axes 軸(CRAWL_AXIS_BIT()の論理和)
+   * @return なし
+   */
+  void calcThetaDot(uint8_t axes);
+
   /**
    * @brief updateState()のサブ関数
    *
-   * 倒立時のクロール上端の速度を計算する.
+   * 倒立時のクロール上端の速度を求めるオドメトリの微分を更新する.上端速度はgetHeadVelocity()で計算する.
    * @return なし
    * @sa updateState()
    */
   void calcHeadVelocity();
+#if CRAWL_RECORDER_RECORDS > 0
+  /**
+   * @brief updateState()のサブ関数
+   *
+   * 更新後の状態をフライトレコーダに記録する.
+   * @param time updateState()を呼び出した時刻 単位:マイクロ秒
+   * @return なし
+   * @sa setRecorder()
+   */
+  void recordState(unsigned long time);
+#endif
   /**
    * @brief init()のサブ関数
    *
@@ -513,12 +941,42 @@ class CrlRobot {
    * @sa init()
    */
   void initTheta();
+#if CRAWL_WARM_BOOT
+  /**
+   * @brief init()のサブ関数
+   *
+   * 保存されたキャリブレーションの結果を短時間の計測で確かめ,使用できればオフセットと姿勢角度を設定する.
+   * @return 使用できた場合true.falseの場合はinitGyroOffset(),initTheta()を行う
+   * @sa init()
+   */
+  bool initWarmBoot();
+#endif
+  /**
+   * @brief initWarmBoot(),setOutputs()のサブ関数
+   *
+   * attitude_dataの加速度を静止時の値として,accsの軸の加速度のフィルタを収束させた状態にし,
+   * axesの軸の姿勢角度を加速度(CRAWL_AHRSが1の場合は姿勢推定)から求める.
+   * @param accs 加速度の軸(CRAWL_AXIS_BIT()の論理和)
+   * @param axes 姿勢角度の軸(CRAWL_AXIS_BIT()の論理和)
+   * @return なし
+   */
+  void seedOutputs(uint8_t accs, uint8_t axes);
+#if CRAWL_GYRO_REFINE_SHIFT > 0
+  /**
+   * @brief updateState()のサブ関数
+   *
+   * 静止している間,ジャイロのオフセットを測定値に少しずつ近づける.
+   * @return なし
+   * @sa CRAWL_GYRO_REFINE_SHIFT
+   */
+  void refineGyroOffset();
+#endif
   /// @endcond
 };
 
 /**
-　* CrlRobotのインスタンス
+　* CrlRobotのインスタンス(ホスト向けではスレッドごとに別の実体となる.同じスレッドで別のインスタンスと併用しないこと)
 　*/
-extern CrlRobot crl;
+extern HAL_THREAD_LOCAL CrlRobot crl;
 
 #endif
@@ -0,0 +1,479 @@
+/**
+ * @file acquisition.cpp
+ * @brief
+ * 姿勢センサとエンコーダをバックグラウンドで連続的に読み出す
+ */
+#include "acquisition.h"
+#include <math.h>
+#include <string.h>
+#include "attitude_sensor.h"
+#include "encoder.h"
+#include "hal.h"
+#include "profiler.h"
+
+#if CRAWL_IMU_FIFO
+/** 一回のバースト読み出しで読むサンプル数の上限(受信長は255バイトまで) */
+#define IMU_FIFO_BURST 8
+/** FIFOの残量がこれを超えていれば,一サンプル分の空きがなく以降のサンプルを捨てている */
+#define IMU_FIFO_FULL (IMU_FIFO_SIZE - IMU_FIFO_SAMPLE_BYTES)
+/** 取り出されないまま溜まったサンプルがこの数に達したら,合計が溢れないよう平均をやり直す */
+#define IMU_AVERAGE_LIMIT 4096
+/** 標本化の周期 単位:マイクロ秒 */
+#define IMU_SAMPLE_US (1000000.0f / CRAWL_IMU_FIFO_RATE)
+
+/** 割り込み要因のレジスタ(INT_STATUS) */
+static const uint8_t int_status_reg[] = {0x3A};
+/** FIFO_OFLOW_INT: FIFOが一杯でサンプルを捨てた */
+#define IMU_INT_FIFO_OVERFLOW 0x10
+/** FIFOの残量の読み出し開始レジスタ(FIFO_COUNTH) */
+static const uint8_t fifo_count_reg[] = {0x72};
+/** FIFOの読み出しレジスタ(FIFO_R_W) */
+static const uint8_t imu_reg[] = {0x74};
+/** FIFOを消去するコマンド(USER_CTRL) */
+static const uint8_t fifo_reset_command[] = {0x6A, IMU_USER_CTRL_FIFO_RESET};
+#else
+/** 姿勢センサの読み出し開始レジスタ(ACCEL_XOUT_H) */
+static const uint8_t imu_reg[] = {0x3B};
+#endif
+/** 地磁気センサの読み出し開始レジスタ(HXL) */
+static const uint8_t mag_reg[] = {0x03};
+/** エンコーダの累計回転数を読み出してリセットするコマンド */
+static const uint8_t encoder_command[] = {0x12};
+
+// 以下の状態はバスと同じくスレッド(AVRではプログラム全体)に一つだけ持ち,CrlRobotのインスタンスごとには持たない.
+// 同時に使えるのは1スレッドに1台までとなる(crawl.hのCrlRobotを参照).
+
+/** 読み出し中の生データ */
+#if CRAWL_IMU_FIFO
+static HAL_THREAD_LOCAL uint8_t imu_buf[IMU_FIFO_BURST * IMU_FIFO_SAMPLE_BYTES];
+static HAL_THREAD_LOCAL uint8_t fifo_count_buf[2];
+static HAL_THREAD_LOCAL uint8_t int_status_buf[1];
+#else
+static HAL_THREAD_LOCAL uint8_t imu_buf[14];
+#endif
+static HAL_THREAD_LOCAL uint8_t mag_buf[7];
+static HAL_THREAD_LOCAL uint8_t encoder_buf[4];
+
+/** 完了済みの最新の生データ */
+#if CRAWL_IMU_FIFO
+/** 前回取り出してから読み出したサンプルの合計(加速度XYZ,温度,ジャイロXYZ) */
+static HAL_THREAD_LOCAL long imu_sum[7];
+/** 前回取り出してから読み出したサンプル数 */
+static HAL_THREAD_LOCAL uint16_t imu_samples = 0;
+/** 実行中の一組でバースト読み出しするサンプル数 */
+static HAL_THREAD_LOCAL uint8_t burst_samples = 0;
+/** 次の一組の最初にFIFOを消去するか */
+static HAL_THREAD_LOCAL bool fifo_reset_pending = false;
+/** サンプルを失ってFIFOを消去した回数 */
+static HAL_THREAD_LOCAL volatile uint16_t fifo_overflows = 0;
+/** 前回取り出した時刻 */
+static HAL_THREAD_LOCAL unsigned long take_at;
+/** 取り出したジャイロの値の積分から,読み出したサンプルの積分を引いた差 単位:生値×マイクロ秒 */
+static HAL_THREAD_LOCAL float gyro_carry[3];
+/** 前回取り出した時点のfifo_overflows */
+static HAL_THREAD_LOCAL uint16_t take_overflows;
+#else
+static HAL_THREAD_LOCAL uint8_t latest_imu[14];
+#endif
+static HAL_THREAD_LOCAL uint8_t latest_mag[7];
+/** 前回取り出してからの回転数の合計 */
+static HAL_THREAD_LOCAL short int pending_left = 0;
+static HAL_THREAD_LOCAL short int pending_right = 0;
+/** 新しい計測結果があるか */
+static HAL_THREAD_LOCAL volatile bool fresh = false;
+/** 連続読み出しを開始済みか */
+static HAL_THREAD_LOCAL bool running = false;
+/** 地磁気センサを読み出すか */
+static HAL_THREAD_LOCAL volatile bool read_mag = true;
+/** 実行中の一組で地磁気センサを読み出しているか */
+static HAL_THREAD_LOCAL bool mag_submitted = false;
+/** 一組の読み出しの実行中か */
+static HAL_THREAD_LOCAL volatile bool busy = false;
+/** 一組を投入した時刻 */
+static HAL_THREAD_LOCAL unsigned long cycle_at;
+/** 最近の一組の読み出しの所要時間の最大値 単位:マイクロ秒 */
+static HAL_THREAD_LOCAL volatile unsigned long cycle_us = 0;
+#if CRAWL_IMU_FIFO
+/** 一度に読み出せなかったサンプルがFIFOに残っているか */
+static HAL_THREAD_LOCAL volatile bool fifo_backlog = false;
+/** 開始(FIFOの消去)後の最初のサンプルをまだ読み出していないか */
+static HAL_THREAD_LOCAL volatile bool fifo_priming = false;
+#endif
+#if !CRAWL_IMU_SYNC
+/** 取り出した後の次の組をrequestAcquisition()で開始済みか */
+static HAL_THREAD_LOCAL volatile bool requested = false;
+#endif
+#if CRAWL_IMU_SYNC
+/** 読み出せなかったサンプルの数 */
+static HAL_THREAD_LOCAL volatile uint16_t missed = 0;
+/** 一組の読み出しの完了時に呼び出す関数 */
+static HAL_THREAD_LOCAL void (*cycle_callback)(void*) = NULL;
+static HAL_THREAD_LOCAL void* cycle_context = NULL;
+#endif
+
+static void onCycleDone(HalI2cTransaction* transaction);
+
+#if CRAWL_IMU_FIFO
+/** 受信長は一組ごとにFIFOの残量から決める */
+#define IMU_READ_LENGTH 0
+#else
+#define IMU_READ_LENGTH 14
+#endif
+
+#if CRAWL_PROFILER
+/** 直前の読み出しが完了した時刻(一組の最初の読み出しでは一組を投入した時刻) */
+static HAL_THREAD_LOCAL unsigned long lap_at;
+
+/** 姿勢センサ,地磁気センサの読み出しの完了時に割り込み内で呼ばれる */
+static void onReadDone(HalI2cTransaction* transaction);
+
+static HAL_THREAD_LOCAL HalI2cTransaction imu_read = {HAL_ADDR_MPU9250, imu_reg, 1, imu_buf, IMU_READ_LENGTH,
+                                                      onReadDone, HAL_I2C_DONE, NULL};
+static HAL_THREAD_LOCAL HalI2cTransaction mag_read = {HAL_ADDR_AK8963, mag_reg, 1, mag_buf, 7, onReadDone, HAL_I2C_DONE,
+                                                      NULL};
+
+static void onReadDone(HalI2cTransaction* transaction) {
+  lap_at = profilerLap(transaction == &imu_read ? CRAWL_PHASE_IMU_READ : CRAWL_PHASE_MAG_READ, lap_at);
+}
+#else
+static HAL_THREAD_LOCAL HalI2cTransaction imu_read = {HAL_ADDR_MPU9250, imu_reg, 1, imu_buf, IMU_READ_LENGTH, NULL,
+                                                      HAL_I2C_DONE, NULL};
+static HAL_THREAD_LOCAL HalI2cTransaction mag_read = {HAL_ADDR_AK8963, mag_reg, 1, mag_buf, 7, NULL, HAL_I2C_DONE,
+                                                      NULL};
+#endif
+#if CRAWL_ENCODER_REPEATED_START
+/** コマンドの送信とリピーテッドスタートでの累計回転数の受信を一度に行う */
+static HAL_THREAD_LOCAL HalI2cTransaction encoder_read = {HAL_ADDR_MOTOR, encoder_command, 1, encoder_buf, 4,
+                                                          onCycleDone, HAL_I2C_DONE, NULL};
+#else
+static HAL_THREAD_LOCAL HalI2cTransaction encoder_write = {HAL_ADDR_MOTOR, encoder_command, 1, NULL, 0, NULL,
+                                                           HAL_I2C_DONE, NULL};
+static HAL_THREAD_LOCAL HalI2cTransaction encoder_read = {HAL_ADDR_MOTOR, NULL, 0, encoder_buf, 4, onCycleDone,
+                                                          HAL_I2C_DONE, NULL};
+#endif
+
+/** 累計回転数の読み出しを投入する */
+static void submitEncoder() {
+#if !CRAWL_ENCODER_REPEATED_START
+  halI2cSubmit(&encoder_write);
+#endif
+  halI2cSubmit(&encoder_read);
+}
+
+#if CRAWL_IMU_FIFO
+static void onFifoCount(HalI2cTransaction* transaction);
+
+static HAL_THREAD_LOCAL HalI2cTransaction int_status_read = {HAL_ADDR_MPU9250, int_status_reg, 1, int_status_buf, 1,
+                                                             NULL, HAL_I2C_DONE, NULL};
+static HAL_THREAD_LOCAL HalI2cTransaction fifo_count = {HAL_ADDR_MPU9250, fifo_count_reg, 1, fifo_count_buf, 2,
+                                                        onFifoCount, HAL_I2C_DONE, NULL};
+static HAL_THREAD_LOCAL HalI2cTransaction fifo_reset = {HAL_ADDR_MPU9250, fifo_reset_command, 2, NULL, 0, NULL,
+                                                        HAL_I2C_DONE, NULL};
+
+/** FIFOの残量の読み出し完了時に割り込み内で呼ばれ,一組の残りを投入する */
+static void onFifoCount(HalI2cTransaction* transaction) {
+  uint16_t count = ((fifo_count_buf[0] & 0x1f) << 8) | fifo_count_buf[1];
+
+  burst_samples = 0;
+  if (transaction->status == HAL_I2C_DONE) {
+    bool overflow = int_status_read.status == HAL_I2C_DONE && (int_status_buf[0] & IMU_INT_FIFO_OVERFLOW);
+    if (overflow || count > IMU_FIFO_FULL) {
+      // 一杯になった後のサンプルは捨てられているため,溜まった古いサンプルごと消去して読み直す
+      if (fifo_overflows != 0xffff) fifo_overflows++;
+      halI2cSubmit(&fifo_reset);
+    } else {
+      count /= IMU_FIFO_SAMPLE_BYTES;
+      burst_samples = count < IMU_FIFO_BURST ? count : IMU_FIFO_BURST;  // 残りは次の組で読む
+      fifo_backlog = count > IMU_FIFO_BURST;
+    }
+  }
+  if (burst_samples > 0) {
+    imu_read.rx_length = burst_samples * IMU_FIFO_SAMPLE_BYTES;
+    halI2cSubmit(&imu_read);
+  } else {
+#if CRAWL_PROFILER
+    lap_at = profilerLap(CRAWL_PHASE_IMU_READ, lap_at);
+#endif
+  }
+  mag_submitted = read_mag;
+  if (mag_submitted) halI2cSubmit(&mag_read);
+  submitEncoder();
+}
+
+/** バースト読み出ししたサンプルを合計に加える */
+static void accumulateFifo() {
+  const uint8_t* sample = imu_buf;
+
+  if (imu_samples >= IMU_AVERAGE_LIMIT) {
+    memset(imu_sum, 0, sizeof(imu_sum));
+    imu_samples = 0;
+  }
+  for (uint8_t n = 0; n < burst_samples; n++) {
+    for (uint8_t i = 0; i < 7; i++) imu_sum[i] += (int16_t)((sample[i * 2] << 8) | sample[i * 2 + 1]);
+    sample += IMU_FIFO_SAMPLE_BYTES;
+  }
+  imu_samples += burst_samples;
+}
+#endif
+
+static void submitCycle() {
+  busy = true;
+  cycle_at = halMicros();
+#if CRAWL_PROFILER
+  lap_at = cycle_at;  // 先に投入されたモータ指令の送信を待つ時間は姿勢センサの読み出しに含まれる
+#endif
+#if CRAWL_IMU_FIFO
+  if (fifo_reset_pending) {
+    fifo_reset_pending = false;
+    halI2cSubmit(&fifo_reset);
+  }
+  halI2cSubmit(&int_status_read);  // 読み出しでオーバーフローのフラグが消える
+  halI2cSubmit(&fifo_count);       // 残りはonFifoCount()で投入する
+#else
+  halI2cSubmit(&imu_read);
+  mag_submitted = read_mag;
+  if (mag_submitted) halI2cSubmit(&mag_read);
+  submitEncoder();
+#endif
+}
+
+/** 一組の読み出しの完了時に割り込み内で呼ばれる */
+static void onCycleDone(HalI2cTransaction* transaction) {
+#if CRAWL_PROFILER
+  profilerLap(CRAWL_PHASE_ENCODER_READ, lap_at);
+#endif
+#if CRAWL_IMU_FIFO
+  if (burst_samples > 0) {
+    if (imu_read.status == HAL_I2C_DONE) {
+      accumulateFifo();
+      fresh = true;
+      fifo_priming = false;
+    } else {
+      // 途中まで読み出された可能性があり,サンプルの区切りが分からなくなるため消去する
+      if (fifo_overflows != 0xffff) fifo_overflows++;
+      fifo_reset_pending = true;
+    }
+  }
+  if (mag_submitted && mag_read.status == HAL_I2C_DONE) memcpy(latest_mag, mag_buf, sizeof(latest_mag));
+#else
+  if (imu_read.status == HAL_I2C_DONE && (!mag_submitted || mag_read.status == HAL_I2C_DONE)) {
+    memcpy(latest_imu, imu_buf, sizeof(latest_imu));
+    if (mag_submitted) memcpy(latest_mag, mag_buf, sizeof(latest_mag));
+    fresh = true;
+  }
+#endif
+#if CRAWL_ENCODER_REPEATED_START
+  if (transaction->status == HAL_I2C_DONE) {
+#else
+  if (encoder_write.status == HAL_I2C_DONE && transaction->status == HAL_I2C_DONE) {
+#endif
+    pending_right += (short int)((encoder_buf[0] << 8) | encoder_buf[1]);
+    pending_left += (short int)((encoder_buf[2] << 8) | encoder_buf[3]);
+  }
+  // 所要時間はFIFOのサンプル数などで組ごとに変わるため,最大値を保持してゆっくり減らす
+  unsigned long us = halMicros() - cycle_at;
+  cycle_us = us > cycle_us ? us : cycle_us - ((cycle_us - us) >> 4);
+  busy = false;
+#if CRAWL_IMU_FIFO
+  // FIFOに残ったサンプルは溢れる前に続けて読み出す.
+  // 開始直後はFIFOが空のため,最初の取り出しに計測結果が揃うよう最初のサンプルが溜まるまで読み直す
+  if (running && (fifo_backlog || fifo_priming)) {
+    submitCycle();
+    return;
+  }
+#endif
+#if CRAWL_IMU_SYNC
+  // 次の組はデータレディ割り込みで開始する
+  if (cycle_callback) cycle_callback(cycle_context);
+#endif
+}
+
+#if !CRAWL_IMU_SYNC
+/** 実行中の組がなければ次の組を開始する */
+static void startCycle() {
+  uint8_t state = halEnterCritical();
+  if (running && !busy) submitCycle();
+  halExitCritical(state);
+}
+
+void requestAcquisition() {
+  startCycle();
+  requested = true;
+}
+#endif
+
+#if CRAWL_IMU_SYNC
+/** 姿勢センサのデータレディ割り込みで呼ばれる */
+static void onDataReady(void*) {
+  if (!running) return;
+  if (busy) {
+    if (missed != 0xffff) missed++;
+    return;
+  }
+  submitCycle();
+}
+#endif
+
+void startAcquisition() {
+  uint8_t state;
+
+  if (running) return;  // 実行中のトランザクションを再投入しない
+  running = true;
+  busy = false;
+  mag_submitted = false;
+#if CRAWL_IMU_FIFO
+  fifo_backlog = false;
+  fifo_priming = true;
+  fifo_reset_pending = false;
+  burst_samples = 0;
+  resetAttitudeFifo();  // 初期化中に溜まった(溢れた)サンプルを捨てる
+#endif
+  state = halEnterCritical();
+  // 前回の連続読み出しの所要時間,要求,計数を持ち越さない
+  fresh = false;
+  cycle_us = 0;
+#if !CRAWL_IMU_SYNC
+  requested = false;
+#endif
+#if CRAWL_IMU_SYNC
+  missed = 0;
+#endif
+#if CRAWL_IMU_FIFO
+  memset(imu_sum, 0, sizeof(imu_sum));
+  imu_samples = 0;
+  take_at = halMicros();
+  memset(gyro_carry, 0, sizeof(gyro_carry));
+  fifo_overflows = 0;
+  take_overflows = 0;
+#endif
+  pending_left = 0;
+  pending_right = 0;
+  halExitCritical(state);
+#if CRAWL_IMU_SYNC
+  halImuInterruptBegin(onDataReady, NULL);
+#else
+  submitCycle();
+#endif
+}
+
+void stopAcquisition() {
+  running = false;
+  // 実行中の組が終わるまで待ち,再開時に同じトランザクションを二重に投入しないようにする
+#if CRAWL_IMU_FIFO
+  halI2cWait(&fifo_count);  // 完了時に組の残りが投入される
+#endif
+  halI2cWait(&encoder_read);
+}
+
+bool takeAcquisition(int attitude[10], short int* left, short int* right) {
+#if CRAWL_IMU_FIFO
+  long sum[7];
+  uint16_t samples = 0;
+  uint16_t overflows;
+  unsigned long now = halMicros();
+  unsigned long elapsed = now - take_at;
+  take_at = now;
+#else
+  uint8_t imu[14];
+#endif
+  uint8_t mag[7];
+  bool updated;
+  uint8_t state;
+
+  state = halEnterCritical();
+  updated = fresh;
+  if (updated) {
+#if CRAWL_IMU_FIFO
+    memcpy(sum, imu_sum, sizeof(sum));
+    samples = imu_samples;
+    memset(imu_sum, 0, sizeof(imu_sum));
+    imu_samples = 0;
+#else
+    memcpy(imu, latest_imu, sizeof(imu));
+#endif
+    memcpy(mag, latest_mag, sizeof(mag));
+    fresh = false;
+  }
+#if CRAWL_IMU_FIFO
+  overflows = fifo_overflows;
+#endif
+  *left = pending_left;
+  *right = pending_right;
+  pending_left = 0;
+  pending_right = 0;
+  halExitCritical(state);
+
+#if CRAWL_IMU_FIFO
+  // ジャイロの値は取り出してから次に取り出すまでの間使われるとみなし,その積分が読み出したサンプルの積分と
+  // 一致するように決める.区間ごとのサンプル数の揺らぎ,丸め,新しいサンプルがない区間の分は次の値で補う
+  if (overflows != take_overflows) {
+    take_overflows = overflows;
+    memset(gyro_carry, 0, sizeof(gyro_carry));  // サンプルが欠けた区間の差は補えない
+  } else if (!updated) {
+    for (int i = 0; i < 3; i++) gyro_carry[i] += (float)attitude[i + 4] * elapsed;
+  }
+#endif
+  if (updated) {
+#if CRAWL_IMU_FIFO
+    for (int i = 0; i < 4; i++) attitude[i] = lround((float)sum[i] / samples);  // 加速度と温度は平均値
+    for (int i = 0; i < 3; i++) {
+      float target = sum[i + 4] * IMU_SAMPLE_US - gyro_carry[i];
+      attitude[i + 4] = elapsed != 0 ? lround(target / elapsed) : lround((float)sum[i + 4] / samples);
+      gyro_carry[i] = (float)attitude[i + 4] * elapsed - target;
+    }
+#else
+    for (int i = 0; i < 7; i++) {
+      attitude[i] = (int16_t)((imu[i * 2] << 8) | imu[i * 2 + 1]);
+    }
+#endif
+    for (int i = 7; i < 10; i++) {
+      attitude[i] = (int16_t)((mag[(i - 7) * 2 + 1] << 8) | mag[(i - 7) * 2]);
+    }
+  }
+#if !CRAWL_IMU_SYNC
+  // requestAcquisition()で開始していなければ,次の取り出しに向けてここで開始する
+  if (requested) {
+    requested = false;
+  } else {
+    startCycle();
+  }
+#endif
+  return updated;
+}
+
+unsigned long getAcquisitionMicros() {
+  unsigned long us;
+  uint8_t state = halEnterCritical();
+  us = cycle_us;
+  halExitCritical(state);
+  return us;
+}
+
+void setMagnetometerRead(bool enable) { read_mag = enable; }
+
+#if CRAWL_IMU_FIFO
+uint16_t getImuFifoOverflows() {
+  uint16_t overflows;
+  uint8_t state = halEnterCritical();
+  overflows = fifo_overflows;
+  halExitCritical(state);
+  return overflows;
+}
+#endif
+
+#if CRAWL_IMU_SYNC
+void setAcquisitionCallback(void (*callback)(void*), void* context) {
+  uint8_t state = halEnterCritical();
+  cycle_callback = callback;
+  cycle_context = context;
+  halExitCritical(state);
+}
+
+uint16_t getAcquisitionMissed() {
+  uint16_t count;
+  uint8_t state = halEnterCritical();
+  count = missed;
+  halExitCritical(state);
+  return count;
+}
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file acquisition.h
+ * @brief
+ * 姿勢センサとエンコーダをバックグラウンドで連続的に読み出す
+ *
+ * 姿勢センサ(0x68),地磁気センサ(0x0C),エンコーダ(0x39)の読み出しを一組のI2Cトランザクションとして
+ * キューに入れる.一組は制御周期に一回だけ開始し,バスを占有し続けないようにする.
+ * CrlRobot::realtimeLoop()は周期の境界の直前に完了するようrequestAcquisition()で一組を開始し,
+ * それ以外の場合はtakeAcquisition()が取り出しの後に次の組を開始する.
+ * 制御ループは完了済みの最新の計測結果を取り出すだけで,I2C通信を待たない.
+ *
+ * CRAWL_IMU_FIFOが1の場合,姿勢センサは最新の一サンプルの代わりにFIFOの残量を読み出し,
+ * 溜まったサンプルを一回のバースト読み出しでまとめて読み出す.一回で読み切れなかった場合と,
+ * 開始直後に消去したFIFOにまだサンプルがなかった場合は,続けて次の組を開始する.
+ * FIFOが一杯になった場合は,サンプルの欠けた古いデータごとFIFOを消去して読み出しを続ける.
+ *
+ * CRAWL_IMU_SYNCが1の場合,一組の読み出しは姿勢センサのデータレディ割り込みのたびに一回だけ開始し,
+ * 完了するとsetAcquisitionCallback()で登録した関数を呼び出す.
+ * 前の組が完了する前に次のサンプルが用意された場合,そのサンプルは読み出さずに数える.
+ */
+#ifndef INCLUDED_acquisition_h
+#define INCLUDED_acquisition_h
+#include <stdint.h>
+#include "crawl_config.h"
+/**
+ * @brief 連続読み出しを開始する
+ *
+ * initAttitudeSensor()などで各デバイスを初期化した後に呼び出してください.
+ * 前回の連続読み出しの所要時間,requestAcquisition()の要求,取り出していない計測結果と回転数,
+ * FIFOのオーバーフローと読み出せなかったサンプルの回数は持ち越さず,0から始める.
+ * @return なし
+ */
+void startAcquisition();
+/**
+ * @brief 連続読み出しを停止する
+ *
+ * 実行中の組の読み出しの完了を待ち,次の組を開始しない.startAcquisition()で再開できる.
+ * @return なし
+ */
+void stopAcquisition();
+/**
+ * @brief 完了済みの最新の計測結果を取り出す
+ *
+ * 姿勢データ(getAttitude()と同じ並び)をattitudeに,前回取り出してから完了した読み出しで得た
+ * エンコーダの回転数の合計をleft，rightに格納する.
+ * 前回から新しい計測が完了していない場合,attitudeは更新されず,回転数は0となる.
+ * CRAWL_IMU_FIFOが1の場合,加速度と温度は前回取り出してから読み出した全サンプルの平均となる.
+ * ジャイロはそれらのサンプルの積分値を前回取り出してからの時間で割った値となり,
+ * 取り出しの間隔を掛けて足し合わせたものは,標本化周波数で積分した角度の変化に一致する.
+ * @param attitude 姿勢データの格納先
+ * @param left 左エンコーダの回転数の格納先
+ * @param right 右エンコーダの回転数の格納先
+ * @return 新しい計測結果があればtrue
+ */
+bool takeAcquisition(int attitude[10], short int* left, short int* right);
+#if !CRAWL_IMU_SYNC
+/**
+ * @brief 次の取り出しに向けて一組の読み出しを開始する
+ *
+ * 実行中の組があれば何もしない.呼び出した後の最初のtakeAcquisition()は新たな組を開始しない.
+ * @return なし
+ */
+void requestAcquisition();
+#endif
+/**
+ * @brief 最近の一組の読み出しの所要時間を取得する
+ *
+ * 投入からエンコーダの読み出しの完了までの時間で,先に投入されていたモータ指令の送信を待つ時間を含む.
+ * 組ごとの揺らぎに備えて最大値を保持し,短い組が続くと16組ほどの時定数で減らす.
+ * @return 所要時間 単位:マイクロ秒(まだ完了していなければ0)
+ */
+unsigned long getAcquisitionMicros();
+/**
+ * @brief 地磁気センサを読み出すかを設定する
+ *
+ * 読み出さない間,takeAcquisition()の地磁気の値は最後に読み出した値のままとなる.
+ * 変更は次の組の読み出しから有効になる.初期値は読み出す.
+ * @param enable 読み出す場合true
+ * @return なし
+ */
+void setMagnetometerRead(bool enable);
+#if CRAWL_IMU_FIFO
+/**
+ * @brief 姿勢センサのサンプルを失ってFIFOを消去した回数を取得する
+ *
+ * FIFOが一杯になった場合と,バースト読み出しが失敗した場合に数える.
+ * @return 回数(65535で飽和)
+ */
+uint16_t getImuFifoOverflows();
+#endif
+#if CRAWL_IMU_SYNC
+/**
+ * @brief 一組の読み出しが完了したときに呼び出す関数を登録する
+ *
+ * 関数は割り込みの中から呼び出されるため,短い処理(タスクの解放など)にとどめてください.
+ * startAcquisition()の前に呼び出してください.
+ * @param callback 呼び出す関数(NULLの場合は呼び出さない)
+ * @param context callbackに渡す値
+ * @return なし
+ */
+void setAcquisitionCallback(void (*callback)(void*), void* context);
+/**
+ * @brief 前の組の読み出しが終わっていなかったため読み出せなかったサンプルの数を取得する
+ * @return サンプル数(65535で飽和)
+ */
+uint16_t getAcquisitionMissed();
+#endif
+#endif
@@ -0,0 +1,219 @@
+/**
+ * @file ahrs.cpp
+ * @brief
+ * 四元数による姿勢推定(Mahonyの相補フィルタ)を固定小数点演算で行う.
+ */
+#include "ahrs.h"
+#include <math.h>
+#include <stddef.h>
+#include "fast_math.h"
+
+/** Q2.30の1 */
+#define AHRS_ONE 1073741824L
+
+/** Q2.30をQ2.14に丸める */
+static inline int16_t toQ14(int32_t x) { return (int16_t)((x + 0x8000L) >> 16); }
+
+/** int16_tの範囲に飽和させる */
+static inline int16_t saturate(int32_t x) { return x > 32767 ? 32767 : (x < -32768 ? -32768 : (int16_t)x); }
+
+/**
+ * 平方根の逆数 1/sqrt(m / 2^32) を求める (2^30 <= m < 2^32)
+ *
+ * 初期値を直線近似(相対誤差8.7%以下)で求め,ニュートン法 y = y (3 - x y^2) / 2 を二回反復する(相対誤差3e-4以下).
+ * @return 平方根の逆数 Q1.15 (2の場合は65535)
+ */
+static uint16_t invSqrtUnit(uint32_t m) {
+  uint16_t x = m >> 16;                                  // Q0.16 [0.25, 1)
+  uint16_t y = 69862UL - (((uint32_t)x * 39911) >> 16);  // 2.132 - 1.218 x
+  for (uint8_t i = 0; i < 2; i++) {
+    uint16_t y2 = ((uint32_t)y * y) >> 16;                // Q2.14
+    uint16_t t = ((3UL << 30) - (uint32_t)x * y2) >> 16;  // 3 - x y^2 Q2.14
+    uint32_t next = ((uint32_t)y * t) >> 15;
+    y = next > 65535 ? 65535 : next;
+  }
+  return y;
+}
+
+/**
+ * 3次元ベクトルをQ2.14の単位ベクトルにする
+ * @return 長さが0の場合false
+ */
+static bool normalize(const int16_t v[3], int16_t unit[3]) {
+  int16_t s[3] = {v[0], v[1], v[2]};
+  uint32_t n2 = (uint32_t)((int32_t)s[0] * s[0]) + (uint32_t)((int32_t)s[1] * s[1]) + (uint32_t)((int32_t)s[2] * s[2]);
+  uint16_t k;
+  uint8_t e = 0;
+
+  if (n2 == 0) return false;
+  // 長さを2^13以上にしておき,積s kをint32_tに収める
+  while (n2 < (1UL << 26)) {
+    for (uint8_t i = 0; i < 3; i++) s[i] <<= 1;
+    n2 <<= 2;
+  }
+  // 1/長さ = invSqrtUnit(n2 4^e) 2^(e - 31)
+  while (n2 < (1UL << 30)) {
+    n2 <<= 2;
+    e++;
+  }
+  k = invSqrtUnit(n2);
+  for (uint8_t i = 0; i < 3; i++) unit[i] = (int16_t)(((int32_t)s[i] * k) >> (17 - e));
+  return true;
+}
+
+/**
+ * 地上座標に固定したベクトルを,機体が一周期の回転(半角h)をした後の機体座標で表す v + 2 v x h
+ * @param v 回転前の機体座標で表したベクトル Q2.14
+ * @param h 一周期の回転の半角 単位:2^-(shift+1) rad
+ * @param shift 積から切り捨てるビット数
+ * @param out 書き込み先 Q2.14
+ */
+static void rotate(const int16_t v[3], const int16_t h[3], uint8_t shift, int16_t out[3]) {
+  out[0] = v[0] + (((int32_t)v[1] * h[2] - (int32_t)v[2] * h[1]) >> shift);
+  out[1] = v[1] + (((int32_t)v[2] * h[0] - (int32_t)v[0] * h[2]) >> shift);
+  out[2] = v[2] + (((int32_t)v[0] * h[1] - (int32_t)v[1] * h[0]) >> shift);
+}
+
+MahonyAhrs::MahonyAhrs() : dt(0.01f), kp(1), ki(0) {
+  this->q[0] = AHRS_ONE;
+  this->q[1] = this->q[2] = this->q[3] = 0;
+  for (uint8_t i = 0; i < 3; i++) this->integral[i] = 0;
+  updateCoefficients();
+  updateUp();
+}
+
+void MahonyAhrs::setDt(float dt) {
+  this->dt = dt;
+  updateCoefficients();
+}
+
+void MahonyAhrs::setGains(float kp, float ki) {
+  this->kp = kp;
+  this->ki = ki;
+  updateCoefficients();
+}
+
+void MahonyAhrs::updateCoefficients() {
+  // 一周期の回転の半角 0.5 dt w は,最大の角速度でもint16_tに収まる範囲で小数部のビット数を最大にする
+  int e;
+  float m = frexp(0.5f * this->dt * AHRS_GYRO_SCALE, &e);  // m 2^e, 0.5 <= m < 1
+  long step = lround(m * 32768);
+
+  if (-e < 16) {
+    // dtが長すぎる場合は小数部を16ビットとし,大きな角速度を飽和させる
+    e = -16;
+    step = lround(0.5f * this->dt * AHRS_GYRO_SCALE * 2147483648.0f);
+  }
+  this->step_bits = -e > 30 ? 30 : -e;
+  this->half_step = step > 32767 ? 32767 : step;
+  this->kp_raw = saturate(lround(this->kp / AHRS_GYRO_SCALE));
+  this->ki_raw = saturate(lround(this->ki * this->dt / AHRS_GYRO_SCALE * 4));
+}
+
+void MahonyAhrs::updateUp() {
+  int16_t q0 = toQ14(this->q[0]), q1 = toQ14(this->q[1]), q2 = toQ14(this->q[2]), q3 = toQ14(this->q[3]);
+
+  // 回転行列の第3行(地上座標のZ軸を機体座標で表したもの)
+  this->up[0] = ((int32_t)q1 * q3 - (int32_t)q0 * q2) >> 13;
+  this->up[1] = ((int32_t)q0 * q1 + (int32_t)q2 * q3) >> 13;
+  this->up[2] = ((int32_t)q0 * q0 - (int32_t)q1 * q1 - (int32_t)q2 * q2 + (int32_t)q3 * q3) >> 14;
+}
+
+void MahonyAhrs::reset(float ax, float ay, float az) {
+  float n2 = ax * ax + ay * ay + az * az;
+  float r, w;
+
+  for (uint8_t i = 0; i < 3; i++) this->integral[i] = 0;
+  if (n2 == 0) return;
+  r = fastInvSqrt(n2);
+  ax *= r;
+  ay *= r;
+  az *= r;
+  // 加速度の向きを鉛直上向き(0, 0, 1)に移す最小の回転 q = (1 + a.z, a x z) を正規化する
+  w = 1 + az;
+  if (w < 1e-6f) {
+    this->q[0] = this->q[2] = this->q[3] = 0;  // 真下を向いている場合はX軸周りに半回転
+    this->q[1] = AHRS_ONE;
+  } else {
+    r = fastInvSqrt(w * w + ay * ay + ax * ax);
+    r *= 1.5f - 0.5f * (w * w + ay * ay + ax * ax) * r * r;  // 四元数は精度が必要なため反復を一回加える
+    this->q[0] = lround(w * r * AHRS_ONE);
+    this->q[1] = lround(ay * r * AHRS_ONE);
+    this->q[2] = lround(-ax * r * AHRS_ONE);
+    this->q[3] = 0;
+  }
+  updateUp();
+}
+
+void MahonyAhrs::update(const int16_t acc[3], const int16_t gyro[3], const int16_t mag[3]) {
+  int32_t error[3] = {0, 0, 0};  // Q4.28
+  int16_t unit[3], h[3], up[3], delta;
+  int16_t q0 = toQ14(this->q[0]), q1 = toQ14(this->q[1]), q2 = toQ14(this->q[2]), q3 = toQ14(this->q[3]);
+  int32_t n;
+  uint8_t i, shift = this->step_bits - 16;
+
+  // ジャイロの値による一周期の回転の半角
+  for (i = 0; i < 3; i++) h[i] = saturate(((int32_t)gyro[i] * this->half_step + 0x4000) >> 15);
+  // 推定した向きをこの回転の後の値に進めてから測定値と比べる.前の周期の推定と比べると,
+  // 旋回中は補正が一周期分の回転を打ち消そうとし,推定が真値より一周期先行する
+  rotate(this->up, h, this->step_bits - 1, up);
+
+  // 加速度の向きと推定した鉛直上向きの外積
+  if (normalize(acc, unit)) {
+    error[0] = (int32_t)unit[1] * up[2] - (int32_t)unit[2] * up[1];
+    error[1] = (int32_t)unit[2] * up[0] - (int32_t)unit[0] * up[2];
+    error[2] = (int32_t)unit[0] * up[1] - (int32_t)unit[1] * up[0];
+  }
+  // 地磁気の向きと推定した北(回転行列の第1行)の外積のうち,鉛直成分だけを加える
+  if (mag != NULL && normalize(mag, unit)) {
+    int16_t last[3], north[3], cross[3];
+    int32_t vertical;
+    last[0] = ((int32_t)q0 * q0 + (int32_t)q1 * q1 - (int32_t)q2 * q2 - (int32_t)q3 * q3) >> 14;
+    last[1] = ((int32_t)q1 * q2 - (int32_t)q0 * q3) >> 13;
+    last[2] = ((int32_t)q1 * q3 + (int32_t)q0 * q2) >> 13;
+    rotate(last, h, this->step_bits - 1, north);
+    cross[0] = ((int32_t)unit[1] * north[2] - (int32_t)unit[2] * north[1]) >> 14;
+    cross[1] = ((int32_t)unit[2] * north[0] - (int32_t)unit[0] * north[2]) >> 14;
+    cross[2] = ((int32_t)unit[0] * north[1] - (int32_t)unit[1] * north[0]) >> 14;
+    vertical = ((int32_t)cross[0] * up[0] + (int32_t)cross[1] * up[1] + (int32_t)cross[2] * up[2]) >> 14;
+    for (i = 0; i < 3; i++) error[i] += vertical * up[i];
+  }
+
+  // 誤差を比例・積分し,回転の半角に加える
+  for (i = 0; i < 3; i++) {
+    int16_t e = saturate(error[i] >> 14);
+    int32_t w = ((int32_t)this->kp_raw * e) >> 14;
+    if (this->ki_raw != 0) {
+      const int32_t limit = (int32_t)AHRS_INTEGRAL_LIMIT << 16;
+      int32_t sum = this->integral[i] + (int32_t)this->ki_raw * e;
+      this->integral[i] = sum > limit ? limit : (sum < -limit ? -limit : sum);
+      w += this->integral[i] >> 16;
+    }
+    h[i] = saturate(h[i] + (((int32_t)saturate(w) * this->half_step + 0x4000) >> 15));
+  }
+
+  // q += q (0, h) (積は2^(14+step_bits),qは2^30)
+  this->q[0] += (-(int32_t)q1 * h[0] - (int32_t)q2 * h[1] - (int32_t)q3 * h[2]) >> shift;
+  this->q[1] += ((int32_t)q0 * h[0] + (int32_t)q2 * h[2] - (int32_t)q3 * h[1]) >> shift;
+  this->q[2] += ((int32_t)q0 * h[1] - (int32_t)q1 * h[2] + (int32_t)q3 * h[0]) >> shift;
+  this->q[3] += ((int32_t)q0 * h[2] + (int32_t)q1 * h[1] - (int32_t)q2 * h[0]) >> shift;
+
+  // 長さはほぼ1のため,1/sqrt(n)を1から始めたニュートン法の一回の反復 1 + (1 - n) / 2 で正規化する
+  q0 = toQ14(this->q[0]);
+  q1 = toQ14(this->q[1]);
+  q2 = toQ14(this->q[2]);
+  q3 = toQ14(this->q[3]);
+  n = (int32_t)q0 * q0 + (int32_t)q1 * q1 + (int32_t)q2 * q2 + (int32_t)q3 * q3;  // Q4.28
+  delta = (int16_t)((AHRS_ONE / 4 - n) >> 15);                                    // (1 - n) / 2 Q2.14
+  this->q[0] += ((int32_t)q0 * delta) << 2;
+  this->q[1] += ((int32_t)q1 * delta) << 2;
+  this->q[2] += ((int32_t)q2 * delta) << 2;
+  this->q[3] += ((int32_t)q3 * delta) << 2;
+  updateUp();
+}
+
+int16_t MahonyAhrs::getUp(uint8_t axis) { return this->up[axis]; }
+
+void MahonyAhrs::getQuaternion(float q[4]) {
+  for (uint8_t i = 0; i < 4; i++) q[i] = (float)this->q[i] / AHRS_ONE;
+}
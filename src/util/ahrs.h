@@ -0,0 +1,122 @@
+/**
+ * @file ahrs.h
+ * @brief
+ * 四元数による姿勢推定(Mahonyの相補フィルタ)を固定小数点演算で行う.
+ *
+ * 姿勢を機体座標から地上座標(Z軸が鉛直上向き)への回転を表す四元数qとして持ち,ジャイロの値で積分する.
+ * 加速度の向きと,qから求めた鉛直上向きの向き(ジャイロの値で一周期分進めたもの)の外積を誤差とし,
+ * 比例・積分してジャイロの値に加えることで,3軸を一つの回転として補正する.そのため軸ごとのatan2による相補フィルタと異なり,直立から離れた姿勢や
+ * 複数の軸周りの回転が重なっても各軸の推定が干渉しない.
+ * 地磁気を与えた場合は,地磁気の向きと推定した北(地上座標のX軸)の向きの外積の鉛直成分だけを誤差に加え,
+ * 方位だけを補正する(地磁気の乱れが傾きに影響しない).ハードアイアンなどの地磁気の補正は行わない.
+ *
+ * 演算は16ビット×16ビットの乗算と32ビットの加算で,除算と浮動小数点演算は使わず,一回の更新の乗算の回数は
+ * 分岐によらずほぼ一定(地磁気なしで約60回,地磁気ありで約100回)となる.ベクトルの正規化は平方根の逆数を
+ * 直線近似とニュートン法で求め,四元数の正規化は長さが1に近いことを利用してニュートン法の一回の反復で行う.
+ * 鉛直上向きの向きから姿勢角度を求めるための逆正接には,同じく除算を使わないfxAtan2()を使う.
+ *
+ * | 量                    | 形式           | 分解能            |
+ * |-----------------------|----------------|-------------------|
+ * | 四元数q               | Q2.30 (int32)  | 9.3e-10           |
+ * | 単位ベクトル,誤差     | Q2.14 (int16)  | 6.1e-5            |
+ * | 一周期の回転の半角    | int16          | 2^-16〜2^-30 rad (dtで決まる.dt=0.01秒で9.5e-7 rad) |
+ */
+#ifndef INCLUDED_ahrs_h
+#define INCLUDED_ahrs_h
+#include <stdint.h>
+#include "fixed_point.h"
+
+/** ジャイロの生値1あたりの角速度 単位:rad/s (250/(2^15)/360*2*pi) */
+#define AHRS_GYRO_SCALE 0.00013316f
+/** 積分フィードバックの上限 単位:ジャイロの生値 (約1deg/s) */
+#define AHRS_INTEGRAL_LIMIT 131
+
+class MahonyAhrs {
+  /// @cond develop
+  /** ループ間隔 単位:秒 */
+  float dt;
+  /** 比例ゲイン 単位:1/s */
+  float kp;
+  /** 積分ゲイン 単位:1/s^2 */
+  float ki;
+  /** 姿勢(機体座標から地上座標への回転) Q2.30 */
+  int32_t q[4];
+  /** 地上座標の鉛直上向きを機体座標で表した単位ベクトル Q2.14 */
+  int16_t up[3];
+  /** 積分フィードバック 単位:ジャイロの生値 Q16.16 */
+  int32_t integral[3];
+  /** 誤差1あたりの比例フィードバック 単位:ジャイロの生値 */
+  int16_t kp_raw;
+  /** 誤差1あたりの一周期の積分フィードバックの増分 単位:ジャイロの生値 Q14.2 */
+  int16_t ki_raw;
+  /** ジャイロの生値を一周期の回転の半角に換算する係数 Q1.15 */
+  int16_t half_step;
+  /** 一周期の回転の半角の小数部のビット数 */
+  uint8_t step_bits;
+  /** dt,kp,kiから整数演算の係数を求める */
+  void updateCoefficients();
+  /** qから鉛直上向きの単位ベクトルupを求める */
+  void updateUp();
+  /// @endcond
+
+ public:
+  /**
+   * @brief コンストラクタ
+   *
+   * 姿勢は回転なし(機体のZ軸が鉛直上向き),ループ間隔は0.01秒,比例ゲインは1,積分ゲインは0で初期化されます.
+   */
+  MahonyAhrs();
+  /**
+   * @brief ループ間隔を設定する
+   * @param dt ループ間隔 単位:秒
+   * @return なし
+   */
+  void setDt(float dt);
+  /**
+   * @brief 補正のゲインを設定する
+   *
+   * 比例ゲインの逆数が,加速度(と地磁気)の向きに姿勢が近づく時定数となる.
+   * 積分ゲインはジャイロのオフセットの残りを推定する速さで,0の場合は積分しない.
+   * @param kp 比例ゲイン 単位:1/s
+   * @param ki 積分ゲイン 単位:1/s^2
+   * @return なし
+   */
+  void setGains(float kp, float ki);
+  /**
+   * @brief 姿勢を加速度の向きに合わせる
+   *
+   * 静止時の加速度(重力の反対向き)が鉛直上向きとなる姿勢のうち,回転の最も小さいものにし,積分フィードバックを0にする.
+   * 大きさは問わない.
+   * @param ax 機体のX軸方向の加速度
+   * @param ay 機体のY軸方向の加速度
+   * @param az 機体のZ軸方向の加速度
+   * @return なし
+   */
+  void reset(float ax, float ay, float az);
+  /**
+   * @brief 姿勢を一周期分更新する
+   *
+   * 加速度と地磁気は大きさを問わない.長さが0のベクトルによる補正は行わない.
+   * @param acc 機体座標の加速度(生値など)
+   * @param gyro 機体座標の角速度からオフセットを除いた値 単位:ジャイロの生値(AHRS_GYRO_SCALE rad/s)
+   * @param mag 機体座標の地磁気(生値など).NULLの場合は地磁気による方位の補正を行わない
+   * @return なし
+   * @warning 時間間隔dtごとに呼び出して下さい.
+   */
+  void update(const int16_t acc[3], const int16_t gyro[3], const int16_t mag[3]);
+  /**
+   * @brief 鉛直上向きの単位ベクトルを取得する
+   *
+   * 静止時に加速度センサが示す向きの推定値で,各軸の傾きはfxAtan2()で求められる.
+   * @param axis 機体の軸の番号 [0, 3)
+   * @return 鉛直上向きの単位ベクトルの成分 Q2.14
+   */
+  int16_t getUp(uint8_t axis);
+  /**
+   * @brief 姿勢の四元数を取得する
+   * @param q 書き込み先(w,x,y,zの順).機体座標から地上座標への回転
+   * @return なし
+   */
+  void getQuaternion(float q[4]);
+};
+#endif
@@ -6,74 +6,120 @@
  * センサＩＣとマイコンはシリアル通信（I2C）によりコマンドの送受信をする．
  */
 #include "attitude_sensor.h"
-#include <Arduino.h>
-#include <Wire.h>
+#include "hal.h"
 
-int attitude_data[10];
+
+#if CRAWL_IMU_FIFO
+#if CRAWL_IMU_FIFO_RATE < 4 || CRAWL_IMU_FIFO_RATE > 1000 || 1000 % CRAWL_IMU_FIFO_RATE != 0
+#error "CRAWL_IMU_FIFO_RATE must be a divisor of 1000 between 4 and 1000"
+#endif
+/** 標本化周期 単位:マイクロ秒 */
+static HAL_THREAD_LOCAL unsigned long sample_period_us = 1000000UL / CRAWL_IMU_FIFO_RATE;
+#elif CRAWL_IMU_SYNC
+/** 標本化周期 単位:マイクロ秒 */
+static HAL_THREAD_LOCAL unsigned long sample_period_us = 10000;
+#endif
+
+#if CRAWL_IMU_FIFO || CRAWL_IMU_SYNC
+/** initAttitudeSensor()を呼び出し済みか */
+static HAL_THREAD_LOCAL bool initialized = false;
+
+/** 標本化周期をレジスタに設定する */
+static void applySamplePeriod() {
+  // DLPF_CFG(A_DLPFCFG)が1〜6のときの帯域(ジャイロ) 単位:Hz.加速度もほぼ同じ
+  static const uint8_t bandwidth[] = {184, 92, 41, 20, 10, 5};
+  unsigned long divider = (sample_period_us + 500) / 1000;  // 内部の標本化周波数1kHzに対する分周比
+  if (divider < 1) divider = 1;
+  if (divider > 256) divider = 256;
+  unsigned int rate = 1000 / divider;
+  uint8_t dlpf = 1;
+  while (dlpf < 6 && bandwidth[dlpf - 1] * 2U >= rate) dlpf++;  // 帯域が標本化周波数の半分未満となるもの
+
+  // 0x19 SMPLRT_DIV, 0x1A CONFIG (FIFOが一杯なら新しいサンプルを捨てる), 0x1B, 0x1C 初期値, 0x1D ACCEL_CONFIG2
+  const uint8_t sample_config[] = {0x19, (uint8_t)(divider - 1), (uint8_t)(0x40 | dlpf), 0x00, 0x00, dlpf};
+  halI2cWrite(HAL_ADDR_MPU9250, sample_config, sizeof(sample_config));
+}
+
+void setAttitudeSamplePeriod(unsigned long period_us) {
+  sample_period_us = period_us;
+  if (initialized) applySamplePeriod();
+}
+#endif
+
+#if CRAWL_IMU_FIFO
+void resetAttitudeFifo() {
+  uint8_t int_status;
+  const uint8_t fifo_reset[] = {0x6A, IMU_USER_CTRL_FIFO_RESET};
+  const uint8_t int_status_reg[] = {0x3A};
+
+  halI2cWrite(HAL_ADDR_MPU9250, fifo_reset, sizeof(fifo_reset));
+  halI2cWrite(HAL_ADDR_MPU9250, int_status_reg, sizeof(int_status_reg));
+  halI2cRead(HAL_ADDR_MPU9250, &int_status, 1);  // 溢れていた場合のオーバーフローのフラグを消す
+}
+#endif
 
 void initAttitudeSensor() {
-  Wire.beginTransmission(0x68);
-  Wire.write(0x75);
-  Wire.endTransmission();
-  Wire.requestFrom(0x68, 1);
+  uint8_t who_am_i = 0;
+  const uint8_t who_am_i_reg[] = {0x75};
+  const uint8_t power_on[] = {0x6B, 0x00};
+  const uint8_t bypass_enable[] = {0x37, 0x02};
+  const uint8_t mag_continuous[] = {0x0A, 0x12};
 
-  delay(10);
+  halI2cWrite(HAL_ADDR_MPU9250, who_am_i_reg, sizeof(who_am_i_reg));
+  halI2cRead(HAL_ADDR_MPU9250, &who_am_i, 1);
 
-  if (Wire.read() == 0x71) {
-    Serial.println("Success");
+  halDelay(10);
+
+  if (who_am_i == 0x71) {
+    halSerialPrintln("Success");
   } else {
-    Serial.println("Failed");
+    halSerialPrintln("Failed");
     while (1) continue;
   }
 
-  Wire.beginTransmission(0x68);
-  Wire.write(0x6B);
-  Wire.write(0x00);
-  Wire.endTransmission();
-
-  Wire.beginTransmission(0x68);
-  Wire.write(0x37);
-  Wire.write(0x02);
-  Wire.endTransmission();
-
-  Wire.beginTransmission(0x0C);
-  Wire.write(0x0A);
-  Wire.write(0x12);
-  Wire.endTransmission();
-
-  for (int i = 0; i < 10; i++) {
-    attitude_data[i] = 0;
+  halI2cWrite(HAL_ADDR_MPU9250, power_on, sizeof(power_on));
+  halI2cWrite(HAL_ADDR_MPU9250, bypass_enable, sizeof(bypass_enable));
+  halI2cWrite(HAL_ADDR_AK8963, mag_continuous, sizeof(mag_continuous));
+#if CRAWL_IMU_FIFO || CRAWL_IMU_SYNC
+  applySamplePeriod();
+  initialized = true;
+#endif
+#if CRAWL_IMU_SYNC
+  {
+    // 0x38 INT_ENABLE: RAW_RDY_EN.INTピンは標本化ごとに50マイクロ秒のHIGHパルスを出す(INT_PIN_CFGの初期値)
+    const uint8_t data_ready_enable[] = {0x38, 0x01};
+    halI2cWrite(HAL_ADDR_MPU9250, data_ready_enable, sizeof(data_ready_enable));
   }
+#endif
+#if CRAWL_IMU_FIFO
+  {
+    // 0x23 FIFO_EN: 温度,ジャイロXYZ,加速度(FIFO内の順序はレジスタの順となり,0x3Bからの読み出しと同じ並び)
+    const uint8_t fifo_enable[] = {0x23, 0xF8};
+    // 0x38 INT_ENABLE: FIFO_OFLOW_EN (INT_STATUSでオーバーフローを検出する)
+    const uint8_t overflow_enable[] = {0x38, 0x10};
+    halI2cWrite(HAL_ADDR_MPU9250, fifo_enable, sizeof(fifo_enable));
+    halI2cWrite(HAL_ADDR_MPU9250, overflow_enable, sizeof(overflow_enable));
+    resetAttitudeFifo();
+  }
+#endif
 }
 
-void getAttitude() {
-  int calc_temp;
-  byte calc_temp_b;
+void getAttitude(int attitude[10]) {
+  uint8_t buf[14];
+  const uint8_t accel_reg[] = {0x3B};
+  const uint8_t mag_reg[] = {0x03};
 
-  Wire.beginTransmission(0x68);
-  Wire.write(0x3B);
-  Wire.endTransmission();
-  Wire.requestFrom(0x68, 14);
+  halI2cWrite(HAL_ADDR_MPU9250, accel_reg, sizeof(accel_reg));
+  halI2cRead(HAL_ADDR_MPU9250, buf, 14);
 
   for (int i = 0; i < 7; i++) {
-    calc_temp = Wire.read();
-    calc_temp = calc_temp << 8;
-    calc_temp |= Wire.read();
-    attitude_data[i] = calc_temp;
+    attitude[i] = (int16_t)((buf[i * 2] << 8) | buf[i * 2 + 1]);
   }
 
-  Wire.beginTransmission(0x0C);
-  Wire.write(0x03);
-  Wire.endTransmission();
-  Wire.requestFrom(0x0C, 7);
+  halI2cWrite(HAL_ADDR_AK8963, mag_reg, sizeof(mag_reg));
+  halI2cRead(HAL_ADDR_AK8963, buf, 7);  // 最後のST2の読み出しで次の測定が始まる
 
   for (int i = 7; i < 10; i++) {
-    calc_temp_b = Wire.read();
-    calc_temp = Wire.read();
-    calc_temp = calc_temp << 8;
-    calc_temp |= calc_temp_b;
-    attitude_data[i] = calc_temp;
+    attitude[i] = (int16_t)((buf[(i - 7) * 2 + 1] << 8) | buf[(i - 7) * 2]);
   }
-
-  Wire.read();
 }
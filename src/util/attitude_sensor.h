@@ -7,6 +7,16 @@
  */
 #ifndef INCLUDED_attitude_sensor_h
 #define INCLUDED_attitude_sensor_h
+#include "crawl_config.h"
+
+#if CRAWL_IMU_FIFO
+/** FIFOの一サンプルのバイト数(加速度,温度,ジャイロ.0x3Bからの14バイトと同じ並び) */
+#define IMU_FIFO_SAMPLE_BYTES 14
+/** FIFOの容量 単位:バイト */
+#define IMU_FIFO_SIZE 512
+/** USER_CTRL(0x6A)の値: FIFOを有効にして中身を消去する */
+#define IMU_USER_CTRL_FIFO_RESET 0x44
+#endif
 /**
  * @brief 姿勢センサ機能の初期化関数
  *
@@ -17,10 +27,32 @@ void initAttitudeSensor();
 /**
  * @brief 姿勢データを取得する
  *
- * 取得された姿勢データはグローバル変数attitude_dataに格納される．
+ * 姿勢データは加速度3軸,温度,ジャイロ3軸,地磁気3軸の生値の順に格納される．
+ * @param attitude 姿勢データの格納先
+ * @return なし
+ */
+void getAttitude(int attitude[10]);
+#if CRAWL_IMU_FIFO
+/**
+ * @brief 姿勢センサのFIFOを空にする
+ *
+ * initAttitudeSensor()はCRAWL_IMU_FIFO_RATEでの標本化とFIFOへの書き込みを開始する.
+ * 読み出しを始めるまでに溜まったサンプルとオーバーフローの記録を捨てるために使用する.
  * @return なし
  */
-void getAttitude();
-/** 姿勢データ */
-extern int attitude_data[10];
+void resetAttitudeFifo();
+#endif
+#if CRAWL_IMU_FIFO || CRAWL_IMU_SYNC
+/**
+ * @brief 姿勢センサの標本化周期を設定する
+ *
+ * 内蔵の1kHzの標本化を分周するため,1ミリ秒単位(1〜256ミリ秒)に丸められる.
+ * デジタルローパスフィルタの帯域は,標本化周波数の半分未満となるよう選ばれる.
+ * initAttitudeSensor()の前に呼び出した場合は,initAttitudeSensor()で設定される.
+ * CRAWL_IMU_FIFOが1の場合の初期値はCRAWL_IMU_FIFO_RATE,CRAWL_IMU_SYNCが1の場合は10ミリ秒.
+ * @param period_us 標本化周期 単位:マイクロ秒
+ * @return なし
+ */
+void setAttitudeSamplePeriod(unsigned long period_us);
+#endif
 #endif
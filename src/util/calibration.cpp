@@ -0,0 +1,54 @@
+/**
+ * @file calibration.cpp
+ * @brief
+ * キャリブレーションの結果をEEPROMに保存する
+ */
+#include "calibration.h"
+#include <string.h>
+#include "hal.h"
+#include "telemetry.h"
+
+/** EEPROM上の書式 */
+struct CalibrationRecord {
+  /** 書式のバージョン */
+  uint8_t version;
+  /** 保存する結果 */
+  CalibrationData data;
+  /** versionとdataのCRC */
+  uint16_t crc;
+};
+
+#if CRAWL_CALIBRATION_ADDRESS < 0 || CRAWL_CALIBRATION_ADDRESS + 32 > HAL_EEPROM_SIZE
+#error "CRAWL_CALIBRATION_ADDRESS must leave 32 bytes before the end of the EEPROM"
+#endif
+static_assert(sizeof(CalibrationRecord) <= 32, "CalibrationRecord must fit in 32 bytes");
+
+/** versionとdataのCRCを求める(ホストでは構造体の間に詰め物が入るため,メンバごとに計算する) */
+static uint16_t recordCrc(const CalibrationRecord* record) {
+  uint16_t crc = telemetryCrc(&record->version, sizeof(record->version));
+  return telemetryCrc((const uint8_t*)&record->data, sizeof(record->data), crc);
+}
+
+bool loadCalibration(CalibrationData* data) {
+  CalibrationRecord record;
+
+  halEepromRead(CRAWL_CALIBRATION_ADDRESS, &record, sizeof(record));
+  if (record.version != CALIBRATION_VERSION || record.crc != recordCrc(&record)) return false;
+  *data = record.data;
+  return true;
+}
+
+void saveCalibration(const CalibrationData* data) {
+  CalibrationRecord record;
+
+  memset(&record, 0, sizeof(record));
+  record.version = CALIBRATION_VERSION;
+  record.data = *data;
+  record.crc = recordCrc(&record);
+  halEepromWrite(CRAWL_CALIBRATION_ADDRESS, &record, sizeof(record));
+}
+
+void eraseCalibration() {
+  uint8_t erased = 0xFF;
+  halEepromWrite(CRAWL_CALIBRATION_ADDRESS, &erased, 1);  // バージョンを消せば無効になる
+}
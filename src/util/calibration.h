@@ -0,0 +1,51 @@
+/**
+ * @file calibration.h
+ * @brief
+ * キャリブレーションの結果をEEPROMに保存する
+ *
+ * ジャイロのオフセット,静止時の加速度(姿勢角度の初期値の元),キャリブレーション時の温度を
+ * CRAWL_CALIBRATION_ADDRESSから32バイト(既定では0x3E0〜0x3FF)に,書式のバージョンとCRCを付けて保存する.
+ * 未書き込み(0xFF)や書式の異なる内容は,CRCとバージョンの不一致として読み出し時に除かれる.
+ */
+#ifndef INCLUDED_calibration_h
+#define INCLUDED_calibration_h
+#include <stdint.h>
+#include "crawl_config.h"
+
+/** 書式のバージョン(CalibrationDataの内容を変えたら増やす) */
+#define CALIBRATION_VERSION 1
+
+/**
+ * @struct CalibrationData
+ * @brief
+ * 保存するキャリブレーションの結果
+ */
+struct CalibrationData {
+  /** ジャイロのオフセット(X,Y,Z) 単位:生値 */
+  float gyro_offset[3];
+  /** 静止時の加速度(X,Y,Z) 単位:生値 */
+  int16_t accel[3];
+  /** キャリブレーション時の温度 単位:生値(333.87で1℃,0が21℃) */
+  int16_t temperature;
+};
+
+/**
+ * @brief 保存されたキャリブレーションの結果を読み出す
+ * @param data 書き込み先
+ * @return 有効な結果が保存されていればtrue
+ */
+bool loadCalibration(CalibrationData* data);
+/**
+ * @brief キャリブレーションの結果を保存する
+ *
+ * EEPROMへの書き込みが完了するまで待つ(変わったバイトあたり約3.4ミリ秒).
+ * @param data 保存する結果
+ * @return なし
+ */
+void saveCalibration(const CalibrationData* data);
+/**
+ * @brief 保存されたキャリブレーションの結果を無効にする
+ * @return なし
+ */
+void eraseCalibration();
+#endif
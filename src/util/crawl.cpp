@@ -4,9 +4,10 @@
  * クロールに対して指令を出す,クロールの持っているセンサの情報を取得するためのライブラリ.
  */
 
-#include <Arduino.h>
 // 姿勢センサ
 #include "attitude_sensor.h"
+// センサの連続読み出し
+#include "acquisition.h"
 // モーター指令
 #include "crawl_drive.h"
 // クロールロボット
@@ -14,194 +15,733 @@
 // エンコーダ読み取り
 #include "encoder.h"
 // カルマンフィルタ
-#include "kalmanfilter.h"
-// Declared weak in Arduino.h to allow user redefinitions.
-int atexit(void (*/*func*/)()) { return 0; }
-
-// Weak empty variant initialization function.
-// May be redefined by variant files.
-void initVariant() __attribute__((weak));
-void initVariant() {}
-
-void setupUSB() __attribute__((weak));
-void setupUSB() {}
-
-// I2C
-#include <Wire.h>
+#include "kalmanfilter_bank.h"
+#include "kalmanfilter_bias.h"
+// バス・時計・GPIO
+#include "hal.h"
+// テレメトリ
+#include "telemetry.h"
+// プロファイラ
+#include "profiler.h"
+// キャリブレーションの保存
+#include "calibration.h"
 
 // 数学処理
 #define _USE_MATH_DEFINES
 #include <float.h>
 #include <math.h>
+#include "fast_math.h"
 
-CrlRobot crl;
-KalmanFilter kf;
+HAL_THREAD_LOCAL CrlRobot crl;
 
 #define FOF_ACC_T (1.0 / 25.0)
 #define ODOMETRY_T (1.0 / 50.0)
 #define CRAWL_LENGTH (0.195)
 
-void CrlRobot::init() {
-  ::init();
-  ::initVariant();
+/** 3軸すべてのビット */
+#define ALL_AXES (CRAWL_AXIS_BIT(CRAWL_AXIS_X) | CRAWL_AXIS_BIT(CRAWL_AXIS_Y) | CRAWL_AXIS_BIT(CRAWL_AXIS_Z))
+/** staleのうち上端速度のビット(軸のビットと重ならない) */
+#define STALE_HEAD_VELOCITY 0x08
+
+/** ウォームブートで姿勢センサの起動を待つ時間 単位:ミリ秒 (ジャイロの起動時間は最大35ミリ秒) */
+#define WARM_BOOT_DELAY 50
+/** ウォームブートで保存された結果を確かめるために平均するサンプル数 */
+#define WARM_BOOT_SAMPLES 16
+/** ウォームブートを許す温度の差 単位:生値 (約3℃) */
+#define WARM_BOOT_TEMPERATURE 1000
+/** ウォームブートを許すジャイロの平均とオフセットの差 単位:生値 (約0.25deg/s) */
+#define WARM_BOOT_GYRO 32
+/** 保存時と同じ姿勢で置かれているとみなす加速度の差 単位:生値 (約0.02G) */
+#define WARM_BOOT_ACCEL 328
+
+#if !defined(ARDUINO)
+#include <assert.h>
+/** このスレッドで最後にinit()を呼んだロボット(スレッドの連続読み出しとドライバの状態を使っているもの) */
+static HAL_THREAD_LOCAL const CrlRobot* active_robot = NULL;
+/** 同じスレッドの別のロボットがinit()で状態を奪っていないことを確かめる(ホスト向けのみ) */
+#define ASSERT_ACTIVE_ROBOT() assert(active_robot == this && "another CrlRobot called init() on this thread")
+#else
+#define ASSERT_ACTIVE_ROBOT()
+#endif
 
-#if defined(USBCON)
-  ::USBDevice.attach();
+#if CRAWL_PROFILER
+/** updateState()の中で,直前の区切り(lap)からの時間をフェーズの時間として記録する */
+#define PROFILE_LAP(phase) lap = profilerLap(phase, lap)
+#else
+#define PROFILE_LAP(phase)
 #endif
 
-  Wire.begin();          // I2Cセットアップ
-  pinMode(13, OUTPUT);   // LEDピン設定
-  initAttitudeSensor();  // 姿勢センサ機能の初期化
-  delay(300);
+void CrlRobot::init() {
+#if !defined(ARDUINO)
+  active_robot = this;  // スレッドの連続読み出しとドライバの状態はこのロボットのものになる
+#endif
+  halInit();                       // マイコンとI2Cのセットアップ
+  halPinMode(13, HAL_PIN_OUTPUT);  // LEDピン設定
+  initAttitudeSensor();            // 姿勢センサ機能の初期化
+  for (int i = 0; i < 10; i++) this->attitude_data[i] = 0;
+  this->left_encoder = 0;
+  this->right_encoder = 0;
+#if CRAWL_WARM_BOOT
+  this->warm_boot = loadCalibration(&this->calibration);  // 保存された結果があれば起動を待つ時間も短くする
+  halDelay(this->warm_boot ? WARM_BOOT_DELAY : 300);
+#else
+  halDelay(300);
+#endif
 
-  Serial.begin(9600);     // UARTを9600bpsでセットアップ
-  digitalWrite(13, LOW);  // LEDピン設定
+  halSerialBegin(CRAWL_SERIAL_BAUD);  // シリアル通信をセットアップ
+  halDigitalWrite(13, 0);             // LEDピン設定
 
   resetEncoder();               // 累計回転数を初期化
   initMotor();                  // 累計回転数を初期化
-  this->enable_kalman = false;  // センサヒュージョン方法を設定
-  t2 = micros();
+  this->kalman_axes = 0;     // センサヒュージョン方法を設定
+  this->outputs = CRAWL_OUTPUT_ALL;  // キャリブレーション中はすべての出力を計算する
+  this->theta_axes = ALL_AXES;
+  this->acc_axes = ALL_AXES;
+  this->stale = 0;
+  this->head_velocity = 0;
+#if CRAWL_RECORDER_RECORDS > 0
+  this->enable_recorder = false;  // フライトレコーダは無効
+  this->drain_recorder = false;
+#endif
+#if CRAWL_PROFILER
+  this->send_profile = false;  // プロファイラの計測結果は送らない
+#endif
+  this->kf.setSteadyState(true);  // ゲインが収束したら状態量の更新だけを行う
+#if CRAWL_AHRS
+  this->ahrs.setGains(CRAWL_AHRS_KP, CRAWL_AHRS_KI);
+#endif
+  t2 = halMicros();
   t1 = t2;
 
   kEtoMM = 1.95 / 7000.0;
   rate_theta = 0.99;
+#if CRAWL_FIXED_POINT
+  rate_theta_fx = fxCoefFromFloat(1.0 - rate_theta);
+#endif
 
   this->encoder_left = 0;
   this->encoder_right = 0;
+  this->motor_left = 0;  // 最初のupdateState()では停止の指令を送る
+  this->motor_right = 0;
   fof_acc_x.setT(FOF_ACC_T);
   fof_acc_y.setT(FOF_ACC_T);
   fof_acc_z.setT(FOF_ACC_T);
   ld_odometry.setDt(dt);
   ld_odometry.setT(ODOMETRY_T);
-  delay(300);
+#if CRAWL_WARM_BOOT
+  if (this->warm_boot) this->warm_boot = initWarmBoot();
+  if (!this->warm_boot) {
+    halDelay(300);
+    initGyroOffset();
+    initTheta();
+    ::saveCalibration(&this->calibration);  // 次回の起動で使用する
+  }
+#else
+  halDelay(300);
   initGyroOffset();
   initTheta();
-  digitalWrite(13, HIGH);  // LEDピン設定
+#endif
+#if CRAWL_GYRO_REFINE_SHIFT > 0
+  this->stationary_count = 0;
+#endif
+#if CRAWL_IMU_SYNC
+  this->missed_samples = 0;
+#if !CRAWL_SCHEDULER
+  this->samples_ready = 0;
+  this->skipped_samples = 0;
+#endif
+  setAcquisitionCallback(onSample, this);  // サンプルの読み出しの完了でrealtimeLoop()を解放する
+#endif
+  setOutputs(CRAWL_OUTPUTS);  // 使わない出力の計算と地磁気センサの読み出しを省く
+  startAcquisition();         // センサの連続読み出しを開始
+#if CRAWL_SCHEDULER
+  this->scheduler.begin();  // realtimeLoop()の周期を作るタイマ割り込みを開始
+#endif
+  halDigitalWrite(13, 1);  // LEDピン設定
 }
 void CrlRobot::initGyroOffset() {
   int i;
   float update_rate = 0.98;
-  delay(500);
-  getAttitude();
-  this->offset_gx = attitude_data[4];
-  this->offset_gy = attitude_data[5];
-  this->offset_gz = attitude_data[6];
+#if CRAWL_WARM_BOOT
+  long sum[4] = {0, 0, 0, 0};  // 保存する静止時の加速度と温度
+#endif
+  halDelay(500);
+  getAttitude(this->attitude_data);
+  this->offset_gx = this->attitude_data[4];
+  this->offset_gy = this->attitude_data[5];
+  this->offset_gz = this->attitude_data[6];
   for (i = 0; i < 200; i++) {
-    getAttitude();
-    delay(1);
-    this->offset_gx = this->offset_gx * update_rate + attitude_data[4] * (1.0 - update_rate);
-    this->offset_gy = this->offset_gy * update_rate + attitude_data[5] * (1.0 - update_rate);
-    this->offset_gz = this->offset_gz * update_rate + attitude_data[6] * (1.0 - update_rate);
+    getAttitude(this->attitude_data);
+    halDelay(1);
+    this->offset_gx = this->offset_gx * update_rate + this->attitude_data[4] * (1.0 - update_rate);
+    this->offset_gy = this->offset_gy * update_rate + this->attitude_data[5] * (1.0 - update_rate);
+    this->offset_gz = this->offset_gz * update_rate + this->attitude_data[6] * (1.0 - update_rate);
+#if CRAWL_WARM_BOOT
+    for (int j = 0; j < 4; j++) sum[j] += this->attitude_data[j];
+#endif
   }
+#if CRAWL_FIXED_POINT
+  this->offset_gx_fx = fxFromFloat(this->offset_gx, FX_OFFSET_BITS);
+  this->offset_gy_fx = fxFromFloat(this->offset_gy, FX_OFFSET_BITS);
+  this->offset_gz_fx = fxFromFloat(this->offset_gz, FX_OFFSET_BITS);
+#endif
+#if CRAWL_WARM_BOOT
+  this->calibration.gyro_offset[0] = this->offset_gx;
+  this->calibration.gyro_offset[1] = this->offset_gy;
+  this->calibration.gyro_offset[2] = this->offset_gz;
+  for (i = 0; i < 3; i++) this->calibration.accel[i] = lround(sum[i] / 200.0);
+  this->calibration.temperature = lround(sum[3] / 200.0);
+#endif
 }
+
+#if CRAWL_WARM_BOOT
+bool CrlRobot::initWarmBoot() {
+  long sum[7] = {0, 0, 0, 0, 0, 0, 0};
+  float mean;
+  bool same_pose = true;
+  int i;
+
+  for (i = 0; i < WARM_BOOT_SAMPLES; i++) {
+    halDelay(1);
+    getAttitude(this->attitude_data);
+    for (int j = 0; j < 7; j++) sum[j] += this->attitude_data[j];
+  }
+  // オフセットは温度で変わる.温度が同じでもジャイロの平均がオフセットから離れていれば,動いているか特性が変わった
+  mean = (float)sum[3] / WARM_BOOT_SAMPLES;
+  if (fabs(mean - this->calibration.temperature) > WARM_BOOT_TEMPERATURE) return false;
+  for (i = 0; i < 3; i++) {
+    mean = (float)sum[i + 4] / WARM_BOOT_SAMPLES;
+    if (fabs(mean - this->calibration.gyro_offset[i]) > WARM_BOOT_GYRO) return false;
+  }
+  this->offset_gx = this->calibration.gyro_offset[0];
+  this->offset_gy = this->calibration.gyro_offset[1];
+  this->offset_gz = this->calibration.gyro_offset[2];
+#if CRAWL_FIXED_POINT
+  this->offset_gx_fx = fxFromFloat(this->offset_gx, FX_OFFSET_BITS);
+  this->offset_gy_fx = fxFromFloat(this->offset_gy, FX_OFFSET_BITS);
+  this->offset_gz_fx = fxFromFloat(this->offset_gz, FX_OFFSET_BITS);
+#endif
+
+  // 保存時と同じ姿勢で置かれていれば,長く平均した保存時の加速度から姿勢角度を求める
+  for (i = 0; i < 3; i++) {
+    mean = (float)sum[i] / WARM_BOOT_SAMPLES;
+    if (fabs(mean - this->calibration.accel[i]) > WARM_BOOT_ACCEL) same_pose = false;
+  }
+  for (i = 0; i < 3; i++) {
+    this->attitude_data[i] = same_pose ? this->calibration.accel[i] : lround((float)sum[i] / WARM_BOOT_SAMPLES);
+  }
+#if CRAWL_AHRS
+  this->ahrs.reset(this->attitude_data[1], this->attitude_data[2], this->attitude_data[0]);
+#endif
+  seedOutputs(ALL_AXES, ALL_AXES);
+  return true;
+}
+#endif
+#if !CRAWL_FIXED_POINT
+// 固定小数点演算版はcrawl_fixed.cppに実装
 void CrlRobot::initTheta() {
   int i;
   calcState();
-  this->theta_z = M_PI / 2 - atan2(acc_y, acc_x);
-  this->theta_x = M_PI / 2 - atan2(acc_y, acc_z);
-  this->theta_y = M_PI / 2 - atan2(acc_z, acc_x);
+  this->theta_z = M_PI / 2 - fastAtan2(acc_y, acc_x);
+  this->theta_x = M_PI / 2 - fastAtan2(acc_y, acc_z);
+  this->theta_y = M_PI / 2 - fastAtan2(acc_z, acc_x);
   for (i = 0; i < 200; i++) {
-    delay(1);
-    getAttitude();
+    halDelay(1);
+    getAttitude(this->attitude_data);
     calcState();
   }
+#if CRAWL_AHRS
+  this->ahrs.reset(acc_x, acc_y, acc_z);  // 収束したフィルタの加速度から始める
+  calcThetaAhrs(ALL_AXES);
+#endif
+}
+void CrlRobot::seedOutputs(uint8_t accs, uint8_t axes) {
+  if (accs & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) {
+    fof_acc_x.setOutput(this->attitude_data[1] * 0.00059855);  // 2/2^15*9.80665=0.00059855
+    this->acc_x = fof_acc_x.getOutput();
+  }
+  if (accs & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) {
+    fof_acc_y.setOutput(this->attitude_data[2] * 0.00059855);
+    this->acc_y = fof_acc_y.getOutput();
+  }
+  if (accs & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) {
+    fof_acc_z.setOutput(this->attitude_data[0] * 0.00059855);
+    this->acc_z = fof_acc_z.getOutput();
+  }
+#if CRAWL_AHRS
+  calcThetaAhrs(axes);
+#else
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) this->theta_z = M_PI / 2 - fastAtan2(acc_y, acc_x);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) this->theta_x = M_PI / 2 - fastAtan2(acc_y, acc_z);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) this->theta_y = M_PI / 2 - fastAtan2(acc_z, acc_x);
+#endif
+}
+#if CRAWL_GYRO_REFINE_SHIFT > 0
+void CrlRobot::refineGyroOffset() {
+  float gx = this->attitude_data[4] - this->offset_gx;
+  float gy = this->attitude_data[5] - this->offset_gy;
+  float gz = this->attitude_data[6] - this->offset_gz;
+
+  // 指令もエンコーダも止まっていて,ジャイロの値がオフセットの近くに留まっている間を静止とみなす
+  if (this->motor_left != 0 || this->motor_right != 0 || this->left_encoder != 0 || this->right_encoder != 0 ||
+      fabs(gx) > CRAWL_GYRO_REFINE_GATE || fabs(gy) > CRAWL_GYRO_REFINE_GATE || fabs(gz) > CRAWL_GYRO_REFINE_GATE) {
+    this->stationary_count = 0;
+    return;
+  }
+  if (this->stationary_count < CRAWL_GYRO_REFINE_HOLD) {
+    this->stationary_count++;
+    return;
+  }
+  this->offset_gx += gx * (1.0f / (1L << CRAWL_GYRO_REFINE_SHIFT));
+  this->offset_gy += gy * (1.0f / (1L << CRAWL_GYRO_REFINE_SHIFT));
+  this->offset_gz += gz * (1.0f / (1L << CRAWL_GYRO_REFINE_SHIFT));
+}
+#endif
+#endif
+void CrlRobot::realtimeLoop() {
+  ASSERT_ACTIVE_ROBOT();
+  makeTiming();
 }
-void CrlRobot::realtimeLoop() { makeTiming(); }
 
 void CrlRobot::makeTiming() {
+  unsigned long load = halMicros() - this->t2;
+  bool overrun = load > (unsigned long)this->dt_us;
+#if CRAWL_IMU_SYNC
+  // 前回から制御に使われなかったサンプルがある場合も超過とする
+  uint16_t missed = getMissedSampleCount();
+  if (missed != this->missed_samples) overrun = true;
+  this->missed_samples = missed;
+#endif
   /* dt_us(dt)以内で計算が終了いない場合LED2を点灯させる*/
-  if (micros() - this->t2 > this->dt_us) {
-    digitalWrite(9, HIGH);  // LED2を点灯
+  if (overrun) {
+    halDigitalWrite(9, 1);  // LED2を点灯
   } else {
-    digitalWrite(9, LOW);  // LED2を消灯
+    halDigitalWrite(9, 0);  // LED2を消灯
   }
+  bool send_profile = false;
+#if CRAWL_PROFILER
+  profilerAdd(CRAWL_PHASE_LOAD, load);
+  send_profile = this->send_profile;
+#endif
+  bool telemetry = send_profile;
+#if CRAWL_RECORDER_RECORDS > 0
+  telemetry = telemetry || this->drain_recorder;
+#endif
 
-  while (this->t1 - this->t2 < this->dt_us) this->t1 = micros();
+#if CRAWL_SCHEDULER
+  // 周期の境界(タイマ割り込みによる解放)まで,テレメトリの送出と他のタスクを実行し,なければCPUを休止させる
+#if CRAWL_IMU_SYNC
+  bool periodic = this->dt_us > 0;  // 周期の境界はサンプルの読み出しの完了(onSample())
+#else
+  bool periodic = this->scheduler.isPeriodic(SCHEDULER_LOOP_TASK);
+#endif
+#if !CRAWL_IMU_SYNC
+  // センサの読み出しは周期の境界の直前に完了するよう開始する(休止から起きる間隔の分も前にする)
+  unsigned long lead = getAcquisitionMicros() + CRAWL_ACQUISITION_LEAD_US + CRAWL_SCHEDULER_TICK_US;
+  bool requested = false;
+#endif
+  if (periodic) {
+    this->scheduler.finish(SCHEDULER_LOOP_TASK, this->t2 + load);
+    while (!this->scheduler.take(SCHEDULER_LOOP_TASK)) {
+#if !CRAWL_IMU_SYNC
+      if (!requested && halMicros() - this->t2 + lead >= (unsigned long)this->dt_us) {
+        requestAcquisition();
+        requested = true;
+      }
+#endif
+      if (telemetry) sendTelemetry(&send_profile);
+      if (!this->scheduler.runNext()) this->scheduler.idle();
+    }
+  }
+  this->t1 = halMicros();
+#elif CRAWL_IMU_SYNC
+  // サンプルの読み出しが完了するまでテレメトリを送出する
+  this->t1 = halMicros();
+  while (this->dt_us > 0 && this->samples_ready == 0) {
+    if (telemetry) sendTelemetry(&send_profile);
+    this->t1 = halMicros();
+  }
+  uint8_t state = halEnterCritical();
+  uint8_t ready = this->samples_ready;
+  this->samples_ready = 0;
+  halExitCritical(state);
+  if (ready > 1) {
+    unsigned long skipped = (unsigned long)this->skipped_samples + ready - 1;
+    this->skipped_samples = skipped > 0xFFFF ? 0xFFFF : skipped;
+  }
+#else
+  // 周期の残り時間でテレメトリを送出する(telemetrySend()はブロックしない).
+  // センサの読み出しは周期の境界の直前に完了するよう,一組の所要時間と余裕の分だけ前に開始する
+  unsigned long lead = getAcquisitionMicros() + CRAWL_ACQUISITION_LEAD_US;
+  bool requested = false;
+  this->t1 = halMicros();
+  while (this->t1 - this->t2 < (unsigned long)this->dt_us) {
+    if (!requested && this->t1 - this->t2 + lead >= (unsigned long)this->dt_us) {
+      requestAcquisition();
+      requested = true;
+    }
+    if (telemetry) sendTelemetry(&send_profile);
+    this->t1 = halMicros();
+  }
+#endif
   this->tt = this->t1 - this->t2;
+#if CRAWL_PROFILER
+  profilerAddPeriod(this->tt, this->dt_us, overrun);
+#endif
   this->t2 = this->t1;
 }
 
+void CrlRobot::sendTelemetry(bool* send_profile) {
+#if CRAWL_RECORDER_RECORDS > 0
+  if (this->drain_recorder) this->recorder.drain();
+#endif
+#if CRAWL_PROFILER
+  if (*send_profile && profilerSend()) *send_profile = false;
+#else
+  (void)send_profile;
+#endif
+}
+
 void CrlRobot::updateState() {
-  getAttitude();
-  getResetEncoder();
+  ASSERT_ACTIVE_ROBOT();
+#if CRAWL_RECORDER_RECORDS > 0 || CRAWL_PROFILER
+  unsigned long time = halMicros();
+#endif
+#if CRAWL_PROFILER
+  unsigned long lap = time;
+#endif
+#if CRAWL_GYRO_REFINE_SHIFT > 0
+  // 新しい計測結果があれば静止中のオフセットを補正する
+  if (takeAcquisition(this->attitude_data, &this->left_encoder, &this->right_encoder)) refineGyroOffset();
+#else
+  // バックグラウンドで完了済みの最新の計測結果を使用する
+  takeAcquisition(this->attitude_data, &this->left_encoder, &this->right_encoder);
+#endif
+  PROFILE_LAP(CRAWL_PHASE_ACQUIRE);
   setMoterPower(this->motor_left * 255, this->motor_right * 255);
+  PROFILE_LAP(CRAWL_PHASE_MOTOR_WRITE);
   calcState();
+  PROFILE_LAP(CRAWL_PHASE_CALC_STATE);
 
-  if (!this->enable_kalman) {
-    calcTheta();
-  } else {
-    calcThetaKalmanFilter();
-  }
+  calcTheta();
+  if (this->kalman_axes & this->theta_axes) calcThetaKalmanFilter();
+  PROFILE_LAP(CRAWL_PHASE_THETA);
   calcHeadVelocity();
+  PROFILE_LAP(CRAWL_PHASE_HEAD_VELOCITY);
+#if CRAWL_RECORDER_RECORDS > 0
+  if (this->enable_recorder) recordState(time);
+#endif
+#if CRAWL_PROFILER
+  profilerLap(CRAWL_PHASE_UPDATE, time);
+#endif
 }
 
+#if !CRAWL_FIXED_POINT
+// 固定小数点演算版はcrawl_fixed.cppに実装
 void CrlRobot::calcState() {
-  float ax, ay, az, gx, gy, gz;
+  this->encoder_left += this->left_encoder;
+  this->encoder_right += this->right_encoder;
 
-  this->encoder_left += left_encoder;
-  this->encoder_right += right_encoder;
+  // 使う加速度のフィルタだけを計算する
+  if (this->acc_axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) {
+    fof_acc_x.calculate(this->attitude_data[1] * 0.00059855);  // 2/2^15*9.80665=0.00059855
+    this->acc_x = fof_acc_x.getOutput();
+  }
+  if (this->acc_axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) {
+    fof_acc_y.calculate(this->attitude_data[2] * 0.00059855);
+    this->acc_y = fof_acc_y.getOutput();
+  }
+  if (this->acc_axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) {
+    fof_acc_z.calculate(this->attitude_data[0] * 0.00059855);
+    this->acc_z = fof_acc_z.getOutput();
+  }
 
-  ax = attitude_data[0];
-  ay = attitude_data[1];
-  az = attitude_data[2];
+  this->stale |= ALL_AXES;  // 角速度は必要になった時点でcalcThetaDot()で計算する
+}
 
-  gx = (attitude_data[4] - offset_gx);
-  gy = (attitude_data[5] - offset_gy);
-  gz = (attitude_data[6] - offset_gz);
+void CrlRobot::calcThetaDot(uint8_t axes) {
+  axes &= this->stale;
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) {
+    this->theta_dot_x = (this->attitude_data[5] - offset_gy) * 0.00013316;  // 250/(2^15)/360*2*pi=0.00013316
+  }
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) this->theta_dot_y = (this->attitude_data[6] - offset_gz) * 0.00013316;
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) this->theta_dot_z = (this->attitude_data[4] - offset_gx) * 0.00013316;
+  this->stale &= ~axes;
+}
 
-  fof_acc_x.calculate(ay * 0.00059855);  // 2/2^15*9.80665=0.00059855
-  fof_acc_y.calculate(az * 0.00059855);
-  fof_acc_z.calculate(ax * 0.00059855);
+void CrlRobot::calcTheta() {
+  uint8_t axes = this->theta_axes & ~this->kalman_axes;
+
+#if CRAWL_AHRS
+  // 計算する軸がなくても姿勢推定は続け,再び計算する軸の姿勢角度がその時点の姿勢から始まるようにする
+  if (this->theta_axes) updateAhrs();
+  calcThetaAhrs(axes);
+#else
+  calcThetaDot(axes);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) {
+    float theta1;
+    theta1 = M_PI / 2 - fastAtan2(acc_y, acc_x);
+    this->theta_z = this->theta_z * this->rate_theta + theta1 * (1.0 - this->rate_theta);
+    this->theta_z = this->theta_z + this->theta_dot_z * this->dt;
+  }
 
-  this->acc_x = fof_acc_x.getOutput();  // 2/2^15*9.80665=0.00059855
-  this->acc_y = fof_acc_y.getOutput();
-  this->acc_z = fof_acc_z.getOutput();
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) {
+    float theta2;
+    theta2 = M_PI / 2 - fastAtan2(acc_y, acc_z);
+    this->theta_x = this->theta_x * this->rate_theta + theta2 * (1.0 - this->rate_theta);
+    this->theta_x = this->theta_x + this->theta_dot_x * this->dt;
+  }
 
-  this->theta_dot_x = gy * 0.00013316;  // 250/(2^15)/360*2*pi=0.00013316
-  this->theta_dot_y = gz * 0.00013316;
-  this->theta_dot_z = gx * 0.00013316;
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) {
+    float theta3;
+    theta3 = M_PI / 2 - fastAtan2(acc_z, acc_x);
+    this->theta_y = this->theta_y * this->rate_theta + theta3 * (1.0 - this->rate_theta);
+    this->theta_y = this->theta_y + this->theta_dot_y * this->dt;
+  }
+#endif
 }
 
-void CrlRobot::calcTheta() {
-  float theta1;
-  theta1 = M_PI / 2 - atan2(acc_y, acc_x);
-  this->theta_z = this->theta_z * this->rate_theta + theta1 * (1.0 - this->rate_theta);
-  this->theta_z = this->theta_z + this->theta_dot_z * this->dt;
+void CrlRobot::calcThetaKalmanFilter() {
+  float theta[KALMAN_BANK_AXES], gyro[KALMAN_BANK_AXES];
+  uint8_t axes = this->kalman_axes & this->theta_axes;
+
+  // 3軸をまとめて更新する.カルマンフィルタを使わない軸には相補フィルタの結果(計算しない軸は最後の値)を与える
+  calcThetaDot(this->theta_axes);
+  theta[CRAWL_AXIS_X] = axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X) ? M_PI / 2 - fastAtan2(acc_y, acc_z) : this->theta_x;
+  theta[CRAWL_AXIS_Y] = axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y) ? M_PI / 2 - fastAtan2(acc_z, acc_x) : this->theta_y;
+  theta[CRAWL_AXIS_Z] = axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z) ? M_PI / 2 - fastAtan2(acc_y, acc_x) : this->theta_z;
+  gyro[CRAWL_AXIS_X] = this->theta_dot_x;
+  gyro[CRAWL_AXIS_Y] = this->theta_dot_y;
+  gyro[CRAWL_AXIS_Z] = this->theta_dot_z;
+  this->kf.update(theta, gyro);
+
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) this->theta_x = this->kf.getTheta(CRAWL_AXIS_X);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) this->theta_y = this->kf.getTheta(CRAWL_AXIS_Y);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) this->theta_z = this->kf.getTheta(CRAWL_AXIS_Z);
+}
 
-  float theta2;
-  theta2 = M_PI / 2 - atan2(acc_y, acc_z);
-  this->theta_x = this->theta_x * this->rate_theta + theta2 * (1.0 - this->rate_theta);
-  this->theta_x = this->theta_x + this->theta_dot_x * this->dt;
+#if CRAWL_AHRS
+/** オフセットを除いた角速度をジャイロの生値に丸める */
+static int16_t ahrsGyro(float gyro) {
+  long raw = lround(gyro);
+  return raw > 32767 ? 32767 : (raw < -32768 ? -32768 : raw);
+}
 
-  float theta3;
-  theta3 = M_PI / 2 - atan2(acc_z, acc_x);
-  this->theta_y = this->theta_y * this->rate_theta + theta3 * (1.0 - this->rate_theta);
-  this->theta_y = this->theta_y + this->theta_dot_y * this->dt;
+void CrlRobot::updateAhrs() {
+  // 機体座標の(X,Y,Z)はセンサの(Y,Z,X).地磁気センサ(AK8963)の(X,Y,Z)は加速度センサの(Y,X,-Z)
+  const int16_t acc[3] = {(int16_t)this->attitude_data[1], (int16_t)this->attitude_data[2],
+                          (int16_t)this->attitude_data[0]};
+  const int16_t gyro[3] = {ahrsGyro(this->attitude_data[5] - offset_gy), ahrsGyro(this->attitude_data[6] - offset_gz),
+                           ahrsGyro(this->attitude_data[4] - offset_gx)};
+  const int16_t mag[3] = {(int16_t)this->attitude_data[7], (int16_t)-this->attitude_data[9],
+                          (int16_t)this->attitude_data[8]};
+  this->ahrs.update(acc, gyro, this->outputs & CRAWL_OUTPUT_MAG ? mag : NULL);
 }
 
-void CrlRobot::calcThetaKalmanFilter() {
-  float theta, gyro;
-  theta = M_PI / 2 - atan2(acc_y, acc_x);
-  gyro = this->theta_dot_z;
-  kf.update(theta, gyro, offset_gz * 0.00013316);
-  this->theta_z = kf.getTheta();
+void CrlRobot::calcThetaAhrs(uint8_t axes) {
+  int16_t x = this->ahrs.getUp(CRAWL_AXIS_X), y = this->ahrs.getUp(CRAWL_AXIS_Y), z = this->ahrs.getUp(CRAWL_AXIS_Z);
+  const float scale = 1.0f / (1L << FX_ANGLE_BITS);
+
+  // 逆正接は整数演算で求め,浮動小数点数への変換は最後の一回だけ行う
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) this->theta_z = (FX_HALF_PI - fxAtan2(y, x)) * scale;
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) this->theta_x = (FX_HALF_PI - fxAtan2(y, z)) * scale;
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) this->theta_y = (FX_HALF_PI - fxAtan2(z, x)) * scale;
 }
+#endif
+#endif
 
 void CrlRobot::calcHeadVelocity() {
+  if (!(this->outputs & CRAWL_OUTPUT_HEAD_VELOCITY)) return;
   ld_odometry.calculate((this->encoder_right + this->encoder_left) * this->kEtoMM / 2.0);
-  this->head_velocity = CRAWL_LENGTH * this->getThetaDotZ() * cos(this->theta_z - M_PI / 2.0) - ld_odometry.getOutput();
+  this->stale |= STALE_HEAD_VELOCITY;  // 残りはgetHeadVelocity()で計算する
+}
+
+#if CRAWL_RECORDER_RECORDS > 0
+void CrlRobot::recordState(unsigned long time) {
+  CrlRecord* record = this->recorder.reserve();
+  if (!record) return;  // バッファが一杯
+
+  record->time = time;
+  record->period = this->tt > 0xFFFF ? 0xFFFF : this->tt;
+  for (uint8_t i = 0; i < 10; i++) record->attitude[i] = this->attitude_data[i];
+  record->encoder[0] = this->left_encoder;
+  record->encoder[1] = this->right_encoder;
+  record->motor[0] = this->motor_left * 255;
+  record->motor[1] = this->motor_right * 255;
+  record->theta[CRAWL_AXIS_X] = this->getThetaX() * RECORDER_ANGLE_SCALE;
+  record->theta[CRAWL_AXIS_Y] = this->getThetaY() * RECORDER_ANGLE_SCALE;
+  record->theta[CRAWL_AXIS_Z] = this->getThetaZ() * RECORDER_ANGLE_SCALE;
+  record->head_velocity = this->getHeadVelocity() * RECORDER_VELOCITY_SCALE;
+  this->recorder.commit();
+}
+
+void CrlRobot::setRecorder(bool enable, bool drain) {
+  if (enable && drain) telemetryBegin(CRAWL_TELEMETRY_BAUD);
+  this->enable_recorder = enable;
+  this->drain_recorder = enable && drain;
+}
+
+bool CrlRobot::readRecord(CrlRecord* record) { return this->recorder.read(record); }
+
+uint16_t CrlRobot::getRecorderDropped() { return this->recorder.getDropped(); }
+#endif
+
+#if CRAWL_SCHEDULER
+int8_t CrlRobot::addTask(void (*task)(), float period, uint8_t priority, float deadline) {
+  return this->scheduler.addTask(task, period * 1000000, priority, deadline * 1000000);
+}
+
+void CrlRobot::getTaskStats(int8_t id, CrlTaskStats* stats) { this->scheduler.getStats(id, stats); }
+#endif
+
+#if CRAWL_PROFILER
+void CrlRobot::getProfile(uint8_t phase, CrlProfile* profile) { profilerGet(phase, profile); }
+
+uint16_t CrlRobot::getOverrunCount() { return profilerGetOverruns(); }
+
+void CrlRobot::resetProfile() { profilerReset(); }
+
+void CrlRobot::setProfileTelemetry(bool enable) {
+  if (enable) telemetryBegin(CRAWL_TELEMETRY_BAUD);
+  this->send_profile = enable;
+}
+#endif
+
+#if CRAWL_IMU_FIFO
+uint16_t CrlRobot::getImuOverflowCount() { return getImuFifoOverflows(); }
+#endif
+
+#if CRAWL_WARM_BOOT
+bool CrlRobot::isWarmBoot() { return this->warm_boot; }
+
+void CrlRobot::saveCalibration() {
+#if CRAWL_FIXED_POINT
+  this->calibration.gyro_offset[0] = (float)this->offset_gx_fx / (1L << FX_OFFSET_BITS);
+  this->calibration.gyro_offset[1] = (float)this->offset_gy_fx / (1L << FX_OFFSET_BITS);
+  this->calibration.gyro_offset[2] = (float)this->offset_gz_fx / (1L << FX_OFFSET_BITS);
+#else
+  this->calibration.gyro_offset[0] = this->offset_gx;
+  this->calibration.gyro_offset[1] = this->offset_gy;
+  this->calibration.gyro_offset[2] = this->offset_gz;
+#endif
+  this->calibration.temperature = this->attitude_data[3];  // 静止時の加速度は起動時のものを残す
+  ::saveCalibration(&this->calibration);
+}
+
+void CrlRobot::eraseCalibration() { ::eraseCalibration(); }
+#endif
+
+#if CRAWL_KALMAN_BIAS
+float CrlRobot::getKalmanBias(uint8_t axis) { return this->kf.getBias(axis); }
+#endif
+
+#if CRAWL_AHRS
+void CrlRobot::getQuaternion(float q[4]) { this->ahrs.getQuaternion(q); }
+#endif
+
+#if CRAWL_IMU_SYNC
+void CrlRobot::onSample(void* context) {
+  CrlRobot* robot = (CrlRobot*)context;
+#if CRAWL_SCHEDULER
+  robot->scheduler.release(SCHEDULER_LOOP_TASK);  // 前の解放が残っていればskippedに数えられる
+#else
+  if (robot->samples_ready != 0xFF) robot->samples_ready++;
+#endif
+}
+
+uint16_t CrlRobot::getMissedSampleCount() {
+  unsigned long missed = getAcquisitionMissed();
+#if CRAWL_SCHEDULER
+  CrlTaskStats stats;
+  this->scheduler.getStats(SCHEDULER_LOOP_TASK, &stats);
+  missed += stats.skipped;
+#else
+  missed += this->skipped_samples;
+#endif
+  return missed > 0xFFFF ? 0xFFFF : missed;
 }
+#endif
 
 // 各種アクセサ
 void CrlRobot::setDt(float _dt) {
+#if CRAWL_IMU_SYNC
+  // ループ間隔は姿勢センサの標本化周期とし,分周できる1ミリ秒単位に丸める
+  if (_dt > 0) {
+    long period_ms = lround(_dt * 1000);
+    period_ms = period_ms < 1 ? 1 : (period_ms > 256 ? 256 : period_ms);
+    _dt = period_ms * 0.001f;
+    setAttitudeSamplePeriod(period_ms * 1000UL);
+  }
+#endif
   this->dt = _dt;
   this->dt_us = _dt * 1000000;
+#if CRAWL_FIXED_POINT
+  this->dt_fx = fxCoefFromFloat(_dt);
+#endif
   fof_acc_x.setDt(_dt);
   fof_acc_y.setDt(_dt);
   fof_acc_z.setDt(_dt);
   ld_odometry.setDt(_dt);
+  this->kf.setDt(_dt);
+#if CRAWL_AHRS
+  this->ahrs.setDt(_dt);
+#endif
+#if CRAWL_SCHEDULER && CRAWL_IMU_SYNC
+  this->scheduler.setDeadline(SCHEDULER_LOOP_TASK, this->dt_us);  // 解放はonSample()で行い,周期は持たない
+#elif CRAWL_SCHEDULER
+  this->scheduler.setPeriod(SCHEDULER_LOOP_TASK, this->dt_us);
+#endif
+}
+void CrlRobot::setKalman(bool enable_kalman) { setKalman(enable_kalman, enable_kalman, enable_kalman); }
+void CrlRobot::setKalman(bool enable_x, bool enable_y, bool enable_z) {
+  uint8_t axes = (enable_x ? CRAWL_AXIS_BIT(CRAWL_AXIS_X) : 0) | (enable_y ? CRAWL_AXIS_BIT(CRAWL_AXIS_Y) : 0) |
+                 (enable_z ? CRAWL_AXIS_BIT(CRAWL_AXIS_Z) : 0);
+
+  // 新たにカルマンフィルタを使う軸は,推定値を現在の姿勢角度から始める
+  uint8_t started = axes & ~this->kalman_axes;
+  if (started & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) this->kf.setTheta(CRAWL_AXIS_X, getThetaX());
+  if (started & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) this->kf.setTheta(CRAWL_AXIS_Y, getThetaY());
+  if (started & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) this->kf.setTheta(CRAWL_AXIS_Z, getThetaZ());
+  this->kalman_axes = axes;
+#if CRAWL_AHRS
+  setOutputs(this->outputs);  // 加速度のフィルタはカルマンフィルタの軸だけに必要
+#endif
+}
+
+void CrlRobot::setOutputs(uint8_t outputs) {
+  uint8_t axes = outputs & ALL_AXES;
+  if (outputs & CRAWL_OUTPUT_HEAD_VELOCITY) axes |= CRAWL_AXIS_BIT(CRAWL_AXIS_Z);
+  // 各軸の姿勢角度は他の2軸の加速度から求める
+  uint8_t accs = outputs & CRAWL_OUTPUT_ACC ? ALL_AXES : 0;
+#if CRAWL_AHRS
+  uint8_t filtered = axes & this->kalman_axes;  // 姿勢推定は加速度の生値を使う
+#else
+  uint8_t filtered = axes;
+#endif
+  if (filtered & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) accs |= CRAWL_AXIS_BIT(CRAWL_AXIS_Y) | CRAWL_AXIS_BIT(CRAWL_AXIS_Z);
+  if (filtered & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) accs |= CRAWL_AXIS_BIT(CRAWL_AXIS_Z) | CRAWL_AXIS_BIT(CRAWL_AXIS_X);
+  if (filtered & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) accs |= CRAWL_AXIS_BIT(CRAWL_AXIS_X) | CRAWL_AXIS_BIT(CRAWL_AXIS_Y);
+
+  // 新たに計算するフィルタと姿勢角度は,現在のセンサの値から始める
+  uint8_t started = axes & ~this->theta_axes;
+#if CRAWL_AHRS
+  if (started && !this->theta_axes) {
+    this->ahrs.reset(this->attitude_data[1], this->attitude_data[2], this->attitude_data[0]);  // 更新を止めていた
+  }
+#endif
+  seedOutputs(accs & ~this->acc_axes, started);
+  started &= this->kalman_axes;
+  if (started & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) this->kf.setTheta(CRAWL_AXIS_X, getThetaX());
+  if (started & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) this->kf.setTheta(CRAWL_AXIS_Y, getThetaY());
+  if (started & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) this->kf.setTheta(CRAWL_AXIS_Z, getThetaZ());
+  if (outputs & ~this->outputs & CRAWL_OUTPUT_HEAD_VELOCITY) {
+    ld_odometry.setOutput((this->encoder_right + this->encoder_left) * this->kEtoMM / 2.0);  // 速度0から始める
+  }
+  this->outputs = outputs;
+  this->theta_axes = axes;
+  this->acc_axes = accs;
+  setMagnetometerRead(outputs & CRAWL_OUTPUT_MAG);
 }
-void CrlRobot::setKalman(bool enable_kalman) { this->enable_kalman = enable_kalman; }
 
 void CrlRobot::setMotorLeft(float motor_left) { this->motor_left = motor_left; }
 
@@ -211,25 +751,43 @@ void CrlRobot::resetEncoderLeft() { this->encoder_left = 0; }
 
 void CrlRobot::resetEncoderRight() { this->encoder_right = 0; }
 
+#if !CRAWL_FIXED_POINT
 float CrlRobot::getThetaX() { return this->theta_x; }
 
 float CrlRobot::getThetaY() { return this->theta_y; }
 
 float CrlRobot::getThetaZ() { return this->theta_z; }
 
-float CrlRobot::getHeadVelocity() { return this->head_velocity; }
-
 float CrlRobot::getAccX() { return this->acc_x; }
 
 float CrlRobot::getAccY() { return this->acc_y; }
 
 float CrlRobot::getAccZ() { return this->acc_z; }
 
-float CrlRobot::getThetaDotX() { return this->theta_dot_x; }
+float CrlRobot::getThetaDotX() {
+  calcThetaDot(CRAWL_AXIS_BIT(CRAWL_AXIS_X));
+  return this->theta_dot_x;
+}
+
+float CrlRobot::getThetaDotY() {
+  calcThetaDot(CRAWL_AXIS_BIT(CRAWL_AXIS_Y));
+  return this->theta_dot_y;
+}
 
-float CrlRobot::getThetaDotY() { return this->theta_dot_y; }
+float CrlRobot::getThetaDotZ() {
+  calcThetaDot(CRAWL_AXIS_BIT(CRAWL_AXIS_Z));
+  return this->theta_dot_z;
+}
+#endif
 
-float CrlRobot::getThetaDotZ() { return this->theta_dot_z; }
+float CrlRobot::getHeadVelocity() {
+  if (this->stale & STALE_HEAD_VELOCITY) {
+    this->stale &= ~STALE_HEAD_VELOCITY;
+    this->head_velocity =
+        CRAWL_LENGTH * this->getThetaDotZ() * fastCos(this->getThetaZ() - M_PI / 2.0) - ld_odometry.getOutput();
+  }
+  return this->head_velocity;
+}
 
 float CrlRobot::getEncoderLeft() { return this->encoder_left; }
 
@@ -239,9 +797,12 @@ float CrlRobot::getOdometryLeft() { return this->encoder_left * this->kEtoMM; }
 
 float CrlRobot::getOdometryRight() { return this->encoder_right * this->kEtoMM; }
 
-FirstOrderFilter::FirstOrderFilter() : y(0), T(1), dt(0.001) {}
+FirstOrderFilter::FirstOrderFilter() : dt(0.001), T(1) { updateCoefficients(); }
 
-void FirstOrderFilter::setDt(float dt) { this->dt = dt; }
+void FirstOrderFilter::setDt(float dt) {
+  this->dt = dt;
+  updateCoefficients();
+}
 
 void FirstOrderFilter::setT(float T) {
   if (0.0 < T) {
@@ -249,26 +810,35 @@ void FirstOrderFilter::setT(float T) {
   } else {
     this->T = 1.0;
   }
+  updateCoefficients();
 }
 
-float FirstOrderFilter::calculate(float x) {
-  float k, k0, k1, k2, k3;
-  k0 = (x - y) / T;
-  k1 = (x - (y + k0 * dt * 0.5)) / T;
-  k2 = (x - (y + k1 * dt * 0.5)) / T;
-  k3 = (x - (y + k1 * dt)) / T;
-  k = (k0 + 2 * k1 + 2 * k2 + k3) / 6;
-  y = y + k * dt;
+void FirstOrderFilter::updateCoefficients() {
+  // y[k] = (1 - p) x[k] + p y[k-1] : b0 = 1 - p, b1 = 0, a1 = -p
+  float gain = firstOrderLagGain(this->dt, this->T);
+  float b[2] = {gain, 0};
+  float a[1] = {gain - 1};
+  this->lti.setCoefficients(b, a);
+  this->inv_T = 1 / this->T;
 }
-float FirstOrderFilter::getOutput() { return y; }
+
+float FirstOrderFilter::calculate(float x) { return this->lti.calculate(x); }
+
+void FirstOrderFilter::setOutput(float y) {
+  // 内部状態をp y (p = 1 - gain)としてyを入力すれば,出力はyのまま変わらない
+  this->lti.setState(0, (1 - firstOrderLagGain(this->dt, this->T)) * y);
+  this->lti.calculate(y);
+}
+
+float FirstOrderFilter::getOutput() { return this->lti.getOutput(); }
 
 float LaggedDerivative::calculate(float x) {
-  FirstOrderFilter::calculate(x);
-  this->y = (x - FirstOrderFilter::getOutput()) / FirstOrderFilter::T;
+  this->y = (x - FirstOrderFilter::calculate(x)) * this->inv_T;
+  return this->y;
 }
 float LaggedDerivative::getOutput() { return this->y; }
 
-Integral::Integral() : y(0), dt(0.001), limit_low(-FLT_MAX), limit_high(FLT_MAX) {}
+Integral::Integral() : y(0), limit_low(-FLT_MAX), limit_high(FLT_MAX), dt(0.001) {}
 
 void Integral::setDt(float dt) { this->dt = dt; }
 
@@ -287,13 +857,6 @@ void Integral::setLimit(float limit_low, float limit_high) {
   this->limit_high = limit_high;
 }
 
-void Integral::calculate(float x) {
-  this->y = x * this->dt;
-  if (this->y < limit_low) {
-    this->y = limit_low;
-  }
-  if (limit_high < this->y) {
-    this->y = limit_high;
-  }
-}
+// 出力は今回の入力の x dt だけで,前回の値を加算しない(サンプルプログラムのゲインはこの動作で調整されている)
+void Integral::calculate(float x) { setOutput(x * this->dt); }
 float Integral::getOutput() { return this->y; }
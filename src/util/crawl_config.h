@@ -0,0 +1,261 @@
+/**
+ * @file crawl_config.h
+ * @brief
+ * ライブラリのコンパイル時設定
+ *
+ * 各マクロはこのファイルを編集するか,コンパイラオプション(-D)で上書きして設定する.
+ */
+#ifndef INCLUDED_crawl_config_h
+#define INCLUDED_crawl_config_h
+
+/**
+ * センサヒュージョンを固定小数点演算で行う場合は1,浮動小数点演算で行う場合は0.
+ *
+ * 固定小数点演算は16ビット×16ビットの乗算だけで行うため,FPUを持たないAVRでは浮動小数点演算より速くなる見込みだが,
+ * 有効にする前にtools/avr/cycle_simで両方のビルドのcalcTheta(),updateState()のサイクル数を比べること.
+ * 精度と値の範囲はfixed_point.hを参照.
+ */
+#ifndef CRAWL_FIXED_POINT
+#define CRAWL_FIXED_POINT 0
+#endif
+
+/** 三角関数の実装: 標準ライブラリ(libm) */
+#define FAST_MATH_LIBM 0
+/** 三角関数の実装: 多項式近似 */
+#define FAST_MATH_POLY 1
+/** 三角関数の実装: 表引きと線形補間 */
+#define FAST_MATH_TABLE 2
+/** 三角関数の実装: CORDIC */
+#define FAST_MATH_CORDIC 3
+
+/**
+ * CrlRobotが姿勢角度の計算に使用する三角関数(atan2, sin, cos)の実装.
+ *
+ * FAST_MATH_LIBM, FAST_MATH_POLY, FAST_MATH_TABLE, FAST_MATH_CORDICのいずれかを指定する.
+ * 各実装の誤差はfast_math.hを参照.誤差と計算時間はtools/host/fast_math_bench.cppで計測できる.
+ */
+#ifndef CRAWL_FAST_MATH
+#define CRAWL_FAST_MATH FAST_MATH_POLY
+#endif
+
+/** CrlRobot::init()で開始するシリアル通信(Serial)の通信速度 単位:bps */
+#ifndef CRAWL_SERIAL_BAUD
+#define CRAWL_SERIAL_BAUD 9600
+#endif
+
+/**
+ * テレメトリ(telemetry.h)を送るUART(USART1)の通信速度 単位:bps
+ *
+ * 16MHzのATmega32U4では500000または1000000で誤差が0になる.
+ */
+#ifndef CRAWL_TELEMETRY_BAUD
+#define CRAWL_TELEMETRY_BAUD 1000000
+#endif
+
+/**
+ * CrlRobotのフライトレコーダに保持するレコード数(2のべき乗).0の場合はフライトレコーダを組み込まない.
+ *
+ * 一レコードあたり43バイトのRAMを使用する(8レコードで約344バイト).ATmega32U4のRAMは2.5KBしかないため既定では
+ * 組み込まず,テレメトリでログを取る場合に8などを指定する.詳細はflight_recorder.hを参照.
+ */
+#ifndef CRAWL_RECORDER_RECORDS
+#define CRAWL_RECORDER_RECORDS 0
+#endif
+
+/**
+ * ループのプロファイラ(profiler.h)を組み込む場合は1.
+ *
+ * updateState()の各処理,バックグラウンドのI2C読み出し,ループ周期の時間を計測する.
+ * 有効にすると約400バイトのRAMと,一周期あたりhalMicros()十数回分の時間を使用する.
+ */
+#ifndef CRAWL_PROFILER
+#define CRAWL_PROFILER 0
+#endif
+
+/**
+ * テレメトリ(telemetry.h)の送信を組み込む場合は1.
+ *
+ * AVRではUART(USART1)の送信割り込みとHAL_UART_TX_BUFFER(128)バイトの送信リングバッファを占有し,
+ * Serial1とは併用できない.既定ではフライトレコーダかプロファイラを組み込む場合だけ1となる.
+ */
+#ifndef CRAWL_TELEMETRY
+#define CRAWL_TELEMETRY (CRAWL_RECORDER_RECORDS > 0 || CRAWL_PROFILER)
+#endif
+#if !CRAWL_TELEMETRY && (CRAWL_RECORDER_RECORDS > 0 || CRAWL_PROFILER)
+#error "CRAWL_RECORDER_RECORDS and CRAWL_PROFILER require CRAWL_TELEMETRY"
+#endif
+
+/**
+ * realtimeLoop()の周期をタイマ割り込みで作る場合は1,micros()を読み続けて待つ場合は0.
+ *
+ * 1の場合,realtimeLoop()は周期の境界まで他のタスク(CrlRobot::addTask())を実行し,実行できるものがなければCPUを休止させる.
+ * タイマ割り込みにはTimer1を使用する(hal.hを参照).Timer1を使うServoライブラリや,9番・10番ピンの
+ * analogWrite()とは併用できないため,既定では0とする.
+ */
+#ifndef CRAWL_SCHEDULER
+#define CRAWL_SCHEDULER 0
+#endif
+
+/** スケジューラのタイマ割り込みの周期 単位:マイクロ秒 (タスクとループの周期はこの整数倍に丸められる) */
+#ifndef CRAWL_SCHEDULER_TICK_US
+#define CRAWL_SCHEDULER_TICK_US 1000
+#endif
+
+/** CrlRobot::addTask()で追加できるタスクの数 */
+#ifndef CRAWL_SCHEDULER_TASKS
+#define CRAWL_SCHEDULER_TASKS 4
+#endif
+
+/**
+ * 姿勢センサをMPU-9250内蔵のFIFOから読み出す場合は1,最新の一サンプルだけを読み出す場合は0.
+ *
+ * 1の場合,MPU-9250はCRAWL_IMU_FIFO_RATEで加速度・温度・ジャイロを標本化してFIFOに溜め,
+ * バックグラウンドの読み出し(acquisition.h)は溜まったサンプルをまとめて読み出す.
+ * updateState()が使う値は前回の取り出しから読み出した全サンプルから求める(acquisition.hのtakeAcquisition()).
+ */
+#ifndef CRAWL_IMU_FIFO
+#define CRAWL_IMU_FIFO 0
+#endif
+
+/**
+ * CRAWL_IMU_FIFOが1の場合の標本化周波数 単位:Hz (1000の約数,4〜1000)
+ *
+ * 内蔵のデジタルローパスフィルタの帯域は,この周波数の半分未満となるよう自動的に選ばれる.
+ * 制御ループの周波数の2倍以上とすること.また,I2Cが100kHzの場合は一サンプル(14バイト)の転送に
+ * 約1.3ms掛かるため,500Hz程度までにすること.
+ */
+#ifndef CRAWL_IMU_FIFO_RATE
+#define CRAWL_IMU_FIFO_RATE 250
+#endif
+
+/**
+ * realtimeLoop()の周期を姿勢センサの標本化に同期させる場合は1.
+ *
+ * 1の場合,姿勢センサはsetDt()の周期(1ミリ秒単位)で標本化し,INTピンにデータレディのパルスを出す.
+ * バックグラウンドの読み出しはその割り込みで一組ずつ開始し,読み出しの完了でrealtimeLoop()が戻る.
+ * MPU-9250のINTピンをD7(INT6)に接続すること(hal.hを参照).CRAWL_IMU_FIFOとは併用できない.
+ */
+#ifndef CRAWL_IMU_SYNC
+#define CRAWL_IMU_SYNC 0
+#endif
+#if CRAWL_IMU_SYNC && CRAWL_IMU_FIFO
+#error "CRAWL_IMU_SYNC and CRAWL_IMU_FIFO cannot be enabled together"
+#endif
+
+/**
+ * モータ制御基板(0x39)からエンコーダの累計回転数を読み出す際に,コマンドの送信と受信を
+ * リピーテッドスタートで一つのトランザクションとする場合は1.
+ *
+ * 0の場合は元の手順どおり,コマンドを送信してストップコンディションで区切ってから受信し,同期の読み出し
+ * (getEncoder(),getResetEncoder())では受信の後に25マイクロ秒待つ.1にするとバスの使用時間は一回あたり
+ * 約10マイクロ秒短くなる(tools/host/motor_bus_bench)が,モータ制御基板のファームウェアが
+ * リピーテッドスタートに応答することは実機で確認していないため,確認した場合にのみ1にすること.
+ */
+#ifndef CRAWL_ENCODER_REPEATED_START
+#define CRAWL_ENCODER_REPEATED_START 0
+#endif
+
+/**
+ * CRAWL_IMU_SYNCが0の場合に,realtimeLoop()が一組の読み出し(acquisition.h)を開始する時刻の余裕 単位:マイクロ秒
+ *
+ * 一組は周期の境界から,直前の一組の所要時間にこの値を加えた時間だけ前に開始し,境界の直前に完了させる.
+ * 所要時間の揺らぎ(I2Cの待ちや割り込みの遅れ)より大きくすること.
+ */
+#ifndef CRAWL_ACQUISITION_LEAD_US
+#define CRAWL_ACQUISITION_LEAD_US 300
+#endif
+
+/**
+ * カルマンフィルタでジャイロのバイアスも推定する場合は1.
+ *
+ * 1の場合,setKalman()で有効にした軸は状態量に(角度,角速度,バイアス)を持つBiasKalmanFilterBankで計算し,
+ * キャリブレーション後に温度などで変わったジャイロのオフセットが姿勢角度に残らないようにする.
+ * 共分散の更新は3x3行列となるため,ゲインが収束するまで(100Hzで約50秒)は一回の計算時間が長くなる.
+ */
+#ifndef CRAWL_KALMAN_BIAS
+#define CRAWL_KALMAN_BIAS 0
+#endif
+
+/**
+ * カルマンフィルタを使わない軸の姿勢角度を,軸ごとの相補フィルタの代わりに四元数による姿勢推定(ahrs.h)で求める場合は1.
+ *
+ * 3軸の角速度と加速度(CRAWL_OUTPUT_MAGを含む場合は地磁気も)から一つの姿勢を推定し,その鉛直上向きの向きから
+ * 相補フィルタと同じ式で各軸の姿勢角度を求める.直立から離れた姿勢や複数の軸周りの回転が重なっても各軸が干渉せず,
+ * 加速度の生値を使うため姿勢角度のための加速度のフィルタを省く.姿勢の四元数はCrlRobot::getQuaternion()で取得できる.
+ *
+ * 姿勢推定と姿勢角度の計算は除算と浮動小数点演算を使わない整数演算で,相補フィルタの軸ごとの浮動小数点の
+ * 除算と逆正接をなくす.FPUのないATmega32U4と同じく浮動小数点演算を整数演算で行った相補フィルタと比べ,
+ * tools/host/ahrs_benchでは3軸で約1/10の時間となる(FPUで計算する場合は相補フィルタの約4倍).
+ * 実機のサイクル数はtools/avr/cycle_simで計測できる.
+ */
+#ifndef CRAWL_AHRS
+#define CRAWL_AHRS 0
+#endif
+
+/**
+ * 姿勢推定(CRAWL_AHRS)の比例ゲイン 単位:1/s
+ *
+ * 逆数が加速度の向きに姿勢が近づく時定数となる.初期値1は相補フィルタ(rate_theta=0.99,ループ間隔0.01秒)と同じ時定数.
+ */
+#ifndef CRAWL_AHRS_KP
+#define CRAWL_AHRS_KP 1.0
+#endif
+
+/** 姿勢推定(CRAWL_AHRS)の積分ゲイン 単位:1/s^2 (0の場合はジャイロのオフセットの残りを推定しない) */
+#ifndef CRAWL_AHRS_KI
+#define CRAWL_AHRS_KI 0.0
+#endif
+
+/**
+ * キャリブレーションの結果をEEPROMに保存し,次回のinit()で再利用する(ウォームブート)場合は1.
+ *
+ * 1の場合,init()は保存されたジャイロのオフセットと静止時の加速度を読み出し,数十ミリ秒の計測で
+ * 温度とオフセットが保存時から変わっていないことを確かめられれば,時間の掛かるキャリブレーションを省略する.
+ * 確かめられない場合や保存された値がない場合は,従来どおりキャリブレーションを行って結果を保存する.
+ * EEPROMのCRAWL_CALIBRATION_ADDRESSから32バイトを使うため,スケッチでEEPROMを使う場合は1にする前に
+ * その範囲と重ならないことを確かめること.
+ */
+#ifndef CRAWL_WARM_BOOT
+#define CRAWL_WARM_BOOT 0
+#endif
+
+/**
+ * キャリブレーションの結果を保存するEEPROMのアドレス
+ *
+ * CRAWL_WARM_BOOTが1の場合,ここから32バイトをライブラリが使う.既定の0x3E0では0x3E0〜0x3FF
+ * (ATmega32U4のEEPROM 1KBの末尾32バイト)となり,この範囲にはスケッチから書き込まないこと.
+ */
+#ifndef CRAWL_CALIBRATION_ADDRESS
+#define CRAWL_CALIBRATION_ADDRESS 0x3E0
+#endif
+
+/**
+ * ジャイロのオフセットを静止中に補正する割合 1/2^n (0の場合は補正しない)
+ *
+ * モータを止めてエンコーダも回っていない状態で,ジャイロの値がオフセットの近くに留まっている間,
+ * updateState()ごとにオフセットを測定値へ1/2^nずつ近づける.10とすると100Hzのループで時定数約10秒となる.
+ */
+#ifndef CRAWL_GYRO_REFINE_SHIFT
+#define CRAWL_GYRO_REFINE_SHIFT 0
+#endif
+
+/** 静止とみなすジャイロの値とオフセットの差の上限 単位:生値 (131で1deg/s) */
+#ifndef CRAWL_GYRO_REFINE_GATE
+#define CRAWL_GYRO_REFINE_GATE 100
+#endif
+
+/** オフセットの補正を始めるまでに静止が続くupdateState()の回数(255以下) */
+#ifndef CRAWL_GYRO_REFINE_HOLD
+#define CRAWL_GYRO_REFINE_HOLD 50
+#endif
+
+/**
+ * init()の後にupdateState()で計算する出力(CRAWL_OUTPUT_THETA_Zなどの論理和,crawl.hを参照)
+ *
+ * 例えば倒立制御で姿勢角度(Z軸)と上端速度だけを使う場合はCRAWL_OUTPUT_THETA_Z|CRAWL_OUTPUT_HEAD_VELOCITYとすると,
+ * 他の軸の姿勢角度,使わない加速度のフィルタ,地磁気センサの読み出しを省く.CrlRobot::setOutputs()で変更できる.
+ */
+#ifndef CRAWL_OUTPUTS
+#define CRAWL_OUTPUTS CRAWL_OUTPUT_ALL
+#endif
+#endif
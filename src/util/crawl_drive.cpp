@@ -7,33 +7,43 @@
  * モータ制御基板のＩ２Ｃアドレスは0x0fに設定されている．
  */
 #include "crawl_drive.h"
-#include <Arduino.h>
-#include <Wire.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+
+/** 非同期で送信するモータ回転指令(スレッドに一つ.1スレッドに1台のロボットまで) */
+static HAL_THREAD_LOCAL uint8_t power_command[4];
+/** モータ回転指令のトランザクション */
+static HAL_THREAD_LOCAL HalI2cTransaction power_transaction = {HAL_ADDR_MOTOR, power_command, 4, NULL, 0, NULL,
+                                                               HAL_I2C_DONE, NULL};
 
 void initMotor() {
-  stopMotor();
-  Wire.beginTransmission(0x39);  // モータ基板のI2Cアドレスを指定
-  Wire.write(0x02);              // 回転指令コマンド
-  Wire.write(0x00);              // 回転方向指示(左右とも前進)
-  Wire.write(0x00);              // 右モータPWM指定(停止)
-  Wire.write(0x00);              // 左モータPWM指定(停止)
-  Wire.endTransmission();        // 通信終了
+  const uint8_t stop_command[] = {
+      0x02,  // 回転指令コマンド
+      0x00,  // 回転方向指示(左右とも前進)
+      0x00,  // 右モータPWM指定(停止)
+      0x00   // 左モータPWM指定(停止)
+  };
+  const uint8_t enable_command = 0x01;  // モータ出力を有効化
 
-  Wire.beginTransmission(0x39);  // モータ基板のI2Cアドレスを指定
-  Wire.write(0x01);              // モータ出力を有効化
-  Wire.endTransmission();        // 通信終了
+  stopMotor();
+  halI2cWrite(HAL_ADDR_MOTOR, stop_command, sizeof(stop_command));
+  halI2cWrite(HAL_ADDR_MOTOR, &enable_command, 1);
+  halI2cWait(&power_transaction);
+  memcpy(power_command, stop_command, sizeof(power_command));  // 基板が保持している指令
+  power_transaction.status = HAL_I2C_DONE;                     // 前回の送信の成否によらず,同じ指令は送らない
 }
 
 void stopMotor() {
-  Wire.beginTransmission(0x39);  // モータ基板のI2Cアドレスを指定
-  Wire.write(0x00);              // モータ出力を無効化
-  Wire.endTransmission();        // 通信終了
+  const uint8_t disable_command = 0x00;  // モータ出力を無効化
+  halI2cWrite(HAL_ADDR_MOTOR, &disable_command, 1);
 }
 
 void setMoterPower(int left_power, int right_power) {
-  byte motor_directions = 0x00;
-  byte left_pwm;
-  byte right_pwm;
+  uint8_t command[4];
+  uint8_t motor_directions = 0x00;
+  uint8_t left_pwm;
+  uint8_t right_pwm;
 
   // left_power,right_powerを-255〜255の範囲にする
   if (left_power > 255) left_power = 255;
@@ -52,8 +62,7 @@ void setMoterPower(int left_power, int right_power) {
   if (left_power < 0) motor_directions |= 0x10;
   if (right_power < 0) motor_directions |= 0x01;
 
-  Wire.beginTransmission(0x39);  // モータ基板のI2Cアドレスを指定
-  Wire.write(0x02);              // 回転指令コマンド
+  command[0] = 0x02;  // 回転指令コマンド
 
   // motor_directions
   //   １ビット目が0なら右モータ正回転（前進）
@@ -66,13 +75,19 @@ void setMoterPower(int left_power, int right_power) {
   //
   //      0x10
   //     　左モータ後退，右モータ前進
-  Wire.write(motor_directions);  // 回転方向指示
+  command[1] = motor_directions;  // 回転方向指示
 
   // left_pwm， right_pwm
   //    左右モータのパワー（PWM）
   //    0x00なら停止
   //    0xffなら最大パワー
-  Wire.write(right_pwm);   // 右モータPWM指定
-  Wire.write(left_pwm);    // 左モータPWM指定
-  Wire.endTransmission();  // 通信終了
+  command[2] = right_pwm;  // 右モータPWM指定
+  command[3] = left_pwm;   // 左モータPWM指定
+
+  // 送信は割り込みで行い,完了を待たずにリターンする
+  halI2cWait(&power_transaction);  // 前回の指令が送信中なら完了を待つ
+  // 基板が保持している指令と同じなら送らない(前回の送信が失敗していれば送り直す)
+  if (power_transaction.status == HAL_I2C_DONE && memcmp(power_command, command, sizeof(power_command)) == 0) return;
+  memcpy(power_command, command, sizeof(power_command));
+  halI2cSubmit(&power_transaction);
 }
@@ -39,6 +39,9 @@ void stopMotor();
  * @note
  * 引数の値が-255より小さく，255より大きく指定された場合，
  * それぞれ-255と255に設定される
+ * @note
+ * 指令はI2Cのトランザクションキューに入れられ,送信の完了を待たずにリターンする.
+ * 前回送信した指令(initMotor()の後は停止)と同じ場合は送信しない.
  */
 void setMoterPower(int left_power, int right_power);
 
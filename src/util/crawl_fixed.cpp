@@ -0,0 +1,241 @@
+/**
+ * @file crawl_fixed.cpp
+ * @brief
+ * 固定小数点演算によるセンサヒュージョン(CRAWL_FIXED_POINTが1の場合に使用)
+ *
+ * 生のセンサ値から姿勢角度までを整数演算のみで求める.
+ * 値の形式と浮動小数点演算版との誤差はfixed_point.hを参照.
+ */
+#include "crawl.h"
+#if CRAWL_FIXED_POINT
+#include "attitude_sensor.h"
+#include "encoder.h"
+#include "fixed_point.h"
+#include "hal.h"
+#include "kalmanfilter_bank.h"
+#include "kalmanfilter_bias.h"
+
+/** 加速度の生値を[m/s^2](Q8.24)に換算する係数 2/2^15*9.80665=0.00059855 Q8.24 (積は±2Gで2^31未満) */
+#define FX_ACC_SCALE 10042L
+/** 角速度の生値(Q24.8)を[rad/s](Q16.16)に換算する係数 250/(2^15)/360*2*pi*2^8=0.034088 Q0.20 */
+#define FX_GYRO_SCALE 35745U
+/** FX_GYRO_SCALEの小数部のビット数 */
+#define FX_GYRO_SCALE_BITS 20
+
+void CrlRobot::initTheta() {
+  int i;
+  calcState();
+  this->theta_z_fx = FX_HALF_PI - fxAtan2(acc_y_fx, acc_x_fx);
+  this->theta_x_fx = FX_HALF_PI - fxAtan2(acc_y_fx, acc_z_fx);
+  this->theta_y_fx = FX_HALF_PI - fxAtan2(acc_z_fx, acc_x_fx);
+  for (i = 0; i < 200; i++) {
+    halDelay(1);
+    getAttitude(this->attitude_data);
+    calcState();
+  }
+#if CRAWL_AHRS
+  this->ahrs.reset(acc_x_fx, acc_y_fx, acc_z_fx);  // 収束したフィルタの加速度から始める
+  calcThetaAhrs(CRAWL_AXIS_BIT(CRAWL_AXIS_X) | CRAWL_AXIS_BIT(CRAWL_AXIS_Y) | CRAWL_AXIS_BIT(CRAWL_AXIS_Z));
+#endif
+}
+
+void CrlRobot::seedOutputs(uint8_t accs, uint8_t axes) {
+  if (accs & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) {
+    fof_acc_x.setOutput((int32_t)this->attitude_data[1] * FX_ACC_SCALE);
+    this->acc_x_fx = fof_acc_x.getOutput();
+  }
+  if (accs & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) {
+    fof_acc_y.setOutput((int32_t)this->attitude_data[2] * FX_ACC_SCALE);
+    this->acc_y_fx = fof_acc_y.getOutput();
+  }
+  if (accs & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) {
+    fof_acc_z.setOutput((int32_t)this->attitude_data[0] * FX_ACC_SCALE);
+    this->acc_z_fx = fof_acc_z.getOutput();
+  }
+#if CRAWL_AHRS
+  calcThetaAhrs(axes);
+#else
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) this->theta_z_fx = FX_HALF_PI - fxAtan2(acc_y_fx, acc_x_fx);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) this->theta_x_fx = FX_HALF_PI - fxAtan2(acc_y_fx, acc_z_fx);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) this->theta_y_fx = FX_HALF_PI - fxAtan2(acc_z_fx, acc_x_fx);
+#endif
+}
+
+#if CRAWL_GYRO_REFINE_SHIFT > 0
+void CrlRobot::refineGyroOffset() {
+  const int32_t gate = (int32_t)CRAWL_GYRO_REFINE_GATE << FX_OFFSET_BITS;
+  int32_t gx = ((int32_t)this->attitude_data[4] << FX_OFFSET_BITS) - offset_gx_fx;
+  int32_t gy = ((int32_t)this->attitude_data[5] << FX_OFFSET_BITS) - offset_gy_fx;
+  int32_t gz = ((int32_t)this->attitude_data[6] << FX_OFFSET_BITS) - offset_gz_fx;
+
+  // 指令もエンコーダも止まっていて,ジャイロの値がオフセットの近くに留まっている間を静止とみなす
+  if (this->motor_left != 0 || this->motor_right != 0 || this->left_encoder != 0 || this->right_encoder != 0 ||
+      gx > gate || gx < -gate || gy > gate || gy < -gate || gz > gate || gz < -gate) {
+    this->stationary_count = 0;
+    return;
+  }
+  if (this->stationary_count < CRAWL_GYRO_REFINE_HOLD) {
+    this->stationary_count++;
+    return;
+  }
+  // 切り捨てでは負の側へ偏り続けるため四捨五入する.一回の補正に満たない差はセンサの雑音で均される
+  const int32_t half = (int32_t)1 << (CRAWL_GYRO_REFINE_SHIFT - 1);
+  this->offset_gx_fx += (gx + half) >> CRAWL_GYRO_REFINE_SHIFT;
+  this->offset_gy_fx += (gy + half) >> CRAWL_GYRO_REFINE_SHIFT;
+  this->offset_gz_fx += (gz + half) >> CRAWL_GYRO_REFINE_SHIFT;
+}
+#endif
+
+void CrlRobot::calcState() {
+  this->encoder_left += this->left_encoder;
+  this->encoder_right += this->right_encoder;
+
+  // 生値 * Q8.24 = Q8.24.使う加速度のフィルタだけを計算する
+  if (this->acc_axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) {
+    fof_acc_x.calculate((int32_t)this->attitude_data[1] * FX_ACC_SCALE);
+    this->acc_x_fx = fof_acc_x.getOutput();
+  }
+  if (this->acc_axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) {
+    fof_acc_y.calculate((int32_t)this->attitude_data[2] * FX_ACC_SCALE);
+    this->acc_y_fx = fof_acc_y.getOutput();
+  }
+  if (this->acc_axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) {
+    fof_acc_z.calculate((int32_t)this->attitude_data[0] * FX_ACC_SCALE);
+    this->acc_z_fx = fof_acc_z.getOutput();
+  }
+
+  // 角速度は必要になった時点でcalcThetaDot()で計算する
+  this->stale |= CRAWL_AXIS_BIT(CRAWL_AXIS_X) | CRAWL_AXIS_BIT(CRAWL_AXIS_Y) | CRAWL_AXIS_BIT(CRAWL_AXIS_Z);
+}
+
+void CrlRobot::calcThetaDot(uint8_t axes) {
+  // (生値 Q24.8 - オフセット Q24.8) * Q0.20 を Q16.16 に
+  axes &= this->stale;
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) {
+    this->theta_dot_x_fx =
+        fxMul(((int32_t)this->attitude_data[5] << FX_OFFSET_BITS) - offset_gy_fx, FX_GYRO_SCALE, FX_GYRO_SCALE_BITS);
+  }
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) {
+    this->theta_dot_y_fx =
+        fxMul(((int32_t)this->attitude_data[6] << FX_OFFSET_BITS) - offset_gz_fx, FX_GYRO_SCALE, FX_GYRO_SCALE_BITS);
+  }
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) {
+    this->theta_dot_z_fx =
+        fxMul(((int32_t)this->attitude_data[4] << FX_OFFSET_BITS) - offset_gx_fx, FX_GYRO_SCALE, FX_GYRO_SCALE_BITS);
+  }
+  this->stale &= ~axes;
+}
+
+void CrlRobot::calcTheta() {
+  uint8_t axes = this->theta_axes & ~this->kalman_axes;
+
+#if CRAWL_AHRS
+  // 計算する軸がなくても姿勢推定は続け,再び計算する軸の姿勢角度がその時点の姿勢から始まるようにする
+  if (this->theta_axes) updateAhrs();
+  calcThetaAhrs(axes);
+#else
+  int32_t theta1, theta2, theta3;
+
+  calcThetaDot(axes);
+  // theta = theta * rate + theta1 * (1 - rate) + theta_dot * dt (角速度はQ8.24にそろえてから掛ける)
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) {
+    theta1 = FX_HALF_PI - fxAtan2(acc_y_fx, acc_x_fx);
+    this->theta_z_fx += fxMul(theta1 - this->theta_z_fx, this->rate_theta_fx);
+    this->theta_z_fx += fxMul(this->theta_dot_z_fx << (FX_ANGLE_BITS - FX_VALUE_BITS), this->dt_fx);
+  }
+
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) {
+    theta2 = FX_HALF_PI - fxAtan2(acc_y_fx, acc_z_fx);
+    this->theta_x_fx += fxMul(theta2 - this->theta_x_fx, this->rate_theta_fx);
+    this->theta_x_fx += fxMul(this->theta_dot_x_fx << (FX_ANGLE_BITS - FX_VALUE_BITS), this->dt_fx);
+  }
+
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) {
+    theta3 = FX_HALF_PI - fxAtan2(acc_z_fx, acc_x_fx);
+    this->theta_y_fx += fxMul(theta3 - this->theta_y_fx, this->rate_theta_fx);
+    this->theta_y_fx += fxMul(this->theta_dot_y_fx << (FX_ANGLE_BITS - FX_VALUE_BITS), this->dt_fx);
+  }
+#endif
+}
+
+void CrlRobot::calcThetaKalmanFilter() {
+  float theta[KALMAN_BANK_AXES], gyro[KALMAN_BANK_AXES];
+  uint8_t axes = this->kalman_axes & this->theta_axes;
+
+  // カルマンフィルタは浮動小数点数で計算する.使わない軸には相補フィルタの結果(計算しない軸は最後の値)を与える
+  calcThetaDot(this->theta_axes);
+  theta[CRAWL_AXIS_X] = fxToFloat(
+      axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X) ? FX_HALF_PI - fxAtan2(acc_y_fx, acc_z_fx) : this->theta_x_fx, FX_ANGLE_BITS);
+  theta[CRAWL_AXIS_Y] = fxToFloat(
+      axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y) ? FX_HALF_PI - fxAtan2(acc_z_fx, acc_x_fx) : this->theta_y_fx, FX_ANGLE_BITS);
+  theta[CRAWL_AXIS_Z] = fxToFloat(
+      axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z) ? FX_HALF_PI - fxAtan2(acc_y_fx, acc_x_fx) : this->theta_z_fx, FX_ANGLE_BITS);
+  gyro[CRAWL_AXIS_X] = fxToFloat(this->theta_dot_x_fx, FX_VALUE_BITS);
+  gyro[CRAWL_AXIS_Y] = fxToFloat(this->theta_dot_y_fx, FX_VALUE_BITS);
+  gyro[CRAWL_AXIS_Z] = fxToFloat(this->theta_dot_z_fx, FX_VALUE_BITS);
+  this->kf.update(theta, gyro);
+
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X))
+    this->theta_x_fx = fxFromFloat(this->kf.getTheta(CRAWL_AXIS_X), FX_ANGLE_BITS);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y))
+    this->theta_y_fx = fxFromFloat(this->kf.getTheta(CRAWL_AXIS_Y), FX_ANGLE_BITS);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z))
+    this->theta_z_fx = fxFromFloat(this->kf.getTheta(CRAWL_AXIS_Z), FX_ANGLE_BITS);
+}
+
+#if CRAWL_AHRS
+/** オフセットを除いた角速度(Q24.8)をジャイロの生値に丸める */
+static int16_t ahrsGyro(int32_t gyro) {
+  int32_t raw = (gyro + (1L << (FX_OFFSET_BITS - 1))) >> FX_OFFSET_BITS;
+  return raw > 32767 ? 32767 : (raw < -32768 ? -32768 : raw);
+}
+
+void CrlRobot::updateAhrs() {
+  // 機体座標の(X,Y,Z)はセンサの(Y,Z,X).地磁気センサ(AK8963)の(X,Y,Z)は加速度センサの(Y,X,-Z)
+  const int16_t acc[3] = {(int16_t)this->attitude_data[1], (int16_t)this->attitude_data[2],
+                          (int16_t)this->attitude_data[0]};
+  const int16_t gyro[3] = {ahrsGyro(((int32_t)this->attitude_data[5] << FX_OFFSET_BITS) - offset_gy_fx),
+                           ahrsGyro(((int32_t)this->attitude_data[6] << FX_OFFSET_BITS) - offset_gz_fx),
+                           ahrsGyro(((int32_t)this->attitude_data[4] << FX_OFFSET_BITS) - offset_gx_fx)};
+  const int16_t mag[3] = {(int16_t)this->attitude_data[7], (int16_t)-this->attitude_data[9],
+                          (int16_t)this->attitude_data[8]};
+  this->ahrs.update(acc, gyro, this->outputs & CRAWL_OUTPUT_MAG ? mag : NULL);
+}
+
+void CrlRobot::calcThetaAhrs(uint8_t axes) {
+  int16_t x = this->ahrs.getUp(CRAWL_AXIS_X), y = this->ahrs.getUp(CRAWL_AXIS_Y), z = this->ahrs.getUp(CRAWL_AXIS_Z);
+
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) this->theta_z_fx = FX_HALF_PI - fxAtan2(y, x);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) this->theta_x_fx = FX_HALF_PI - fxAtan2(y, z);
+  if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) this->theta_y_fx = FX_HALF_PI - fxAtan2(z, x);
+}
+#endif
+
+// 各種アクセサ(浮動小数点数への変換は呼び出し時に行う)
+float CrlRobot::getThetaX() { return fxToFloat(this->theta_x_fx, FX_ANGLE_BITS); }
+
+float CrlRobot::getThetaY() { return fxToFloat(this->theta_y_fx, FX_ANGLE_BITS); }
+
+float CrlRobot::getThetaZ() { return fxToFloat(this->theta_z_fx, FX_ANGLE_BITS); }
+
+float CrlRobot::getAccX() { return fxToFloat(this->acc_x_fx, FX_ACC_BITS); }
+
+float CrlRobot::getAccY() { return fxToFloat(this->acc_y_fx, FX_ACC_BITS); }
+
+float CrlRobot::getAccZ() { return fxToFloat(this->acc_z_fx, FX_ACC_BITS); }
+
+float CrlRobot::getThetaDotX() {
+  calcThetaDot(CRAWL_AXIS_BIT(CRAWL_AXIS_X));
+  return fxToFloat(this->theta_dot_x_fx, FX_VALUE_BITS);
+}
+
+float CrlRobot::getThetaDotY() {
+  calcThetaDot(CRAWL_AXIS_BIT(CRAWL_AXIS_Y));
+  return fxToFloat(this->theta_dot_y_fx, FX_VALUE_BITS);
+}
+
+float CrlRobot::getThetaDotZ() {
+  calcThetaDot(CRAWL_AXIS_BIT(CRAWL_AXIS_Z));
+  return fxToFloat(this->theta_dot_z_fx, FX_VALUE_BITS);
+}
+#endif
@@ -0,0 +1,188 @@
+#include "crawl_plant.h"
+#if !defined(ARDUINO)
+#include <math.h>
+#include "hal_host.h"
+
+/** 重力加速度 単位:m/s^2 */
+#define PLANT_GRAVITY 9.80665
+/** 加速度の生値への換算係数 (±2G) */
+#define PLANT_ACCEL_RAW (16384 / PLANT_GRAVITY)
+/** 角速度の生値への換算係数 (±250deg/s) 1/0.00013316 */
+#define PLANT_GYRO_RAW (1 / 0.00013316)
+
+/** 生値の範囲に収めて丸める */
+static int16_t toRaw(float value) {
+  if (value > 32767) return 32767;
+  if (value < -32768) return -32768;
+  return (int16_t)lroundf(value);
+}
+
+CrlPlant::CrlPlant() {
+  this->config.pendulum = CRAWL_PLANT_PENDULUM;
+  this->config.imu_height = 0.03;
+  this->config.com_offset = 0.036;  // examples/C,C++/standのtheta_d_offset
+  this->config.com_height = 0.195 / 2;
+  this->config.crawler_mass = 2;
+  this->config.sprocket_radius = 0.02;
+  this->config.friction = 3;
+  this->config.damping = 0.2;
+  this->config.max_speed = 0.6;
+  this->config.motor_T = 0.05;
+  this->config.deadband = 10;
+  this->config.track_width = 0.08;
+  this->config.meters_per_count = 1.95 / 7000.0;  // CrlRobot::kEtoMMと同じ
+  this->config.gyro_bias[0] = 37;
+  this->config.gyro_bias[1] = -52;
+  this->config.gyro_bias[2] = 18;
+  this->config.gyro_noise = 8;
+  this->config.accel_noise = 60;
+  this->config.temperature = 2000;
+  this->config.initial_tilt = -0.03;
+  this->config.release = 3.0;  // init()のキャリブレーション(約2.4秒)の後
+  this->config.seed = 1;
+  this->reset();
+}
+
+void CrlPlant::reset() {
+  this->time = 0;
+  this->tilt = this->config.initial_tilt;
+  this->tilt_rate = 0;
+  this->tilt_accel = 0;
+  for (int i = 0; i < 2; i++) {
+    this->speed[i] = 0;
+    this->accel[i] = 0;
+    this->position[i] = 0;
+    this->counted[i] = 0;
+  }
+  this->fallen = false;
+  this->noise_seed = this->config.seed;
+}
+
+int16_t CrlPlant::noise(int16_t width) {
+  this->noise_seed = this->noise_seed * 1103515245 + 12345;
+  if (width <= 0) return 0;
+  return (int16_t)((this->noise_seed >> 16) % (2 * width + 1)) - width;
+}
+
+void CrlPlant::step(float dt, int16_t left_pwm, int16_t right_pwm) {
+  this->time += dt;
+  if (!this->isReleased() || this->fallen) {
+    // 手で支えている間,倒れた後は静止している
+    for (int i = 0; i < 2; i++) {
+      this->speed[i] = 0;
+      this->accel[i] = 0;
+    }
+    this->tilt_rate = 0;
+    this->tilt_accel = 0;
+    return;
+  }
+
+  // 不感帯を除いた指令値に対応する無負荷の速度
+  const int16_t pwm[2] = {left_pwm, right_pwm};
+  float target[2];
+  for (int i = 0; i < 2; i++) {
+    int magnitude = pwm[i] < 0 ? -pwm[i] : pwm[i];
+    float command = magnitude > this->config.deadband
+                        ? (float)(magnitude - this->config.deadband) / (255 - this->config.deadband)
+                        : 0;
+    target[i] = (pwm[i] < 0 ? -command : command) * this->config.max_speed;
+  }
+
+  // モータの駆動力は無負荷の速度と,車体に対する駆動輪の周速 x' - r φ' の差に比例する(逆起電力).
+  // 駆動輪を回すトルクの反作用 -r F は車体を後ろへ傾ける.
+  // 車体の質量あたりの運動方程式(x: 左右の平均の移動量, ψ = φ + c)
+  //   (1 + μ) x'' + L cos(ψ) φ'' = f - (1 + μ) k x' + L sin(ψ) φ'^2
+  //   cos(ψ) x'' + l φ'' = g sin(ψ) - r f / L - 減衰
+  // を解く.fはモータの駆動力を車体の質量で割ったもの,kは転がり抵抗.
+  // 左右の差の速度は車体に影響しないため一次遅れとする.
+  const float mass = 1 + this->config.crawler_mass;
+  const float L = this->config.com_height, l = this->config.pendulum, r = this->config.sprocket_radius;
+  float velocity = (this->speed[0] + this->speed[1]) / 2, difference = (this->speed[1] - this->speed[0]) / 2;
+  float direction = this->tilt + this->config.com_offset;
+  float s = sinf(direction), c = cosf(direction);
+  float f = mass / this->config.motor_T * ((target[0] + target[1]) / 2 - velocity + r * this->tilt_rate);
+  float b1 = f - mass * this->config.friction * velocity + L * s * this->tilt_rate * this->tilt_rate;
+  float b2 = PLANT_GRAVITY * s - r * f / L - this->config.damping * this->tilt_rate;
+  float det = mass * l - L * c * c;
+  float a = (b1 * l - L * c * b2) / det;
+  this->tilt_accel = (mass * b2 - c * b1) / det;
+  float difference_accel = ((target[1] - target[0]) / 2 - difference) / this->config.motor_T;
+  this->accel[0] = a - difference_accel;
+  this->accel[1] = a + difference_accel;
+  for (int i = 0; i < 2; i++) {
+    this->speed[i] += this->accel[i] * dt;
+    this->position[i] += this->speed[i] * dt;
+  }
+  this->tilt_rate += this->tilt_accel * dt;
+  this->tilt += this->tilt_rate * dt;
+  if (fabsf(this->tilt) > CRAWL_PLANT_FALL_ANGLE) {
+    this->tilt = this->tilt > 0 ? M_PI / 2 : -M_PI / 2;  // 床に横たわる
+    this->tilt_rate = 0;
+    this->tilt_accel = 0;
+    this->fallen = true;
+  }
+}
+
+void CrlPlant::sense(int16_t accel[3], int16_t gyro[3]) {
+  // センサの位置の加速度(前方x,上方y)に重力の分を加えた比力を,車体に固定した軸に射影する
+  float s = sinf(this->tilt), c = cosf(this->tilt), d = this->config.imu_height;
+  float base = (this->accel[0] + this->accel[1]) / 2;
+  float w2 = this->tilt_rate * this->tilt_rate;
+  float fx = base + d * (this->tilt_accel * c - w2 * s);
+  float fy = PLANT_GRAVITY + d * (-this->tilt_accel * s - w2 * c);
+  // センサのY軸は車体の上方,Z軸は上方を後ろへ90度回した方向.傾きの角速度はX軸周りで負
+  float yaw = (this->speed[1] - this->speed[0]) / this->config.track_width;
+  accel[0] = this->noise(this->config.accel_noise);
+  accel[1] = toRaw((fx * s + fy * c) * PLANT_ACCEL_RAW + this->noise(this->config.accel_noise));
+  accel[2] = toRaw((-fx * c + fy * s) * PLANT_ACCEL_RAW + this->noise(this->config.accel_noise));
+  gyro[0] = toRaw(-this->tilt_rate * PLANT_GYRO_RAW + this->config.gyro_bias[0] + this->noise(this->config.gyro_noise));
+  gyro[1] = toRaw(yaw * c * PLANT_GYRO_RAW + this->config.gyro_bias[1] + this->noise(this->config.gyro_noise));
+  gyro[2] = toRaw(yaw * s * PLANT_GYRO_RAW + this->config.gyro_bias[2] + this->noise(this->config.gyro_noise));
+}
+
+void CrlPlant::takeEncoder(int16_t* left, int16_t* right) {
+  long count[2];
+  for (int i = 0; i < 2; i++) {
+    count[i] = lround(this->position[i] / this->config.meters_per_count);
+  }
+  *left = (int16_t)(count[0] - this->counted[0]);
+  *right = (int16_t)(count[1] - this->counted[1]);
+  this->counted[0] = count[0];
+  this->counted[1] = count[1];
+}
+
+double CrlPlant::getTime() { return this->time; }
+
+float CrlPlant::getTilt() { return this->tilt; }
+
+float CrlPlant::getTiltRate() { return this->tilt_rate; }
+
+float CrlPlant::getPosition() { return (this->position[0] + this->position[1]) / 2; }
+
+bool CrlPlant::isFallen() { return this->fallen; }
+
+bool CrlPlant::isReleased() { return this->time >= this->config.release; }
+
+void hostDrivePlant(CrlPlant* plant, unsigned long us) {
+  uint8_t directions, right_pwm, left_pwm;
+  hostGetMotorCommand(&directions, &right_pwm, &left_pwm);
+  int16_t left = 0, right = 0;
+  if (hostMotorEnabled()) {
+    left = directions & 0x10 ? -left_pwm : left_pwm;
+    right = directions & 0x01 ? -right_pwm : right_pwm;
+  }
+
+  double target = us * 1e-6;
+  for (double dt; (dt = target - plant->getTime()) > 1e-9;) {
+    plant->step(dt < CRAWL_PLANT_STEP_US * 1e-6 ? dt : CRAWL_PLANT_STEP_US * 1e-6, left, right);
+  }
+
+  int16_t accel[3], gyro[3], encoder_left, encoder_right;
+  plant->sense(accel, gyro);
+  plant->takeEncoder(&encoder_left, &encoder_right);
+  hostSetAccel(accel[0], accel[1], accel[2]);
+  hostSetGyro(gyro[0], gyro[1], gyro[2]);
+  hostSetTemperature(plant->config.temperature);
+  hostAddEncoder(encoder_left, encoder_right);
+}
+#endif
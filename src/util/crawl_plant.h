@@ -0,0 +1,190 @@
+/**
+ * @file crawl_plant.h
+ * @brief
+ * ホスト上で制御ループを閉じるための,倒立振子として立つクロールの物理モデル
+ *
+ * 車体は接地点を支点とする剛体の振子(等価長さCRAWL_PLANT_PENDULUM,全長CRAWL_LENGTHの一様な棒なら2/3倍)とし,
+ * クローラの上に載った台車型の倒立振子として,前後の移動と傾きの連成した運動方程式を解く.
+ * モータは指令値(setMoterPower()のPWM)に応じた無負荷の速度と,車体に対する駆動輪の周速との差に比例する力で
+ * クローラを駆動し,その反作用のトルクが車体に加わる.振子の揺れもクローラに反力として返る.
+ * クローラには速度に比例する転がり抵抗があり,左右の速度の差(旋回)は傾きに影響しない一次遅れとする.
+ * 姿勢センサの値は,車体に固定したセンサの位置の加速度(重力と並進・回転による分)と角速度に,
+ * バイアスと一様な雑音を加えた生値として求め,エンコーダはクローラの移動量をパルスに換算する.
+ *
+ * hostDrivePlant()をhostSetImuSource()で設定した関数から呼び出すと,模擬デバイス(hal_host.cpp)の標本化のたびに
+ * 仮想時計の時刻までモデルを進め,センサ値とエンコーダを更新する.モータ指令は模擬モータ制御基板が受信したものを使う.
+ * サンプルプログラム(stand,stand_advanced,stand_kalman)を変更せずに閉ループで動かす例はtools/host/crawl_simを参照.
+ * ホスト専用であり,マイコン向けのビルドには含まれない.
+ */
+#ifndef INCLUDED_crawl_plant_h
+#define INCLUDED_crawl_plant_h
+#if !defined(ARDUINO)
+#include <stdint.h>
+
+/** 振子の等価長さ(慣性モーメント/(質量×重心までの距離)) 単位:m */
+#define CRAWL_PLANT_PENDULUM (0.195 * 2 / 3)
+/** 倒れたとみなす傾き 単位:rad */
+#define CRAWL_PLANT_FALL_ANGLE 1.2
+/** モデルを進める刻みの上限 単位:マイクロ秒 */
+#define CRAWL_PLANT_STEP_US 250
+
+/**
+ * @struct CrlPlantConfig
+ * @brief
+ * 物理モデルのパラメータ.CrlPlantのコンストラクタが初期値を設定する.
+ */
+struct CrlPlantConfig {
+  /** 振子の等価長さ 単位:m */
+  float pendulum;
+  /** 支点から姿勢センサまでの距離 単位:m */
+  float imu_height;
+  /** 重心の偏り(直立時の重心の方向の前方への傾き) 単位:rad */
+  float com_offset;
+  /** 支点から重心までの距離 単位:m */
+  float com_height;
+  /** クローラとモータの回転部の(並進に換算した)質量の車体に対する比 */
+  float crawler_mass;
+  /** クローラの駆動輪の半径 単位:m */
+  float sprocket_radius;
+  /** クローラの転がり抵抗(速度に比例する) 単位:1/s */
+  float friction;
+  /** 回転の粘性減衰 単位:1/s */
+  float damping;
+  /** PWM 255でのクローラの速度 単位:m/s */
+  float max_speed;
+  /** 車体を固定した場合のクローラの速度の応答の時定数 単位:秒 */
+  float motor_T;
+  /** クローラが動き出さないPWMの大きさ(不感帯) */
+  uint8_t deadband;
+  /** 左右のクローラの間隔 単位:m */
+  float track_width;
+  /** エンコーダの1パルスあたりの移動量 単位:m */
+  float meters_per_count;
+  /** ジャイロのバイアス(X,Y,Z) 単位:生値 */
+  int16_t gyro_bias[3];
+  /** ジャイロの雑音の幅 単位:生値 */
+  int16_t gyro_noise;
+  /** 加速度センサの雑音の幅 単位:生値 */
+  int16_t accel_noise;
+  /** 温度センサの生値 */
+  int16_t temperature;
+  /** 初期の傾き(前方が正) 単位:rad */
+  float initial_tilt;
+  /** 手を放す時刻.それまでは初期の傾きのまま静止させておく 単位:秒 */
+  float release;
+  /** 雑音の乱数の種 */
+  uint32_t seed;
+};
+
+/**
+ * @class CrlPlant
+ * @brief
+ * クロールの物理モデル
+ *
+ * 傾きφは直立からの前方への傾きで,CrlRobot::getThetaZ()はおよそπ/2-φとなる.
+ */
+class CrlPlant {
+ public:
+  /** パラメータ.変更した後はreset()を呼び出す */
+  CrlPlantConfig config;
+
+  /**
+   * @brief コンストラクタ.パラメータを初期値にしてreset()する
+   */
+  CrlPlant();
+  /**
+   * @brief 状態を時刻0,初期の傾きで静止した状態に戻す
+   * @return なし
+   */
+  void reset();
+  /**
+   * @brief モデルを進める
+   * @param dt 進める時間 単位:秒
+   * @param left_pwm 左モータの指令値 [-255, 255] (正が前進)
+   * @param right_pwm 右モータの指令値 [-255, 255]
+   * @return なし
+   */
+  void step(float dt, int16_t left_pwm, int16_t right_pwm);
+  /**
+   * @brief 現在の加速度センサとジャイロセンサの生値を求める(雑音を含む)
+   * @param accel 加速度の生値(X,Y,Z)の書き込み先
+   * @param gyro ジャイロの生値(X,Y,Z)の書き込み先
+   * @return なし
+   */
+  void sense(int16_t accel[3], int16_t gyro[3]);
+  /**
+   * @brief 前回の呼び出しからのエンコーダのパルス数を取り出す
+   * @param left 左エンコーダのパルス数の書き込み先
+   * @param right 右エンコーダのパルス数の書き込み先
+   * @return なし
+   */
+  void takeEncoder(int16_t* left, int16_t* right);
+  /**
+   * @brief 経過時間を取得する
+   * @return 経過時間 単位:秒
+   */
+  double getTime();
+  /**
+   * @brief 傾きを取得する
+   * @return 直立からの前方への傾き 単位:rad
+   */
+  float getTilt();
+  /**
+   * @brief 傾きの角速度を取得する
+   * @return 角速度 単位:rad/s
+   */
+  float getTiltRate();
+  /**
+   * @brief 左右のクローラの移動量の平均を取得する
+   * @return 移動量 単位:m
+   */
+  float getPosition();
+  /**
+   * @brief 倒れたか調べる
+   * @return 傾きがCRAWL_PLANT_FALL_ANGLEを超えたことがあればtrue
+   */
+  bool isFallen();
+  /**
+   * @brief 手を放したか調べる
+   * @return config.releaseの時刻を過ぎていればtrue
+   */
+  bool isReleased();
+
+  /// @cond develop
+ private:
+  /** 経過時間 単位:秒 */
+  double time;
+  /** 傾き,角速度 */
+  float tilt, tilt_rate;
+  /** 直前の角加速度 単位:rad/s^2 */
+  float tilt_accel;
+  /** 左右のクローラの速度 単位:m/s */
+  float speed[2];
+  /** 左右のクローラの直前の加速度 単位:m/s^2 */
+  float accel[2];
+  /** 左右のクローラの移動量 単位:m */
+  double position[2];
+  /** エンコーダへ出力済みのパルス数 */
+  long counted[2];
+  /** 倒れたらtrue */
+  bool fallen;
+  /** 雑音の乱数の状態 */
+  uint32_t noise_seed;
+  /** -width〜widthの一様な雑音 */
+  int16_t noise(int16_t width);
+  /// @endcond
+};
+
+/**
+ * @brief 模擬デバイスの標本化に合わせて物理モデルを進め,センサ値とエンコーダを更新する
+ *
+ * hostSetImuSource()で設定した関数から,標本化の時刻を与えて呼び出す.
+ * 前回の呼び出しからの時間をCRAWL_PLANT_STEP_US以下の刻みで進め,その間のモータ指令は模擬モータ制御基板が
+ * 最後に受信したもの(モータ出力が無効なら0)とする.時刻0はhostReset()の時点.
+ * @param plant 物理モデル
+ * @param us 標本化の時刻 単位:マイクロ秒
+ * @return なし
+ */
+void hostDrivePlant(CrlPlant* plant, unsigned long us);
+#endif
+#endif
@@ -9,45 +9,33 @@
  * モータ制御基板のＩ２Ｃアドレスは0x0fに設定されている．
  */
 
-#include <Arduino.h>
-#include <Wire.h>
-
-short int right_encoder = 0;
-short int left_encoder = 0;
-
-void getResetEncoder() {
-  Wire.beginTransmission(0x39);
-  Wire.write(0x12);
-  Wire.endTransmission();
-
-  Wire.requestFrom(0x39, 4);
-  delayMicroseconds(25);
-
-  right_encoder = Wire.read() << 8;
-  right_encoder |= Wire.read();
-
-  left_encoder = Wire.read() << 8;
-  left_encoder |= Wire.read();
+#include "encoder.h"
+#include <stddef.h>
+#include "hal.h"
+
+/** コマンドを送り,モータ制御基板から累計回転数を読み出す */
+static void readEncoder(uint8_t command, short int* left, short int* right) {
+  uint8_t buf[4] = {0, 0, 0, 0};
+#if CRAWL_ENCODER_REPEATED_START
+  HalI2cTransaction transaction = {HAL_ADDR_MOTOR, &command, 1, buf, 4, NULL, HAL_I2C_DONE, NULL};
+
+  halI2cSubmit(&transaction);
+  halI2cWait(&transaction);
+#else
+  halI2cWrite(HAL_ADDR_MOTOR, &command, 1);
+  halI2cRead(HAL_ADDR_MOTOR, buf, 4);
+  halDelayMicroseconds(25);
+#endif
+
+  *right = (int16_t)((buf[0] << 8) | buf[1]);
+  *left = (int16_t)((buf[2] << 8) | buf[3]);
 }
 
-void getEncoder() {
-  Wire.beginTransmission(0x39);
-  Wire.write(0x11);
-  Wire.endTransmission();
-
-  Wire.requestFrom(0x39, 4);
-  delayMicroseconds(25);
+void getResetEncoder(short int* left, short int* right) { readEncoder(0x12, left, right); }
 
-  right_encoder = Wire.read() << 8;
-  right_encoder |= Wire.read();
-
-  left_encoder = Wire.read() << 8;
-  left_encoder |= Wire.read();
-  // Serial.println(left_encoder);
-}
+void getEncoder(short int* left, short int* right) { readEncoder(0x11, left, right); }
 
 void resetEncoder() {
-  Wire.beginTransmission(0x39);
-  Wire.write(0x10);
-  Wire.endTransmission();
+  const uint8_t command = 0x10;
+  halI2cWrite(HAL_ADDR_MOTOR, &command, 1);
 }
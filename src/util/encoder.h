@@ -13,28 +13,26 @@
 /**
  * @brief  モータ軸累計回転数を取得し,累計回転数をゼロに戻す
  *
- * 累計回転数はグローバル変数right_encoder，left_encoderに格納される．
  * 前進していれば正の数，後退していれば負の数となる．
  * その後,累計回転数をゼロに戻す．
+ * @param left 左累計回転数の格納先
+ * @param right 右累計回転数の格納先
  * @return なし
  */
-void getResetEncoder();
+void getResetEncoder(short int* left, short int* right);
 /**
  * @brief  モータ軸累計回転数を取得する
  *
- * 累計回転数はグローバル変数right_encoder，left_encoderに格納される．
  * 前進していれば正の数，後退していれば負の数となる．
+ * @param left 左累計回転数の格納先
+ * @param right 右累計回転数の格納先
  * @return なし
  */
-void getEncoder();
+void getEncoder(short int* left, short int* right);
 /**
  * @brief  累計回転数をゼロに戻す
  *
  * @return なし
  */
 void resetEncoder();
-/** 左累計回転数 */
-extern short int left_encoder;
-/** 右累計回転数 */
-extern short int right_encoder;
 #endif
@@ -0,0 +1,258 @@
+/**
+ * @file fast_math.cpp
+ * @brief
+ * 姿勢角度の計算に用いる高速な三角関数
+ */
+#include "fast_math.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+/** 表はフラッシュメモリに置く */
+#define FAST_MATH_PROGMEM PROGMEM
+#define readFloat(p) pgm_read_float(p)
+#define readLong(p) ((int32_t)pgm_read_dword(p))
+#else
+#define FAST_MATH_PROGMEM
+#define readFloat(p) (*(p))
+#define readLong(p) (*(p))
+#endif
+
+#define FM_PI 3.14159265f
+#define FM_HALF_PI 1.57079633f
+/** pi/2を二つに分けた値(Cody-Waiteの引数還元用) */
+#define FM_HALF_PI_HI 1.57079637f
+#define FM_HALF_PI_LO -4.37113883e-8f
+#define FM_TWO_OVER_PI 0.636619772f
+#define FM_ONE_OVER_TWO_PI 0.159154943f
+
+/** sin(i * pi / 128) (i = 0〜64) */
+static const float sin_table[65] FAST_MATH_PROGMEM = {
+    0.000000000f, 0.024541229f, 0.049067674f, 0.073564564f, 0.098017140f, 0.122410675f,
+    0.146730474f, 0.170961889f, 0.195090322f, 0.219101240f, 0.242980180f, 0.266712757f,
+    0.290284677f, 0.313681740f, 0.336889853f, 0.359895037f, 0.382683432f, 0.405241314f,
+    0.427555093f, 0.449611330f, 0.471396737f, 0.492898192f, 0.514102744f, 0.534997620f,
+    0.555570233f, 0.575808191f, 0.595699304f, 0.615231591f, 0.634393284f, 0.653172843f,
+    0.671558955f, 0.689540545f, 0.707106781f, 0.724247083f, 0.740951125f, 0.757208847f,
+    0.773010453f, 0.788346428f, 0.803207531f, 0.817584813f, 0.831469612f, 0.844853565f,
+    0.857728610f, 0.870086991f, 0.881921264f, 0.893224301f, 0.903989293f, 0.914209756f,
+    0.923879533f, 0.932992799f, 0.941544065f, 0.949528181f, 0.956940336f, 0.963776066f,
+    0.970031253f, 0.975702130f, 0.980785280f, 0.985277642f, 0.989176510f, 0.992479535f,
+    0.995184727f, 0.997290457f, 0.998795456f, 0.999698819f, 1.000000000f};
+
+/** atan(i / 32) (i = 0〜32) */
+static const float atan_table[33] FAST_MATH_PROGMEM = {
+    0.000000000f, 0.031239833f, 0.062418810f, 0.093476781f, 0.124354995f, 0.154996742f,
+    0.185347950f, 0.215357700f, 0.244978663f, 0.274167451f, 0.302884868f, 0.331096077f,
+    0.358770670f, 0.385882669f, 0.412410442f, 0.438336560f, 0.463647609f, 0.488333951f,
+    0.512389460f, 0.535811238f, 0.558599315f, 0.580756354f, 0.602287346f, 0.623199330f,
+    0.643501109f, 0.663202993f, 0.682316555f, 0.700854408f, 0.718830000f, 0.736257429f,
+    0.753151281f, 0.769526480f, 0.785398163f};
+
+/** CORDICの回転角 atan(2^-i) Q3.29 */
+static const int32_t cordic_angle[24] FAST_MATH_PROGMEM = {
+    421657428L, 248918915L, 131521918L, 66762579L, 33510843L, 16771758L,
+    8387925L, 4194219L, 2097141L, 1048575L, 524288L, 262144L,
+    131072L, 65536L, 32768L, 16384L, 8192L, 4096L,
+    2048L, 1024L, 512L, 256L, 128L, 64L};
+/** CORDICの利得の逆数 Q3.29 */
+#define CORDIC_INV_GAIN 326016437L
+/** CORDICの反復回数 */
+#define CORDIC_ITERATIONS 24
+
+/**
+ * 八分円への折り返しを行い,atan2を求める.
+ * atan_unitには0 <= z <= 1の逆正接を与える.
+ */
+static inline float atan2Octant(float y, float x, float (*atan_unit)(float)) {
+  float ax = fabs(x);
+  float ay = fabs(y);
+  float angle;
+
+  if (ax == 0 && ay == 0) return 0;
+  if (ay <= ax) {
+    angle = atan_unit(ay / ax);
+  } else {
+    angle = FM_HALF_PI - atan_unit(ax / ay);
+  }
+  if (x < 0) angle = FM_PI - angle;
+  if (y < 0) angle = -angle;
+  return angle;
+}
+
+/**
+ * xをk * pi / 2 + r (|r| <= pi / 4)に分解する
+ * @return 象限k mod 4
+ */
+static inline uint8_t reduceQuadrant(float x, float* r) {
+  float k = floor(x * FM_TWO_OVER_PI + 0.5f);
+  *r = (x - k * FM_HALF_PI_HI) - k * FM_HALF_PI_LO;
+  return (uint8_t)((int32_t)k & 3);
+}
+
+// 多項式近似
+
+/** atan(z) 0 <= z <= 1 (Abramowitz and Stegun 4.4.49) */
+static float atanUnitPoly(float z) {
+  float z2 = z * z;
+  return z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f + z2 * (-0.0851330f + z2 * 0.0208351f))));
+}
+
+/** sin(r) |r| <= pi/4 */
+static inline float sinReduced(float r) {
+  float r2 = r * r;
+  return r + r * r2 * (-1.66666667e-1f + r2 * (8.33333333e-3f + r2 * -1.98412698e-4f));
+}
+
+/** cos(r) |r| <= pi/4 */
+static inline float cosReduced(float r) {
+  float r2 = r * r;
+  return 1.0f + r2 * (-0.5f + r2 * (4.16666667e-2f + r2 * (-1.38888889e-3f + r2 * 2.48015873e-5f)));
+}
+
+/** 象限qの角度k * pi / 2 + rの正弦 */
+static inline float sinQuadrant(uint8_t q, float s, float c) {
+  switch (q) {
+    case 0:
+      return s;
+    case 1:
+      return c;
+    case 2:
+      return -s;
+    default:
+      return -c;
+  }
+}
+
+float atan2Poly(float y, float x) { return atan2Octant(y, x, atanUnitPoly); }
+
+float sinPoly(float x) {
+  float r;
+  uint8_t q = reduceQuadrant(x, &r);
+  return (q & 1) ? sinQuadrant(q, 0, cosReduced(r)) : sinQuadrant(q, sinReduced(r), 0);
+}
+
+float cosPoly(float x) {
+  float r;
+  uint8_t q = (reduceQuadrant(x, &r) + 1) & 3;  // cos(x) = sin(x + pi/2)
+  return (q & 1) ? sinQuadrant(q, 0, cosReduced(r)) : sinQuadrant(q, sinReduced(r), 0);
+}
+
+// 表引き
+
+/** atan(z) 0 <= z <= 1 */
+static float atanUnitTable(float z) {
+  float t = z * 32;
+  uint8_t i = (uint8_t)t;
+  float a;
+  if (i >= 32) return readFloat(&atan_table[32]);
+  a = readFloat(&atan_table[i]);
+  return a + (t - i) * (readFloat(&atan_table[i + 1]) - a);
+}
+
+float atan2Table(float y, float x) { return atan2Octant(y, x, atanUnitTable); }
+
+float sinTable(float x) {
+  float t = x * FM_ONE_OVER_TWO_PI;
+  float a, b;
+  uint8_t i, j;
+
+  t = (t - floor(t)) * 256;  // 一周を256分割した位置
+  i = (uint8_t)t;
+  t -= i;
+  j = i & 63;
+  if (i & 64) {  // 第2,第4象限は表を逆にたどる
+    a = readFloat(&sin_table[64 - j]);
+    b = readFloat(&sin_table[63 - j]);
+  } else {
+    a = readFloat(&sin_table[j]);
+    b = readFloat(&sin_table[j + 1]);
+  }
+  a += t * (b - a);
+  return (i & 128) ? -a : a;
+}
+
+float cosTable(float x) { return sinTable(x + FM_HALF_PI); }
+
+// CORDIC
+
+/** ベクトル(x, y)をx軸上へ回転させ,回転角を返す(ベクトルモード) */
+static int32_t cordicVector(int32_t x, int32_t y) {
+  int32_t z = 0;
+  int32_t t;
+  for (uint8_t i = 0; i < CORDIC_ITERATIONS; i++) {
+    t = x;
+    if (y > 0) {
+      x += y >> i;
+      y -= t >> i;
+      z += readLong(&cordic_angle[i]);
+    } else {
+      x -= y >> i;
+      y += t >> i;
+      z -= readLong(&cordic_angle[i]);
+    }
+  }
+  return z;
+}
+
+/** 角度z Q3.29 の余弦と正弦を求める(回転モード) */
+static void cordicRotate(int32_t z, int32_t* c, int32_t* s) {
+  int32_t x = CORDIC_INV_GAIN;
+  int32_t y = 0;
+  int32_t t;
+  for (uint8_t i = 0; i < CORDIC_ITERATIONS; i++) {
+    t = x;
+    if (z >= 0) {
+      x -= y >> i;
+      y += t >> i;
+      z -= readLong(&cordic_angle[i]);
+    } else {
+      x += y >> i;
+      y -= t >> i;
+      z += readLong(&cordic_angle[i]);
+    }
+  }
+  *c = x;
+  *s = y;
+}
+
+float atan2Cordic(float y, float x) {
+  float m = fabs(x) > fabs(y) ? fabs(x) : fabs(y);
+  int e;
+  int32_t ix, iy, z;
+
+  if (m == 0) return 0;
+  frexp(m, &e);  // 大きい方の成分を[0.5, 1)に正規化してQ3.29に変換する
+  ix = (int32_t)ldexp(fabs(x), 29 - e);
+  iy = (int32_t)ldexp(y, 29 - e);
+  z = cordicVector(ix, iy);  // 右半平面での角度
+  if (x < 0) z = (y < 0 ? -FM_PI : FM_PI) * 536870912.0f - z;
+  return z * (1.0f / 536870912.0f);
+}
+
+float sinCordic(float x) {
+  float r;
+  int32_t c, s;
+  uint8_t q = reduceQuadrant(x, &r);
+  cordicRotate((int32_t)(r * 536870912.0f), &c, &s);
+  return sinQuadrant(q, s * (1.0f / 536870912.0f), c * (1.0f / 536870912.0f));
+}
+
+float cosCordic(float x) {
+  float r;
+  int32_t c, s;
+  uint8_t q = (reduceQuadrant(x, &r) + 1) & 3;  // cos(x) = sin(x + pi/2)
+  cordicRotate((int32_t)(r * 536870912.0f), &c, &s);
+  return sinQuadrant(q, s * (1.0f / 536870912.0f), c * (1.0f / 536870912.0f));
+}
+
+float fastInvSqrt(float x) {
+  uint32_t i;
+  float y;
+
+  memcpy(&i, &x, sizeof(i));
+  i = 0x5F3759DFUL - (i >> 1);  // 指数部を-1/2倍し,仮数部も含めて誤差が小さくなるよう定数を選んだ初期値
+  memcpy(&y, &i, sizeof(y));
+  return y * (1.5f - 0.5f * x * y * y);
+}
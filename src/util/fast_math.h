@@ -0,0 +1,110 @@
+/**
+ * @file fast_math.h
+ * @brief
+ * 姿勢角度の計算に用いる高速な三角関数
+ *
+ * 精度と速度の異なる三つの実装を持つ.
+ * | 実装     | 方式                         | atan2の誤差 | sin/cosの誤差 [-2pi, 2pi] | sin/cosの誤差 [-100, 100] |
+ * |----------|------------------------------|-------------|---------------------------|---------------------------|
+ * | Poly     | 多項式近似                   | 1.2e-5 rad  | 4.3e-7                    | 3.7e-6                    |
+ * | Table    | 表引きと線形補間             | 8.0e-5 rad  | 7.6e-5                    | 7.6e-5                    |
+ * | Cordic   | 32ビット整数演算のCORDIC     | 3.8e-7 rad  | 2.6e-7                    | 3.9e-6                    |
+ *
+ * 誤差は倍精度のlibmとの差の最大値.
+ * sin/cosは|x|が大きくなると,引数を象限に還元する際の丸め誤差(約|x| * 4e-8)の分だけ誤差が増える.
+ * atan2(0, 0)は0を返す.
+ * 姿勢推定(ahrs.h)のベクトルの正規化には平方根の逆数fastInvSqrt()を用いる.
+ *
+ * CrlRobotはcrawl_config.hのCRAWL_FAST_MATHで選択した実装をfastAtan2(), fastSin(), fastCos()経由で使用する.
+ * 誤差と一回あたりの計算時間はtools/host/fast_math_bench.cppで計測できる.
+ */
+#ifndef INCLUDED_fast_math_h
+#define INCLUDED_fast_math_h
+#include <math.h>
+#include "crawl_config.h"
+
+/**
+ * @brief 多項式近似による逆正接
+ * @param y Y座標
+ * @param x X座標
+ * @return atan2(y, x) 単位:rad [-pi, pi]
+ */
+float atan2Poly(float y, float x);
+/**
+ * @brief 多項式近似による正弦
+ * @param x 角度 単位:rad
+ * @return sin(x)
+ */
+float sinPoly(float x);
+/**
+ * @brief 多項式近似による余弦
+ * @param x 角度 単位:rad
+ * @return cos(x)
+ */
+float cosPoly(float x);
+/**
+ * @brief 表引きによる逆正接
+ * @param y Y座標
+ * @param x X座標
+ * @return atan2(y, x) 単位:rad [-pi, pi]
+ */
+float atan2Table(float y, float x);
+/**
+ * @brief 表引きによる正弦
+ * @param x 角度 単位:rad
+ * @return sin(x)
+ */
+float sinTable(float x);
+/**
+ * @brief 表引きによる余弦
+ * @param x 角度 単位:rad
+ * @return cos(x)
+ */
+float cosTable(float x);
+/**
+ * @brief CORDICによる逆正接
+ * @param y Y座標
+ * @param x X座標
+ * @return atan2(y, x) 単位:rad [-pi, pi]
+ */
+float atan2Cordic(float y, float x);
+/**
+ * @brief CORDICによる正弦
+ * @param x 角度 単位:rad
+ * @return sin(x)
+ */
+float sinCordic(float x);
+/**
+ * @brief CORDICによる余弦
+ * @param x 角度 単位:rad
+ * @return cos(x)
+ */
+float cosCordic(float x);
+/**
+ * @brief 平方根の逆数
+ *
+ * 浮動小数点数のビット列を整数とみなして指数部を半分にした初期値から,ニュートン法を一回行う.
+ * 相対誤差は1.8e-3以下.CRAWL_FAST_MATHによらずこの実装を使う.
+ * @param x 入力値(正の数)
+ * @return 1/sqrt(x)
+ */
+float fastInvSqrt(float x);
+
+#if CRAWL_FAST_MATH == FAST_MATH_POLY
+inline float fastAtan2(float y, float x) { return atan2Poly(y, x); }
+inline float fastSin(float x) { return sinPoly(x); }
+inline float fastCos(float x) { return cosPoly(x); }
+#elif CRAWL_FAST_MATH == FAST_MATH_TABLE
+inline float fastAtan2(float y, float x) { return atan2Table(y, x); }
+inline float fastSin(float x) { return sinTable(x); }
+inline float fastCos(float x) { return cosTable(x); }
+#elif CRAWL_FAST_MATH == FAST_MATH_CORDIC
+inline float fastAtan2(float y, float x) { return atan2Cordic(y, x); }
+inline float fastSin(float x) { return sinCordic(x); }
+inline float fastCos(float x) { return cosCordic(x); }
+#else
+inline float fastAtan2(float y, float x) { return atan2(y, x); }
+inline float fastSin(float x) { return sin(x); }
+inline float fastCos(float x) { return cos(x); }
+#endif
+#endif
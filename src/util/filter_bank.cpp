@@ -0,0 +1,254 @@
+/**
+ * @file filter_bank.cpp
+ * @brief
+ * 一次のフィルタのまとめ計算(ホスト専用)
+ */
+#if !defined(ARDUINO)
+#include "filter_bank.h"
+#include "lti_filter.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILTER_BANK_AVX2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FILTER_BANK_NEON 1
+#endif
+
+/** SIMD計算時に配列の末尾に足しておく要素数 */
+#define FILTER_BANK_PADDING 8
+
+FilterBank::FilterBank(size_t size)
+    : n(size),
+      b0(size + FILTER_BANK_PADDING, 1),
+      b1(size + FILTER_BANK_PADDING, 0),
+      a1(size + FILTER_BANK_PADDING, 0),
+      inv_T(size + FILTER_BANK_PADDING, 1),
+      low(size + FILTER_BANK_PADDING, -FLT_MAX),
+      high(size + FILTER_BANK_PADDING, FLT_MAX),
+      derivative(size + FILTER_BANK_PADDING, 0),
+      s(size + FILTER_BANK_PADDING, 0),
+      y(size + FILTER_BANK_PADDING, 0) {}
+
+size_t FilterBank::size() { return this->n; }
+
+void FilterBank::setFirstOrderFilter(size_t i, float dt, float T) {
+  if (!(0.0 < T)) T = 1.0;
+  // FirstOrderFilter::updateCoefficients()と同じ係数
+  float gain = firstOrderLagGain(dt, T);
+  this->b0[i] = gain;
+  this->b1[i] = 0;
+  this->a1[i] = gain - 1;
+  this->inv_T[i] = 1 / T;
+  this->low[i] = -FLT_MAX;
+  this->high[i] = FLT_MAX;
+  this->derivative[i] = 0;
+}
+
+void FilterBank::setLaggedDerivative(size_t i, float dt, float T) {
+  setFirstOrderFilter(i, dt, T);
+  this->derivative[i] = 0xFFFFFFFF;
+}
+
+void FilterBank::setIntegral(size_t i, float dt, float limit_low, float limit_high) {
+  // Integral::calculate()と同じく y = x dt (a1 = 0 のため状態は0のまま)
+  this->b0[i] = dt;
+  this->b1[i] = 0;
+  this->a1[i] = 0;
+  this->inv_T[i] = 1;
+  this->low[i] = limit_low;
+  this->high[i] = limit_high;
+  this->derivative[i] = 0;
+}
+
+void FilterBank::reset() {
+  for (size_t i = 0; i < this->s.size(); i++) {
+    this->s[i] = 0;
+    this->y[i] = 0;
+  }
+}
+
+const float* FilterBank::getOutput() { return this->y.data(); }
+
+/*
+ * 一サンプル分の計算.要素ごとに次を計算する(各クラスと同じ演算順序).
+ *   v = b0 x + s                      (LtiFilter<1>::calculate())
+ *   s = clamp(b1 x - a1 v)            (Integral以外は制限値が±FLT_MAXで変化しない)
+ *   y = derivative ? (x - v) / T : clamp(v)
+ */
+static void calculateScalar(size_t begin, size_t end, const float* x, const float* b0, const float* b1,
+                            const float* a1, const float* inv_T, const float* low, const float* high,
+                            const uint32_t* derivative, float* s, float* y) {
+  for (size_t i = begin; i < end; i++) {
+    float v = b0[i] * x[i] + s[i];
+    float next = b1[i] * x[i] - a1[i] * v;
+    if (next < low[i]) next = low[i];
+    if (high[i] < next) next = high[i];
+    s[i] = next;
+    float out = v;
+    if (out < low[i]) out = low[i];
+    if (high[i] < out) out = high[i];
+    y[i] = derivative[i] ? (x[i] - v) * inv_T[i] : out;
+  }
+}
+
+#if FILTER_BANK_AVX2
+/*
+ * 融合積和演算による丸めの違いを避けるため,"fma"は有効にしない.
+ * clampは比較とblendで行う(_mm256_max_psはNaNの扱いがスカラーの比較と異なるため使わない).
+ */
+__attribute__((target("avx2"))) static size_t calculateAvx2(size_t n, const float* x, const float* b0,
+                                                             const float* b1, const float* a1, const float* inv_T,
+                                                             const float* low, const float* high,
+                                                             const uint32_t* derivative, float* s, float* y) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 vx = _mm256_loadu_ps(x + i);
+    __m256 vlow = _mm256_loadu_ps(low + i);
+    __m256 vhigh = _mm256_loadu_ps(high + i);
+    __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(b0 + i), vx), _mm256_loadu_ps(s + i));
+    __m256 next =
+        _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(b1 + i), vx), _mm256_mul_ps(_mm256_loadu_ps(a1 + i), v));
+    next = _mm256_blendv_ps(next, vlow, _mm256_cmp_ps(next, vlow, _CMP_LT_OQ));
+    next = _mm256_blendv_ps(next, vhigh, _mm256_cmp_ps(vhigh, next, _CMP_LT_OQ));
+    _mm256_storeu_ps(s + i, next);
+    __m256 out = _mm256_blendv_ps(v, vlow, _mm256_cmp_ps(v, vlow, _CMP_LT_OQ));
+    out = _mm256_blendv_ps(out, vhigh, _mm256_cmp_ps(vhigh, out, _CMP_LT_OQ));
+    __m256 d = _mm256_mul_ps(_mm256_sub_ps(vx, v), _mm256_loadu_ps(inv_T + i));
+    __m256 mask = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(derivative + i)));
+    _mm256_storeu_ps(y + i, _mm256_blendv_ps(out, d, mask));
+  }
+  return i;
+}
+#endif
+
+#if FILTER_BANK_NEON
+static size_t calculateNeon(size_t n, const float* x, const float* b0, const float* b1, const float* a1,
+                            const float* inv_T, const float* low, const float* high, const uint32_t* derivative,
+                            float* s, float* y) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t vx = vld1q_f32(x + i);
+    float32x4_t vlow = vld1q_f32(low + i);
+    float32x4_t vhigh = vld1q_f32(high + i);
+    // vmlaq_f32は融合積和演算になる場合があるため,乗算と加算を分けて行う
+    float32x4_t v = vaddq_f32(vmulq_f32(vld1q_f32(b0 + i), vx), vld1q_f32(s + i));
+    float32x4_t next = vsubq_f32(vmulq_f32(vld1q_f32(b1 + i), vx), vmulq_f32(vld1q_f32(a1 + i), v));
+    next = vbslq_f32(vcltq_f32(next, vlow), vlow, next);
+    next = vbslq_f32(vcltq_f32(vhigh, next), vhigh, next);
+    vst1q_f32(s + i, next);
+    float32x4_t out = vbslq_f32(vcltq_f32(v, vlow), vlow, v);
+    out = vbslq_f32(vcltq_f32(vhigh, out), vhigh, out);
+    float32x4_t d = vmulq_f32(vsubq_f32(vx, v), vld1q_f32(inv_T + i));
+    vst1q_f32(y + i, vbslq_f32(vld1q_u32(derivative + i), d, out));
+  }
+  return i;
+}
+#endif
+
+void FilterBank::calculate(const float* x) {
+  size_t done = 0;
+#if FILTER_BANK_AVX2
+  if (__builtin_cpu_supports("avx2")) {
+    done = calculateAvx2(this->n, x, this->b0.data(), this->b1.data(), this->a1.data(), this->inv_T.data(),
+                         this->low.data(), this->high.data(), this->derivative.data(), this->s.data(),
+                         this->y.data());
+  }
+#elif FILTER_BANK_NEON
+  done = calculateNeon(this->n, x, this->b0.data(), this->b1.data(), this->a1.data(), this->inv_T.data(),
+                       this->low.data(), this->high.data(), this->derivative.data(), this->s.data(), this->y.data());
+#endif
+  calculateScalar(done, this->n, x, this->b0.data(), this->b1.data(), this->a1.data(), this->inv_T.data(),
+                  this->low.data(), this->high.data(), this->derivative.data(), this->s.data(), this->y.data());
+}
+
+const char* FilterBank::backend() {
+#if FILTER_BANK_AVX2
+  if (__builtin_cpu_supports("avx2")) return "avx2";
+#elif FILTER_BANK_NEON
+  return "neon";
+#endif
+  return "scalar";
+}
+
+/*
+ * firstOrderFilterBlock()
+ *
+ * y[k] = g x[k] + p y[k-1] をW要素ごとに次のように計算する.
+ *   u[j] = g x[j]
+ *   u[j] += p   u[j-1]  (j >= 1)
+ *   u[j] += p^2 u[j-2]  (j >= 2)
+ *   u[j] += p^4 u[j-4]  (j >= 4)    ... ここまででu[j] = sum_{i<=j} p^(j-i) g x[i]
+ *   y[j] = u[j] + p^(j+1) y[-1]
+ */
+#if FILTER_BANK_AVX2
+__attribute__((target("avx2"))) static size_t blockAvx2(float gain, float p, float& y, const float* x, float* out,
+                                                         size_t n) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256i shift1 = _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6);
+  const __m256i shift2 = _mm256_setr_epi32(0, 0, 0, 1, 2, 3, 4, 5);
+  const __m256i shift4 = _mm256_setr_epi32(0, 0, 0, 0, 0, 1, 2, 3);
+  const __m256 vg = _mm256_set1_ps(gain);
+  const __m256 p1 = _mm256_set1_ps(p);
+  const __m256 p2 = _mm256_set1_ps(p * p);
+  const __m256 p4 = _mm256_set1_ps(p * p * p * p);
+  float powers[8];
+  powers[0] = p;
+  for (int j = 1; j < 8; j++) powers[j] = powers[j - 1] * p;
+  const __m256 carry = _mm256_loadu_ps(powers);
+
+  __m256 prev = _mm256_set1_ps(y);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 u = _mm256_mul_ps(vg, _mm256_loadu_ps(x + i));
+    u = _mm256_add_ps(u, _mm256_mul_ps(p1, _mm256_blend_ps(_mm256_permutevar8x32_ps(u, shift1), zero, 0x01)));
+    u = _mm256_add_ps(u, _mm256_mul_ps(p2, _mm256_blend_ps(_mm256_permutevar8x32_ps(u, shift2), zero, 0x03)));
+    u = _mm256_add_ps(u, _mm256_mul_ps(p4, _mm256_blend_ps(_mm256_permutevar8x32_ps(u, shift4), zero, 0x0F)));
+    u = _mm256_add_ps(u, _mm256_mul_ps(carry, prev));
+    _mm256_storeu_ps(out + i, u);
+    prev = _mm256_permutevar8x32_ps(u, _mm256_set1_epi32(7));
+  }
+  y = _mm256_cvtss_f32(prev);
+  return i;
+}
+#endif
+
+#if FILTER_BANK_NEON
+static size_t blockNeon(float gain, float p, float& y, const float* x, float* out, size_t n) {
+  const float32x4_t zero = vdupq_n_f32(0);
+  const float powers[4] = {p, p * p, p * p * p, p * p * p * p};
+  const float32x4_t carry = vld1q_f32(powers);
+  float32x4_t prev = vdupq_n_f32(y);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t u = vmulq_n_f32(vld1q_f32(x + i), gain);
+    u = vaddq_f32(u, vmulq_n_f32(vextq_f32(zero, u, 3), p));
+    u = vaddq_f32(u, vmulq_n_f32(vextq_f32(zero, u, 2), powers[1]));
+    u = vaddq_f32(u, vmulq_f32(carry, prev));
+    vst1q_f32(out + i, u);
+    prev = vdupq_n_f32(vgetq_lane_f32(u, 3));
+  }
+  y = vgetq_lane_f32(prev, 0);
+  return i;
+}
+#endif
+
+void firstOrderFilterBlock(float dt, float T, float& y, const float* x, float* out, size_t n) {
+  if (!(0.0 < T)) T = 1.0;
+  float gain = firstOrderLagGain(dt, T);
+  float a1 = gain - 1;
+  size_t i = 0;
+#if FILTER_BANK_AVX2
+  if (__builtin_cpu_supports("avx2")) i = blockAvx2(gain, -a1, y, x, out, n);
+#elif FILTER_BANK_NEON
+  i = blockNeon(gain, -a1, y, x, out, n);
+#endif
+  // 残り(とSIMDを使わない場合の全体)はFirstOrderFilterと同じ演算順序で計算する
+  float s = -a1 * y;
+  for (; i < n; i++) {
+    float v = gain * x[i] + s;
+    s = 0 * x[i] - a1 * v;
+    out[i] = v;
+    y = v;
+  }
+}
+#endif
@@ -0,0 +1,134 @@
+/**
+ * @file filter_bank.h
+ * @brief
+ * ホスト上でログの後処理やシミュレーションを行うための,一次のフィルタのまとめ計算
+ *
+ * - FilterBank: 独立したN個のフィルタ(FirstOrderFilter,LaggedDerivative,Integral)を一サンプルずつ進める.
+ *   各フィルタの係数と状態を要素ごとの配列に持ち,AVX2(8要素)またはNEON(4要素)でまとめて計算する.
+ *   演算の順序は各クラスと同じで,融合積和演算も使わないため,x86-64では結果がビット単位で一致する.
+ *   AArch64などコンパイラが各クラスの乗算と加算を融合積和演算にまとめる環境では,差は丸め一回分となる.
+ * - firstOrderFilterBlock(): 一つの一次遅れフィルタにサンプルの列を通す.
+ *   y[k] = g x[k] + p y[k-1] の漸化式をSIMDレジスタの幅ごとの並列プレフィックス和として計算するため,
+ *   丸めの順序が異なり,FirstOrderFilterとの差はFILTER_BANK_BLOCK_TOLERANCE以内となる.
+ *
+ * AVX2は実行時にCPUが対応しているかを調べて使用する.対応していない場合やその他の環境ではスカラー演算で計算する.
+ * ホスト専用であり,マイコン向けのビルドには含まれない.
+ */
+#ifndef INCLUDED_filter_bank_h
+#define INCLUDED_filter_bank_h
+#if !defined(ARDUINO)
+#include <float.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * firstOrderFilterBlock()とFirstOrderFilterの出力の差の上限(入力の最大絶対値に対する比)
+ *
+ * tools/host/filter_bank_benchで,dt/T = 0.001〜1,一様乱数と正弦波の入力について確認している
+ * (実測の最大値は約2e-6).差の大部分は,漸化式を逐次計算する側に蓄積する丸め誤差による.
+ */
+#define FILTER_BANK_BLOCK_TOLERANCE 1e-5f
+
+/**
+ * @class FilterBank
+ * @brief
+ * 独立した一次のフィルタをまとめて計算する
+ *
+ * 各フィルタは設定関数で種類と係数を決める.初期状態では入力をそのまま出力する.
+ */
+class FilterBank {
+ public:
+  /**
+   * @brief コンストラクタ
+   * @param size フィルタの数
+   */
+  explicit FilterBank(size_t size);
+  /**
+   * @brief フィルタの数を取得する
+   * @return フィルタの数
+   */
+  size_t size();
+  /**
+   * @brief i番目のフィルタをFirstOrderFilterと同じ一次遅れフィルタにする
+   * @param i フィルタの番号
+   * @param dt サンプリング時間 単位:秒
+   * @param T 時定数 単位:秒 (0以下の場合は1秒)
+   * @return なし
+   */
+  void setFirstOrderFilter(size_t i, float dt, float T);
+  /**
+   * @brief i番目のフィルタをLaggedDerivativeと同じ不完全微分にする
+   * @param i フィルタの番号
+   * @param dt サンプリング時間 単位:秒
+   * @param T 時定数 単位:秒 (0以下の場合は1秒)
+   * @return なし
+   */
+  void setLaggedDerivative(size_t i, float dt, float T);
+  /**
+   * @brief i番目のフィルタをIntegralと同じ制限付き積分にする
+   *
+   * 制限の範囲が0を含む場合にIntegralと一致する.
+   * @param i フィルタの番号
+   * @param dt サンプリング時間 単位:秒
+   * @param limit_low 下限値
+   * @param limit_high 上限値
+   * @return なし
+   */
+  void setIntegral(size_t i, float dt, float limit_low = -FLT_MAX, float limit_high = FLT_MAX);
+  /**
+   * @brief 全てのフィルタの内部状態と出力値を0にする
+   * @return なし
+   */
+  void reset();
+  /**
+   * @brief 全てのフィルタを一サンプル進める
+   * @param x 各フィルタへの入力(size()個)
+   * @return なし
+   */
+  void calculate(const float* x);
+  /**
+   * @brief 出力値を取得する
+   * @return 各フィルタの出力値(size()個)
+   */
+  const float* getOutput();
+  /**
+   * @brief 使用している計算方法を取得する
+   * @return "avx2","neon","scalar"のいずれか
+   */
+  static const char* backend();
+
+  /// @cond develop
+ private:
+  /** フィルタの数 */
+  size_t n;
+  /** 係数 b0, b1, a1 (LtiFilter<1>と同じ) */
+  std::vector<float> b0, b1, a1;
+  /** 不完全微分の場合の時定数の逆数 */
+  std::vector<float> inv_T;
+  /** 出力と内部状態の制限値 */
+  std::vector<float> low, high;
+  /** 不完全微分なら全ビット1,それ以外は0 */
+  std::vector<uint32_t> derivative;
+  /** 内部状態 */
+  std::vector<float> s;
+  /** 出力値 */
+  std::vector<float> y;
+  /// @endcond
+};
+
+/**
+ * @brief 一つの一次遅れフィルタにサンプルの列を通す
+ *
+ * FirstOrderFilterをsetDt(dt),setT(T)として,x[0]〜x[n-1]を順にcalculate()した場合の出力をoutに書き込む.
+ * @param dt サンプリング時間 単位:秒
+ * @param T 時定数 単位:秒 (0以下の場合は1秒)
+ * @param y 呼び出し前の出力値.最後の出力値に更新される
+ * @param x 入力の列
+ * @param out 出力の書き込み先(xと同じでもよい)
+ * @param n サンプル数
+ * @return なし
+ */
+void firstOrderFilterBlock(float dt, float T, float& y, const float* x, float* out, size_t n);
+#endif
+#endif
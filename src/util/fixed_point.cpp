@@ -0,0 +1,98 @@
+/**
+ * @file fixed_point.cpp
+ * @brief
+ * センサヒュージョン用の固定小数点演算
+ */
+#include "fixed_point.h"
+#include "lti_filter.h"
+
+FxCoef fxCoefFromFloat(float x) {
+  FxCoef c = {0, 16};
+  while (c.bits < 31 && x * (float)(1UL << (c.bits + 1)) < 65535.5f) c.bits++;
+  float scaled = x * (float)(1UL << c.bits) + 0.5f;
+  c.mant = scaled < 65535.0f ? (uint16_t)scaled : 65535;
+  return c;
+}
+
+int32_t fxAtan2(int32_t y, int32_t x) {
+  uint32_t ay = y < 0 ? -(uint32_t)y : (uint32_t)y;
+  uint32_t ax = x < 0 ? -(uint32_t)x : (uint32_t)x;
+  uint32_t n, d, zr;
+  uint16_t num, den, r, z, z2, p1;
+  int16_t p;
+  int32_t angle;
+
+  if (ax == 0 && ay == 0) return 0;
+
+  // 0 <= num/den <= 1 となるよう八分円に折り返し,denを[2^15, 2^16)に正規化する
+  if (ay <= ax) {
+    n = ay;
+    d = ax;
+  } else {
+    n = ax;
+    d = ay;
+  }
+  while (d >= 0x10000UL) {
+    d >>= 1;
+    n >>= 1;
+  }
+  while (d < 0x8000UL) {
+    d <<= 1;
+    n <<= 1;
+  }
+  num = n;
+  den = d;
+  // 2^16/den (Q1.15)を直線近似(相対誤差1/17以下)とニュートン法 r = r + r (1 - den r) の二回の反復で求め,
+  // 除算を使わずに比 z = num/den (Q0.16)を求める
+  r = 92521UL - (((uint32_t)den * 61681) >> 16);  // 48/17 - 32/17 den
+  for (uint8_t i = 0; i < 2; i++) {
+    int16_t g = 32768 - (uint16_t)(((uint32_t)den * r) >> 16);  // 反復は下から収束するためgは0以上
+    r += ((int32_t)r * g) >> 15;
+  }
+  zr = ((uint32_t)num * r + 0x4000) >> 15;
+  z = zr > 65535 ? 65535 : zr;
+
+  // atan(z)の近似多項式(Abramowitz and Stegun 4.4.49, |誤差| <= 1e-5 rad).
+  // 各項の大きさに合わせて小数部のビット数を変え,丸め誤差を抑える
+  z2 = ((uint32_t)z * z + 0x8000) >> 16;
+  p = 10924;                                                   // 0.0208351 Q19
+  p = -11158 + (int16_t)(((int32_t)p * z2 + 0x20000L) >> 18);  // -0.0851330 Q17
+  p = 23611 + (int16_t)(((int32_t)p * z2 + 0x8000) >> 16);     // 0.1801410 Q17
+  p = -21646 + (int16_t)(((int32_t)p * z2 + 0x10000L) >> 17);  // -0.3302995 Q16
+  p1 = 65527 + (int16_t)(((int32_t)p * z2 + 0x8000) >> 16);    // 0.9998660 Q16
+  angle = ((uint32_t)p1 * z + 0x80) >> (32 - FX_ANGLE_BITS);
+
+  if (ay > ax) angle = FX_HALF_PI - angle;
+  if (x < 0) angle = FX_PI - angle;
+  if (y < 0) angle = -angle;
+  return angle;
+}
+
+FixedFirstOrderFilter::FixedFirstOrderFilter() : dt(0.001), T(1), y(0) { updateGain(); }
+
+void FixedFirstOrderFilter::setDt(float dt) {
+  this->dt = dt;
+  updateGain();
+}
+
+void FixedFirstOrderFilter::setT(float T) {
+  if (0.0 < T) {
+    this->T = T;
+  } else {
+    this->T = 1.0;
+  }
+  updateGain();
+}
+
+void FixedFirstOrderFilter::updateGain() {
+  gain = fxCoefFromFloat(firstOrderLagGain(dt, T));
+}
+
+int32_t FixedFirstOrderFilter::calculate(int32_t x) {
+  y += fxMul(x - y, gain);
+  return y;
+}
+
+void FixedFirstOrderFilter::setOutput(int32_t y) { this->y = y; }
+
+int32_t FixedFirstOrderFilter::getOutput() { return y; }
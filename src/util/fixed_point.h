@@ -0,0 +1,186 @@
+/**
+ * @file fixed_point.h
+ * @brief
+ * センサヒュージョン用の固定小数点演算
+ *
+ * 値はすべてint32_tで保持し,下位のビットを小数部とする.Qm.nはm+n=32ビットのうちnビットが小数部であることを表す.
+ * CRAWL_FIXED_POINTが1の場合に使用する各量の形式と範囲は次の通り.
+ *
+ * | 量                       | 形式    | 範囲              | 分解能           |
+ * |--------------------------|---------|-------------------|------------------|
+ * | 加速度 [m/s^2]           | Q8.24   | ±128              | 6.0e-8           |
+ * | 角速度 [rad/s]           | Q16.16  | ±32768            | 1.5e-5           |
+ * | 姿勢角度 [rad]           | Q8.24   | ±128              | 6.0e-8           |
+ * | ジャイロのオフセット [生値] | Q24.8   | ±8388608          | 3.9e-3           |
+ * | フィルタ係数,時間 [s]     | FxCoef  | (0, 1]            | 相対誤差1.5e-5以下 |
+ *
+ * 浮動小数点演算版(CRAWL_FIXED_POINT=0)との誤差は次の通り.
+ * - 加速度,角速度の換算係数の量子化による相対誤差は3e-5以下.
+ * - fxAtan2()の誤差は7e-5 rad以下.
+ *   内訳は多項式近似誤差1e-5 rad,比と多項式の各項の量子化誤差4e-5 rad,入力の量子化誤差.
+ * - tools/host/traces/sway_drive.csv(10秒,1000サンプル)をtrace_replayで再生し,浮動小数点演算版で作った
+ *   基準出力と比べた最大誤差は,姿勢角度2.2e-5 rad(--kalmanでは1.8e-5 rad),上端速度3.8e-6 m/s.
+ *   CXXFLAGS="-O2 -DCRAWL_FIXED_POINT=1" でビルドしたtrace_replayに--tolerance 3e-5を与えて確かめる.
+ * - 傾いていない軸の姿勢角度は雑音程度の大きさの加速度二成分の逆正接となるため,加速度の量子化誤差が
+ *   そのまま角度の誤差になる.加速度をQ16.16で持つと最大1.2e-3 radとなるため,Q8.24で持つ.
+ *
+ * 乗算は一方を16ビットの係数とし,32ビット×16ビットを16ビット×16ビット→32ビットの二つの積に分けて行う.
+ * AVRでは64ビットの乗算とシフトがlibgccの関数呼び出しになるため,avr-gccがインライン展開できる
+ * 16ビット×16ビットの積だけを使う.fxAtan2()も除算を使わず,16ビット×16ビットの積だけで計算する.
+ * AVR上のサイクル数はtools/avr/cycle_simの"fxAtan2","atan2f","FixedFirstOrderFilter"の区間で確認する.
+ */
+#ifndef INCLUDED_fixed_point_h
+#define INCLUDED_fixed_point_h
+#include <stdint.h>
+
+/** 姿勢角度,フィルタ係数の小数部ビット数 */
+#define FX_ANGLE_BITS 24
+/**
+ * 加速度の小数部ビット数.
+ * 姿勢角度は加速度の二成分の逆正接から求め,傾いていない軸では両成分が雑音程度(1e-2 m/s^2)まで小さくなるため,
+ * 値の範囲(±2G)より分解能を優先する
+ */
+#define FX_ACC_BITS 24
+/** 角速度の小数部ビット数 */
+#define FX_VALUE_BITS 16
+/** ジャイロのオフセットの小数部ビット数 */
+#define FX_OFFSET_BITS 8
+
+/** pi Q8.24 */
+#define FX_PI 52707179L
+/** pi/2 Q8.24 */
+#define FX_HALF_PI 26353589L
+
+/**
+ * @struct FxCoef
+ * @brief
+ * 16ビットの仮数と小数部のビット数で表した正の係数 mant * 2^-bits
+ */
+struct FxCoef {
+  /** 仮数 */
+  uint16_t mant;
+  /** 小数部のビット数 [16, 31] */
+  uint8_t bits;
+};
+
+/**
+ * @brief 固定小数点数と16ビットの係数の積を求める
+ *
+ * aを上位・下位16ビットに分け,16ビット×16ビット→32ビットの二つの積から求める.
+ * 結果は(a * b) >> shiftを64ビットで計算した場合と一致する.
+ * @param a 入力値
+ * @param b 係数
+ * @param shift 積から切り捨てる小数部のビット数 (16以上)
+ * @return (a * b) >> shift
+ */
+inline int32_t fxMul(int32_t a, uint16_t b, uint8_t shift) {
+  int32_t high = (int32_t)(int16_t)(a >> 16) * b;
+  uint32_t low = (uint32_t)(uint16_t)a * b;
+  return (high + (int32_t)(low >> 16)) >> (shift - 16);
+}
+/**
+ * @brief 固定小数点数と係数の積を求める
+ * @param a 入力値
+ * @param c 係数
+ * @return a * c (aと同じ形式)
+ */
+inline int32_t fxMul(int32_t a, FxCoef c) { return fxMul(a, c.mant, c.bits); }
+/**
+ * @brief 浮動小数点数を係数に変換する
+ *
+ * 仮数が[2^15, 2^16)となるよう小数部のビット数を選ぶ(0.5を超える場合は16ビット,1は65535/2^16とする).
+ * @param x 入力値 [0, 1]
+ * @return 係数
+ */
+FxCoef fxCoefFromFloat(float x);
+/**
+ * @brief 浮動小数点数を固定小数点数に変換する
+ * @param x 入力値
+ * @param bits 小数部のビット数
+ * @return 固定小数点数(最近接丸め)
+ */
+inline int32_t fxFromFloat(float x, uint8_t bits) {
+  float scaled = x * (float)(1UL << bits);
+  return (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+/**
+ * @brief 固定小数点数を浮動小数点数に変換する
+ * @param x 入力値
+ * @param bits 小数部のビット数
+ * @return 浮動小数点数
+ */
+inline float fxToFloat(int32_t x, uint8_t bits) { return (float)x / (float)(1UL << bits); }
+/**
+ * @brief 逆正接を求める
+ *
+ * 引数y,xは同じ形式の固定小数点数であればよい.大きい方の絶対値を16ビットに正規化し,
+ * 比を逆数の直線近似とニュートン法で求めて多項式で近似する(除算を使わない).
+ * @param y Y座標
+ * @param x X座標
+ * @return atan2(y, x) 単位:rad Q8.24 [-pi, pi]
+ */
+int32_t fxAtan2(int32_t y, int32_t x);
+
+/**
+ * @class FixedFirstOrderFilter
+ * @brief
+ * 固定小数点演算による一次遅れフィルタークラス.
+ *
+ * FirstOrderFilterと同じ使い方で,入出力を固定小数点数で扱う.
+ * FirstOrderFilterと同じ厳密に離散化した一回の更新
+ * y += (1 - exp(-dt/T)) * (x - y)
+ * の係数をsetDt(),setT()の際に求めておき,一回の更新を一回の乗算で行う.
+ */
+class FixedFirstOrderFilter {
+  /// @cond develop
+  /** サンプリング時間 */
+  float dt;
+  /** 時定数 */
+  float T;
+  /** 更新係数 */
+  FxCoef gain;
+  /** 出力値 */
+  int32_t y;
+  /** 更新係数を求める */
+  void updateGain();
+  /// @endcond
+ public:
+  /**
+   * @brief コンストラクタ
+   *
+   * 出力初期値は0,時定数は1秒,サンプリングタイムは1ミリ秒で初期化されます.
+   * @return なし
+   */
+  FixedFirstOrderFilter();
+  /**
+   * @brief サンプリングタイムを設定する
+   * @param dt ループ間隔 単位:秒
+   * @return なし
+   */
+  void setDt(float dt);
+  /**
+   * @brief 時定数を設定する
+   * @param T 時定数 単位:秒
+   * @return なし
+   */
+  void setT(float T);
+  /**
+   * @brief 入力から出力を計算する
+   * @param x 入力値(固定小数点数)
+   * @return フィルタを通した値
+   * @attention ループ中では一回だけ呼び出すようにしてください.
+   */
+  int32_t calculate(int32_t x);
+  /**
+   * @brief 出力値を設定する
+   * @param y 出力値(入力と同じ形式の固定小数点数)
+   * @return なし
+   */
+  void setOutput(int32_t y);
+  /**
+   * @brief 出力値を取得する
+   * @return フィルタを通した値(入力と同じ形式の固定小数点数)
+   */
+  int32_t getOutput();
+};
+#endif
@@ -0,0 +1,60 @@
+#include "flight_recorder.h"
+#if CRAWL_RECORDER_RECORDS > 0
+#include <stddef.h>
+#include <string.h>
+#include "telemetry.h"
+
+/** インデックスを一周させるためのマスク */
+#define RECORDER_MASK (CRAWL_RECORDER_RECORDS - 1)
+
+static_assert(sizeof(CrlRecord) <= TELEMETRY_MAX_PAYLOAD, "CrlRecord does not fit in a telemetry frame");
+
+/*
+ * レコードの内容とインデックスの更新の順序を入れ替えないためのコンパイラバリア.
+ * 書き込み側と読み出し側は同じコア(AVR)または同じスレッド(ホスト)で動作するため,これで十分.
+ */
+#define RECORDER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+FlightRecorder::FlightRecorder() : head(0), tail(0), sequence(0), dropped(0) {}
+
+CrlRecord* FlightRecorder::reserve() {
+  uint8_t head = this->head;
+  if ((uint8_t)(head - this->tail) >= CRAWL_RECORDER_RECORDS) {
+    this->dropped++;
+    this->sequence++;
+    return NULL;
+  }
+  CrlRecord* record = &this->records[head & RECORDER_MASK];
+  record->sequence = this->sequence++;
+  return record;
+}
+
+void FlightRecorder::commit() {
+  RECORDER_BARRIER();
+  this->head++;
+}
+
+bool FlightRecorder::read(CrlRecord* record) {
+  uint8_t tail = this->tail;
+  if (tail == this->head) return false;
+  RECORDER_BARRIER();
+  memcpy(record, &this->records[tail & RECORDER_MASK], sizeof(CrlRecord));
+  RECORDER_BARRIER();
+  this->tail = tail + 1;
+  return true;
+}
+
+void FlightRecorder::drain() {
+  uint8_t tail = this->tail;
+  while (tail != this->head) {
+    RECORDER_BARRIER();
+    if (!telemetrySend(TELEMETRY_RECORD, &this->records[tail & RECORDER_MASK], sizeof(CrlRecord))) break;
+    RECORDER_BARRIER();
+    this->tail = ++tail;
+  }
+}
+
+uint8_t FlightRecorder::getCount() { return this->head - this->tail; }
+
+uint16_t FlightRecorder::getDropped() { return this->dropped; }
+#endif
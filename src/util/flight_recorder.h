@@ -0,0 +1,111 @@
+/**
+ * @file flight_recorder.h
+ * @brief
+ * 制御ループの状態を記録するRAM上のリングバッファ(フライトレコーダ)
+ *
+ * CrlRobot::updateState()の度に一レコードを追記し,CrlRobot::realtimeLoop()が次の周期を待つ間に
+ * テレメトリのフレーム(telemetry.h,種類TELEMETRY_RECORD)としてUARTへ送出する(drain()).
+ *
+ * 書き込み側(reserve, commit)と読み出し側(read, drain)はそれぞれ一つだけとし,書き込み側はhead,読み出し側はtailだけを更新する.
+ * インデックスは1バイトのため,AVRでも割り込みを禁止せずに読み書きできる.
+ * バッファが一杯の場合は新しいレコードを捨てて数を数えるだけで,書き込みは常に一定時間で終わる.
+ */
+#ifndef INCLUDED_flight_recorder_h
+#define INCLUDED_flight_recorder_h
+#include <stdint.h>
+#include "crawl_config.h"
+
+/** 姿勢角度を記録する際の倍率 (Q3.12 [rad]) */
+#define RECORDER_ANGLE_SCALE 4096.0
+/** 上端速度を記録する際の倍率 (Q3.12 [m/s]) */
+#define RECORDER_VELOCITY_SCALE 4096.0
+
+/**
+ * @struct CrlRecord
+ * @brief
+ * 一周期分の記録
+ */
+struct CrlRecord {
+  /** レコードの通し番号(捨てられたレコードも数えるため,欠けた番号から取りこぼしが分かる) */
+  uint8_t sequence;
+  /** updateState()を呼び出した時刻 単位:マイクロ秒 */
+  uint32_t time;
+  /** 直前の周期の長さ(CrlRobot::tt) 単位:マイクロ秒 */
+  uint16_t period;
+  /** 姿勢センサの生値(attitude_data: 加速度3軸,温度,ジャイロ3軸,地磁気3軸) */
+  int16_t attitude[10];
+  /** エンコーダの回転数の増分(左,右) */
+  int16_t encoder[2];
+  /** モータ指令値(左,右) [-255, 255] */
+  int16_t motor[2];
+  /** 姿勢角度(X,Y,Z) 単位:rad * RECORDER_ANGLE_SCALE */
+  int16_t theta[3];
+  /** 上端速度 単位:m/s * RECORDER_VELOCITY_SCALE */
+  int16_t head_velocity;
+} __attribute__((packed));
+
+#if CRAWL_RECORDER_RECORDS > 0
+#if (CRAWL_RECORDER_RECORDS & (CRAWL_RECORDER_RECORDS - 1)) != 0 || CRAWL_RECORDER_RECORDS > 128
+#error CRAWL_RECORDER_RECORDS must be a power of two not greater than 128
+#endif
+
+/**
+ * @class FlightRecorder
+ * @brief
+ * CrlRecordのリングバッファ
+ */
+class FlightRecorder {
+  /// @cond develop
+  /** レコード */
+  CrlRecord records[CRAWL_RECORDER_RECORDS];
+  /** 次に書き込む位置(書き込み側だけが更新する) */
+  volatile uint8_t head;
+  /** 次に読み出す位置(読み出し側だけが更新する) */
+  volatile uint8_t tail;
+  /** 次のレコードの通し番号 */
+  uint8_t sequence;
+  /** 捨てたレコードの数 */
+  volatile uint16_t dropped;
+  /// @endcond
+ public:
+  FlightRecorder();
+  /**
+   * @brief 書き込むレコードの領域を取得する
+   *
+   * 書き込み後にcommit()を呼び出すと,読み出し側から見えるようになります.
+   * @return レコードの領域.バッファが一杯の場合はNULL(捨てたレコードとして数える)
+   */
+  CrlRecord* reserve();
+  /**
+   * @brief reserve()で取得したレコードを確定する
+   * @return なし
+   */
+  void commit();
+  /**
+   * @brief 最も古いレコードを取り出す
+   * @param record 書き込み先
+   * @return レコードがあればtrue
+   * @attention drain()と併用しないで下さい
+   */
+  bool read(CrlRecord* record);
+  /**
+   * @brief 溜まっているレコードを,UARTの送信リングバッファに収まる分だけ送出する
+   *
+   * telemetrySend()を用いるため,ブロックしません.送りきれなかったレコードは次回の呼び出しで送出します.
+   * 事前にtelemetryBegin()を呼び出してください.
+   * @return なし
+   */
+  void drain();
+  /**
+   * @brief 溜まっているレコード数を取得する
+   * @return レコード数
+   */
+  uint8_t getCount();
+  /**
+   * @brief バッファが一杯で捨てたレコードの数を取得する
+   * @return 捨てたレコードの数
+   */
+  uint16_t getDropped();
+};
+#endif
+#endif
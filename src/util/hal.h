@@ -0,0 +1,253 @@
+/**
+ * @file hal.h
+ * @brief
+ * ハードウェア抽象化層(バス・時計・GPIO)
+ *
+ * センサやモータのドライバはArduinoのWire, micros(), delay(), digitalWrite()を直接呼ばず,
+ * この関数群を経由してハードウェアにアクセスする.
+ * 実体はビルド対象によって切り替わる.
+ * - Arduino(AVR)向け: hal_avr.cpp
+ * - Linuxなどのホスト向け: hal_host.cpp (I2Cデバイスのレジスタマップを模擬する)
+ */
+#ifndef INCLUDED_hal_h
+#define INCLUDED_hal_h
+#include <stdint.h>
+
+/** UARTの送信リングバッファのバイト数(2のべき乗,128以下) */
+#ifndef HAL_UART_TX_BUFFER
+#define HAL_UART_TX_BUFFER 128
+#endif
+/** EEPROMのバイト数(ATmega32U4) */
+#define HAL_EEPROM_SIZE 1024
+/** 姿勢センサ(MPU-9250)のI2Cアドレス */
+#define HAL_ADDR_MPU9250 0x68
+/** 地磁気センサ(AK8963)のI2Cアドレス */
+#define HAL_ADDR_AK8963 0x0C
+/** モータ制御基板のI2Cアドレス */
+#define HAL_ADDR_MOTOR 0x39
+
+/**
+ * バスとデバイスごとに1つ持つ静的変数(ドライバのバッファや状態)に付ける記憶域指定.
+ * ホスト向けではスレッドごとに別の実体(thread_local)となり,1スレッドに1台のロボットと模擬デバイスを
+ * 動かせる(CrlRobotのインスタンスごとには分かれないため,1スレッドで2台を交互に使うことはできない).
+ * Arduino(AVR)向けではスレッドがないため何も付けない.
+ */
+#if defined(ARDUINO)
+#define HAL_THREAD_LOCAL
+#else
+#define HAL_THREAD_LOCAL thread_local
+#endif
+
+/** ピンを入力に設定する */
+#define HAL_PIN_INPUT 0x0
+/** ピンを出力に設定する */
+#define HAL_PIN_OUTPUT 0x1
+
+/** I2Cトランザクションの状態: 完了 */
+#define HAL_I2C_DONE 0
+/** I2Cトランザクションの状態: 実行待ちまたは実行中 */
+#define HAL_I2C_PENDING 1
+/** I2Cトランザクションの状態: エラー(NACKなど) */
+#define HAL_I2C_ERROR 2
+
+/**
+ * @struct HalI2cTransaction
+ * @brief
+ * 非同期I2Cトランザクション
+ *
+ * tx_dataを送信した後,rx_lengthが1以上ならリピーテッドスタートを挟んでrx_dataへ受信する.
+ * 送信バイト数が0の場合は受信のみを行う.
+ * 構造体の領域は呼び出し側が確保し,完了するまで保持しておくこと.
+ */
+struct HalI2cTransaction {
+  /** 7ビットI2Cアドレス */
+  uint8_t address;
+  /** 送信データ */
+  const uint8_t* tx_data;
+  /** 送信バイト数 */
+  uint8_t tx_length;
+  /** 受信データの格納先 */
+  uint8_t* rx_data;
+  /** 受信バイト数 */
+  uint8_t rx_length;
+  /** 完了時に呼び出される関数(割り込み内で実行される).不要ならNULL */
+  void (*callback)(HalI2cTransaction* transaction);
+  /** 状態 HAL_I2C_DONE, HAL_I2C_PENDING, HAL_I2C_ERROR */
+  volatile uint8_t status;
+  /** キュー内の次のトランザクション(HAL内部で使用) */
+  HalI2cTransaction* volatile next;
+};
+
+/**
+ * @brief ボードの初期化
+ *
+ * マイコン周辺機能の初期化とI2Cバスのセットアップを行う.
+ * @return なし
+ */
+void halInit();
+/**
+ * @brief I2Cデバイスへデータを書き込む
+ *
+ * 書き込みが完了するまで待つ.
+ * @param address 7ビットI2Cアドレス
+ * @param data 書き込むデータ
+ * @param length 書き込むバイト数
+ * @return 0:成功 それ以外:エラー
+ */
+uint8_t halI2cWrite(uint8_t address, const uint8_t* data, uint8_t length);
+/**
+ * @brief I2Cデバイスからデータを読み込む
+ *
+ * 読み込みが完了するまで待つ.
+ * @param address 7ビットI2Cアドレス
+ * @param data 読み込んだデータの格納先
+ * @param length 読み込むバイト数
+ * @return 実際に読み込んだバイト数
+ */
+uint8_t halI2cRead(uint8_t address, uint8_t* data, uint8_t length);
+/**
+ * @brief I2Cトランザクションをキューに追加する
+ *
+ * 直ちにリターンし,バスが空き次第割り込みによって順に実行される.
+ * 完了時にはstatusが更新され,callbackが呼び出される.
+ * callbackの中から次のトランザクションを追加することもできる.
+ * @param transaction 実行するトランザクション
+ * @return なし
+ */
+void halI2cSubmit(HalI2cTransaction* transaction);
+/**
+ * @brief I2Cトランザクションの完了を待つ
+ * @param transaction 完了を待つトランザクション
+ * @return なし
+ */
+void halI2cWait(HalI2cTransaction* transaction);
+/**
+ * @brief 一定周期の割り込み(タイマ)を開始する
+ *
+ * period_usごとに割り込みの中からcallback(context)を呼び出す.再度呼び出すと周期と関数を設定し直す.
+ * AVRではTimer1を使用するため,Timer1を使うライブラリ(Servoなど)やピン9,10のanalogWrite()とは併用できない.
+ * AVRではCRAWL_SCHEDULERが1の場合だけ組み込まれる.
+ * @param period_us 周期 単位:マイクロ秒 (0の場合はタイマを止める)
+ * @param callback 呼び出す関数
+ * @param context callbackに渡す値
+ * @return なし
+ */
+void halTimerBegin(unsigned long period_us, void (*callback)(void*), void* context);
+/**
+ * @brief 姿勢センサのINTピンの割り込みを開始する
+ *
+ * INTピンの立ち上がりごとに割り込みの中からcallback(context)を呼び出す.
+ * AVRではMPU-9250のINTピンをD7(PE6,INT6)に接続して使用する.CRAWL_IMU_SYNCが1の場合だけ組み込まれる.
+ * @param callback 呼び出す関数(NULLの場合は割り込みを止める)
+ * @param context callbackに渡す値
+ * @return なし
+ */
+void halImuInterruptBegin(void (*callback)(void*), void* context);
+/**
+ * @brief 次の割り込みまでCPUを休止させる
+ *
+ * halEnterCritical()で割り込みを禁止した状態で,割り込み処理が更新するデータを調べてから呼び出す.
+ * 割り込みを許可すると同時に休止するため,調べてから休止するまでの間の割り込みを取りこぼさない.
+ * リターン時には割り込みは許可されている.
+ * @return なし
+ */
+void halSleep();
+/**
+ * @brief 割り込みを禁止する
+ *
+ * 割り込み処理と共有するデータを操作する間に使用する.
+ * @return 禁止する前の割り込み状態.halExitCritical()に渡す
+ */
+uint8_t halEnterCritical();
+/**
+ * @brief 割り込み状態を元に戻す
+ * @param state halEnterCritical()の戻り値
+ * @return なし
+ */
+void halExitCritical(uint8_t state);
+/**
+ * @brief 起動からの経過時間を取得する
+ * @return 経過時間 単位:マイクロ秒
+ */
+unsigned long halMicros();
+/**
+ * @brief 指定時間待つ
+ * @param ms 待ち時間 単位:ミリ秒
+ * @return なし
+ */
+void halDelay(unsigned long ms);
+/**
+ * @brief 指定時間待つ
+ * @param us 待ち時間 単位:マイクロ秒
+ * @return なし
+ */
+void halDelayMicroseconds(unsigned int us);
+/**
+ * @brief ピンの入出力を設定する
+ * @param pin ピン番号
+ * @param mode HAL_PIN_INPUTまたはHAL_PIN_OUTPUT
+ * @return なし
+ */
+void halPinMode(uint8_t pin, uint8_t mode);
+/**
+ * @brief ピンの出力を設定する
+ * @param pin ピン番号
+ * @param value 0:LOW それ以外:HIGH
+ * @return なし
+ */
+void halDigitalWrite(uint8_t pin, uint8_t value);
+/**
+ * @brief シリアル通信を開始する
+ * @param baud 通信速度 単位:bps
+ * @return なし
+ */
+void halSerialBegin(unsigned long baud);
+/**
+ * @brief シリアル通信で文字列を一行送信する
+ * @param str 送信する文字列
+ * @return なし
+ */
+void halSerialPrintln(const char* str);
+/**
+ * @brief UART(USART1)を送信専用で開始する
+ *
+ * 送信は割り込みで駆動し,halUartWrite()で書き込んだバイト列を送信リングバッファから順に送り出す.
+ * AVRではCRAWL_TELEMETRYが1の場合だけ組み込まれる(halUartAvailableForWrite(),halUartWrite()も同じ).
+ * @param baud 通信速度 単位:bps
+ * @return なし
+ */
+void halUartBegin(unsigned long baud);
+/**
+ * @brief UARTの送信リングバッファの空きを取得する
+ * @return 空きバイト数
+ */
+uint8_t halUartAvailableForWrite();
+/**
+ * @brief UARTの送信リングバッファにバイト列を書き込む
+ *
+ * 空きが足りない場合は何も書き込まない.ブロックしない.
+ * @param data 送信するデータ
+ * @param length 送信するバイト数
+ * @return 書き込んだ場合true (lengthが0の場合は何もせずtrue)
+ */
+bool halUartWrite(const uint8_t* data, uint8_t length);
+/**
+ * @brief EEPROMから読み込む
+ * @param address 読み込み開始アドレス
+ * @param data 読み込んだデータの格納先
+ * @param length 読み込むバイト数
+ * @return なし
+ */
+void halEepromRead(uint16_t address, void* data, uint16_t length);
+/**
+ * @brief EEPROMへ書き込む
+ *
+ * 値が変わるバイトだけを書き込み,完了するまで待つ.AVRでは1バイトあたり約3.4ミリ秒掛かる.
+ * 書き換え回数には上限(10万回程度)があるため,周期的に呼び出さないこと.
+ * @param address 書き込み開始アドレス
+ * @param data 書き込むデータ
+ * @param length 書き込むバイト数
+ * @return なし
+ */
+void halEepromWrite(uint16_t address, const void* data, uint16_t length);
+#endif
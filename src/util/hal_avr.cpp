@@ -0,0 +1,321 @@
+/**
+ * @file hal_avr.cpp
+ * @brief
+ * ハードウェア抽象化層のArduino(AVR)向け実装
+ *
+ * 時計,GPIO,シリアル通信はArduinoのコアライブラリをそのまま利用する.
+ * I2CはTWI割り込みで駆動するトランザクションキューとして実装しており,
+ * 通信中もCPUは他の処理を進めることができる.
+ * TWIの割り込みベクタを占有するため,Wireライブラリとは併用できない.
+ * 同様に,UART(USART1)の送信はUDRE割り込みで駆動するため,Serial1とは併用できない(CRAWL_TELEMETRYが1の場合).
+ * 周期割り込みにはTimer1を使用する(CRAWL_SCHEDULERが1の場合).
+ * 姿勢センサのINTピンにはD7(INT6)を使用する(CRAWL_IMU_SYNCが1の場合).
+ */
+#if defined(ARDUINO)
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <avr/sleep.h>
+#include <util/twi.h>
+#include "crawl_config.h"
+#include "hal.h"
+
+/** I2Cバスのクロック周波数 単位:Hz */
+#ifndef HAL_I2C_CLOCK
+#define HAL_I2C_CLOCK 100000L
+#endif
+
+// Declared weak in Arduino.h to allow user redefinitions.
+int atexit(void (*/*func*/)()) { return 0; }
+
+// Weak empty variant initialization function.
+// May be redefined by variant files.
+void initVariant() __attribute__((weak));
+void initVariant() {}
+
+void setupUSB() __attribute__((weak));
+void setupUSB() {}
+
+/** 実行中のトランザクション(キューの先頭) */
+static HalI2cTransaction* volatile i2c_head = NULL;
+/** キューの末尾 */
+static HalI2cTransaction* volatile i2c_tail = NULL;
+/** 実行中のトランザクションの送受信位置 */
+static volatile uint8_t i2c_index;
+/** 実行中のトランザクションが受信フェーズか */
+static volatile bool i2c_reading;
+/** 完了コールバックの実行中か */
+static volatile bool i2c_dispatching = false;
+
+/** TWCRに書き込む値: 割り込みを有効にして次の動作へ進める */
+#define TWCR_NEXT (_BV(TWEN) | _BV(TWIE) | _BV(TWINT))
+
+void halInit() {
+  ::init();
+  ::initVariant();
+
+#if defined(USBCON)
+  ::USBDevice.attach();
+#endif
+
+  // I2Cセットアップ(内部プルアップ有効)
+  digitalWrite(SDA, HIGH);
+  digitalWrite(SCL, HIGH);
+  TWSR &= ~(_BV(TWPS0) | _BV(TWPS1));
+  TWBR = ((F_CPU / HAL_I2C_CLOCK) - 16) / 2;
+  TWCR = _BV(TWEN);
+}
+
+/** バスが空いている状態から先頭のトランザクションを開始する */
+static void i2cStart() {
+  i2c_index = 0;
+  i2c_reading = false;
+  while (TWCR & _BV(TWSTO)) continue;  // 直前のストップコンディションの送出を待つ
+  TWCR = TWCR_NEXT | _BV(TWSTA);
+}
+
+/** 先頭のトランザクションを完了させ,続きがあればストップに続けてスタートを送出する */
+static void i2cFinish(uint8_t status) {
+  HalI2cTransaction* transaction = i2c_head;
+
+  i2c_head = transaction->next;
+  if (i2c_head == NULL) i2c_tail = NULL;
+  transaction->next = NULL;
+  transaction->status = status;
+
+  i2c_dispatching = true;
+  if (transaction->callback != NULL) transaction->callback(transaction);
+  i2c_dispatching = false;
+
+  i2c_index = 0;
+  i2c_reading = false;
+  if (i2c_head != NULL) {
+    TWCR = TWCR_NEXT | _BV(TWSTO) | _BV(TWSTA);  // ストップ送出後,スタートを送出
+  } else {
+    TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWSTO);  // バスを解放
+  }
+}
+
+ISR(TWI_vect) {
+  HalI2cTransaction* transaction = i2c_head;
+
+  switch (TW_STATUS) {
+    case TW_START:
+    case TW_REP_START:
+      if (!i2c_reading && (transaction->tx_length > 0 || transaction->rx_length == 0)) {
+        TWDR = (transaction->address << 1) | TW_WRITE;
+      } else {
+        i2c_reading = true;
+        TWDR = (transaction->address << 1) | TW_READ;
+      }
+      i2c_index = 0;
+      TWCR = TWCR_NEXT;
+      break;
+
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+      if (i2c_index < transaction->tx_length) {
+        TWDR = transaction->tx_data[i2c_index++];
+        TWCR = TWCR_NEXT;
+      } else if (transaction->rx_length > 0) {
+        i2c_reading = true;
+        TWCR = TWCR_NEXT | _BV(TWSTA);  // リピーテッドスタート
+      } else {
+        i2cFinish(HAL_I2C_DONE);
+      }
+      break;
+
+    case TW_MR_DATA_ACK:
+      transaction->rx_data[i2c_index++] = TWDR;
+    // fall through
+    case TW_MR_SLA_ACK:
+      if (i2c_index + 1 < transaction->rx_length) {
+        TWCR = TWCR_NEXT | _BV(TWEA);  // 続けて受信する
+      } else {
+        TWCR = TWCR_NEXT;  // 最後のバイトにはNACKを返す
+      }
+      break;
+
+    case TW_MR_DATA_NACK:
+      transaction->rx_data[i2c_index++] = TWDR;
+      i2cFinish(HAL_I2C_DONE);
+      break;
+
+    default:  // NACK,アービトレーション喪失,バスエラー
+      i2cFinish(HAL_I2C_ERROR);
+      break;
+  }
+}
+
+void halI2cSubmit(HalI2cTransaction* transaction) {
+  uint8_t state;
+
+  transaction->next = NULL;
+  transaction->status = HAL_I2C_PENDING;
+
+  state = halEnterCritical();
+  if (i2c_tail != NULL) {
+    i2c_tail->next = transaction;
+    i2c_tail = transaction;
+  } else {
+    i2c_head = transaction;
+    i2c_tail = transaction;
+    if (!i2c_dispatching) i2cStart();  // コールバック内ではi2cFinish()が開始する
+  }
+  halExitCritical(state);
+}
+
+void halI2cWait(HalI2cTransaction* transaction) {
+  while (transaction->status == HAL_I2C_PENDING) continue;
+}
+
+uint8_t halI2cWrite(uint8_t address, const uint8_t* data, uint8_t length) {
+  HalI2cTransaction transaction = {address, data, length, NULL, 0, NULL, HAL_I2C_DONE, NULL};
+  halI2cSubmit(&transaction);
+  halI2cWait(&transaction);
+  return transaction.status == HAL_I2C_DONE ? 0 : 2;
+}
+
+uint8_t halI2cRead(uint8_t address, uint8_t* data, uint8_t length) {
+  HalI2cTransaction transaction = {address, NULL, 0, data, length, NULL, HAL_I2C_DONE, NULL};
+  if (length == 0) return 0;
+  halI2cSubmit(&transaction);
+  halI2cWait(&transaction);
+  return transaction.status == HAL_I2C_DONE ? length : 0;
+}
+
+uint8_t halEnterCritical() {
+  uint8_t state = SREG;
+  cli();
+  return state;
+}
+
+void halExitCritical(uint8_t state) { SREG = state; }
+
+#if CRAWL_SCHEDULER
+// Timer1の割り込みベクタは,スケジューラを使う場合だけ占有する
+/** タイマ割り込みで呼び出す関数 */
+static void (*volatile timer_callback)(void*) = NULL;
+/** timer_callbackに渡す値 */
+static void* volatile timer_context = NULL;
+
+void halTimerBegin(unsigned long period_us, void (*callback)(void*), void* context) {
+  TIMSK1 = 0;
+  TCCR1A = 0;
+  TCCR1B = 0;
+  timer_callback = callback;
+  timer_context = context;
+  if (period_us == 0 || callback == NULL) return;
+
+  // CTCモード.プリスケーラ8(16MHzで0.5マイクロ秒単位,最長32ミリ秒),それより長い周期は64
+  unsigned long counts = period_us * (F_CPU / 1000000UL) / 8;
+  uint8_t prescaler = _BV(CS11);
+  if (counts > 0x10000UL) {
+    counts /= 8;
+    prescaler = _BV(CS11) | _BV(CS10);
+  }
+  OCR1A = counts - 1;
+  TCNT1 = 0;
+  TIFR1 = _BV(OCF1A);
+  TCCR1B = _BV(WGM12) | prescaler;
+  TIMSK1 = _BV(OCIE1A);
+}
+
+ISR(TIMER1_COMPA_vect) { timer_callback(timer_context); }
+#endif
+
+#if CRAWL_IMU_SYNC
+// INT6の割り込みベクタは,姿勢センサの標本化に同期する場合だけ占有する
+/** INTピンの割り込みで呼び出す関数 */
+static void (*volatile imu_callback)(void*) = NULL;
+/** imu_callbackに渡す値 */
+static void* volatile imu_context = NULL;
+
+void halImuInterruptBegin(void (*callback)(void*), void* context) {
+  EIMSK &= ~_BV(INT6);
+  imu_callback = callback;
+  imu_context = context;
+  if (callback == NULL) return;
+
+  DDRE &= ~_BV(PE6);  // D7を入力にする(MPU-9250のINTはプッシュプル出力)
+  PORTE &= ~_BV(PE6);
+  EICRB = (EICRB & ~(_BV(ISC61) | _BV(ISC60))) | _BV(ISC61) | _BV(ISC60);  // 立ち上がりエッジ
+  EIFR = _BV(INTF6);
+  EIMSK |= _BV(INT6);
+}
+
+ISR(INT6_vect) { imu_callback(imu_context); }
+#endif
+
+void halSleep() {
+  // アイドルモードではタイマ,UART,TWI,USB,外部割り込みで復帰する
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sei();        // seiの直後の命令は割り込みより先に実行されるため,
+  sleep_cpu();  // 割り込みを許可してから休止するまでの間に割り込みが入ることはない
+  sleep_disable();
+}
+
+unsigned long halMicros() { return micros(); }
+
+void halDelay(unsigned long ms) { delay(ms); }
+
+void halDelayMicroseconds(unsigned int us) { delayMicroseconds(us); }
+
+void halPinMode(uint8_t pin, uint8_t mode) { pinMode(pin, mode == HAL_PIN_OUTPUT ? OUTPUT : INPUT); }
+
+void halDigitalWrite(uint8_t pin, uint8_t value) { digitalWrite(pin, value ? HIGH : LOW); }
+
+void halSerialBegin(unsigned long baud) { Serial.begin(baud); }
+
+void halSerialPrintln(const char* str) { Serial.println(str); }
+
+#if CRAWL_TELEMETRY
+// USART1の割り込みベクタと送信リングバッファは,テレメトリを使う場合だけ占有する
+/** UARTの送信リングバッファ */
+static uint8_t uart_tx_buffer[HAL_UART_TX_BUFFER];
+/** 次に書き込む位置(halUartWrite()だけが更新する) */
+static volatile uint8_t uart_tx_head = 0;
+/** 次に送信する位置(割り込みだけが更新する) */
+static volatile uint8_t uart_tx_tail = 0;
+
+void halUartBegin(unsigned long baud) {
+  // 倍速モードで誤差が小さくなるよう四捨五入する(16MHzでは500k,1Mbpsが誤差0)
+  uint16_t ubrr = (F_CPU / 4 / baud - 1) / 2;
+  UCSR1A = _BV(U2X1);
+  UBRR1H = ubrr >> 8;
+  UBRR1L = ubrr;
+  UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);  // 8N1
+  UCSR1B = _BV(TXEN1);
+}
+
+uint8_t halUartAvailableForWrite() { return HAL_UART_TX_BUFFER - (uint8_t)(uart_tx_head - uart_tx_tail); }
+
+bool halUartWrite(const uint8_t* data, uint8_t length) {
+  uint8_t head = uart_tx_head;
+  if (length == 0) return true;  // 空のまま送信割り込みを許可すると,割り込みがバッファの外の値を送ってしまう
+  if (length > HAL_UART_TX_BUFFER - (uint8_t)(head - uart_tx_tail)) return false;
+  for (uint8_t i = 0; i < length; i++) uart_tx_buffer[(uint8_t)(head + i) & (HAL_UART_TX_BUFFER - 1)] = data[i];
+  __asm__ __volatile__("" ::: "memory");
+  uart_tx_head = head + length;
+  // 割り込みがUDRIE1を落とすのはリングバッファが空の場合だけなので,headを進めた後なら読み書きが競合しても問題ない
+  UCSR1B |= _BV(UDRIE1);
+  return true;
+}
+
+/** 送信データレジスタが空いたら次の1バイトを送る.リングバッファが空になったら割り込みを止める */
+ISR(USART1_UDRE_vect) {
+  uint8_t tail = uart_tx_tail;
+  UDR1 = uart_tx_buffer[tail & (HAL_UART_TX_BUFFER - 1)];
+  uart_tx_tail = ++tail;
+  if (tail == uart_tx_head) UCSR1B &= ~_BV(UDRIE1);
+}
+#endif
+
+void halEepromRead(uint16_t address, void* data, uint16_t length) {
+  eeprom_read_block(data, (const void*)address, length);
+}
+
+void halEepromWrite(uint16_t address, const void* data, uint16_t length) {
+  eeprom_update_block(data, (void*)address, length);
+}
+#endif
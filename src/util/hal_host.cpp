@@ -0,0 +1,584 @@
+/**
+ * @file hal_host.cpp
+ * @brief
+ * ハードウェア抽象化層のホスト(Linuxなど)向け実装
+ *
+ * 実機の代わりにI2Cデバイスのレジスタマップと仮想時計を模擬する.
+ * I2Cトランザクションはキューに入れられ,転送時間ぶん仮想時計が進んだ時点で実行される.
+ */
+#if !defined(ARDUINO)
+#include "hal_host.h"
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+#include "hal.h"
+
+/** ピン数 */
+#define HOST_PIN_COUNT 32
+/** EEPROMの1バイトの書き込みに掛かる時間 単位:マイクロ秒 */
+#define HOST_EEPROM_WRITE_US 3400
+
+/** MPU-9250のレジスタ */
+static HAL_THREAD_LOCAL uint8_t mpu_reg[128];
+/** MPU-9250のレジスタポインタ */
+static HAL_THREAD_LOCAL uint8_t mpu_ptr;
+/** MPU-9250のFIFO */
+static HAL_THREAD_LOCAL std::deque<uint8_t> mpu_fifo;
+/** MPU-9250が次に標本化する仮想時刻 */
+static HAL_THREAD_LOCAL unsigned long imu_sample_at;
+/** 標本化の時刻ごとに呼び出す関数 */
+static HAL_THREAD_LOCAL void (*imu_source)(unsigned long);
+/** AK8963のレジスタ */
+static HAL_THREAD_LOCAL uint8_t ak_reg[32];
+/** AK8963のレジスタポインタ */
+static HAL_THREAD_LOCAL uint8_t ak_ptr;
+/** モータ出力の有効/無効 */
+static HAL_THREAD_LOCAL bool motor_enabled;
+/** モータ回転指令(方向,右PWM,左PWM) */
+static HAL_THREAD_LOCAL uint8_t motor_command[3];
+/** 最後に受信したモータ制御基板へのコマンド */
+static HAL_THREAD_LOCAL uint8_t motor_last_command;
+/** モータ制御基板内の累計回転数 */
+static HAL_THREAD_LOCAL int16_t encoder_count[2];
+/** 読み出し用にラッチされた累計回転数 */
+static HAL_THREAD_LOCAL int16_t encoder_latch[2];
+/** 仮想時計 単位:マイクロ秒 */
+static HAL_THREAD_LOCAL unsigned long now_us;
+/** halMicros()一回あたりに進む時間 */
+static HAL_THREAD_LOCAL unsigned long micros_tick;
+/** I2Cクロック周波数 */
+static HAL_THREAD_LOCAL unsigned long i2c_clock;
+/** I2C通信時間の累計 */
+static HAL_THREAD_LOCAL unsigned long i2c_bus_us;
+/** 実行中のトランザクション(キューの先頭) */
+static HAL_THREAD_LOCAL HalI2cTransaction* i2c_head;
+/** キューの末尾 */
+static HAL_THREAD_LOCAL HalI2cTransaction* i2c_tail;
+/** 先頭のトランザクションが完了する仮想時刻 */
+static HAL_THREAD_LOCAL unsigned long i2c_done_at;
+/** バスの処理中か(再入防止) */
+static HAL_THREAD_LOCAL bool i2c_running;
+/** 完了コールバックの実行中か(halMicros()はトランザクションの完了時刻を返す) */
+static HAL_THREAD_LOCAL bool i2c_dispatching;
+/** タイマ割り込みの周期(0は停止) */
+static HAL_THREAD_LOCAL unsigned long timer_period;
+/** 次のタイマ割り込みの仮想時刻 */
+static HAL_THREAD_LOCAL unsigned long timer_next_at;
+/** タイマ割り込みで呼び出す関数 */
+static HAL_THREAD_LOCAL void (*timer_callback)(void*);
+/** timer_callbackに渡す値 */
+static HAL_THREAD_LOCAL void* timer_context;
+/** 姿勢センサのINTピンの割り込みで呼び出す関数 */
+static HAL_THREAD_LOCAL void (*imu_callback)(void*);
+/** imu_callbackに渡す値 */
+static HAL_THREAD_LOCAL void* imu_context;
+/** 割り込みの処理中か(halMicros()は割り込みの時刻を返す) */
+static HAL_THREAD_LOCAL bool irq_dispatching;
+/** 処理中の割り込みの時刻 */
+static HAL_THREAD_LOCAL unsigned long irq_at;
+/** halSleep()で休止した仮想時間の累計 */
+static HAL_THREAD_LOCAL unsigned long sleep_us;
+/** ピンの出力値 */
+static HAL_THREAD_LOCAL uint8_t pins[HOST_PIN_COUNT];
+/** シリアル出力を表示するか */
+static HAL_THREAD_LOCAL bool serial_echo;
+/** UARTの通信速度 */
+static HAL_THREAD_LOCAL unsigned long uart_baud;
+/** UARTの送信リングバッファが空になる仮想時刻 */
+static HAL_THREAD_LOCAL double uart_idle_at;
+/** halUartWrite()で送信されたバイト列(hostTakeUartOutput()で取り出す) */
+static HAL_THREAD_LOCAL std::vector<uint8_t> uart_output;
+/** EEPROMの内容(hostReset()では消去しない) */
+static HAL_THREAD_LOCAL uint8_t eeprom[HAL_EEPROM_SIZE];
+
+static void putBigEndian(uint8_t* reg, int16_t value) {
+  reg[0] = (uint16_t)value >> 8;
+  reg[1] = (uint16_t)value & 0xff;
+}
+
+static void putLittleEndian(uint8_t* reg, int16_t value) {
+  reg[0] = (uint16_t)value & 0xff;
+  reg[1] = (uint16_t)value >> 8;
+}
+
+/** スタート,アドレス,データ,ストップの転送に要する時間を求める */
+static unsigned long transactionMicros(const HalI2cTransaction* transaction) {
+  unsigned long bits = 1;  // ストップ
+  if (transaction->tx_length > 0 || transaction->rx_length == 0) bits += 1 + (1 + transaction->tx_length) * 9;
+  if (transaction->rx_length > 0) bits += 1 + (1 + transaction->rx_length) * 9;
+  return (bits * 1000000UL + i2c_clock - 1) / i2c_clock;
+}
+
+/** MPU-9250のバイパスが有効ならAK8963がバス上に現れる */
+static bool akVisible() { return (mpu_reg[0x37] & 0x02) != 0; }
+
+void hostReset() {
+  // キューに残っていたトランザクションは完了しないため失敗とする
+  for (HalI2cTransaction* t = i2c_head; t != NULL; t = t->next) t->status = HAL_I2C_ERROR;
+  memset(mpu_reg, 0, sizeof(mpu_reg));
+  memset(ak_reg, 0, sizeof(ak_reg));
+  mpu_reg[0x6B] = 0x01;  // PWR_MGMT_1 リセット値
+  mpu_reg[0x75] = 0x71;  // WHO_AM_I
+  ak_reg[0x00] = 0x48;   // WIA
+  mpu_ptr = 0;
+  mpu_fifo.clear();
+  imu_sample_at = 0;
+  imu_source = NULL;
+  ak_ptr = 0;
+  motor_enabled = false;
+  memset(motor_command, 0, sizeof(motor_command));
+  motor_last_command = 0;
+  memset(encoder_count, 0, sizeof(encoder_count));
+  memset(encoder_latch, 0, sizeof(encoder_latch));
+  now_us = 0;
+  micros_tick = 1;
+  i2c_clock = 100000;
+  i2c_bus_us = 0;
+  i2c_head = NULL;
+  i2c_tail = NULL;
+  i2c_done_at = 0;
+  i2c_running = false;
+  i2c_dispatching = false;
+  timer_period = 0;
+  timer_next_at = 0;
+  timer_callback = NULL;
+  timer_context = NULL;
+  imu_callback = NULL;
+  imu_context = NULL;
+  irq_dispatching = false;
+  irq_at = 0;
+  sleep_us = 0;
+  memset(pins, 0, sizeof(pins));
+  serial_echo = false;
+  uart_baud = 0;
+  uart_idle_at = 0;
+  uart_output.clear();
+}
+
+void hostSetAccel(int16_t x, int16_t y, int16_t z) {
+  putBigEndian(&mpu_reg[0x3B], x);
+  putBigEndian(&mpu_reg[0x3D], y);
+  putBigEndian(&mpu_reg[0x3F], z);
+}
+
+void hostSetGyro(int16_t x, int16_t y, int16_t z) {
+  putBigEndian(&mpu_reg[0x43], x);
+  putBigEndian(&mpu_reg[0x45], y);
+  putBigEndian(&mpu_reg[0x47], z);
+}
+
+void hostSetTemperature(int16_t raw) { putBigEndian(&mpu_reg[0x41], raw); }
+
+void hostSetMag(int16_t x, int16_t y, int16_t z) {
+  putLittleEndian(&ak_reg[0x03], x);
+  putLittleEndian(&ak_reg[0x05], y);
+  putLittleEndian(&ak_reg[0x07], z);
+  ak_reg[0x02] |= 0x01;  // ST1 DRDY
+}
+
+void hostSetImuSource(void (*source)(unsigned long us)) { imu_source = source; }
+
+void hostAddEncoder(int16_t left, int16_t right) {
+  encoder_count[0] += left;
+  encoder_count[1] += right;
+}
+
+bool hostMotorEnabled() { return motor_enabled; }
+
+void hostGetMotorCommand(uint8_t* directions, uint8_t* right_pwm, uint8_t* left_pwm) {
+  *directions = motor_command[0];
+  *right_pwm = motor_command[1];
+  *left_pwm = motor_command[2];
+}
+
+
+void hostSetMicrosTick(unsigned long us) { micros_tick = us; }
+
+void hostSetI2cClock(unsigned long hz) { i2c_clock = hz; }
+
+unsigned long hostGetI2cBusMicros() { return i2c_bus_us; }
+
+unsigned long hostGetSleepMicros() { return sleep_us; }
+
+uint8_t hostGetPin(uint8_t pin) { return pin < HOST_PIN_COUNT ? pins[pin] : 0; }
+
+void hostSetSerialEcho(bool enable) { serial_echo = enable; }
+
+void hostEraseEeprom() { memset(eeprom, 0xFF, sizeof(eeprom)); }
+
+size_t hostTakeUartOutput(uint8_t* buffer, size_t size) {
+  if (size > uart_output.size()) size = uart_output.size();
+  memcpy(buffer, uart_output.data(), size);
+  uart_output.erase(uart_output.begin(), uart_output.begin() + size);
+  return size;
+}
+
+/** 静的変数の初期化順に依存しないよう,最初のHAL呼び出しより前に模擬デバイスを初期化する */
+static struct HostAutoReset {
+  HostAutoReset() {
+    hostEraseEeprom();
+    hostReset();
+  }
+} host_auto_reset;
+
+void halInit() {}
+
+/** FIFO_COUNTH,FIFO_COUNTLをFIFOの残量に合わせる */
+static void updateFifoCount() { putBigEndian(&mpu_reg[0x72], (int16_t)mpu_fifo.size()); }
+
+/** FIFO_ENで選ばれたセンサの値を,レジスタの順にFIFOへ書き込む */
+static void pushFifoSample() {
+  static const struct {
+    uint8_t enable;
+    uint8_t reg;
+    uint8_t length;
+  } blocks[] = {{0x08, 0x3B, 6}, {0x80, 0x41, 2}, {0x40, 0x43, 2}, {0x20, 0x45, 2}, {0x10, 0x47, 2}};
+  uint8_t sample[14];
+  size_t length = 0;
+
+  for (size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++) {
+    if ((mpu_reg[0x23] & blocks[i].enable) == 0) continue;
+    memcpy(&sample[length], &mpu_reg[blocks[i].reg], blocks[i].length);
+    length += blocks[i].length;
+  }
+  if (length == 0) return;
+  if (mpu_fifo.size() + length > 512) {
+    // INT_STATUS FIFO_OFLOW_INTを立て,CONFIGのFIFO_MODEが1なら新しいサンプルを捨て,0なら古いものを上書きする
+    mpu_reg[0x3A] |= 0x10;
+    if (mpu_reg[0x1A] & 0x40) return;
+    mpu_fifo.erase(mpu_fifo.begin(), mpu_fifo.begin() + (mpu_fifo.size() + length - 512));
+  }
+  mpu_fifo.insert(mpu_fifo.end(), sample, sample + length);
+  updateFifoCount();
+}
+
+/** 時刻atまでの標本化を行う */
+static void sampleImu(unsigned long at) {
+  // DLPF_CFGが1〜6なら内部の標本化周波数は1kHz,それ以外は8kHz
+  unsigned long period = ((mpu_reg[0x1A] & 0x07) - 1u < 6u ? 1000UL : 125UL) * (1 + mpu_reg[0x19]);
+  bool fifo = (mpu_reg[0x6A] & 0x40) != 0;
+
+  if ((long)(imu_sample_at - at) > 0) return;
+  if (imu_source == NULL && !fifo) {
+    imu_sample_at += ((at - imu_sample_at) / period + 1) * period;
+    mpu_reg[0x3A] |= 0x01;
+    return;
+  }
+  while ((long)(imu_sample_at - at) <= 0) {
+    if (imu_source != NULL) imu_source(imu_sample_at);
+    if (fifo) pushFifoSample();
+    mpu_reg[0x3A] |= 0x01;  // INT_STATUS RAW_DATA_RDY_INT
+    imu_sample_at += period;
+  }
+}
+
+/** MPU-9250のレジスタへの書き込み後の処理 */
+static void mpuWritten(uint8_t reg) {
+  if (reg == 0x6A && (mpu_reg[0x6A] & 0x04)) {  // USER_CTRL FIFO_RST
+    mpu_fifo.clear();
+    updateFifoCount();
+    mpu_reg[0x6A] &= ~0x04;
+  }
+}
+
+/** 模擬デバイスへの書き込み */
+static uint8_t deviceWrite(uint8_t address, const uint8_t* data, uint8_t length) {
+  uint8_t i;
+  if (address == HAL_ADDR_MPU9250) {
+    if (length == 0) return 0;
+    sampleImu(i2c_done_at);
+    mpu_ptr = data[0] & 0x7f;
+    for (i = 1; i < length; i++) {
+      mpu_reg[mpu_ptr] = data[i];
+      mpuWritten(mpu_ptr);
+      mpu_ptr = (mpu_ptr + 1) & 0x7f;
+    }
+    return 0;
+  }
+  if (address == HAL_ADDR_AK8963 && akVisible()) {
+    if (length == 0) return 0;
+    ak_ptr = data[0] & 0x1f;
+    for (i = 1; i < length; i++) {
+      ak_reg[ak_ptr] = data[i];
+      ak_ptr = (ak_ptr + 1) & 0x1f;
+    }
+    return 0;
+  }
+  if (address == HAL_ADDR_MOTOR) {
+    if (length == 0) return 0;
+    motor_last_command = data[0];
+    switch (data[0]) {
+      case 0x00:  // モータ出力を無効化
+        motor_enabled = false;
+        break;
+      case 0x01:  // モータ出力を有効化
+        motor_enabled = true;
+        break;
+      case 0x02:  // 回転指令
+        if (length == 4) memcpy(motor_command, &data[1], 3);
+        break;
+      case 0x10:  // 累計回転数をリセット
+        encoder_count[0] = 0;
+        encoder_count[1] = 0;
+        break;
+      case 0x11:  // 累計回転数を読み出し用にラッチ
+        memcpy(encoder_latch, encoder_count, sizeof(encoder_latch));
+        break;
+      case 0x12:  // 累計回転数をラッチしてリセット
+        memcpy(encoder_latch, encoder_count, sizeof(encoder_latch));
+        encoder_count[0] = 0;
+        encoder_count[1] = 0;
+        break;
+    }
+    return 0;
+  }
+  return 2;  // アドレスに対してNACK
+}
+
+/** 模擬デバイスからの読み込み */
+static uint8_t deviceRead(uint8_t address, uint8_t* data, uint8_t length) {
+  uint8_t i;
+  if (address == HAL_ADDR_MPU9250) {
+    sampleImu(i2c_done_at);
+    for (i = 0; i < length; i++) {
+      if (mpu_ptr == 0x74) {  // FIFO_R_W: レジスタポインタは進まない
+        data[i] = mpu_fifo.empty() ? 0xff : mpu_fifo.front();
+        if (!mpu_fifo.empty()) mpu_fifo.pop_front();
+        continue;
+      }
+      data[i] = mpu_reg[mpu_ptr];
+      if (mpu_ptr == 0x3A) mpu_reg[0x3A] = 0;  // INT_STATUSは読み出しで消える
+      mpu_ptr = (mpu_ptr + 1) & 0x7f;
+    }
+    updateFifoCount();
+    return length;
+  }
+  if (address == HAL_ADDR_AK8963 && akVisible()) {
+    for (i = 0; i < length; i++) {
+      if (ak_ptr == 0x09) ak_reg[0x02] &= ~0x01;  // ST2の読み出しで測定完了
+      data[i] = ak_reg[ak_ptr];
+      ak_ptr = (ak_ptr + 1) & 0x1f;
+    }
+    return length;
+  }
+  if (address == HAL_ADDR_MOTOR) {
+    uint8_t response[4];
+    if (motor_last_command != 0x11 && motor_last_command != 0x12) return 0;
+    putBigEndian(&response[0], encoder_latch[1]);
+    putBigEndian(&response[2], encoder_latch[0]);
+    for (i = 0; i < length; i++) data[i] = i < 4 ? response[i] : 0xff;
+    return length;
+  }
+  return 0;
+}
+
+/** 仮想時刻までに完了するトランザクションを実行する */
+static void runBus() {
+  HalI2cTransaction* transaction;
+  uint8_t status;
+
+  if (i2c_running) return;
+  i2c_running = true;
+  while (i2c_head != NULL && i2c_done_at <= now_us) {
+    transaction = i2c_head;
+    status = HAL_I2C_DONE;
+    if (transaction->tx_length > 0 || transaction->rx_length == 0) {
+      if (deviceWrite(transaction->address, transaction->tx_data, transaction->tx_length) != 0) status = HAL_I2C_ERROR;
+    }
+    if (status == HAL_I2C_DONE && transaction->rx_length > 0) {
+      if (deviceRead(transaction->address, transaction->rx_data, transaction->rx_length) == 0) status = HAL_I2C_ERROR;
+    }
+
+    i2c_head = transaction->next;
+    if (i2c_head == NULL) i2c_tail = NULL;
+    transaction->next = NULL;
+    transaction->status = status;
+    bool queued = i2c_head != NULL;  // コールバックが空のキューに投入したものはhalI2cSubmit()で開始する
+    if (transaction->callback != NULL) {
+      // 実機の割り込みと同じく,コールバックからは完了した時刻に見える
+      i2c_dispatching = true;
+      transaction->callback(transaction);
+      i2c_dispatching = false;
+    }
+
+    if (queued) {
+      unsigned long us = transactionMicros(i2c_head);
+      i2c_done_at += us;
+      i2c_bus_us += us;
+    }
+  }
+  i2c_running = false;
+}
+
+/** 姿勢センサのデータレディ割り込みが有効か(INT_ENABLEのRAW_RDY_EN) */
+static bool imuInterruptEnabled() { return imu_callback != NULL && (mpu_reg[0x38] & 0x01) != 0; }
+
+/**
+ * 仮想時計を進め,その間に完了するI2C通信と,タイマおよび姿勢センサの割り込みを時刻の順に処理する.
+ * 割り込みの中で進めた時間(割り込みの処理時間)は,割り込まれた処理が使えなかった時間として終了時刻を延ばす.
+ */
+static void advance(unsigned long us) {
+  unsigned long target = now_us + us;
+  while (!irq_dispatching) {
+    bool timer = timer_period != 0 && (long)(timer_next_at - target) <= 0;
+    bool imu = imuInterruptEnabled() && (long)(imu_sample_at - target) <= 0;
+    if (timer && imu) timer = (long)(timer_next_at - imu_sample_at) <= 0;
+    if (!timer && !imu) break;
+    irq_at = timer ? timer_next_at : imu_sample_at;
+    if ((long)(irq_at - now_us) > 0) now_us = irq_at;
+    runBus();  // 割り込みの時刻までに完了する通信を先に処理する
+    unsigned long entered = now_us;
+    irq_dispatching = true;
+    if (timer) {
+      timer_callback(timer_context);
+      timer_next_at += timer_period;
+    } else {
+      sampleImu(irq_at);  // 標本化を終えた時点でINTピンにパルスが出る
+      imu_callback(imu_context);
+    }
+    irq_dispatching = false;
+    target += now_us - entered;
+  }
+  now_us = target;
+  runBus();
+}
+
+void hostAdvanceMicros(unsigned long us) { advance(us); }
+
+void halI2cSubmit(HalI2cTransaction* transaction) {
+  transaction->next = NULL;
+  transaction->status = HAL_I2C_PENDING;
+  if (i2c_tail != NULL) {
+    i2c_tail->next = transaction;
+    i2c_tail = transaction;
+  } else {
+    unsigned long us = transactionMicros(transaction);
+    i2c_head = transaction;
+    i2c_tail = transaction;
+    // 完了コールバックから投入された場合は,直前のトランザクションの完了時刻から開始する
+    i2c_done_at = (i2c_dispatching ? i2c_done_at : now_us) + us;
+    i2c_bus_us += us;
+  }
+}
+
+void halI2cWait(HalI2cTransaction* transaction) {
+  while (transaction->status == HAL_I2C_PENDING && i2c_head != NULL) {
+    if (now_us < i2c_done_at) {
+      advance(i2c_done_at - now_us);  // 完了まで待たされた分,時計を進める
+    } else {
+      runBus();
+    }
+  }
+}
+
+uint8_t halI2cWrite(uint8_t address, const uint8_t* data, uint8_t length) {
+  HalI2cTransaction transaction = {address, data, length, NULL, 0, NULL, HAL_I2C_DONE, NULL};
+  halI2cSubmit(&transaction);
+  halI2cWait(&transaction);
+  return transaction.status == HAL_I2C_DONE ? 0 : 2;
+}
+
+uint8_t halI2cRead(uint8_t address, uint8_t* data, uint8_t length) {
+  HalI2cTransaction transaction = {address, NULL, 0, data, length, NULL, HAL_I2C_DONE, NULL};
+  if (length == 0) return 0;
+  halI2cSubmit(&transaction);
+  halI2cWait(&transaction);
+  return transaction.status == HAL_I2C_DONE ? length : 0;
+}
+
+uint8_t halEnterCritical() { return 0; }
+
+void halExitCritical(uint8_t /*state*/) {}
+
+unsigned long halMicros() {
+  if (irq_dispatching) return now_us;  // 割り込みの時刻に,割り込みの中で進めた時間(処理時間)を加えたもの
+  if (i2c_dispatching) return i2c_done_at;
+  unsigned long t = now_us;
+  advance(micros_tick);
+  return t;
+}
+
+void halTimerBegin(unsigned long period_us, void (*callback)(void*), void* context) {
+  timer_period = callback != NULL ? period_us : 0;
+  timer_next_at = now_us + period_us;
+  timer_callback = callback;
+  timer_context = context;
+}
+
+void halImuInterruptBegin(void (*callback)(void*), void* context) {
+  sampleImu(now_us);  // 開始より前の標本化では割り込まない
+  imu_callback = callback;
+  imu_context = context;
+}
+
+void halSleep() {
+  // 次のI2Cの完了,タイマ割り込み,姿勢センサの割り込みまで仮想時計を進める
+  unsigned long wait = 0;
+  if (i2c_head != NULL && i2c_done_at > now_us) wait = i2c_done_at - now_us;
+  if (timer_period != 0 && (wait == 0 || timer_next_at - now_us < wait)) wait = timer_next_at - now_us;
+  if (imuInterruptEnabled() && (long)(imu_sample_at - now_us) > 0 && (wait == 0 || imu_sample_at - now_us < wait)) {
+    wait = imu_sample_at - now_us;
+  }
+  sleep_us += wait;
+  advance(wait);
+}
+
+void halDelay(unsigned long ms) { advance(ms * 1000UL); }
+
+void halDelayMicroseconds(unsigned int us) { advance(us); }
+
+void halPinMode(uint8_t /*pin*/, uint8_t /*mode*/) {}
+
+void halDigitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < HOST_PIN_COUNT) pins[pin] = value ? 1 : 0;
+}
+
+void halSerialBegin(unsigned long /*baud*/) {}
+
+void halSerialPrintln(const char* str) {
+  if (serial_echo) {
+    fputs(str, stdout);
+    fputc('\n', stdout);
+  }
+}
+
+void halUartBegin(unsigned long baud) {
+  uart_baud = baud;
+  uart_idle_at = now_us;
+}
+
+/** 送信リングバッファに残っているバイト数(1バイトあたり10ビットの時間で送り出される) */
+static unsigned long uartPending() {
+  if (uart_idle_at < now_us) uart_idle_at = now_us;
+  return (unsigned long)((uart_idle_at - now_us) * uart_baud / 10e6 + 0.999);
+}
+
+uint8_t halUartAvailableForWrite() {
+  if (uart_baud == 0) return 0;
+  return HAL_UART_TX_BUFFER - uartPending();
+}
+
+bool halUartWrite(const uint8_t* data, uint8_t length) {
+  if (length > halUartAvailableForWrite()) return false;
+  uart_idle_at += length * 10e6 / uart_baud;
+  uart_output.insert(uart_output.end(), data, data + length);
+  return true;
+}
+
+void halEepromRead(uint16_t address, void* data, uint16_t length) {
+  for (uint16_t i = 0; i < length; i++) {
+    ((uint8_t*)data)[i] = address + i < HAL_EEPROM_SIZE ? eeprom[address + i] : 0xFF;
+  }
+}
+
+void halEepromWrite(uint16_t address, const void* data, uint16_t length) {
+  unsigned long written = 0;
+  for (uint16_t i = 0; i < length && address + i < HAL_EEPROM_SIZE; i++) {
+    if (eeprom[address + i] == ((const uint8_t*)data)[i]) continue;
+    eeprom[address + i] = ((const uint8_t*)data)[i];
+    written++;
+  }
+  advance(written * HOST_EEPROM_WRITE_US);
+}
+#endif
@@ -0,0 +1,155 @@
+/**
+ * @file hal_host.h
+ * @brief
+ * ハードウェア抽象化層のホスト(Linuxなど)向け実装を操作する関数群
+ *
+ * ホスト向け実装ではI2Cバス上の次のデバイスのレジスタマップを模擬する.
+ * - 姿勢センサ MPU-9250 (0x68, FIFOを含む)
+ * - 地磁気センサ AK8963 (0x0C, MPU-9250のバイパス有効時のみ応答)
+ * - モータ制御基板 (0x39)
+ * - EEPROM (1KB,hostReset()では消去されない)
+ *
+ * 時計は仮想時計であり,halDelay()などの待ちや同期I2C通信の所要時間だけ進む.
+ * 非同期I2Cトランザクションは,仮想時計が転送時間ぶん進んだ時点で完了する.
+ * ベンチマークやユニットテストから,センサ値の注入やモータ指令の確認にこの関数群を使用する.
+ *
+ * 模擬デバイスと仮想時計の状態はスレッドごとに持つ(HAL_THREAD_LOCAL).メインスレッドの状態はプログラムの
+ * 開始時に初期化されるが,新しく作ったスレッドでは最初にhostEraseEeprom()とhostReset()を呼ぶこと.
+ */
+#ifndef INCLUDED_hal_host_h
+#define INCLUDED_hal_host_h
+#if !defined(ARDUINO)
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief 模擬デバイスと仮想時計を電源投入直後の状態に戻す
+ * @return なし
+ */
+void hostReset();
+/**
+ * @brief 加速度センサの生値を設定する
+ * @param x X軸の生値
+ * @param y Y軸の生値
+ * @param z Z軸の生値
+ * @return なし
+ */
+void hostSetAccel(int16_t x, int16_t y, int16_t z);
+/**
+ * @brief ジャイロセンサの生値を設定する
+ * @param x X軸の生値
+ * @param y Y軸の生値
+ * @param z Z軸の生値
+ * @return なし
+ */
+void hostSetGyro(int16_t x, int16_t y, int16_t z);
+/**
+ * @brief 温度センサの生値を設定する
+ * @param raw 生値(333.87で1℃,0が21℃)
+ * @return なし
+ */
+void hostSetTemperature(int16_t raw);
+/**
+ * @brief 地磁気センサの生値を設定する
+ * @param x X軸の生値
+ * @param y Y軸の生値
+ * @param z Z軸の生値
+ * @return なし
+ */
+void hostSetMag(int16_t x, int16_t y, int16_t z);
+/**
+ * @brief 姿勢センサが標本化するたびに呼び出す関数を設定する
+ *
+ * 模擬MPU-9250はSMPLRT_DIVとCONFIGで決まる周期(初期値は125マイクロ秒)で標本化し,
+ * FIFOが有効ならFIFO_ENで選ばれた値をFIFO(512バイト)へ書き込む.
+ * 設定した関数は書き込みの直前に標本化の時刻を引数として呼ばれるため,hostSetAccel()などで
+ * 時間とともに変化するセンサ値を与えられる.I2C通信の処理中に呼ばれるため,HALの関数は呼び出さないこと.
+ * @param source 呼び出す関数(NULLで解除)
+ * @return なし
+ */
+void hostSetImuSource(void (*source)(unsigned long us));
+/**
+ * @brief エンコーダの累計回転数を加算する
+ * @param left 左エンコーダの加算値 単位:パルス
+ * @param right 右エンコーダの加算値 単位:パルス
+ * @return なし
+ */
+void hostAddEncoder(int16_t left, int16_t right);
+/**
+ * @brief モータ出力が有効か調べる
+ * @return 有効ならtrue
+ */
+bool hostMotorEnabled();
+/**
+ * @brief 最後に受信したモータ回転指令を取得する
+ * @param directions 回転方向指示
+ * @param right_pwm 右モータPWM
+ * @param left_pwm 左モータPWM
+ * @return なし
+ */
+void hostGetMotorCommand(uint8_t* directions, uint8_t* right_pwm, uint8_t* left_pwm);
+/**
+ * @brief 仮想時計を進める
+ * @param us 進める時間 単位:マイクロ秒
+ * @return なし
+ */
+void hostAdvanceMicros(unsigned long us);
+/**
+ * @brief halMicros()を一回呼び出すごとに進む仮想時間を設定する
+ *
+ * micros()をポーリングして待つ処理が終了するよう,初期値は1マイクロ秒.
+ * @param us 進める時間 単位:マイクロ秒
+ * @return なし
+ */
+void hostSetMicrosTick(unsigned long us);
+/**
+ * @brief I2Cバスのクロック周波数を設定する
+ *
+ * I2Cトランザクションは,この周波数で転送した場合の所要時間をかけて実行される.初期値は100kHz.
+ * @param hz クロック周波数 単位:Hz
+ * @return なし
+ */
+void hostSetI2cClock(unsigned long hz);
+/**
+ * @brief これまでにI2C通信に費やした仮想時間を取得する
+ * @return 通信時間の累計 単位:マイクロ秒
+ */
+unsigned long hostGetI2cBusMicros();
+/**
+ * @brief halSleep()で休止した仮想時間の累計を取得する
+ *
+ * halSleep()は次のI2Cの完了またはタイマ割り込みの時刻まで仮想時計を進める.
+ * @return 休止時間の累計 単位:マイクロ秒
+ */
+unsigned long hostGetSleepMicros();
+/**
+ * @brief ピンの出力値を取得する
+ * @param pin ピン番号
+ * @return 0:LOW 1:HIGH
+ */
+uint8_t hostGetPin(uint8_t pin);
+/**
+ * @brief シリアル出力を標準出力へ表示するか設定する
+ * @param enable 表示する場合true
+ * @return なし
+ */
+void hostSetSerialEcho(bool enable);
+/**
+ * @brief 模擬EEPROMを消去する(全バイト0xFF)
+ *
+ * 模擬EEPROMの内容はhostReset()では消えないため,再起動をまたいで保存される値を模擬できる.
+ * halEepromWrite()は書き換えたバイト数に応じて仮想時計を進める.
+ * @return なし
+ */
+void hostEraseEeprom();
+/**
+ * @brief halUartWrite()で送信されたバイト列を取り出す
+ *
+ * 送信リングバッファ(HAL_UART_TX_BUFFERバイト)はhalUartBegin()で設定した通信速度で仮想時間とともに空いていく.
+ * @param buffer 書き込み先
+ * @param size 取り出す最大バイト数
+ * @return 取り出したバイト数
+ */
+size_t hostTakeUartOutput(uint8_t* buffer, size_t size);
+#endif
+#endif
@@ -1,120 +1,126 @@
 #include "kalmanfilter.h"
+#include <math.h>
 
 KalmanFilter::KalmanFilter() {
   this->dt = 0.01;
-  this->posteriori_state[0] = 0;
-  this->posteriori_state[1] = 0;
-  this->F[0][0] = 1;
-  this->F[0][1] = this->dt;
+  this->z = Mat<2, 1>::zeros();
 
-  this->F[1][0] = 0;
-  this->F[1][1] = 1;
+  this->F = Mat<2, 2>::identity();
+  this->F(0, 1) = this->dt;
 
-  this->transpose((float*)this->F, 2, 2, (float*)this->FT);
+  this->H = Mat<2, 2>::identity();
 
-  this->H[0][0] = 1;
-  this->H[0][1] = 0;
-
-  this->H[1][0] = 0;
-  this->H[1][1] = 1;
-
-  this->transpose((float*)this->H, 2, 2, (float*)this->HT);
-
-  this->posteriori_covariance[0][0] = 1;
-  this->posteriori_covariance[0][1] = 0;
-
-  this->posteriori_covariance[1][0] = 0;
-  this->posteriori_covariance[1][1] = 1;
+  this->P = SymMat<2>::identity();
 
   this->q1 = 0.0001;
   this->q2 = 0.001;
 
   this->r1 = 1;
   this->r2 = 1;
-}
 
-void KalmanFilter::add(float* A, float* B, int m, int n, float* C) {
-  int i, j;
-  for (i = 0; i < m; i++)
-    for (j = 0; j < n; j++) C[n * i + j] = A[n * i + j] + B[n * i + j];
-}
-void KalmanFilter::subtract(float* A, float* B, int m, int n, float* C) {
-  int i, j;
-  for (i = 0; i < m; i++)
-    for (j = 0; j < n; j++) C[n * i + j] = A[n * i + j] - B[n * i + j];
-}
-void KalmanFilter::multiply(float* A, float* B, int m, int p, int n, float* C) {
-  int i, j, k;
-  for (i = 0; i < m; i++)
-    for (j = 0; j < n; j++) {
-      C[n * i + j] = 0;
-      for (k = 0; k < p; k++) C[n * i + j] = C[n * i + j] + A[p * i + k] * B[n * k + j];
-    }
+  this->K = Mat<2, 2>::zeros();
+  this->enable_steady_state = false;
+  this->steady_state = false;
 }
-void KalmanFilter::multiply3(float* A, float* B, float* C, int m, int p, int r, int n, float* D) {
-  float AB[m][r];
-  multiply((float*)A, (float*)B, m, p, r, (float*)AB);
-  multiply((float*)AB, (float*)C, m, r, n, (float*)D);
-}
-void KalmanFilter::transpose(float* A, int m, int n, float* B) {
-  int i, j;
-  for (i = 0; i < m; i++)
-    for (j = 0; j < n; j++) B[m * j + i] = A[n * i + j];
-}
-void KalmanFilter::inverse2d(float* A, float* B) {
-  float det = A[0] * A[3] - A[1] * A[2];
-  B[0] = A[3] / det;
-  B[1] = -A[1] / det;
-  B[2] = -A[2] / det;
-  B[3] = A[0] / det;
+
+float KalmanFilter::updateCovariance() {
+  // P = F P F.T + Q
+  this->P = congruence(this->F, this->P);
+  this->P(0, 0) += this->q1;
+  this->P(1, 1) += this->q2;
+
+  // S = H P H.T + R
+  SymMat<2> S = congruence(this->H, this->P);
+  S(0, 0) += this->r1;
+  S(1, 1) += this->r2;
+
+  // K = P H.T S^{-1}
+  Mat<2, 2> K = (this->P * transpose(this->H)) * inverse(S);
+
+  // P = P - K S K.T
+  this->P = this->P - congruence(K, S);
+
+  float change = 0, scale = 0;
+  Unroll<4>::run([&](uint8_t k) MAT_BODY {
+    float d = fabs(K.a[k / 2][k % 2] - this->K.a[k / 2][k % 2]);
+    float g = fabs(K.a[k / 2][k % 2]);
+    if (d > change) change = d;
+    if (g > scale) scale = g;
+  });
+  this->K = K;
+  return scale > 0 ? change / scale : change;
 }
 
 void KalmanFilter::update(float theta, float gyro, float gyro_offset) {
-  float observation[2];
-  observation[0] = theta;
-  observation[1] = gyro - gyro_offset;
+  Mat<2, 1> observation;
+  observation(0, 0) = theta;
+  observation(1, 0) = gyro - gyro_offset;
 
   // z = F z
-  this->priori_state[0] = this->posteriori_state[0] + this->posteriori_state[1] * dt;
-  this->priori_state[1] = this->posteriori_state[1];
+  this->z = this->F * this->z;
 
-  // P = F P F.T + Q
-  this->multiply3((float*)F, (float*)this->posteriori_covariance, (float*)this->FT, 2, 2, 2, 2,
-                  (float*)this->priori_covariance);
-  this->priori_covariance[0][0] += this->q1;
-  this->priori_covariance[1][1] += this->q2;
+  if (!this->steady_state) {
+    float change = this->updateCovariance();
+    if (this->enable_steady_state && change < KALMAN_GAIN_TOLERANCE) this->steady_state = true;
+  }
 
-  // S = H P H.T + R
-  this->multiply3((float*)H, (float*)this->priori_covariance, (float*)this->HT, 2, 2, 2, 2, (float*)this->S);
-  this->S[0][0] += this->r1;
-  this->S[1][1] += this->r2;
+  // z = z + K (x - H z)
+  this->z = this->z + this->K * (observation - this->H * this->z);
+}
 
-  // K = P H.T S^{-1}
-  this->inverse2d((float*)this->S, (float*)this->S_inverse);
-  this->multiply3((float*)this->priori_covariance, (float*)this->HT, (float*)this->S_inverse, 2, 2, 2, 2,
-                  (float*)this->K);
+float KalmanFilter::getTheta() { return this->z(0, 0); }
 
-  // e = (x - H z)
-  this->estimated_observation[0] = this->priori_state[0];
-  this->estimated_observation[1] = this->priori_state[1];
-  this->subtract((float*)observation, (float*)this->estimated_observation, 2, 1, (float*)this->e);
+float KalmanFilter::getThetaDot() { return this->z(1, 0); }
 
-  // z = z + K e
-  this->multiply((float*)this->K, (float*)this->e, 2, 2, 1, (float*)this->state_modify);
-  this->add((float*)this->priori_state, (float*)this->state_modify, 2, 1, (float*)this->posteriori_state);
+float KalmanFilter::getThetaVariance() { return this->P(0, 0); }
 
-  // P = P - K  S  K.T
-  this->transpose((float*)this->K, 2, 2, (float*)this->KT);
-  this->multiply3((float*)this->K, (float*)this->S, (float*)this->KT, 2, 2, 2, 2, (float*)this->covariance_modify);
+void KalmanFilter::setDt(float dt) {
+  this->dt = dt;
+  this->F(0, 1) = dt;
+  this->steady_state = false;
+}
 
-  this->subtract((float*)this->priori_covariance, (float*)this->covariance_modify, 2, 2,
-                 (float*)this->posteriori_covariance);
+void KalmanFilter::setProcessNoise(float q1, float q2) {
+  this->q1 = q1;
+  this->q2 = q2;
+  this->steady_state = false;
 }
 
-float KalmanFilter::getTheta() { return this->posteriori_state[0]; }
+void KalmanFilter::setObservationNoise(float r1, float r2) {
+  this->r1 = r1;
+  this->r2 = r2;
+  this->steady_state = false;
+}
 
-float KalmanFilter::getThetaDot() { return this->posteriori_state[1]; }
+void KalmanFilter::setSteadyState(bool enable) {
+  this->enable_steady_state = enable;
+  if (!enable) this->steady_state = false;
+}
 
-float KalmanFilter::getThetaVariance() { return this->posteriori_covariance[0][0]; }
+int KalmanFilter::solveSteadyState() {
+  this->enable_steady_state = true;
+  for (int i = 1; i <= KALMAN_MAX_ITERATIONS; i++) {
+    if (this->updateCovariance() < KALMAN_GAIN_TOLERANCE) {
+      this->steady_state = true;
+      return i;
+    }
+  }
+  return -1;
+}
+
+void KalmanFilter::setSteadyStateGain(const float gain[2][2], const float covariance[3]) {
+  Unroll<4>::run([&](uint8_t k) MAT_BODY { this->K.a[k / 2][k % 2] = gain[k / 2][k % 2]; });
+  Unroll<3>::run([&](uint8_t k) MAT_BODY { this->P.a[k] = covariance[k]; });
+  this->enable_steady_state = true;
+  this->steady_state = true;
+}
+
+bool KalmanFilter::isSteadyState() { return this->steady_state; }
 
-void KalmanFilter::setDt(float dt) { this->dt = dt; }
+void KalmanFilter::getGain(float gain[2][2]) {
+  Unroll<4>::run([&](uint8_t k) MAT_BODY { gain[k / 2][k % 2] = this->K.a[k / 2][k % 2]; });
+}
+
+void KalmanFilter::getCovariance(float covariance[3]) {
+  Unroll<3>::run([&](uint8_t k) MAT_BODY { covariance[k] = this->P.a[k]; });
+}
@@ -1,109 +1,44 @@
-
 /**
  * @file kalmanfilter.h
  * @brief
  * カルマンフィルタによって加速度センサとジャイロセンサから姿勢情報を推定する.
  */
+#ifndef INCLUDED_kalmanfilter_h
+#define INCLUDED_kalmanfilter_h
+#include "matrix.h"
+
+/** 定常カルマンゲインへの収束を判定するゲインの相対変化量の閾値 */
+#define KALMAN_GAIN_TOLERANCE 1e-6f
+/** solveSteadyState()で共分散の漸化式を反復する最大回数 */
+#define KALMAN_MAX_ITERATIONS 10000
+
 class KalmanFilter {
  private:
-  /**
-   * @brief 行列の和を計算する
-   * @param A 入力行列
-   * @param B 入力行列
-   * @param m 入力行列の列数
-   * @param n 入力行列の行数
-   * @param C 出力行列 (A + B)
-   * @return なし
-   */
-  void add(float* A, float* B, int m, int n, float* C);
-  /**
-   * @brief 行列の差を計算する
-   * @param A 入力行列
-   * @param B 入力行列
-   * @param m 入力行列の列数
-   * @param n 入力行列の行数
-   * @param C 出力行列 (A - B)
-   * @return なし
-   */
-  void subtract(float* A, float* B, int m, int n, float* C);
-  /**
-   * @brief 行列の積を計算する
-   * @param A 入力行列
-   * @param B 入力行列
-   * @param m 入力行列Aの列数
-   * @param p 入力行列Aの列数, 入力行列Bの行数
-   * @param n 入力行列Bの列数
-   * @param C 出力行列 (A * B)
-   * @return なし
-   */
-  void multiply(float* A, float* B, int m, int p, int n, float* C);
-  /**
-   * @brief 3つの行列の積を計算する
-   * @param A 入力行列
-   * @param B 入力行列
-   * @param C 入力行列
-   * @param m 入力行列Aの列数
-   * @param p 入力行列Aの列数, 入力行列Bの行数
-   * @param r 入力行列Bの列数, 入力行列Cの行数
-   * @param n 入力行列Cの列数
-   * @param D 出力行列 (A * B * C)
-   * @return なし
-   */
-  void multiply3(float* A, float* B, float* C, int m, int p, int r, int n, float* D);
-  /**
-   * @brief 転置行列を計算する
-   * @param A 入力行列
-   * @param m 入力行列の列数
-   * @param n 入力行列の行数
-   * @param B 出力行列 A^T
-   * @return なし
-   */
-  void transpose(float* A, int m, int n, float* B);
-  /**
-   * @brief 2行2列の行列の逆行列を計算する
-   * @param A 2行2列入力行列
-   * @param B 出力行列 A^{-1}
-   * @return なし
-   */
-  void inverse2d(float* A, float* B);
   /** ループ間隔 初期値は0.01秒 */
   float dt;
-  /** 事前状態推定値 */
-  float priori_state[2];
-  /** 事後状態推定値 */
-  float posteriori_state[2];
-  /** 事前推定量の分散共分散行列 */
-  float priori_covariance[2][2];
-  /** 事後推定量の分散共分散行列 */
-  float posteriori_covariance[2][2];
+  /** 状態推定値(角度,角速度) */
+  Mat<2, 1> z;
+  /** 推定量の分散共分散行列 */
+  SymMat<2> P;
   /** 転移行列 */
-  float F[2][2];
-  /** 転移行列の転置行列 */
-  float FT[2][2];
+  Mat<2, 2> F;
   /** 観測行列 */
-  float H[2][2];
-  /** 観測行列の転置行列 */
-  float HT[2][2];
+  Mat<2, 2> H;
   /** プロセスノイズの分散 */
   float q1, q2;
   /** 観測ノイズの分散 */
   float r1, r2;
-  /** 観測予測誤差の分散共分散行列 */
-  float S[2][2];
-  /** 観測予測誤差の分散共分散行列の転置行列 */
-  float S_inverse[2][2];
   /** カルマンゲイン */
-  float K[2][2];
-  /** カルマンゲインの転置行列 */
-  float KT[2][2];
-  /** 推定観測値 */
-  float estimated_observation[2];
-  /** 観測値と推定観測値の誤差 */
-  float e[2];
-  /** 状態量の修正量 */
-  float state_modify[2];
-  /** 推定量の分散共分散行列の修正量 */
-  float covariance_modify[2][2];
+  Mat<2, 2> K;
+  /** 定常カルマンゲインモードが有効ならtrue */
+  bool enable_steady_state;
+  /** Kが定常カルマンゲインに収束していればtrue */
+  bool steady_state;
+  /**
+   * @brief 分散共分散行列Pを一周期分更新し,カルマンゲインKを計算する
+   * @return 更新前後のKの要素の変化量の最大値を,Kの要素の絶対値の最大値で割ったもの
+   */
+  float updateCovariance();
 
  public:
   KalmanFilter();
@@ -141,7 +76,76 @@ class KalmanFilter {
   float getThetaDot();
   /**
    * @brief ループ間隔を設定する
+   *
+   * 転移行列を作り直し,定常カルマンゲインは無効になります.
    * @return なし
    */
   void setDt(float);
+  /**
+   * @brief プロセスノイズの分散を設定する
+   *
+   * 定常カルマンゲインは無効になります.
+   * @param q1 角度のプロセスノイズの分散
+   * @param q2 角速度のプロセスノイズの分散
+   * @return なし
+   */
+  void setProcessNoise(float q1, float q2);
+  /**
+   * @brief 観測ノイズの分散を設定する
+   *
+   * 定常カルマンゲインは無効になります.
+   * @param r1 加速度センサから算出した角度の観測ノイズの分散
+   * @param r2 ジャイロセンサの観測ノイズの分散
+   * @return なし
+   */
+  void setObservationNoise(float r1, float r2);
+  /**
+   * @brief 定常カルマンゲインモードを設定する
+   *
+   * 有効にすると,update()の度に計算されるカルマンゲインの相対変化量がKALMAN_GAIN_TOLERANCE未満になった時点で
+   * ゲインを固定し,以降のupdate()では状態量の更新(z = F z + K (x - H F z))だけを行います.
+   * setDt(),setProcessNoise(),setObservationNoise()でパラメータが変更されると
+   * 自動的に通常のカルマンフィルタに戻り,再び収束した時点でゲインを固定します.
+   * @param enable 有効にする場合true
+   * @return なし
+   */
+  void setSteadyState(bool enable);
+  /**
+   * @brief 共分散の漸化式(リッカチ方程式)を収束するまで反復し,定常カルマンゲインを求める
+   *
+   * 観測値を用いずに共分散だけを更新するため,初期化時に呼び出せば最初のupdate()から定常ゲインで動作します.
+   * 定常カルマンゲインモードも有効になります.
+   * @return 収束までの反復回数.KALMAN_MAX_ITERATIONS回で収束しなかった場合は-1
+   * @attention 2x2行列の演算を数百回繰り返すため,制御ループの中では呼び出さないで下さい
+   */
+  int solveSteadyState();
+  /**
+   * @brief 事前に求めた定常カルマンゲインを設定する
+   *
+   * ホスト上で求めた値(tools/host/kalman_gain)を定数として与えることで,初期化時の反復を省略できます.
+   * 定常カルマンゲインモードも有効になります.
+   * @param gain カルマンゲイン
+   * @param covariance 定常状態の分散共分散行列(上三角部分 {P00, P01, P11})
+   * @return なし
+   * @attention 現在のdt,ノイズの分散で求めた値を与えて下さい
+   */
+  void setSteadyStateGain(const float gain[2][2], const float covariance[3]);
+  /**
+   * @brief カルマンゲインが固定されているかを取得する
+   * @return 定常カルマンゲインで動作している場合true
+   */
+  bool isSteadyState();
+  /**
+   * @brief 現在のカルマンゲインを取得する
+   * @param gain カルマンゲインの書き込み先
+   * @return なし
+   */
+  void getGain(float gain[2][2]);
+  /**
+   * @brief 現在の分散共分散行列を取得する
+   * @param covariance 上三角部分 {P00, P01, P11} の書き込み先
+   * @return なし
+   */
+  void getCovariance(float covariance[3]);
 };
+#endif
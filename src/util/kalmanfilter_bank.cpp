@@ -0,0 +1,121 @@
+#include "kalmanfilter_bank.h"
+#include <math.h>
+
+KalmanFilterBank::KalmanFilterBank() {
+  this->dt = 0.01;
+  for (uint8_t i = 0; i < KALMAN_BANK_LANES; i++) {
+    this->theta[i] = 0;
+    this->theta_dot[i] = 0;
+
+    this->p00[i] = 1;
+    this->p01[i] = 0;
+    this->p11[i] = 1;
+
+    this->k00[i] = 0;
+    this->k01[i] = 0;
+    this->k10[i] = 0;
+    this->k11[i] = 0;
+
+    this->q1[i] = 0.0001;
+    this->q2[i] = 0.001;
+
+    this->r1[i] = 1;
+    this->r2[i] = 1;
+  }
+  this->enable_steady_state = false;
+  this->steady_state = false;
+}
+
+void KalmanFilterBank::update(const float theta[KALMAN_BANK_AXES], const float gyro[KALMAN_BANK_AXES]) {
+  const float dt = this->dt;
+  float x[KALMAN_BANK_LANES], g[KALMAN_BANK_LANES];
+  for (uint8_t i = 0; i < KALMAN_BANK_LANES; i++) {
+    x[i] = i < KALMAN_BANK_AXES ? theta[i] : 0;
+    g[i] = i < KALMAN_BANK_AXES ? gyro[i] : 0;
+  }
+
+  if (!this->steady_state) {
+    // 各軸のゲインの変化量と大きさ(要素の絶対値の和).分岐を含めずにループをベクトル化できるようにする
+    float change[KALMAN_BANK_LANES], scale[KALMAN_BANK_LANES];
+    for (uint8_t i = 0; i < KALMAN_BANK_LANES; i++) {
+      // P = F P F.T + Q
+      float p00 = this->p00[i] + dt * (2 * this->p01[i] + dt * this->p11[i]) + this->q1[i];
+      float p01 = this->p01[i] + dt * this->p11[i];
+      float p11 = this->p11[i] + this->q2[i];
+
+      // S = P + R, K = P S^{-1}
+      float s00 = p00 + this->r1[i];
+      float s11 = p11 + this->r2[i];
+      float inv_det = 1 / (s00 * s11 - p01 * p01);
+      float k00 = (p00 * s11 - p01 * p01) * inv_det;
+      float k01 = (p01 * s00 - p00 * p01) * inv_det;
+      float k10 = (p01 * s11 - p11 * p01) * inv_det;
+      float k11 = (p11 * s00 - p01 * p01) * inv_det;
+
+      // P = (I - K) P
+      this->p00[i] = p00 - (k00 * p00 + k01 * p01);
+      this->p01[i] = p01 - (k00 * p01 + k01 * p11);
+      this->p11[i] = p11 - (k10 * p01 + k11 * p11);
+
+      change[i] = fabsf(k00 - this->k00[i]) + fabsf(k01 - this->k01[i]) + fabsf(k10 - this->k10[i]) +
+                  fabsf(k11 - this->k11[i]);
+      scale[i] = fabsf(k00) + fabsf(k01) + fabsf(k10) + fabsf(k11);
+
+      this->k00[i] = k00;
+      this->k01[i] = k01;
+      this->k10[i] = k10;
+      this->k11[i] = k11;
+    }
+    if (this->enable_steady_state) {
+      bool converged = true;
+      for (uint8_t i = 0; i < KALMAN_BANK_AXES; i++) {
+        if (change[i] >= KALMAN_GAIN_TOLERANCE * scale[i]) converged = false;
+      }
+      this->steady_state = converged;
+    }
+  }
+
+  for (uint8_t i = 0; i < KALMAN_BANK_LANES; i++) {
+    // z = F z
+    float z0 = this->theta[i] + this->theta_dot[i] * dt;
+    float z1 = this->theta_dot[i];
+
+    // z = z + K (x - z)
+    float e0 = x[i] - z0;
+    float e1 = g[i] - z1;
+    this->theta[i] = z0 + this->k00[i] * e0 + this->k01[i] * e1;
+    this->theta_dot[i] = z1 + this->k10[i] * e0 + this->k11[i] * e1;
+  }
+}
+
+float KalmanFilterBank::getTheta(uint8_t axis) { return this->theta[axis]; }
+
+float KalmanFilterBank::getThetaDot(uint8_t axis) { return this->theta_dot[axis]; }
+
+float KalmanFilterBank::getThetaVariance(uint8_t axis) { return this->p00[axis]; }
+
+void KalmanFilterBank::setTheta(uint8_t axis, float theta) { this->theta[axis] = theta; }
+
+void KalmanFilterBank::setDt(float dt) {
+  this->dt = dt;
+  this->steady_state = false;
+}
+
+void KalmanFilterBank::setProcessNoise(uint8_t axis, float q1, float q2) {
+  this->q1[axis] = q1;
+  this->q2[axis] = q2;
+  this->steady_state = false;
+}
+
+void KalmanFilterBank::setObservationNoise(uint8_t axis, float r1, float r2) {
+  this->r1[axis] = r1;
+  this->r2[axis] = r2;
+  this->steady_state = false;
+}
+
+void KalmanFilterBank::setSteadyState(bool enable) {
+  this->enable_steady_state = enable;
+  if (!enable) this->steady_state = false;
+}
+
+bool KalmanFilterBank::isSteadyState() { return this->steady_state; }
@@ -0,0 +1,124 @@
+/**
+ * @file kalmanfilter_bank.h
+ * @brief
+ * 3軸分のカルマンフィルタをまとめて更新する.
+ *
+ * 各軸の状態量,分散共分散行列,カルマンゲインを軸ごとの配列(struct-of-arrays)として保持し,
+ * 3軸を分岐のない一つのループで更新する.観測行列は単位行列に固定し,2x2行列の演算を要素ごとに展開している.
+ * 一軸あたりの計算はKalmanFilterと同じだが,共分散の更新はP = (I - K) Pで行うため,丸め誤差の範囲で結果が異なる.
+ */
+#ifndef INCLUDED_kalmanfilter_bank_h
+#define INCLUDED_kalmanfilter_bank_h
+#include <stdint.h>
+#include "kalmanfilter.h"
+
+/** KalmanFilterBankがまとめて更新する軸の数 */
+#define KALMAN_BANK_AXES 3
+#if defined(__AVR__)
+/** 内部の配列の要素数 */
+#define KALMAN_BANK_LANES KALMAN_BANK_AXES
+#else
+/** 内部の配列の要素数(ホストではSIMDレジスタの幅に揃え,余った要素も含めて一度に計算する) */
+#define KALMAN_BANK_LANES 4
+#endif
+
+class KalmanFilterBank {
+ private:
+  /** ループ間隔 初期値は0.01秒 */
+  float dt;
+  /** 状態推定値(角度) */
+  float theta[KALMAN_BANK_LANES];
+  /** 状態推定値(角速度) */
+  float theta_dot[KALMAN_BANK_LANES];
+  /** 推定量の分散共分散行列の要素 */
+  float p00[KALMAN_BANK_LANES], p01[KALMAN_BANK_LANES], p11[KALMAN_BANK_LANES];
+  /** カルマンゲインの要素 */
+  float k00[KALMAN_BANK_LANES], k01[KALMAN_BANK_LANES], k10[KALMAN_BANK_LANES], k11[KALMAN_BANK_LANES];
+  /** プロセスノイズの分散 */
+  float q1[KALMAN_BANK_LANES], q2[KALMAN_BANK_LANES];
+  /** 観測ノイズの分散 */
+  float r1[KALMAN_BANK_LANES], r2[KALMAN_BANK_LANES];
+  /** 定常カルマンゲインモードが有効ならtrue */
+  bool enable_steady_state;
+  /** 全軸のカルマンゲインが定常カルマンゲインに収束していればtrue */
+  bool steady_state;
+
+ public:
+  KalmanFilterBank();
+  /**
+   * @brief 全軸の状態量の更新
+   * @param theta 加速度センサから算出した各軸の角度 [rad]
+   * @param gyro オフセットを除いた各軸のジャイロセンサの値 [rad/s]
+   * @return なし
+   * @warning 時間間隔dtごとに呼び出して下さい。
+   */
+  void update(const float theta[KALMAN_BANK_AXES], const float gyro[KALMAN_BANK_AXES]);
+  /**
+   * @brief カルマンフィルタによって推定された角度を取得する
+   * @param axis 軸の番号 [0, KALMAN_BANK_AXES)
+   * @return カルマンフィルタによって推定された角度
+   */
+  float getTheta(uint8_t axis);
+  /**
+   * @brief カルマンフィルタによって推定された角度の推定値の分散を取得する
+   * @param axis 軸の番号 [0, KALMAN_BANK_AXES)
+   * @return カルマンフィルタによって推定された角度の推定値の分散
+   */
+  float getThetaVariance(uint8_t axis);
+  /**
+   * @brief カルマンフィルタによって推定された角速度を取得する
+   * @param axis 軸の番号 [0, KALMAN_BANK_AXES)
+   * @return カルマンフィルタによって推定された角速度
+   */
+  float getThetaDot(uint8_t axis);
+  /**
+   * @brief 角度の推定値を設定する
+   *
+   * 相補フィルタから切り替える際などに,推定値を現在の角度に合わせるために使用します.
+   * @param axis 軸の番号 [0, KALMAN_BANK_AXES)
+   * @param theta 角度 [rad]
+   * @return なし
+   */
+  void setTheta(uint8_t axis, float theta);
+  /**
+   * @brief ループ間隔を設定する
+   *
+   * 定常カルマンゲインは無効になります.
+   * @return なし
+   */
+  void setDt(float);
+  /**
+   * @brief プロセスノイズの分散を設定する
+   *
+   * 定常カルマンゲインは無効になります.
+   * @param axis 軸の番号 [0, KALMAN_BANK_AXES)
+   * @param q1 角度のプロセスノイズの分散
+   * @param q2 角速度のプロセスノイズの分散
+   * @return なし
+   */
+  void setProcessNoise(uint8_t axis, float q1, float q2);
+  /**
+   * @brief 観測ノイズの分散を設定する
+   *
+   * 定常カルマンゲインは無効になります.
+   * @param axis 軸の番号 [0, KALMAN_BANK_AXES)
+   * @param r1 加速度センサから算出した角度の観測ノイズの分散
+   * @param r2 ジャイロセンサの観測ノイズの分散
+   * @return なし
+   */
+  void setObservationNoise(uint8_t axis, float r1, float r2);
+  /**
+   * @brief 定常カルマンゲインモードを設定する
+   *
+   * KalmanFilter::setSteadyState()と同じ動作をします.全軸のゲインが収束した時点でゲインを固定します.
+   * @param enable 有効にする場合true
+   * @return なし
+   */
+  void setSteadyState(bool enable);
+  /**
+   * @brief カルマンゲインが固定されているかを取得する
+   * @return 定常カルマンゲインで動作している場合true
+   */
+  bool isSteadyState();
+};
+#endif
@@ -0,0 +1,162 @@
+#include "kalmanfilter_bias.h"
+#include <math.h>
+
+BiasKalmanFilter::BiasKalmanFilter() {
+  this->dt = 0.01;
+  this->z = Mat<3, 1>::zeros();
+
+  this->F = Mat<3, 3>::identity();
+  this->F(0, 1) = this->dt;
+
+  this->H = Mat<2, 3>::zeros();
+  this->H(0, 0) = 1;
+  this->H(1, 1) = 1;
+  this->H(1, 2) = 1;
+
+  this->P = SymMat<3>::identity();
+  this->P(2, 2) = 0.001;
+
+  this->q1 = 0.0001;
+  this->q2 = 0.001;
+  this->q3 = 1e-9;
+
+  this->r1 = 1;
+  this->r2 = 1;
+
+  this->K = Mat<3, 2>::zeros();
+  this->enable_steady_state = false;
+  this->steady_state = false;
+}
+
+float BiasKalmanFilter::updateCovariance() {
+  // P = F P F.T + Q
+  this->P = congruence(this->F, this->P);
+  this->P(0, 0) += this->q1;
+  this->P(1, 1) += this->q2;
+  this->P(2, 2) += this->q3;
+
+  // S = H P H.T + R
+  SymMat<2> S = congruence(this->H, this->P);
+  S(0, 0) += this->r1;
+  S(1, 1) += this->r2;
+
+  // K = P H.T S^{-1}
+  Mat<3, 2> K = (this->P * transpose(this->H)) * inverse(S);
+
+  // P = P - K S K.T
+  this->P = this->P - congruence(K, S);
+
+  float change = 0, scale = 0;
+  Unroll<6>::run([&](uint8_t k) MAT_BODY {
+    float d = fabs(K.a[k / 2][k % 2] - this->K.a[k / 2][k % 2]);
+    float g = fabs(K.a[k / 2][k % 2]);
+    if (d > change) change = d;
+    if (g > scale) scale = g;
+  });
+  this->K = K;
+  return scale > 0 ? change / scale : change;
+}
+
+void BiasKalmanFilter::update(float theta, float gyro) {
+  // z = F z (Fの零要素の積は展開しない)
+  this->z(0, 0) += this->z(1, 0) * this->dt;
+
+  if (!this->steady_state) {
+    float change = this->updateCovariance();
+    if (this->enable_steady_state && change < KALMAN_GAIN_TOLERANCE) this->steady_state = true;
+  }
+
+  // z = z + K (x - H z)
+  Mat<2, 1> innovation;
+  innovation(0, 0) = theta - this->z(0, 0);
+  innovation(1, 0) = gyro - (this->z(1, 0) + this->z(2, 0));
+  this->z = this->z + this->K * innovation;
+}
+
+float BiasKalmanFilter::getTheta() { return this->z(0, 0); }
+
+float BiasKalmanFilter::getThetaDot() { return this->z(1, 0); }
+
+float BiasKalmanFilter::getBias() { return this->z(2, 0); }
+
+float BiasKalmanFilter::getThetaVariance() { return this->P(0, 0); }
+
+void BiasKalmanFilter::setTheta(float theta) { this->z(0, 0) = theta; }
+
+void BiasKalmanFilter::setDt(float dt) {
+  this->dt = dt;
+  this->F(0, 1) = dt;
+  this->steady_state = false;
+}
+
+void BiasKalmanFilter::setProcessNoise(float q1, float q2, float q3) {
+  this->q1 = q1;
+  this->q2 = q2;
+  this->q3 = q3;
+  this->steady_state = false;
+}
+
+void BiasKalmanFilter::setObservationNoise(float r1, float r2) {
+  this->r1 = r1;
+  this->r2 = r2;
+  this->steady_state = false;
+}
+
+void BiasKalmanFilter::setSteadyState(bool enable) {
+  this->enable_steady_state = enable;
+  if (!enable) this->steady_state = false;
+}
+
+int BiasKalmanFilter::solveSteadyState() {
+  this->enable_steady_state = true;
+  for (int i = 1; i <= KALMAN_MAX_ITERATIONS; i++) {
+    if (this->updateCovariance() < KALMAN_GAIN_TOLERANCE) {
+      this->steady_state = true;
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool BiasKalmanFilter::isSteadyState() { return this->steady_state; }
+
+void BiasKalmanFilter::getGain(float gain[3][2]) {
+  Unroll<6>::run([&](uint8_t k) MAT_BODY { gain[k / 2][k % 2] = this->K.a[k / 2][k % 2]; });
+}
+
+void BiasKalmanFilterBank::update(const float theta[KALMAN_BIAS_AXES], const float gyro[KALMAN_BIAS_AXES]) {
+  for (uint8_t i = 0; i < KALMAN_BIAS_AXES; i++) this->axes[i].update(theta[i], gyro[i]);
+}
+
+float BiasKalmanFilterBank::getTheta(uint8_t axis) { return this->axes[axis].getTheta(); }
+
+float BiasKalmanFilterBank::getThetaVariance(uint8_t axis) { return this->axes[axis].getThetaVariance(); }
+
+float BiasKalmanFilterBank::getThetaDot(uint8_t axis) { return this->axes[axis].getThetaDot(); }
+
+float BiasKalmanFilterBank::getBias(uint8_t axis) { return this->axes[axis].getBias(); }
+
+void BiasKalmanFilterBank::setTheta(uint8_t axis, float theta) { this->axes[axis].setTheta(theta); }
+
+void BiasKalmanFilterBank::setDt(float dt) {
+  for (uint8_t i = 0; i < KALMAN_BIAS_AXES; i++) this->axes[i].setDt(dt);
+}
+
+void BiasKalmanFilterBank::setProcessNoise(uint8_t axis, float q1, float q2, float q3) {
+  this->axes[axis].setProcessNoise(q1, q2, q3);
+}
+
+void BiasKalmanFilterBank::setObservationNoise(uint8_t axis, float r1, float r2) {
+  this->axes[axis].setObservationNoise(r1, r2);
+}
+
+void BiasKalmanFilterBank::setSteadyState(bool enable) {
+  for (uint8_t i = 0; i < KALMAN_BIAS_AXES; i++) this->axes[i].setSteadyState(enable);
+}
+
+bool BiasKalmanFilterBank::isSteadyState() {
+  for (uint8_t i = 0; i < KALMAN_BIAS_AXES; i++) {
+    if (!this->axes[i].isSteadyState()) return false;
+  }
+  return true;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file kalmanfilter_bias.h
+ * @brief
+ * ジャイロのバイアスを状態量に加えたカルマンフィルタによって姿勢情報を推定する.
+ *
+ * 状態量は(角度,角速度,ジャイロのバイアス)の3つで,観測は加速度センサから算出した角度と,
+ * 角速度とバイアスの和としてのジャイロの値の2つ.観測行列は
+ *   H = [1 0 0; 0 1 1]
+ * となる.加速度由来の角度の変化とジャイロの値の差からバイアスを推定し続けるため,
+ * キャリブレーション後に温度などでオフセットが変わっても,その分が角度に残らない.
+ * 行列演算はKalmanFilterと同じくmatrix.hの次元を固定した展開済みの演算で行う.
+ */
+#ifndef INCLUDED_kalmanfilter_bias_h
+#define INCLUDED_kalmanfilter_bias_h
+#include <stdint.h>
+#include "kalmanfilter.h"
+
+/** BiasKalmanFilterBankがまとめて更新する軸の数 */
+#define KALMAN_BIAS_AXES 3
+
+class BiasKalmanFilter {
+ private:
+  /** ループ間隔 初期値は0.01秒 */
+  float dt;
+  /** 状態推定値(角度,角速度,バイアス) */
+  Mat<3, 1> z;
+  /** 推定量の分散共分散行列 */
+  SymMat<3> P;
+  /** 転移行列 */
+  Mat<3, 3> F;
+  /** 観測行列 */
+  Mat<2, 3> H;
+  /** プロセスノイズの分散 */
+  float q1, q2, q3;
+  /** 観測ノイズの分散 */
+  float r1, r2;
+  /** カルマンゲイン */
+  Mat<3, 2> K;
+  /** 定常カルマンゲインモードが有効ならtrue */
+  bool enable_steady_state;
+  /** Kが定常カルマンゲインに収束していればtrue */
+  bool steady_state;
+  /**
+   * @brief 分散共分散行列Pを一周期分更新し,カルマンゲインKを計算する
+   * @return 更新前後のKの要素の変化量の最大値を,Kの要素の絶対値の最大値で割ったもの
+   */
+  float updateCovariance();
+
+ public:
+  BiasKalmanFilter();
+  /**
+   * @brief 状態量の更新
+   *
+   * 加速度センサから算出した角度とジャイロセンサの値を用いて状態量(角度,角速度,バイアス)を更新する.
+   * @param theta 加速度センサから算出した角度 [rad]
+   * @param gyro ジャイロセンサの値 [rad/s] (キャリブレーションしたオフセットを除いた値でもよい.残りをバイアスとして推定する)
+   * @return なし
+   * @warning 時間間隔dtごとに呼び出して下さい。
+   */
+  void update(float theta, float gyro);
+  /**
+   * @brief カルマンフィルタによって推定された角度を取得する
+   * @return カルマンフィルタによって推定された角度
+   */
+  float getTheta();
+  /**
+   * @brief カルマンフィルタによって推定された角度の推定値の分散を取得する
+   * @return カルマンフィルタによって推定された角度の推定値の分散
+   */
+  float getThetaVariance();
+  /**
+   * @brief カルマンフィルタによって推定された角速度(バイアスを除いたもの)を取得する
+   * @return カルマンフィルタによって推定された角速度
+   */
+  float getThetaDot();
+  /**
+   * @brief カルマンフィルタによって推定されたジャイロのバイアスを取得する
+   * @return カルマンフィルタによって推定されたバイアス [rad/s]
+   */
+  float getBias();
+  /**
+   * @brief 角度の推定値を設定する
+   * @param theta 角度 [rad]
+   * @return なし
+   */
+  void setTheta(float theta);
+  /**
+   * @brief ループ間隔を設定する
+   *
+   * 転移行列を作り直し,定常カルマンゲインは無効になります.
+   * @return なし
+   */
+  void setDt(float);
+  /**
+   * @brief プロセスノイズの分散を設定する
+   *
+   * 定常カルマンゲインは無効になります.
+   * @param q1 角度のプロセスノイズの分散
+   * @param q2 角速度のプロセスノイズの分散
+   * @param q3 バイアスのプロセスノイズ(一周期あたりのランダムウォーク)の分散
+   * @return なし
+   */
+  void setProcessNoise(float q1, float q2, float q3);
+  /**
+   * @brief 観測ノイズの分散を設定する
+   *
+   * 定常カルマンゲインは無効になります.
+   * @param r1 加速度センサから算出した角度の観測ノイズの分散
+   * @param r2 ジャイロセンサの観測ノイズの分散
+   * @return なし
+   */
+  void setObservationNoise(float r1, float r2);
+  /**
+   * @brief 定常カルマンゲインモードを設定する
+   *
+   * KalmanFilter::setSteadyState()と同じ動作をします.
+   * @param enable 有効にする場合true
+   * @return なし
+   */
+  void setSteadyState(bool enable);
+  /**
+   * @brief 共分散の漸化式(リッカチ方程式)を収束するまで反復し,定常カルマンゲインを求める
+   *
+   * 定常カルマンゲインモードも有効になります.
+   * @return 収束までの反復回数.KALMAN_MAX_ITERATIONS回で収束しなかった場合は-1
+   * @attention 3x3行列の演算を数千回繰り返すため,制御ループの中では呼び出さないで下さい
+   */
+  int solveSteadyState();
+  /**
+   * @brief カルマンゲインが固定されているかを取得する
+   * @return 定常カルマンゲインで動作している場合true
+   */
+  bool isSteadyState();
+  /**
+   * @brief 現在のカルマンゲインを取得する
+   * @param gain カルマンゲインの書き込み先
+   * @return なし
+   */
+  void getGain(float gain[3][2]);
+};
+
+/**
+ * @class BiasKalmanFilterBank
+ * @brief
+ * 3軸分のBiasKalmanFilterをKalmanFilterBankと同じ使い方でまとめて更新する.
+ *
+ * CRAWL_KALMAN_BIASが1の場合,CrlRobotはKalmanFilterBankの代わりにこのクラスを使用する.
+ */
+class BiasKalmanFilterBank {
+ private:
+  /** 各軸のフィルタ */
+  BiasKalmanFilter axes[KALMAN_BIAS_AXES];
+
+ public:
+  /**
+   * @brief 全軸の状態量の更新
+   * @param theta 加速度センサから算出した各軸の角度 [rad]
+   * @param gyro 各軸のジャイロセンサの値 [rad/s]
+   * @return なし
+   * @warning 時間間隔dtごとに呼び出して下さい。
+   */
+  void update(const float theta[KALMAN_BIAS_AXES], const float gyro[KALMAN_BIAS_AXES]);
+  /**
+   * @brief カルマンフィルタによって推定された角度を取得する
+   * @param axis 軸の番号 [0, KALMAN_BIAS_AXES)
+   * @return カルマンフィルタによって推定された角度
+   */
+  float getTheta(uint8_t axis);
+  /**
+   * @brief カルマンフィルタによって推定された角度の推定値の分散を取得する
+   * @param axis 軸の番号 [0, KALMAN_BIAS_AXES)
+   * @return カルマンフィルタによって推定された角度の推定値の分散
+   */
+  float getThetaVariance(uint8_t axis);
+  /**
+   * @brief カルマンフィルタによって推定された角速度を取得する
+   * @param axis 軸の番号 [0, KALMAN_BIAS_AXES)
+   * @return カルマンフィルタによって推定された角速度
+   */
+  float getThetaDot(uint8_t axis);
+  /**
+   * @brief カルマンフィルタによって推定されたジャイロのバイアスを取得する
+   * @param axis 軸の番号 [0, KALMAN_BIAS_AXES)
+   * @return カルマンフィルタによって推定されたバイアス [rad/s]
+   */
+  float getBias(uint8_t axis);
+  /**
+   * @brief 角度の推定値を設定する
+   * @param axis 軸の番号 [0, KALMAN_BIAS_AXES)
+   * @param theta 角度 [rad]
+   * @return なし
+   */
+  void setTheta(uint8_t axis, float theta);
+  /**
+   * @brief ループ間隔を設定する
+   *
+   * 定常カルマンゲインは無効になります.
+   * @return なし
+   */
+  void setDt(float);
+  /**
+   * @brief プロセスノイズの分散を設定する
+   * @param axis 軸の番号 [0, KALMAN_BIAS_AXES)
+   * @param q1 角度のプロセスノイズの分散
+   * @param q2 角速度のプロセスノイズの分散
+   * @param q3 バイアスのプロセスノイズの分散
+   * @return なし
+   */
+  void setProcessNoise(uint8_t axis, float q1, float q2, float q3);
+  /**
+   * @brief 観測ノイズの分散を設定する
+   * @param axis 軸の番号 [0, KALMAN_BIAS_AXES)
+   * @param r1 加速度センサから算出した角度の観測ノイズの分散
+   * @param r2 ジャイロセンサの観測ノイズの分散
+   * @return なし
+   */
+  void setObservationNoise(uint8_t axis, float r1, float r2);
+  /**
+   * @brief 定常カルマンゲインモードを設定する
+   * @param enable 有効にする場合true
+   * @return なし
+   */
+  void setSteadyState(bool enable);
+  /**
+   * @brief カルマンゲインが固定されているかを取得する
+   * @return 全軸が定常カルマンゲインで動作している場合true
+   */
+  bool isSteadyState();
+};
+#endif
@@ -0,0 +1,11 @@
+#include "lti_filter.h"
+#include <math.h>
+
+float firstOrderLagGain(float dt, float T) {
+  float h = dt / T;
+  if (h < 0.01) {
+    // 1 - exp(-h) = h - h^2/2 + h^3/6 - h^4/24 + ... (h < 0.01で打ち切り誤差はfloatの丸め誤差以下)
+    return h * (1 - h * (1.0f / 2 - h * (1.0f / 6 - h * (1.0f / 24))));
+  }
+  return 1 - exp(-h);
+}
@@ -0,0 +1,110 @@
+/**
+ * @file lti_filter.h
+ * @brief
+ * 係数をキャッシュした離散時間線形時不変(LTI)フィルタ
+ *
+ * 伝達関数
+ *   H(z) = (b0 + b1 z^-1 + ... + bN z^-N) / (1 + a1 z^-1 + ... + aN z^-N)
+ * を転置直接形II(DF2T)で計算する.係数は設定時に一度だけ求め,一回の更新は2N+1回の乗算で済む.
+ * 次数はテンプレート引数として与え,ループはコンパイル時に展開される.
+ *
+ * 連続時間の一次遅れ 1/(Ts+1) は,入力を一周期の間一定とみなすと厳密に
+ *   y[k] = p y[k-1] + (1 - p) x[k],  p = exp(-dt/T)
+ * と離散化できる.FirstOrderFilter,LaggedDerivativeはこの形の一次のフィルタとして実装している.
+ */
+#ifndef INCLUDED_lti_filter_h
+#define INCLUDED_lti_filter_h
+#include <stdint.h>
+#include "matrix.h"
+
+/**
+ * @brief 一次遅れを厳密に離散化した際の更新係数 1 - exp(-dt/T) を求める
+ *
+ * dt/Tが小さい場合も桁落ちしないよう級数展開で計算する.
+ * @param dt サンプリング時間 単位:秒
+ * @param T 時定数 単位:秒
+ * @return 更新係数 (0, 1]
+ */
+float firstOrderLagGain(float dt, float T);
+
+/**
+ * @class LtiFilter
+ * @brief
+ * N次の離散時間LTIフィルタ(転置直接形II)
+ *
+ * 初期状態は入力をそのまま出力する(b0 = 1,その他の係数は0).
+ */
+template <uint8_t N>
+class LtiFilter {
+  /// @cond develop
+ protected:
+  /** 分子の係数 b0〜bN */
+  float b[N + 1];
+  /** 分母の係数 a1〜aN (a0 = 1) */
+  float a[N];
+  /** 内部状態 */
+  float s[N];
+  /** 出力値 */
+  float y;
+  /// @endcond
+ public:
+  LtiFilter() {
+    Unroll<N + 1>::run([&](uint8_t i) MAT_BODY { this->b[i] = i == 0 ? 1 : 0; });
+    Unroll<N>::run([&](uint8_t i) MAT_BODY { this->a[i] = 0; });
+    reset();
+  }
+  /**
+   * @brief 係数を設定する
+   *
+   * 内部状態は変更しません.
+   * @param b 分子の係数 b0〜bN
+   * @param a 分母の係数 a1〜aN
+   * @return なし
+   */
+  void setCoefficients(const float b[N + 1], const float a[N]) {
+    Unroll<N + 1>::run([&](uint8_t i) MAT_BODY { this->b[i] = b[i]; });
+    Unroll<N>::run([&](uint8_t i) MAT_BODY { this->a[i] = a[i]; });
+  }
+  /**
+   * @brief 内部状態と出力値を0にする
+   * @return なし
+   */
+  void reset() {
+    Unroll<N>::run([&](uint8_t i) MAT_BODY { this->s[i] = 0; });
+    this->y = 0;
+  }
+  /**
+   * @brief 内部状態を設定する
+   * @param i 内部状態の番号 [0, N)
+   * @param value 設定する値
+   * @return なし
+   */
+  void setState(uint8_t i, float value) { this->s[i] = value; }
+  /**
+   * @brief 内部状態を取得する
+   * @param i 内部状態の番号 [0, N)
+   * @return 内部状態の値
+   */
+  float getState(uint8_t i) { return this->s[i]; }
+  /**
+   * @brief 入力から出力を計算する
+   * @param x 入力値
+   * @return 出力値
+   */
+  float calculate(float x) {
+    float y = this->b[0] * x + this->s[0];
+    Unroll<N - 1>::run([&](uint8_t i) MAT_BODY { this->s[i] = this->b[i + 1] * x - this->a[i] * y + this->s[i + 1]; });
+    this->s[N - 1] = this->b[N] * x - this->a[N - 1] * y;
+    this->y = y;
+    return y;
+  }
+  /**
+   * @brief 出力値を取得する
+   * @return 最後に計算した出力値
+   */
+  float getOutput() { return this->y; }
+};
+
+/** 二次のLTIフィルタ(バイクアッドフィルタ) */
+typedef LtiFilter<2> Biquad;
+#endif
@@ -0,0 +1,231 @@
+/**
+ * @file matrix.h
+ * @brief
+ * 次元をコンパイル時に固定した小さな行列の演算
+ *
+ * ループはテンプレートによりコンパイル時に展開されるため,最適化レベル(-Os)によらず
+ * 分岐やインデックス計算を含まない直線的なコードになる.
+ * 一時領域の大きさもコンパイル時に決まり,可変長配列は使用しない.
+ *
+ * 対称行列SymMatは上三角部分N(N+1)/2要素だけを保持し,
+ * A P A^Tのように結果が対称になる演算では上三角部分だけを計算する.
+ */
+#ifndef INCLUDED_matrix_h
+#define INCLUDED_matrix_h
+#include <stdint.h>
+
+/** 行列演算を呼び出し元へ強制的に展開する */
+#define MAT_INLINE inline __attribute__((always_inline))
+/** ループ本体(ラムダ式)を呼び出し元へ強制的に展開する */
+#define MAT_BODY __attribute__((always_inline))
+
+/**
+ * @brief 0〜N-1の各インデックスについて関数fを呼び出す(コンパイル時展開)
+ */
+template <uint8_t N>
+struct Unroll {
+  template <typename F>
+  static MAT_INLINE void run(F f) {
+    Unroll<N - 1>::run(f);
+    f(N - 1);
+  }
+};
+template <>
+struct Unroll<0> {
+  template <typename F>
+  static MAT_INLINE void run(F) {}
+};
+
+/**
+ * @struct Mat
+ * @brief
+ * R行C列の行列
+ */
+template <uint8_t R, uint8_t C>
+struct Mat {
+  /** 要素 */
+  float a[R][C];
+
+  MAT_INLINE float& operator()(uint8_t i, uint8_t j) { return a[i][j]; }
+  MAT_INLINE const float& operator()(uint8_t i, uint8_t j) const { return a[i][j]; }
+
+  /** 零行列 */
+  static Mat zeros() {
+    Mat m;
+    Unroll<R * C>::run([&](uint8_t k) MAT_BODY { m.a[k / C][k % C] = 0; });
+    return m;
+  }
+  /** 単位行列 */
+  static Mat identity() {
+    Mat m;
+    Unroll<R>::run([&](uint8_t i) MAT_BODY {
+      Unroll<C>::run([&](uint8_t j) MAT_BODY { m.a[i][j] = i == j ? 1 : 0; });
+    });
+    return m;
+  }
+};
+
+/**
+ * @struct SymMat
+ * @brief
+ * N行N列の対称行列.上三角部分だけを保持する.
+ */
+template <uint8_t N>
+struct SymMat {
+  /** 上三角部分の要素(行優先) */
+  float a[N * (N + 1) / 2];
+
+  /** (i, j)要素の格納位置 */
+  static MAT_INLINE uint8_t index(uint8_t i, uint8_t j) {
+    return i <= j ? i * N - i * (i - 1) / 2 + (j - i) : j * N - j * (j - 1) / 2 + (i - j);
+  }
+  MAT_INLINE float& operator()(uint8_t i, uint8_t j) { return a[index(i, j)]; }
+  MAT_INLINE const float& operator()(uint8_t i, uint8_t j) const {
+    return a[index(i, j)];
+  }
+
+  /** 零行列 */
+  static SymMat zeros() {
+    SymMat m;
+    Unroll<N * (N + 1) / 2>::run([&](uint8_t k) MAT_BODY { m.a[k] = 0; });
+    return m;
+  }
+  /** 単位行列 */
+  static SymMat identity() {
+    SymMat m = zeros();
+    Unroll<N>::run([&](uint8_t i) MAT_BODY { m(i, i) = 1; });
+    return m;
+  }
+};
+
+/** 行列の和 A + B */
+template <uint8_t R, uint8_t C>
+MAT_INLINE Mat<R, C> operator+(const Mat<R, C>& A, const Mat<R, C>& B) {
+  Mat<R, C> D;
+  Unroll<R * C>::run([&](uint8_t k) MAT_BODY { D.a[k / C][k % C] = A.a[k / C][k % C] + B.a[k / C][k % C]; });
+  return D;
+}
+
+/** 行列の差 A - B */
+template <uint8_t R, uint8_t C>
+MAT_INLINE Mat<R, C> operator-(const Mat<R, C>& A, const Mat<R, C>& B) {
+  Mat<R, C> D;
+  Unroll<R * C>::run([&](uint8_t k) MAT_BODY { D.a[k / C][k % C] = A.a[k / C][k % C] - B.a[k / C][k % C]; });
+  return D;
+}
+
+/** 行列の積 A B */
+template <uint8_t R, uint8_t P, uint8_t C>
+MAT_INLINE Mat<R, C> operator*(const Mat<R, P>& A, const Mat<P, C>& B) {
+  Mat<R, C> D;
+  Unroll<R>::run([&](uint8_t i) MAT_BODY {
+    Unroll<C>::run([&](uint8_t j) MAT_BODY {
+      float sum = 0;
+      Unroll<P>::run([&](uint8_t k) MAT_BODY { sum += A.a[i][k] * B.a[k][j]; });
+      D.a[i][j] = sum;
+    });
+  });
+  return D;
+}
+
+/** 対称行列と行列の積 P B */
+template <uint8_t N, uint8_t C>
+MAT_INLINE Mat<N, C> operator*(const SymMat<N>& P, const Mat<N, C>& B) {
+  Mat<N, C> D;
+  Unroll<N>::run([&](uint8_t i) MAT_BODY {
+    Unroll<C>::run([&](uint8_t j) MAT_BODY {
+      float sum = 0;
+      Unroll<N>::run([&](uint8_t k) MAT_BODY { sum += P(i, k) * B.a[k][j]; });
+      D.a[i][j] = sum;
+    });
+  });
+  return D;
+}
+
+/** 行列と対称行列の積 A P */
+template <uint8_t R, uint8_t N>
+MAT_INLINE Mat<R, N> operator*(const Mat<R, N>& A, const SymMat<N>& P) {
+  Mat<R, N> D;
+  Unroll<R>::run([&](uint8_t i) MAT_BODY {
+    Unroll<N>::run([&](uint8_t j) MAT_BODY {
+      float sum = 0;
+      Unroll<N>::run([&](uint8_t k) MAT_BODY { sum += A.a[i][k] * P(k, j); });
+      D.a[i][j] = sum;
+    });
+  });
+  return D;
+}
+
+/** 対称行列の和 A + B */
+template <uint8_t N>
+MAT_INLINE SymMat<N> operator+(const SymMat<N>& A, const SymMat<N>& B) {
+  SymMat<N> D;
+  Unroll<N * (N + 1) / 2>::run([&](uint8_t k) MAT_BODY { D.a[k] = A.a[k] + B.a[k]; });
+  return D;
+}
+
+/** 対称行列の差 A - B */
+template <uint8_t N>
+MAT_INLINE SymMat<N> operator-(const SymMat<N>& A, const SymMat<N>& B) {
+  SymMat<N> D;
+  Unroll<N * (N + 1) / 2>::run([&](uint8_t k) MAT_BODY { D.a[k] = A.a[k] - B.a[k]; });
+  return D;
+}
+
+/** 転置行列 A^T */
+template <uint8_t R, uint8_t C>
+MAT_INLINE Mat<C, R> transpose(const Mat<R, C>& A) {
+  Mat<C, R> D;
+  Unroll<R>::run([&](uint8_t i) MAT_BODY {
+    Unroll<C>::run([&](uint8_t j) MAT_BODY { D.a[j][i] = A.a[i][j]; });
+  });
+  return D;
+}
+
+/** 対称行列の合同変換 A P A^T (上三角部分だけを計算する) */
+template <uint8_t R, uint8_t N>
+MAT_INLINE SymMat<R> congruence(const Mat<R, N>& A, const SymMat<N>& P) {
+  Mat<R, N> AP = A * P;
+  SymMat<R> D;
+  Unroll<R>::run([&](uint8_t i) MAT_BODY {
+    Unroll<R>::run([&](uint8_t j) MAT_BODY {
+      if (j < i) return;
+      float sum = 0;
+      Unroll<N>::run([&](uint8_t k) MAT_BODY { sum += AP.a[i][k] * A.a[j][k]; });
+      D(i, j) = sum;
+    });
+  });
+  return D;
+}
+
+/** 1行1列の対称行列の逆行列 */
+MAT_INLINE SymMat<1> inverse(const SymMat<1>& A) {
+  SymMat<1> B;
+  B.a[0] = 1 / A.a[0];
+  return B;
+}
+
+/** 2行2列の対称行列の逆行列 */
+MAT_INLINE SymMat<2> inverse(const SymMat<2>& A) {
+  SymMat<2> B;
+  float inv_det = 1 / (A(0, 0) * A(1, 1) - A(0, 1) * A(0, 1));
+  B(0, 0) = A(1, 1) * inv_det;
+  B(0, 1) = -A(0, 1) * inv_det;
+  B(1, 1) = A(0, 0) * inv_det;
+  return B;
+}
+
+/** 3行3列の対称行列の逆行列(余因子展開) */
+MAT_INLINE SymMat<3> inverse(const SymMat<3>& A) {
+  SymMat<3> B;
+  B(0, 0) = A(1, 1) * A(2, 2) - A(1, 2) * A(1, 2);
+  B(0, 1) = A(0, 2) * A(1, 2) - A(0, 1) * A(2, 2);
+  B(0, 2) = A(0, 1) * A(1, 2) - A(0, 2) * A(1, 1);
+  B(1, 1) = A(0, 0) * A(2, 2) - A(0, 2) * A(0, 2);
+  B(1, 2) = A(0, 1) * A(0, 2) - A(0, 0) * A(1, 2);
+  B(2, 2) = A(0, 0) * A(1, 1) - A(0, 1) * A(0, 1);
+  float inv_det = 1 / (A(0, 0) * B(0, 0) + A(0, 1) * B(0, 1) + A(0, 2) * B(0, 2));
+  Unroll<6>::run([&](uint8_t k) MAT_BODY { B.a[k] *= inv_det; });
+  return B;
+}
+#endif
@@ -0,0 +1,75 @@
+#include "profiler.h"
+#if CRAWL_PROFILER
+#include <string.h>
+#include "hal.h"
+#include "telemetry.h"
+
+static_assert(sizeof(CrlProfileFrame) <= TELEMETRY_MAX_PAYLOAD, "CrlProfileFrame does not fit in a telemetry frame");
+
+/** フェーズごとの計測結果 */
+static HAL_THREAD_LOCAL CrlProfile profiles[CRAWL_PHASE_COUNT];
+/** ループ内の処理が設定した周期を超えた回数 */
+static HAL_THREAD_LOCAL uint16_t overruns;
+/** 次にprofilerSend()で送るフェーズ */
+static HAL_THREAD_LOCAL uint8_t send_phase;
+
+/** 時間をヒストグラムの区間に変換する */
+static uint8_t bucketOf(unsigned long us) {
+  uint8_t bucket = 0;
+  us >>= PROFILER_BUCKET_SHIFT;
+  while (us != 0 && bucket < PROFILER_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static void addSample(uint8_t phase, unsigned long us, unsigned long histogram_us) {
+  CrlProfile* profile = &profiles[phase];
+  uint16_t value = us > 0xFFFF ? 0xFFFF : us;
+  if (profile->count == 0 || value < profile->min) profile->min = value;
+  if (value > profile->max) profile->max = value;
+  profile->count++;
+  profile->sum += us;
+  uint8_t bucket = bucketOf(histogram_us);
+  if (profile->histogram[bucket] != 0xFFFF) profile->histogram[bucket]++;
+}
+
+void profilerAdd(uint8_t phase, unsigned long us) { addSample(phase, us, us); }
+
+unsigned long profilerLap(uint8_t phase, unsigned long since) {
+  unsigned long now = halMicros();
+  addSample(phase, now - since, now - since);
+  return now;
+}
+
+void profilerAddPeriod(unsigned long period, unsigned long dt, bool overrun) {
+  addSample(CRAWL_PHASE_PERIOD, period, period > dt ? period - dt : dt - period);
+  if (overrun && overruns != 0xFFFF) overruns++;
+}
+
+void profilerGet(uint8_t phase, CrlProfile* profile) {
+  uint8_t state = halEnterCritical();  // I2C読み出しのフェーズは割り込みの中で更新される
+  memcpy(profile, &profiles[phase], sizeof(CrlProfile));
+  halExitCritical(state);
+}
+
+uint16_t profilerGetOverruns() { return overruns; }
+
+void profilerReset() {
+  uint8_t state = halEnterCritical();
+  memset(profiles, 0, sizeof(profiles));
+  overruns = 0;
+  halExitCritical(state);
+}
+
+bool profilerSend() {
+  CrlProfileFrame frame;
+  frame.phase = send_phase;
+  frame.overruns = overruns;
+  profilerGet(send_phase, &frame.profile);
+  if (!telemetrySend(TELEMETRY_PROFILE, &frame, sizeof(frame))) return false;
+  if (++send_phase == CRAWL_PHASE_COUNT) send_phase = 0;
+  return true;
+}
+#endif
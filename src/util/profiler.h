@@ -0,0 +1,131 @@
+/**
+ * @file profiler.h
+ * @brief
+ * 制御ループの処理時間の計測(プロファイラ)
+ *
+ * updateState()の各処理(フェーズ)の時間,バックグラウンドで行うI2C読み出しの時間,
+ * ループ内の処理時間とループ周期を計測し,フェーズごとに最小・最大・平均とヒストグラムを保持する.
+ * ループ周期のヒストグラムは,周期そのものではなく設定した周期からのずれ(ジッタ)の絶対値を数える.
+ *
+ * ヒストグラムの区間は4マイクロ秒(AVRのmicros()の分解能)から倍々に広がる.
+ * 区間iは[4*2^(i-1), 4*2^i)マイクロ秒で,区間0は4マイクロ秒未満,最後の区間はそれ以上の全てを数える.
+ *
+ * I2C読み出しのフェーズは割り込みの中で記録される.profilerGet()は割り込みを禁止してコピーする.
+ * CRAWL_PROFILERが0の場合,関数は組み込まれない.
+ */
+#ifndef INCLUDED_profiler_h
+#define INCLUDED_profiler_h
+#include <stdint.h>
+#include "crawl_config.h"
+
+/** フェーズ: 姿勢センサのI2C読み出し(バックグラウンド) */
+#define CRAWL_PHASE_IMU_READ 0
+/** フェーズ: 地磁気センサのI2C読み出し(バックグラウンド) */
+#define CRAWL_PHASE_MAG_READ 1
+/** フェーズ: エンコーダのI2C読み出し(バックグラウンド) */
+#define CRAWL_PHASE_ENCODER_READ 2
+/** フェーズ: 読み出し結果の取り出し(takeAcquisition()) */
+#define CRAWL_PHASE_ACQUIRE 3
+/** フェーズ: モータ指令の送信(I2Cトランザクションの投入) */
+#define CRAWL_PHASE_MOTOR_WRITE 4
+/** フェーズ: センサ値の換算(calcState()) */
+#define CRAWL_PHASE_CALC_STATE 5
+/** フェーズ: 姿勢角度の計算(相補フィルタとカルマンフィルタ) */
+#define CRAWL_PHASE_THETA 6
+/** フェーズ: 上端速度の計算(calcHeadVelocity()) */
+#define CRAWL_PHASE_HEAD_VELOCITY 7
+/** フェーズ: updateState()全体 */
+#define CRAWL_PHASE_UPDATE 8
+/** フェーズ: realtimeLoop()から戻って次に呼び出すまでのループ内の処理 */
+#define CRAWL_PHASE_LOAD 9
+/** フェーズ: ループ周期(ヒストグラムは設定した周期からのずれ) */
+#define CRAWL_PHASE_PERIOD 10
+/** フェーズの数 */
+#define CRAWL_PHASE_COUNT 11
+
+/** ヒストグラムの区間の数 */
+#define PROFILER_BUCKETS 10
+/** ヒストグラムの最初の区間の幅(2のべき乗の指数) 単位:マイクロ秒 */
+#define PROFILER_BUCKET_SHIFT 2
+
+/**
+ * @struct CrlProfile
+ * @brief
+ * 一つのフェーズの計測結果
+ */
+struct CrlProfile {
+  /** 計測回数 */
+  uint32_t count;
+  /** 時間の合計(countで割ると平均) 単位:マイクロ秒 */
+  uint32_t sum;
+  /** 最小値 単位:マイクロ秒 */
+  uint16_t min;
+  /** 最大値(65535で飽和) 単位:マイクロ秒 */
+  uint16_t max;
+  /** ヒストグラム(各区間65535で飽和) */
+  uint16_t histogram[PROFILER_BUCKETS];
+} __attribute__((packed));
+
+/**
+ * @struct CrlProfileFrame
+ * @brief
+ * テレメトリ(種類TELEMETRY_PROFILE)で送る内容
+ */
+struct CrlProfileFrame {
+  /** フェーズ(CRAWL_PHASE_*) */
+  uint8_t phase;
+  /** 周期を超過した回数 */
+  uint16_t overruns;
+  /** 計測結果 */
+  CrlProfile profile;
+} __attribute__((packed));
+
+#if CRAWL_PROFILER
+/**
+ * @brief フェーズの時間を記録する
+ * @param phase フェーズ(CRAWL_PHASE_*)
+ * @param us 時間 単位:マイクロ秒
+ * @return なし
+ */
+void profilerAdd(uint8_t phase, unsigned long us);
+/**
+ * @brief sinceから現在までの時間をフェーズの時間として記録する
+ * @param phase フェーズ(CRAWL_PHASE_*)
+ * @param since フェーズの開始時刻(halMicros()) 単位:マイクロ秒
+ * @return 現在時刻(次のフェーズの開始時刻として使う) 単位:マイクロ秒
+ */
+unsigned long profilerLap(uint8_t phase, unsigned long since);
+/**
+ * @brief ループ周期を記録する
+ * @param period 周期 単位:マイクロ秒
+ * @param dt 設定した周期 単位:マイクロ秒
+ * @param overrun ループ内の処理が設定した周期を超えた場合true
+ * @return なし
+ */
+void profilerAddPeriod(unsigned long period, unsigned long dt, bool overrun);
+/**
+ * @brief フェーズの計測結果を取得する
+ * @param phase フェーズ(CRAWL_PHASE_*)
+ * @param profile 書き込み先
+ * @return なし
+ */
+void profilerGet(uint8_t phase, CrlProfile* profile);
+/**
+ * @brief ループ内の処理が設定した周期を超えた回数を取得する
+ * @return 回数
+ */
+uint16_t profilerGetOverruns();
+/**
+ * @brief 全ての計測結果を消去する
+ * @return なし
+ */
+void profilerReset();
+/**
+ * @brief 次のフェーズの計測結果をテレメトリで送る
+ *
+ * 呼び出すたびにフェーズを一つずつ順に送る.UARTの送信リングバッファに空きがない場合は送らない.
+ * @return 送った場合true
+ */
+bool profilerSend();
+#endif
+#endif
@@ -0,0 +1,149 @@
+#include "scheduler.h"
+#if CRAWL_SCHEDULER
+#include <string.h>
+#include "hal.h"
+
+/** 周期をタイマ割り込みの回数に丸める(0より大きい周期は少なくとも1回) */
+static uint16_t toTicks(unsigned long period_us) {
+  unsigned long ticks = (period_us + CRAWL_SCHEDULER_TICK_US / 2) / CRAWL_SCHEDULER_TICK_US;
+  if (ticks == 0 && period_us > 0) ticks = 1;
+  return ticks > 0xFFFF ? 0xFFFF : ticks;
+}
+
+Scheduler::Scheduler() : count(1) {
+  memset(this->tasks, 0, sizeof(this->tasks));
+  this->tasks[SCHEDULER_LOOP_TASK].priority = 0xFF;
+}
+
+void Scheduler::begin() { halTimerBegin(CRAWL_SCHEDULER_TICK_US, onTick, this); }
+
+void Scheduler::onTick(void* context) { ((Scheduler*)context)->tick(); }
+
+void Scheduler::tick() {
+  unsigned long now = halMicros();
+  for (uint8_t i = 0; i < this->count; i++) {
+    Task* task = &this->tasks[i];
+    if (task->period == 0 || --task->countdown != 0) continue;
+    task->countdown = task->period;
+    releaseTask(task, now);
+  }
+  // 割り込みタスクは,ループ内の処理や他のタスクの実行中でも解放した割り込みの中で実行する
+  for (Task* task; (task = takeNext(true)) != NULL;) run(task);
+}
+
+void Scheduler::releaseTask(Task* task, unsigned long now) {
+  if (task->pending) {
+    if (task->stats.skipped != 0xFFFF) task->stats.skipped++;
+  } else {
+    task->release_at = now;
+    task->pending = true;
+  }
+}
+
+void Scheduler::release(uint8_t id) { releaseTask(&this->tasks[id], halMicros()); }
+
+void Scheduler::setDeadline(uint8_t id, unsigned long deadline_us) {
+  uint8_t state = halEnterCritical();
+  this->tasks[id].deadline = deadline_us;
+  halExitCritical(state);
+}
+
+int8_t Scheduler::addTask(void (*function)(), unsigned long period_us, uint8_t priority, unsigned long deadline_us) {
+  if (function == NULL || this->count > CRAWL_SCHEDULER_TASKS) return SCHEDULER_NO_TASK;
+  uint8_t id = this->count;
+  Task* task = &this->tasks[id];
+  task->function = function;
+  task->priority = priority;
+  task->deadline = deadline_us;
+  setPeriod(id, period_us);
+  uint8_t state = halEnterCritical();
+  this->count++;  // 設定を終えてから割り込みに見せる
+  halExitCritical(state);
+  return id;
+}
+
+void Scheduler::setPeriod(uint8_t id, unsigned long period_us) {
+  uint16_t ticks = toTicks(period_us);
+  uint8_t state = halEnterCritical();
+  this->tasks[id].period = ticks;
+  this->tasks[id].countdown = ticks;
+  halExitCritical(state);
+}
+
+bool Scheduler::isPeriodic(uint8_t id) { return this->tasks[id].period != 0; }
+
+bool Scheduler::take(uint8_t id) {
+  Task* task = &this->tasks[id];
+  uint8_t state = halEnterCritical();
+  bool released = task->pending;
+  if (released) {
+    task->pending = false;
+    task->started_release = task->release_at;
+    task->running = true;
+  }
+  halExitCritical(state);
+  return released;
+}
+
+void Scheduler::finish(uint8_t id, unsigned long now) {
+  Task* task = &this->tasks[id];
+  if (task->running) complete(task, now);
+}
+
+void Scheduler::complete(Task* task, unsigned long finish) {
+  unsigned long response = finish - task->started_release;
+  unsigned long deadline = task->deadline ? task->deadline : (unsigned long)task->period * CRAWL_SCHEDULER_TICK_US;
+  uint8_t state = halEnterCritical();  // skippedは割り込みの中で更新される
+  task->running = false;
+  task->stats.runs++;
+  if (response > task->stats.max_response) task->stats.max_response = response;
+  if (deadline != 0 && response > deadline && task->stats.missed != 0xFFFF) task->stats.missed++;
+  halExitCritical(state);
+}
+
+Scheduler::Task* Scheduler::takeNext(bool interrupt) {
+  Task* next = NULL;
+  uint8_t state = halEnterCritical();
+  for (uint8_t i = SCHEDULER_LOOP_TASK + 1; i < this->count; i++) {
+    Task* task = &this->tasks[i];
+    if ((task->priority >= SCHEDULER_INTERRUPT_PRIORITY) != interrupt) continue;
+    if (task->pending && (next == NULL || task->priority > next->priority)) next = task;
+  }
+  if (next != NULL) {
+    next->pending = false;
+    next->started_release = next->release_at;
+    next->running = true;
+  }
+  halExitCritical(state);
+  return next;
+}
+
+void Scheduler::run(Task* task) {
+  task->function();
+  complete(task, halMicros());
+}
+
+bool Scheduler::runNext() {
+  Task* next = takeNext(false);
+  if (next == NULL) return false;
+  run(next);
+  return true;
+}
+
+void Scheduler::idle() {
+  uint8_t state = halEnterCritical();
+  for (uint8_t i = 0; i < this->count; i++) {
+    if (this->tasks[i].pending) {
+      halExitCritical(state);
+      return;
+    }
+  }
+  halSleep();  // 割り込みを許可すると同時に休止する
+}
+
+void Scheduler::getStats(uint8_t id, CrlTaskStats* stats) {
+  uint8_t state = halEnterCritical();
+  memcpy(stats, &this->tasks[id].stats, sizeof(CrlTaskStats));
+  halExitCritical(state);
+}
+#endif
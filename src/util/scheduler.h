@@ -0,0 +1,186 @@
+/**
+ * @file scheduler.h
+ * @brief
+ * タイマ割り込みで周期タスクを解放するスケジューラ
+ *
+ * タイマ割り込み(CRAWL_SCHEDULER_TICK_USごと)で各タスクの周期を数え,周期の境界でタスクを解放(実行待ちに)する.
+ * 優先度がSCHEDULER_INTERRUPT_PRIORITY以上のタスク(割り込みタスク)は,解放したタイマ割り込みの中で
+ * 優先度の高い順にそのまま実行するため,ループ内の処理やupdateState(),他のタスクの実行中でも周期どおりに実行される.
+ * それ以外のタスクの関数はメインの処理(runNext())から優先度の高い順に,最後まで実行される(割り込みタスク以外には
+ * 割り込まれない).実行できるタスクがなければidle()でCPUを休止させる.
+ * runNext()はrealtimeLoop()の待ち時間にだけ呼ばれるため,割り込みタスク以外でループ内の処理より短い周期のタスクは,
+ * その間の解放のうち一回しか実行されない.
+ *
+ * タスク0(SCHEDULER_LOOP_TASK)は関数を持たず,CrlRobot::realtimeLoop()が周期の境界を待つために使用する.
+ * 各タスクについて,解放から完了までの時間(応答時間)と,期限を過ぎた回数,前の解放が実行されないうちに
+ * 次の解放が来て実行されなかった回数を数える.
+ * CRAWL_SCHEDULERが0の場合,Schedulerは組み込まれない.
+ */
+#ifndef INCLUDED_scheduler_h
+#define INCLUDED_scheduler_h
+#include <stdint.h>
+#include "crawl_config.h"
+
+/** realtimeLoop()の周期を表すタスクの番号 */
+#define SCHEDULER_LOOP_TASK 0
+/** addTask()でタスクを追加できなかった場合の戻り値 */
+#define SCHEDULER_NO_TASK -1
+/**
+ * タイマ割り込みの中で実行するタスクの優先度の下限
+ *
+ * 割り込みタスクは割り込みを禁止したまま実行されるため,I2Cの完了を待つ関数やシリアル通信の送信を待つ関数を
+ * 呼ばず,処理時間はCRAWL_SCHEDULER_TICK_USより十分短く(数十マイクロ秒程度)すること.
+ * 処理時間の分だけI2Cの割り込みの応答が遅れる.
+ */
+#define SCHEDULER_INTERRUPT_PRIORITY 128
+
+/**
+ * @struct CrlTaskStats
+ * @brief
+ * タスクの実行状況
+ */
+struct CrlTaskStats {
+  /** 実行回数 */
+  uint32_t runs;
+  /** 完了が期限を過ぎた回数 */
+  uint16_t missed;
+  /** 前の解放が実行されないうちに次の解放が来て,実行されなかった回数 */
+  uint16_t skipped;
+  /** 解放から完了までの時間の最大値 単位:マイクロ秒 */
+  uint32_t max_response;
+};
+
+#if CRAWL_SCHEDULER
+/**
+ * @class Scheduler
+ * @brief
+ * 周期タスクのスケジューラ
+ */
+class Scheduler {
+  /// @cond develop
+  /** タスク */
+  struct Task {
+    /** 実行する関数(SCHEDULER_LOOP_TASKではNULL) */
+    void (*function)();
+    /** 周期 単位:タイマ割り込みの回数 (0は停止) */
+    uint16_t period;
+    /** 次の解放までのタイマ割り込みの回数 */
+    uint16_t countdown;
+    /** 優先度(大きいほど先に実行する) */
+    uint8_t priority;
+    /** 解放されて実行を待っているか */
+    volatile bool pending;
+    /** 実行中(SCHEDULER_LOOP_TASKでは解放を受け取ってからfinish()まで)か */
+    bool running;
+    /** 解放された時刻 単位:マイクロ秒 */
+    volatile unsigned long release_at;
+    /** 実行中の解放の時刻 単位:マイクロ秒 */
+    unsigned long started_release;
+    /** 期限(解放からの時間) 単位:マイクロ秒 (0は周期と同じ) */
+    unsigned long deadline;
+    /** 実行状況 */
+    CrlTaskStats stats;
+  };
+  /** タスク.先頭はSCHEDULER_LOOP_TASK */
+  Task tasks[CRAWL_SCHEDULER_TASKS + 1];
+  /** 登録済みのタスクの数 */
+  uint8_t count;
+
+  /** タイマ割り込みから呼ばれる */
+  static void onTick(void* context);
+  /** 周期を数えてタスクを解放し,解放された割り込みタスクを実行する */
+  void tick();
+  /**
+   * 解放されているタスクのうち,割り込みタスク(interruptがtrue)かそれ以外で最も優先度の高いものを実行中にする
+   * @return 実行中にしたタスク.なければNULL
+   */
+  Task* takeNext(bool interrupt);
+  /** 実行中にしたタスクを実行し,実行状況を更新する */
+  void run(Task* task);
+  /** タスクを解放する.前の解放が実行待ちのままなら実行されなかった回数を数える */
+  void releaseTask(Task* task, unsigned long now);
+  /** 実行を終えたタスクの実行状況を更新する */
+  void complete(Task* task, unsigned long finish);
+  /// @endcond
+ public:
+  Scheduler();
+  /**
+   * @brief タイマ割り込みを開始する
+   * @return なし
+   */
+  void begin();
+  /**
+   * @brief 周期タスクを追加する
+   * @param function 実行する関数
+   * @param period_us 周期 単位:マイクロ秒 (CRAWL_SCHEDULER_TICK_USの整数倍に丸める)
+   * @param priority 優先度(大きいほど先に実行する).SCHEDULER_INTERRUPT_PRIORITY以上はタイマ割り込みの中で実行する
+   * @param deadline_us 期限(解放からの時間) 単位:マイクロ秒 (0の場合は周期と同じ)
+   * @return タスクの番号.追加できない場合はSCHEDULER_NO_TASK
+   */
+  int8_t addTask(void (*function)(), unsigned long period_us, uint8_t priority, unsigned long deadline_us = 0);
+  /**
+   * @brief タスクの周期を設定する
+   *
+   * 次の解放は設定した時点から一周期後になります.
+   * @param id タスクの番号
+   * @param period_us 周期 単位:マイクロ秒 (0の場合は停止)
+   * @return なし
+   */
+  void setPeriod(uint8_t id, unsigned long period_us);
+  /**
+   * @brief タスクの周期が0より大きいか調べる
+   * @param id タスクの番号
+   * @return 周期が設定されていればtrue
+   */
+  bool isPeriodic(uint8_t id);
+  /**
+   * @brief タスクを解放する
+   *
+   * 周期を0にしたタスクを,タイマ以外の割り込み(姿勢センサのデータレディなど)から解放するために使用します.
+   * 割り込みの中から呼び出せます.
+   * @param id タスクの番号
+   * @return なし
+   */
+  void release(uint8_t id);
+  /**
+   * @brief タスクの期限を設定する
+   * @param id タスクの番号
+   * @param deadline_us 期限(解放からの時間) 単位:マイクロ秒 (0の場合は周期と同じ)
+   * @return なし
+   */
+  void setDeadline(uint8_t id, unsigned long deadline_us);
+  /**
+   * @brief 関数を持たないタスク(SCHEDULER_LOOP_TASK)の解放を受け取る
+   *
+   * 解放されていれば実行中とし,finish()で完了とします.
+   * @param id タスクの番号
+   * @return 解放されていればtrue
+   */
+  bool take(uint8_t id);
+  /**
+   * @brief take()で受け取ったタスクを完了とする
+   * @param id タスクの番号
+   * @param now 現在時刻 単位:マイクロ秒
+   * @return なし
+   */
+  void finish(uint8_t id, unsigned long now);
+  /**
+   * @brief 解放されている関数付きのタスク(割り込みタスクを除く)のうち,最も優先度の高いものを一つ実行する
+   * @return 実行した場合true
+   */
+  bool runNext();
+  /**
+   * @brief 解放されているタスクがなければ,次の割り込みまでCPUを休止させる
+   * @return なし
+   */
+  void idle();
+  /**
+   * @brief タスクの実行状況を取得する
+   * @param id タスクの番号
+   * @param stats 書き込み先
+   * @return なし
+   */
+  void getStats(uint8_t id, CrlTaskStats* stats);
+};
+#endif
+#endif
@@ -0,0 +1,100 @@
+#include "telemetry.h"
+#include "hal.h"
+
+uint16_t telemetryCrc(const uint8_t* data, uint8_t length, uint16_t crc) {
+  // 1バイトずつ,表を使わずに計算する(AVRで1バイトあたり約20命令)
+  for (uint8_t i = 0; i < length; i++) {
+    crc = (crc >> 8) | (crc << 8);
+    crc ^= data[i];
+    crc ^= (crc & 0xff) >> 4;
+    crc ^= crc << 12;
+    crc ^= (crc & 0xff) << 5;
+  }
+  return crc;
+}
+
+/** COBSの符号化の途中状態 */
+struct CobsEncoder {
+  /** 現在のブロックの符号を書き込む位置 */
+  uint8_t* code;
+  /** 次に書き込む位置 */
+  uint8_t* out;
+  /** 現在のブロックの符号(ブロック内のバイト数 + 1) */
+  uint8_t n;
+};
+
+static void cobsPut(CobsEncoder* cobs, uint8_t byte) {
+  if (byte != 0) {
+    *cobs->out++ = byte;
+    if (++cobs->n != 0xFF) return;
+  }
+  // 0x00の位置,または254バイトでブロックを閉じる
+  *cobs->code = cobs->n;
+  cobs->code = cobs->out++;
+  cobs->n = 1;
+}
+
+uint8_t telemetryEncode(uint8_t type, const void* payload, uint8_t length, uint8_t* frame) {
+  if (length > TELEMETRY_MAX_PAYLOAD) return 0;
+  const uint8_t header[2] = {TELEMETRY_VERSION, type};
+  uint16_t crc = telemetryCrc(header, 2);
+  crc = telemetryCrc((const uint8_t*)payload, length, crc);
+
+  CobsEncoder cobs = {frame, frame + 1, 1};
+  cobsPut(&cobs, header[0]);
+  cobsPut(&cobs, header[1]);
+  for (uint8_t i = 0; i < length; i++) cobsPut(&cobs, ((const uint8_t*)payload)[i]);
+  cobsPut(&cobs, crc & 0xff);
+  cobsPut(&cobs, crc >> 8);
+  *cobs.code = cobs.n;
+  *cobs.out++ = 0;
+  return cobs.out - frame;
+}
+
+int16_t telemetryDecode(const uint8_t* frame, uint8_t length, uint8_t* type, uint8_t* payload) {
+  uint8_t body[TELEMETRY_MAX_PAYLOAD + 4];
+  uint8_t size = 0;
+  uint8_t i = 0;
+  while (i < length) {
+    uint8_t code = frame[i++];
+    if (code == 0 || i + code - 1 > length) return TELEMETRY_ERROR_FRAME;
+    for (uint8_t j = 1; j < code; j++) {
+      if (size >= sizeof(body) || frame[i] == 0) return TELEMETRY_ERROR_FRAME;
+      body[size++] = frame[i++];
+    }
+    // 最後のブロックと254バイトのブロックの後には0x00がない
+    if (code != 0xFF && i < length) {
+      if (size >= sizeof(body)) return TELEMETRY_ERROR_FRAME;
+      body[size++] = 0;
+    }
+  }
+  if (size < 4) return TELEMETRY_ERROR_FRAME;
+  size -= 2;
+  if (telemetryCrc(body, size) != (body[size] | (uint16_t)body[size + 1] << 8)) return TELEMETRY_ERROR_CRC;
+  if (body[0] != TELEMETRY_VERSION) return TELEMETRY_ERROR_VERSION;
+  *type = body[1];
+  for (uint8_t j = 2; j < size; j++) payload[j - 2] = body[j];
+  return size - 2;
+}
+
+#if CRAWL_TELEMETRY
+/** telemetryBegin()で設定した通信速度(0は未開始) */
+static HAL_THREAD_LOCAL unsigned long telemetry_baud = 0;
+
+void telemetryBegin(unsigned long baud) {
+  static const uint8_t delimiter = 0;
+  if (baud == telemetry_baud) return;
+  halUartBegin(baud);
+  halUartWrite(&delimiter, 1);  // 受信側が最初のフレームの先頭を区切りとして認識できるように
+  telemetry_baud = baud;
+}
+
+bool telemetrySend(uint8_t type, const void* payload, uint8_t length) {
+  uint8_t frame[TELEMETRY_MAX_FRAME];
+  if (telemetry_baud == 0) return false;
+  // 符号化の前に空きを調べる(送信中は割り込みのたびに呼ばれることがあるため)
+  if (halUartAvailableForWrite() < (uint16_t)length + 6) return false;
+  uint8_t size = telemetryEncode(type, payload, length, frame);
+  return size > 0 && halUartWrite(frame, size);
+}
+#endif
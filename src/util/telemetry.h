@@ -0,0 +1,89 @@
+/**
+ * @file telemetry.h
+ * @brief
+ * UARTで送るバイナリテレメトリのフレーム
+ *
+ * 一つのフレームは次のバイト列をCOBS(Consistent Overhead Byte Stuffing)で符号化し,区切りの0x00を付けたもの.
+ * | バイト数 | 内容                                              |
+ * |----------|---------------------------------------------------|
+ * | 1        | スキーマのバージョン(TELEMETRY_VERSION)           |
+ * | 1        | 種類(TELEMETRY_RECORDなど)                        |
+ * | n        | 内容(リトルエンディアン.種類ごとに構造体が決まる) |
+ * | 2        | ここまでのCRC-16/CCITT-FALSE(リトルエンディアン) |
+ *
+ * フレームの中に0x00は現れないため,受信側は途中から読み始めても次の0x00で同期できる.
+ * 内容の構造体を変更した場合はTELEMETRY_VERSIONを上げること.
+ * ホスト側のデコーダはtools/host/telemetry_decode.cpp.
+ * 送信(telemetryBegin(),telemetrySend())はCRAWL_TELEMETRYが1の場合だけ組み込まれる.
+ */
+#ifndef INCLUDED_telemetry_h
+#define INCLUDED_telemetry_h
+#include <stdint.h>
+#include "crawl_config.h"
+
+/** スキーマのバージョン */
+#define TELEMETRY_VERSION 1
+/** 種類: CrlRecord(flight_recorder.h) */
+#define TELEMETRY_RECORD 0x01
+/** 種類: CrlProfileFrame(profiler.h) */
+#define TELEMETRY_PROFILE 0x02
+
+/** 内容の最大バイト数 */
+#define TELEMETRY_MAX_PAYLOAD 64
+/** 符号化後のフレームの最大バイト数(ヘッダ2,CRC2,COBSの符号1,区切り1を含む) */
+#define TELEMETRY_MAX_FRAME (TELEMETRY_MAX_PAYLOAD + 6)
+
+/** telemetryDecode()のエラー: COBSの符号化が壊れている,または長さが不正 */
+#define TELEMETRY_ERROR_FRAME -1
+/** telemetryDecode()のエラー: CRCが一致しない */
+#define TELEMETRY_ERROR_CRC -2
+/** telemetryDecode()のエラー: 未対応のバージョン */
+#define TELEMETRY_ERROR_VERSION -3
+
+/**
+ * @brief CRC-16/CCITT-FALSE(多項式0x1021,初期値0xFFFF)を計算する
+ * @param data データ
+ * @param length バイト数
+ * @param crc 途中までのCRC(続きを計算する場合)
+ * @return CRC
+ */
+uint16_t telemetryCrc(const uint8_t* data, uint8_t length, uint16_t crc = 0xFFFF);
+/**
+ * @brief フレームを符号化する
+ * @param type 種類
+ * @param payload 内容
+ * @param length 内容のバイト数(TELEMETRY_MAX_PAYLOAD以下)
+ * @param frame 書き込み先(TELEMETRY_MAX_FRAMEバイト以上)
+ * @return 区切りの0x00を含むフレームのバイト数.lengthが大きすぎる場合は0
+ */
+uint8_t telemetryEncode(uint8_t type, const void* payload, uint8_t length, uint8_t* frame);
+/**
+ * @brief フレームを復号する
+ * @param frame 区切りの0x00を除いたフレーム
+ * @param length frameのバイト数
+ * @param type 種類の書き込み先
+ * @param payload 内容の書き込み先(TELEMETRY_MAX_PAYLOADバイト以上)
+ * @return 内容のバイト数.失敗した場合はTELEMETRY_ERROR_FRAME,TELEMETRY_ERROR_CRC,TELEMETRY_ERROR_VERSION
+ */
+int16_t telemetryDecode(const uint8_t* frame, uint8_t length, uint8_t* type, uint8_t* payload);
+#if CRAWL_TELEMETRY
+/**
+ * @brief UARTでのテレメトリの送信を開始する
+ *
+ * 区切りの0x00を1バイト送る.既に同じ通信速度で開始している場合は何もしない.
+ * @param baud 通信速度 単位:bps
+ * @return なし
+ */
+void telemetryBegin(unsigned long baud);
+/**
+ * @brief フレームを符号化してUARTの送信リングバッファに書き込む
+ *
+ * 送信は割り込みで行われるため,ブロックしない.空きが足りない場合はフレームごと書き込まない.
+ * @param type 種類
+ * @param payload 内容
+ * @param length 内容のバイト数(TELEMETRY_MAX_PAYLOAD以下)
+ * @return 書き込んだ場合true
+ */
+bool telemetrySend(uint8_t type, const void* payload, uint8_t length);
+#endif
+#endif
@@ -0,0 +1,49 @@
+#!/bin/bash
+
+##
+## build.sh --- build the cycle benchmark firmware and its simavr runner
+##
+## Usage: ./tools/avr/build.sh [OUTPUT_DIR]
+##
+## The library is compiled for the ATmega32U4 with avr-gcc as an Arduino
+## build would (ARDUINO defined), except that the hardware abstraction
+## layer is tools/avr/hal_stub.cpp instead of src/util/hal_avr.cpp, so
+## the Arduino core is not needed (tools/host/include/Arduino.h maps the
+## few Arduino functions used by crawl.h onto the HAL). Set CRAWL_FLAGS to build other
+## configurations (e.g. CRAWL_FLAGS="-DCRAWL_FIXED_POINT=1").
+## The runner links against simavr (libsimavr, libelf).
+##
+## Run: ./_avr_build/cycle_sim
+##
+
+set -eu
+
+# Move the current directory to the top of git directory
+cd $(git rev-parse --show-toplevel)
+
+out=${1:-_avr_build}
+avr_cxx=${AVR_CXX:-avr-g++}
+avr_size=${AVR_SIZE:-avr-size}
+cxx=${CXX:-g++}
+crawl_flags=${CRAWL_FLAGS:-}
+avr_flags="-mmcu=atmega32u4 -DF_CPU=16000000L -DARDUINO=10800 -Os -g -std=gnu++11 -fno-exceptions
+    -ffunction-sections -fdata-sections -fno-threadsafe-statics $crawl_flags"
+includes="-Itools/host/include -Isrc -Isrc/util -Itools/avr"
+
+mkdir -p "$out/obj"
+
+objs=""
+for src in src/util/*.cpp tools/avr/hal_stub.cpp tools/avr/cycle_bench.cpp; do
+    # hal_avr.cpp needs the Arduino core; hal_stub.cpp replaces it
+    if [ "$src" == "src/util/hal_avr.cpp" ]; then continue; fi
+    obj="$out/obj/$(basename "${src%.cpp}").o"
+    echo "Compiling $src..."
+    $avr_cxx $avr_flags $includes -c "$src" -o "$obj"
+    objs="$objs $obj"
+done
+echo "Linking $out/cycle_bench.elf..."
+$avr_cxx $avr_flags -Wl,--gc-sections $objs -o "$out/cycle_bench.elf" -lm
+$avr_size "$out/cycle_bench.elf"
+
+echo "Linking $out/cycle_sim..."
+$cxx -O2 -g -Itools/avr tools/avr/cycle_sim.cpp -o "$out/cycle_sim" -lsimavr -lelf
@@ -0,0 +1,157 @@
+/**
+ * @file cycle_bench.cpp
+ * @brief
+ * ATmega32U4上で主要な関数の実行サイクル数を計測するファームウェア(cycle_simで実行する)
+ *
+ * hal_stub.cppの模擬デバイスでcrl.init()を行った後,BENCH_LOOPS回のループで姿勢センサの値を全方向に振りながら,
+ * stand_advancedと同じ制御のループ全体と,calcState(),calcTheta(),calcThetaKalmanFilter(),
+ * KalmanFilter::update(),FirstOrderFilter::calculate(),MahonyAhrs::update()をそれぞれ区間として計測する.
+ * 固定小数点演算のfxAtan2()とFixedFirstOrderFilter::calculate()も,浮動小数点演算のatan2f()と並べて計測する.
+ * 前半は相補フィルタ,後半は全軸カルマンフィルタで動かし,KalmanFilter::update()は定常カルマンゲインを
+ * 使う場合と使わない場合の両方を計測する.
+ * 最後に静的に確保したRAMの量と,起動時にスタックに書いた模様から求めたスタックの最大使用量を報告する.
+ */
+#include <avr/io.h>
+#include <crawl.h>
+#include "ahrs.h"
+#include "cycle_bench.h"
+#include "fixed_point.h"
+#include "hal_stub.h"
+#include "kalmanfilter.h"
+
+/** スタックに書いておく模様 */
+#define STACK_PAINT 0xC5
+
+/** .bssの終端と,スタックの初期位置(RAMの終端) */
+extern uint8_t _end;
+extern uint8_t __stack;
+
+/** 計算結果を捨てられないようにするための変数 */
+static volatile float sink;
+
+/** 区間の開始・終了を書き込む */
+#define BENCH_MARK(value) (_SFR_MEM8(BENCH_MARK_ADDR) = (value))
+/** exprの実行を区間idとして計測する */
+#define BENCH(id, expr)           \
+  do {                            \
+    BENCH_MARK(id);               \
+    expr;                         \
+    BENCH_MARK((id) | BENCH_END); \
+  } while (0)
+
+/**
+ * 起動直後(.init1,スタックとゼロレジスタの準備前)に,.bssの終端からRAMの終端までを模様で埋める.
+ * avr-libcのFAQにある方法と同じ.
+ */
+void paintStack() __attribute__((naked, used, section(".init1")));
+void paintStack() {
+  __asm__ __volatile__(
+      "    ldi r30, lo8(_end)\n"
+      "    ldi r31, hi8(_end)\n"
+      "    ldi r24, %0\n"
+      "    ldi r25, hi8(__stack)\n"
+      "    rjmp 2f\n"
+      "1:  st Z+, r24\n"
+      "2:  cpi r30, lo8(__stack)\n"
+      "    cpc r31, r25\n"
+      "    brlo 1b\n"
+      "    breq 1b\n" ::"i"(STACK_PAINT));
+}
+
+/** 模様が残っている(一度も使われていない)スタックの下端から,スタックの最大使用量を求める */
+static uint16_t stackHighWater() {
+  const uint8_t* p = &_end;
+  while (p <= &__stack && *p == STACK_PAINT) p++;
+  return &__stack - p + 1;
+}
+
+/** 報告の16ビットの値を書き込む */
+static void report(uint16_t value) {
+  _SFR_MEM8(BENCH_DATA_ADDR) = value & 0xff;
+  _SFR_MEM8(BENCH_DATA_ADDR) = value >> 8;
+}
+
+/** i回目のループの姿勢センサの値を設定する(重力の方向を全方向に回し,角速度の符号も変える) */
+static void setSensors(int i) {
+  float a = i * 0.0251327f;  // 250回で一周
+  float b = i * 0.0113f;
+  int16_t gx = (int16_t)(16384 * sinf(a) * cosf(b));
+  int16_t gy = (int16_t)(16384 * cosf(a) * cosf(b));
+  int16_t gz = (int16_t)(16384 * sinf(b));
+  stubSetAccel(gx, gy, gz);
+  stubSetGyro((int16_t)(3000 * sinf(3 * a)), (int16_t)(-2000 * cosf(2 * a)), (int16_t)(1000 * sinf(a)));
+  stubSetMag((int16_t)(200 * cosf(a)), (int16_t)(200 * sinf(a)), -300);
+  stubAddEncoder((int16_t)(40 * sinf(a)), (int16_t)(40 * cosf(a)));
+}
+
+int main() {
+  KalmanFilter kalman, kalman_steady;
+  FirstOrderFilter fof_err2, fof_err2i;
+  Integral err2i;
+  MahonyAhrs ahrs;
+  FixedFirstOrderFilter fof_fixed;
+  int32_t fx_angle;
+  float angle;
+
+  crl.init();
+  crl.setDt(BENCH_DT);
+  kalman.setDt(BENCH_DT);
+  kalman_steady.setDt(BENCH_DT);
+  kalman_steady.setSteadyState(true);
+  kalman_steady.solveSteadyState();
+  fof_err2.setDt(BENCH_DT);
+  fof_err2.setT(1.0 / 15);
+  fof_err2i.setDt(BENCH_DT);
+  fof_err2i.setT(1.0 / 5);
+  err2i.setDt(BENCH_DT);
+  err2i.setLimit(-5.0, 5.0);
+  ahrs.setDt(BENCH_DT);
+  fof_fixed.setDt(BENCH_DT);
+  fof_fixed.setT(0.1);
+
+  for (int i = 0; i < BENCH_LOOPS; i++) {
+    setSensors(i);
+    if (i == BENCH_LOOPS / 2) crl.setKalman(true);
+    crl.realtimeLoop();
+
+    // stand_advancedと同じループ
+    BENCH_MARK(BENCH_LOOP);
+    BENCH(BENCH_UPDATE_STATE, crl.updateState());
+    float theta = crl.getThetaZ();
+    float err2 = -crl.getHeadVelocity();
+    float err1 = (M_PI / 2 + fof_err2i.getOutput() * 40.0f) - theta;
+    BENCH(BENCH_FIRST_ORDER, fof_err2.calculate(err2));
+    err2i.calculate(err2);
+    fof_err2i.calculate(err2i.getOutput());
+    float u = err1 * 5.0f + fof_err2.getOutput() * 8.0f;
+    if (theta < M_PI / 4 || 3 * M_PI / 4 < theta) u = 0;
+    crl.setMotorLeft(u);
+    crl.setMotorRight(u);
+    BENCH_MARK(BENCH_LOOP | BENCH_END);
+
+    // 個々の関数(updateState()の中と同じ状態で,もう一度呼び出す)
+    BENCH(BENCH_EMPTY, );
+    BENCH(BENCH_CALC_STATE, crl.calcState());
+    BENCH(BENCH_CALC_THETA, crl.calcTheta());
+    if (i >= BENCH_LOOPS / 2) BENCH(BENCH_CALC_THETA_KALMAN, crl.calcThetaKalmanFilter());
+    BENCH(BENCH_KALMAN_UPDATE, kalman.update(crl.getThetaX(), crl.getThetaDotX(), 0));
+    BENCH(BENCH_KALMAN_STEADY, kalman_steady.update(crl.getThetaX(), crl.getThetaDotX(), 0));
+    const int* data = crl.attitude_data;  // 機体座標に並べ替えた生値(オフセットは除かない)
+    const int16_t acc[3] = {(int16_t)data[1], (int16_t)data[2], (int16_t)data[0]};
+    const int16_t gyro[3] = {(int16_t)data[5], (int16_t)data[6], (int16_t)data[4]};
+    const int16_t mag[3] = {(int16_t)data[7], (int16_t)-data[9], (int16_t)data[8]};
+    BENCH(BENCH_AHRS_UPDATE, ahrs.update(acc, gyro, mag));
+    BENCH(BENCH_FX_ATAN2, fx_angle = fxAtan2(acc[1], acc[0]));
+    BENCH(BENCH_ATAN2F, angle = atan2f(acc[1], acc[0]));
+    BENCH(BENCH_FIXED_FIRST_ORDER, fof_fixed.calculate(fx_angle));
+    sink = kalman.getTheta() + kalman_steady.getTheta() + fof_err2.getOutput() + ahrs.getUp(0) + angle +
+           fof_fixed.getOutput();
+  }
+
+  report((uint16_t)(&_end - (uint8_t*)RAMSTART) - stubRamBytes());  // BENCH_REPORT_STATIC
+  report(stubRamBytes());                                            // BENCH_REPORT_STUB
+  report(stackHighWater());                                          // BENCH_REPORT_STACK
+  report(RAMEND - RAMSTART + 1);                                     // BENCH_REPORT_RAM
+  BENCH_MARK(BENCH_DONE);
+  while (1) continue;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file cycle_bench.h
+ * @brief
+ * サイクル計測用ファームウェア(cycle_bench.cpp)とシミュレータ側の計測プログラム(cycle_sim.cpp)で共有する定義
+ *
+ * ファームウェアは計測区間の前後でBENCH_MARK_ADDRに区間番号を書き込み,シミュレータはその書き込みの
+ * サイクル数の差を区間の実行サイクル数として集計する.区間番号に無関係なI/Oレジスタ(GPIOR0)を使うため,
+ * 書き込み自体は1命令(out)で,計測の誤差はBENCH_EMPTYの区間で求めて差し引く.
+ * 結果の報告(RAMの使用量など)はBENCH_DATA_ADDRへ1バイトずつ書き込む.
+ */
+#ifndef INCLUDED_cycle_bench_h
+#define INCLUDED_cycle_bench_h
+
+/** 区間の開始・終了を書き込むレジスタ(ATmega32U4のGPIOR0)のデータ空間のアドレス */
+#define BENCH_MARK_ADDR 0x3E
+/** 報告を書き込むレジスタ(ATmega32U4のGPIOR1)のデータ空間のアドレス */
+#define BENCH_DATA_ADDR 0x4A
+
+/** 区間の終了を表すビット(区間番号に加える) */
+#define BENCH_END 0x80
+/** 計測の終了(報告の書き込みの後) */
+#define BENCH_DONE 0x7F
+
+/** 区間: 空(計測の誤差) */
+#define BENCH_EMPTY 0
+/** 区間: CrlRobot::calcState() */
+#define BENCH_CALC_STATE 1
+/** 区間: CrlRobot::calcTheta() */
+#define BENCH_CALC_THETA 2
+/** 区間: CrlRobot::calcThetaKalmanFilter() (3軸) */
+#define BENCH_CALC_THETA_KALMAN 3
+/** 区間: KalmanFilter::update() (定常カルマンゲインを使わない) */
+#define BENCH_KALMAN_UPDATE 4
+/** 区間: KalmanFilter::update() (定常カルマンゲイン) */
+#define BENCH_KALMAN_STEADY 5
+/** 区間: FirstOrderFilter::calculate() */
+#define BENCH_FIRST_ORDER 6
+/** 区間: CrlRobot::updateState() */
+#define BENCH_UPDATE_STATE 7
+/** 区間: realtimeLoop()から戻ってからのループ内の処理全体(stand_advancedと同じ制御) */
+#define BENCH_LOOP 8
+/** 区間: MahonyAhrs::update() (地磁気あり,CRAWL_AHRSによらず計測する) */
+#define BENCH_AHRS_UPDATE 9
+/** 区間: fxAtan2() (CRAWL_FIXED_POINTによらず計測する) */
+#define BENCH_FX_ATAN2 10
+/** 区間: atan2f() (fxAtan2()との比較用) */
+#define BENCH_ATAN2F 11
+/** 区間: FixedFirstOrderFilter::calculate() (CRAWL_FIXED_POINTによらず計測する) */
+#define BENCH_FIXED_FIRST_ORDER 12
+/** 区間の数 */
+#define BENCH_SECTIONS 13
+
+/** 報告: 静的に確保したRAM(.data,.bss)のバイト数(TWIの模擬の分を除く) 2バイト */
+#define BENCH_REPORT_STATIC 0
+/** 報告: TWIの模擬が使うRAMのバイト数 2バイト */
+#define BENCH_REPORT_STUB 2
+/** 報告: スタックの最大使用量のバイト数 2バイト */
+#define BENCH_REPORT_STACK 4
+/** 報告: RAMの総バイト数 2バイト */
+#define BENCH_REPORT_RAM 6
+/** 報告のバイト数 */
+#define BENCH_REPORT_BYTES 8
+
+/** ループの回数(前半は相補フィルタ,後半は全軸カルマンフィルタ) */
+#define BENCH_LOOPS 1000
+/** ループ間隔 単位:秒 */
+#define BENCH_DT 0.01
+/** CPUのクロック周波数 単位:Hz */
+#define BENCH_F_CPU 16000000UL
+
+#endif
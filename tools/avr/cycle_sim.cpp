@@ -0,0 +1,169 @@
+/**
+ * @file cycle_sim.cpp
+ * @brief
+ * サイクル計測用ファームウェア(cycle_bench.elf)をsimavrのATmega32U4で実行し,区間ごとのサイクル数と
+ * RAMの使用量を表示する.
+ *
+ * ファームウェアがBENCH_MARK_ADDRに書き込んだ時点のサイクル数の差を区間の実行サイクル数とし,
+ * 区間ごとに最小・平均・最大(最悪の経路)を求める.BENCH_EMPTYの最小値を計測の誤差として全区間から差し引く.
+ * ループ全体の最大がループ間隔(--budget-usで変更,既定はBENCH_DTの10ms)のサイクル数を超えるか,
+ * 静的なRAMとスタックの最大使用量の合計がRAMの総量からRAM_MARGINバイトを引いた量を超えた場合はNGとして
+ * 終了コード1を返す.TWIの模擬が使うRAMは,実機では使わないため合計から除く.
+ *
+ * Usage: cycle_sim [--budget-us US] [ELF]
+ *   ELFの初期値は_avr_build/cycle_bench.elf(tools/avr/build.shの出力)
+ */
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <stdint.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "cycle_bench.h"
+
+/** 実行するサイクル数の上限(初期化と全ループは約13秒分) */
+#define SIM_CYCLE_LIMIT (BENCH_F_CPU * 60)
+/** RAMの残りの下限 単位:バイト */
+#define RAM_MARGIN 128
+
+/** 区間の名前 */
+static const char* const SECTION_NAMES[BENCH_SECTIONS] = {"(overhead)",
+                                                           "calcState",
+                                                           "calcTheta",
+                                                           "calcThetaKalmanFilter",
+                                                           "KalmanFilter::update",
+                                                           "  (steady state)",
+                                                           "FirstOrderFilter",
+                                                           "updateState",
+                                                           "loop (stand_advanced)",
+                                                           "MahonyAhrs::update",
+                                                           "fxAtan2",
+                                                           "atan2f",
+                                                           "FixedFirstOrderFilter"};
+
+/** 区間ごとの集計 */
+struct Section {
+  /** 開始時のサイクル数 */
+  avr_cycle_count_t begin;
+  /** 計測回数 */
+  unsigned long count;
+  /** 最小値,最大値,合計 */
+  avr_cycle_count_t min, max, sum;
+};
+
+/** 計測の状態 */
+struct Bench {
+  Section sections[BENCH_SECTIONS];
+  /** 報告のバイト列 */
+  uint8_t report[BENCH_REPORT_BYTES];
+  /** 受け取った報告のバイト数 */
+  int reported;
+  /** BENCH_DONEを受け取ったらtrue */
+  bool done;
+};
+
+static void onMark(avr_t* avr, avr_io_addr_t addr, uint8_t value, void* param) {
+  Bench* bench = (Bench*)param;
+  avr->data[addr] = value;
+  if (value == BENCH_DONE) {
+    bench->done = true;
+    return;
+  }
+  uint8_t id = value & ~BENCH_END;
+  if (id >= BENCH_SECTIONS) return;
+  Section* section = &bench->sections[id];
+  if (!(value & BENCH_END)) {
+    section->begin = avr->cycle;
+    return;
+  }
+  avr_cycle_count_t cycles = avr->cycle - section->begin;
+  if (section->count == 0 || cycles < section->min) section->min = cycles;
+  if (cycles > section->max) section->max = cycles;
+  section->sum += cycles;
+  section->count++;
+}
+
+static void onData(avr_t* avr, avr_io_addr_t addr, uint8_t value, void* param) {
+  Bench* bench = (Bench*)param;
+  avr->data[addr] = value;
+  if (bench->reported < BENCH_REPORT_BYTES) bench->report[bench->reported++] = value;
+}
+
+/** 報告の16ビットの値 */
+static unsigned reportWord(const Bench& bench, int offset) {
+  return bench.report[offset] | (bench.report[offset + 1] << 8);
+}
+
+int main(int argc, char** argv) {
+  const char* path = "_avr_build/cycle_bench.elf";
+  double budget_us = BENCH_DT * 1e6;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--budget-us") == 0 && i + 1 < argc) {
+      budget_us = atof(argv[++i]);
+    } else if (argv[i][0] != '-') {
+      path = argv[i];
+    } else {
+      fprintf(stderr, "Usage: %s [--budget-us US] [ELF]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(path, &firmware) != 0) {
+    fprintf(stderr, "%s: cannot read firmware\n", path);
+    return 2;
+  }
+  strcpy(firmware.mmcu, "atmega32u4");
+  firmware.frequency = BENCH_F_CPU;
+  avr_t* avr = avr_make_mcu_by_name(firmware.mmcu);
+  if (avr == NULL) {
+    fprintf(stderr, "simavr does not support %s\n", firmware.mmcu);
+    return 2;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+
+  static Bench bench;
+  avr_register_io_write(avr, BENCH_MARK_ADDR, onMark, &bench);
+  avr_register_io_write(avr, BENCH_DATA_ADDR, onData, &bench);
+  int state = cpu_Running;
+  while (!bench.done && avr->cycle < SIM_CYCLE_LIMIT) {
+    state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed) break;
+  }
+  if (!bench.done || bench.reported < BENCH_REPORT_BYTES) {
+    fprintf(stderr, "%s: firmware did not finish (state %d, %llu cycles)\n", path, state,
+            (unsigned long long)avr->cycle);
+    return 2;
+  }
+
+  const double mhz = BENCH_F_CPU / 1e6;
+  const avr_cycle_count_t overhead = bench.sections[BENCH_EMPTY].min;
+  printf("firmware             : %s (%s, %.0f MHz)\n", path, firmware.mmcu, mhz);
+  printf("%-22s: %8s %8s %8s cycles %9s\n", "section", "min", "avg", "max", "max us");
+  for (int i = 1; i < BENCH_SECTIONS; i++) {
+    const Section& s = bench.sections[i];
+    if (s.count == 0) continue;
+    double min = (double)s.min - overhead, max = (double)s.max - overhead, avg = (double)s.sum / s.count - overhead;
+    printf("%-22s: %8.0f %8.0f %8.0f        %9.1f\n", SECTION_NAMES[i], min, avg, max, max / mhz);
+  }
+
+  unsigned static_ram = reportWord(bench, BENCH_REPORT_STATIC), stub_ram = reportWord(bench, BENCH_REPORT_STUB);
+  unsigned stack = reportWord(bench, BENCH_REPORT_STACK), ram = reportWord(bench, BENCH_REPORT_RAM);
+  int free_ram = (int)ram - (int)(static_ram + stack);  // 実機では模擬の分のRAMは使わない
+  printf("static RAM           : %u bytes (+%u bytes for the TWI stub)\n", static_ram, stub_ram);
+  printf("stack high-water     : %u bytes\n", stack);
+  printf("free RAM (worst)     : %d of %u bytes\n", free_ram, ram);
+
+  int errors = 0;
+  double budget = budget_us * mhz;
+  double loop_max = (double)bench.sections[BENCH_LOOP].max - overhead;
+  printf("loop budget          : %.0f cycles (%.0f us), worst loop uses %.1f %%\n", budget, budget_us,
+         100 * loop_max / budget);
+  if (!(loop_max <= budget)) errors++;
+  if (free_ram < RAM_MARGIN) errors++;
+  printf("%s\n", errors ? "NG" : "OK");
+  return errors ? 1 : 0;
+}
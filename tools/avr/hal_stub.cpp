@@ -0,0 +1,358 @@
+/**
+ * @file hal_stub.cpp
+ * @brief
+ * サイクル計測用のハードウェア抽象化層(ATmega32U4,Arduinoのコアライブラリを使わない)
+ *
+ * I2CデバイスはTWIを使わずにRAM上のレジスタで模擬する.トランザクションはhal_avr.cppと同じくキューに入れ,
+ * hal_host.cppと同じ100kHzの転送時間の後にTimer3の比較一致割り込みの中で完了させ,コールバックを呼び出す.
+ * そのため,バックグラウンドの読み出しの割り込み処理もループの計測に含まれる.
+ * 時計はTimer3(プリスケーラ64,4マイクロ秒単位)で,周期割り込み(CRAWL_SCHEDULER)はhal_avr.cppと同じくTimer1を使う.
+ * UART,シリアル,GPIOは何もしない.姿勢センサのINTピンの割り込み(CRAWL_IMU_SYNC)は模擬しない.
+ */
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <string.h>
+#include "crawl_config.h"
+#include "hal.h"
+#include "hal_stub.h"
+
+#if CRAWL_IMU_SYNC
+#error "hal_stub.cpp does not emulate the data-ready interrupt of the attitude sensor"
+#endif
+
+/** I2Cバスのクロック周波数 単位:Hz */
+#define STUB_I2C_CLOCK 100000UL
+/** Timer3の1カウントの時間 単位:マイクロ秒 */
+#define STUB_TICK_US 4
+/** 姿勢センサがFIFOに標本を積む間隔 単位:マイクロ秒 */
+#define STUB_FIFO_PERIOD_US 1000UL
+
+/** 模擬デバイスの状態(RAMの使用量を分けて数えるため一つにまとめる) */
+static struct {
+  /** MPU-9250のレジスタ */
+  uint8_t mpu_reg[128];
+  /** MPU-9250のレジスタポインタ */
+  uint8_t mpu_ptr;
+  /** FIFOの読み出し位置(一標本の中のバイト位置) */
+  uint8_t fifo_offset;
+  /** FIFOを最後に読み出した時刻 */
+  unsigned long fifo_at;
+  /** AK8963のレジスタ */
+  uint8_t ak_reg[32];
+  /** AK8963のレジスタポインタ */
+  uint8_t ak_ptr;
+  /** 最後に受信したモータ制御基板へのコマンド */
+  uint8_t motor_last_command;
+  /** モータ制御基板内の累計回転数 */
+  int16_t encoder_count[2];
+  /** 読み出し用にラッチされた累計回転数 */
+  int16_t encoder_latch[2];
+} stub;
+
+/** Timer3のオーバーフローの回数 */
+static volatile unsigned long timer_overflows = 0;
+/** 実行中のトランザクション(キューの先頭) */
+static HalI2cTransaction* volatile i2c_head = NULL;
+/** キューの末尾 */
+static HalI2cTransaction* volatile i2c_tail = NULL;
+
+static void putBigEndian(uint8_t* reg, int16_t value) {
+  reg[0] = (uint16_t)value >> 8;
+  reg[1] = (uint16_t)value & 0xff;
+}
+
+static void putLittleEndian(uint8_t* reg, int16_t value) {
+  reg[0] = (uint16_t)value & 0xff;
+  reg[1] = (uint16_t)value >> 8;
+}
+
+/** 前回の読み出しからFIFOに溜まったバイト数 */
+static uint16_t fifoBytes() {
+  unsigned long samples = (halMicros() - stub.fifo_at) / STUB_FIFO_PERIOD_US;
+  if (samples > 512 / 14) samples = 512 / 14;
+  return samples * 14;
+}
+
+/** 模擬デバイスへの書き込み */
+static uint8_t deviceWrite(uint8_t address, const uint8_t* data, uint8_t length) {
+  uint8_t i;
+  if (address != HAL_ADDR_MPU9250 && address != HAL_ADDR_AK8963 && address != HAL_ADDR_MOTOR) return 2;  // NACK
+  if (length == 0) return 0;
+  if (address == HAL_ADDR_MPU9250) {
+    stub.mpu_ptr = data[0] & 0x7f;
+    for (i = 1; i < length; i++) {
+      stub.mpu_reg[stub.mpu_ptr] = data[i];
+      if (stub.mpu_ptr == 0x6A && (data[i] & 0x04)) stub.fifo_at = halMicros();  // USER_CTRL FIFO_RST
+      stub.mpu_ptr = (stub.mpu_ptr + 1) & 0x7f;
+    }
+    return 0;
+  }
+  if (address == HAL_ADDR_AK8963) {
+    stub.ak_ptr = data[0] & 0x1f;
+    for (i = 1; i < length; i++) {
+      stub.ak_reg[stub.ak_ptr] = data[i];
+      stub.ak_ptr = (stub.ak_ptr + 1) & 0x1f;
+    }
+    return 0;
+  }
+  if (address == HAL_ADDR_MOTOR) {
+    stub.motor_last_command = data[0];
+    if (data[0] == 0x11 || data[0] == 0x12) memcpy(stub.encoder_latch, stub.encoder_count, sizeof(stub.encoder_latch));
+    if (data[0] == 0x10 || data[0] == 0x12) memset(stub.encoder_count, 0, sizeof(stub.encoder_count));
+  }
+  return 0;
+}
+
+/** 模擬デバイスからの読み込み */
+static uint8_t deviceRead(uint8_t address, uint8_t* data, uint8_t length) {
+  uint8_t i;
+  if (address == HAL_ADDR_MPU9250) {
+    uint16_t count = fifoBytes();
+    putBigEndian(&stub.mpu_reg[0x72], count);  // FIFO_COUNT
+    stub.mpu_reg[0x3A] |= 0x01;                // INT_STATUS RAW_DATA_RDY_INT
+    for (i = 0; i < length; i++) {
+      if (stub.mpu_ptr == 0x74) {  // FIFO_R_W: 加速度,温度,角速度のレジスタの値を標本として繰り返す
+        data[i] = stub.mpu_reg[0x3B + stub.fifo_offset];
+        if (++stub.fifo_offset == 14) stub.fifo_offset = 0;
+        continue;
+      }
+      data[i] = stub.mpu_reg[stub.mpu_ptr];
+      stub.mpu_ptr = (stub.mpu_ptr + 1) & 0x7f;
+    }
+    if (stub.mpu_ptr == 0x74) stub.fifo_at += (unsigned long)(length / 14) * STUB_FIFO_PERIOD_US;
+    return length;
+  }
+  if (address == HAL_ADDR_AK8963) {
+    for (i = 0; i < length; i++) {
+      data[i] = stub.ak_reg[stub.ak_ptr];
+      stub.ak_ptr = (stub.ak_ptr + 1) & 0x1f;
+    }
+    return length;
+  }
+  if (address == HAL_ADDR_MOTOR) {
+    uint8_t response[4];
+    if (stub.motor_last_command != 0x11 && stub.motor_last_command != 0x12) return 0;
+    putBigEndian(&response[0], stub.encoder_latch[1]);
+    putBigEndian(&response[2], stub.encoder_latch[0]);
+    for (i = 0; i < length; i++) data[i] = i < 4 ? response[i] : 0xff;
+    return length;
+  }
+  return 0;
+}
+
+/** 先頭のトランザクションの転送時間の後に比較一致割り込みを起こす(割り込み禁止で呼び出す) */
+static void startHead() {
+  const HalI2cTransaction* transaction = i2c_head;
+  unsigned long bits = 1;  // ストップ
+  if (transaction->tx_length > 0 || transaction->rx_length == 0) bits += 1 + (1 + transaction->tx_length) * 9;
+  if (transaction->rx_length > 0) bits += 1 + (1 + transaction->rx_length) * 9;
+  uint16_t ticks = (bits * (1000000UL / STUB_TICK_US) + STUB_I2C_CLOCK - 1) / STUB_I2C_CLOCK;
+  OCR3A = TCNT3 + (ticks > 0 ? ticks : 1);
+  TIFR3 = _BV(OCF3A);
+  TIMSK3 |= _BV(OCIE3A);
+}
+
+ISR(TIMER3_OVF_vect) { timer_overflows++; }
+
+ISR(TIMER3_COMPA_vect) {
+  HalI2cTransaction* transaction = i2c_head;
+  uint8_t status = HAL_I2C_DONE;
+
+  if (transaction == NULL) {
+    TIMSK3 &= ~_BV(OCIE3A);
+    return;
+  }
+  if (transaction->tx_length > 0 || transaction->rx_length == 0) {
+    if (deviceWrite(transaction->address, transaction->tx_data, transaction->tx_length) != 0) status = HAL_I2C_ERROR;
+  }
+  if (status == HAL_I2C_DONE && transaction->rx_length > 0) {
+    if (deviceRead(transaction->address, transaction->rx_data, transaction->rx_length) == 0) status = HAL_I2C_ERROR;
+  }
+
+  i2c_head = transaction->next;
+  if (i2c_head == NULL) {
+    i2c_tail = NULL;
+    TIMSK3 &= ~_BV(OCIE3A);
+  } else {
+    startHead();
+  }
+  transaction->next = NULL;
+  transaction->status = status;
+  if (transaction->callback != NULL) transaction->callback(transaction);
+}
+
+void halInit() {
+  memset(&stub, 0, sizeof(stub));
+  stub.mpu_reg[0x6B] = 0x01;  // PWR_MGMT_1 リセット値
+  stub.mpu_reg[0x75] = 0x71;  // WHO_AM_I
+  stub.ak_reg[0x00] = 0x48;   // WIA
+
+  // Timer3: ノーマルモード,プリスケーラ64(16MHzで4マイクロ秒単位)
+  TCCR3A = 0;
+  TCCR3B = _BV(CS31) | _BV(CS30);
+  TCNT3 = 0;
+  TIFR3 = _BV(TOV3) | _BV(OCF3A);
+  TIMSK3 = _BV(TOIE3);
+  sei();
+}
+
+void halI2cSubmit(HalI2cTransaction* transaction) {
+  uint8_t state;
+
+  transaction->next = NULL;
+  transaction->status = HAL_I2C_PENDING;
+
+  state = halEnterCritical();
+  if (i2c_tail != NULL) {
+    i2c_tail->next = transaction;
+    i2c_tail = transaction;
+  } else {
+    i2c_head = transaction;
+    i2c_tail = transaction;
+    startHead();
+  }
+  halExitCritical(state);
+}
+
+void halI2cWait(HalI2cTransaction* transaction) {
+  while (transaction->status == HAL_I2C_PENDING) continue;
+}
+
+uint8_t halI2cWrite(uint8_t address, const uint8_t* data, uint8_t length) {
+  HalI2cTransaction transaction = {address, data, length, NULL, 0, NULL, HAL_I2C_DONE, NULL};
+  halI2cSubmit(&transaction);
+  halI2cWait(&transaction);
+  return transaction.status == HAL_I2C_DONE ? 0 : 2;
+}
+
+uint8_t halI2cRead(uint8_t address, uint8_t* data, uint8_t length) {
+  HalI2cTransaction transaction = {address, NULL, 0, data, length, NULL, HAL_I2C_DONE, NULL};
+  if (length == 0) return 0;
+  halI2cSubmit(&transaction);
+  halI2cWait(&transaction);
+  return transaction.status == HAL_I2C_DONE ? length : 0;
+}
+
+uint8_t halEnterCritical() {
+  uint8_t state = SREG;
+  cli();
+  return state;
+}
+
+void halExitCritical(uint8_t state) { SREG = state; }
+
+#if CRAWL_SCHEDULER
+/** タイマ割り込みで呼び出す関数 */
+static void (*volatile timer_callback)(void*) = NULL;
+/** timer_callbackに渡す値 */
+static void* volatile timer_context = NULL;
+
+void halTimerBegin(unsigned long period_us, void (*callback)(void*), void* context) {
+  TIMSK1 = 0;
+  TCCR1A = 0;
+  TCCR1B = 0;
+  timer_callback = callback;
+  timer_context = context;
+  if (period_us == 0 || callback == NULL) return;
+
+  // CTCモード.プリスケーラ8(16MHzで0.5マイクロ秒単位,最長32ミリ秒),それより長い周期は64
+  unsigned long counts = period_us * (F_CPU / 1000000UL) / 8;
+  uint8_t prescaler = _BV(CS11);
+  if (counts > 0x10000UL) {
+    counts /= 8;
+    prescaler = _BV(CS11) | _BV(CS10);
+  }
+  OCR1A = counts - 1;
+  TCNT1 = 0;
+  TIFR1 = _BV(OCF1A);
+  TCCR1B = _BV(WGM12) | prescaler;
+  TIMSK1 = _BV(OCIE1A);
+}
+
+ISR(TIMER1_COMPA_vect) { timer_callback(timer_context); }
+#endif
+
+void halSleep() {
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+}
+
+unsigned long halMicros() {
+  uint8_t state = halEnterCritical();
+  uint16_t count = TCNT3;
+  unsigned long overflows = timer_overflows;
+  if ((TIFR3 & _BV(TOV3)) && count < 0x8000) overflows++;  // 割り込み禁止中に起きたオーバーフロー
+  halExitCritical(state);
+  return ((overflows << 16) + count) * STUB_TICK_US;
+}
+
+void halDelay(unsigned long ms) {
+  unsigned long start = halMicros();
+  while (halMicros() - start < ms * 1000) continue;
+}
+
+void halDelayMicroseconds(unsigned int us) {
+  unsigned long start = halMicros();
+  while (halMicros() - start < us) continue;
+}
+
+void halPinMode(uint8_t pin, uint8_t mode) {}
+
+void halDigitalWrite(uint8_t pin, uint8_t value) {}
+
+void halSerialBegin(unsigned long baud) {}
+
+void halSerialPrintln(const char* str) {}
+
+void halUartBegin(unsigned long baud) {}
+
+uint8_t halUartAvailableForWrite() { return HAL_UART_TX_BUFFER; }
+
+bool halUartWrite(const uint8_t* data, uint8_t length) { return true; }
+
+void halEepromRead(uint16_t address, void* data, uint16_t length) {
+  eeprom_read_block(data, (const void*)address, length);
+}
+
+void halEepromWrite(uint16_t address, const void* data, uint16_t length) {
+  eeprom_update_block(data, (void*)address, length);
+}
+
+void stubSetAccel(int16_t x, int16_t y, int16_t z) {
+  uint8_t state = halEnterCritical();
+  putBigEndian(&stub.mpu_reg[0x3B], x);
+  putBigEndian(&stub.mpu_reg[0x3D], y);
+  putBigEndian(&stub.mpu_reg[0x3F], z);
+  halExitCritical(state);
+}
+
+void stubSetGyro(int16_t x, int16_t y, int16_t z) {
+  uint8_t state = halEnterCritical();
+  putBigEndian(&stub.mpu_reg[0x43], x);
+  putBigEndian(&stub.mpu_reg[0x45], y);
+  putBigEndian(&stub.mpu_reg[0x47], z);
+  halExitCritical(state);
+}
+
+void stubSetMag(int16_t x, int16_t y, int16_t z) {
+  uint8_t state = halEnterCritical();
+  putLittleEndian(&stub.ak_reg[0x03], x);
+  putLittleEndian(&stub.ak_reg[0x05], y);
+  putLittleEndian(&stub.ak_reg[0x07], z);
+  stub.ak_reg[0x02] |= 0x01;  // ST1 DRDY
+  halExitCritical(state);
+}
+
+void stubAddEncoder(int16_t left, int16_t right) {
+  uint8_t state = halEnterCritical();
+  stub.encoder_count[0] += left;
+  stub.encoder_count[1] += right;
+  halExitCritical(state);
+}
+
+uint16_t stubRamBytes() { return sizeof(stub); }
@@ -0,0 +1,51 @@
+/**
+ * @file hal_stub.h
+ * @brief
+ * サイクル計測用のハードウェア抽象化層(hal_stub.cpp)でセンサの値を設定する関数
+ *
+ * hal_stub.cppはATmega32U4上でI2Cデバイス(MPU-9250,AK8963,モータ制御基板)のレジスタを模擬する.
+ * TWIの代わりにTimer3の比較一致割り込みで,100kHzのI2Cの転送時間の後にトランザクションを完了させる.
+ * 値の意味と符号はhal_host.hのhostSet*()と同じ.
+ */
+#ifndef INCLUDED_hal_stub_h
+#define INCLUDED_hal_stub_h
+#include <stdint.h>
+
+/**
+ * @brief 加速度の生値を設定する
+ * @param x X軸
+ * @param y Y軸
+ * @param z Z軸
+ * @return なし
+ */
+void stubSetAccel(int16_t x, int16_t y, int16_t z);
+/**
+ * @brief 角速度の生値を設定する
+ * @param x X軸
+ * @param y Y軸
+ * @param z Z軸
+ * @return なし
+ */
+void stubSetGyro(int16_t x, int16_t y, int16_t z);
+/**
+ * @brief 地磁気の生値を設定し,AK8963の測定完了を立てる
+ * @param x X軸
+ * @param y Y軸
+ * @param z Z軸
+ * @return なし
+ */
+void stubSetMag(int16_t x, int16_t y, int16_t z);
+/**
+ * @brief エンコーダの累計回転数に加える
+ * @param left 左エンコーダ
+ * @param right 右エンコーダ
+ * @return なし
+ */
+void stubAddEncoder(int16_t left, int16_t right);
+/**
+ * @brief 模擬デバイスが使うRAMのバイト数を取得する
+ * @return バイト数
+ */
+uint16_t stubRamBytes();
+
+#endif
@@ -0,0 +1,534 @@
+/**
+ * @file ahrs_bench.cpp
+ * @brief
+ * 姿勢推定(ahrs.h)と軸ごとの相補フィルタ(CrlRobot::calcTheta()と同じ式)に,真値の分かる3次元の運動を
+ * 合成したセンサ値を与え,姿勢角度の誤差と一回あたりの計算時間を表示する.
+ *
+ * 運動は機体を寝かせた状態(X軸とY軸の姿勢角度を比べる)と直立した状態(Z軸の姿勢角度を比べる)の2つで,
+ * どちらも2軸の傾きの振動に一定の速さの旋回を重ねる.センサ値は機体座標で与え,雑音とジャイロのオフセットの
+ * 残りを加える.姿勢推定の姿勢角度はCrlRobotと同じく,推定した鉛直上向きの向きから相補フィルタと同じ式で求める.
+ * 姿勢推定は地磁気の有無それぞれについて,推定した四元数の方位(鉛直軸周りの回転)の誤差も表示する.
+ * 地磁気がない場合はジャイロのオフセットの残りで方位がずれ続け,ある場合は地磁気の向きに保たれる.
+ * fxAtan2()の誤差は,全ての八分円にわたる格子点でatan2()と比べる.
+ *
+ * 計算時間はホスト上の値で,x86ではTSCのサイクル数も表示する.ホストは浮動小数点演算を一命令で行うため,
+ * 整数演算だけの姿勢推定はそのままでは相補フィルタより遅い.FPUのないATmega32U4と条件を揃えるため,
+ * 相補フィルタと同じ演算を整数演算だけで行う単精度浮動小数点数(SoftFloat,floatとビット単位で同じ結果になる
+ * ことを確かめる)でも計測し,姿勢推定(姿勢角度の計算を含む)がこれより短ければOKを表示する.
+ * x86の整数演算はATmega32U4より相対的に速いため比は実機より小さく出る.実機のサイクル数は
+ * tools/avr/cycle_simのMahonyAhrs::updateとcalcThetaの区間で計測できる.
+ *
+ * Usage: ahrs_bench [SECONDS]
+ */
+#include <crawl.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "ahrs.h"
+#include "fast_math.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+/** ループ間隔 単位:秒 */
+#define DT 0.01
+/** 加速度の生値 単位:1G */
+#define ACC_1G 16384
+/** 加速度の生値を[m/s^2]に換算する係数(CrlRobotと同じ) */
+#define ACC_SCALE 0.00059855f
+/** 相補フィルタの係数(CrlRobotと同じ) */
+#define RATE_THETA 0.99f
+
+/** 機体座標から地上座標への回転 */
+struct Quat {
+  double w, x, y, z;
+};
+
+static Quat mul(const Quat& a, const Quat& b) {
+  return {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z, a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+          a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x, a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+}
+
+static Quat conj(const Quat& q) { return {q.w, -q.x, -q.y, -q.z}; }
+
+/** 軸(単位ベクトル)周りにangle[rad]の回転 */
+static Quat axisAngle(double x, double y, double z, double angle) {
+  double s = sin(angle / 2);
+  return {cos(angle / 2), x * s, y * s, z * s};
+}
+
+/** 地上座標のベクトルvを機体座標で表す */
+static void toBody(const Quat& q, const double v[3], double out[3]) {
+  Quat p = mul(mul(conj(q), {0, v[0], v[1], v[2]}), q);
+  out[0] = p.x;
+  out[1] = p.y;
+  out[2] = p.z;
+}
+
+/** 運動の設定 */
+struct Scenario {
+  /** 名前 */
+  const char* name;
+  /** 比べる姿勢角度の軸(CRAWL_AXIS_BIT()の論理和) */
+  uint8_t axes;
+  /** 基準の姿勢 */
+  Quat base;
+  /** 地上座標のX軸周り,Y軸周りの傾きの振幅 単位:rad */
+  double tilt_x, tilt_y;
+  /** 地上座標のZ軸周りの旋回の速さ 単位:rad/s */
+  double yaw_rate;
+};
+
+/** 時刻tの姿勢 */
+static Quat pose(const Scenario& s, double t) {
+  Quat yaw = axisAngle(0, 0, 1, s.yaw_rate * t);
+  Quat tilt_y = axisAngle(0, 1, 0, s.tilt_y * sin(2 * M_PI * 0.7 * t));
+  Quat tilt_x = axisAngle(1, 0, 0, s.tilt_x * sin(2 * M_PI * 0.45 * t));
+  return mul(mul(mul(yaw, tilt_y), tilt_x), s.base);
+}
+
+/** 一周期分のセンサの生値(機体座標)と真の姿勢 */
+struct Sample {
+  int16_t acc[3], gyro[3], mag[3];
+  float theta[3];
+  Quat pose;
+};
+
+/** 鉛直上向きの向き(静止時の加速度)からCrlRobotと同じ式で姿勢角度を求める */
+static void thetaFromUp(float x, float y, float z, float theta[3]) {
+  theta[CRAWL_AXIS_X] = M_PI / 2 - fastAtan2(y, z);
+  theta[CRAWL_AXIS_Y] = M_PI / 2 - fastAtan2(z, x);
+  theta[CRAWL_AXIS_Z] = M_PI / 2 - fastAtan2(y, x);
+}
+
+static int16_t toRaw(double x) { return (int16_t)fmax(-32768, fmin(32767, lround(x))); }
+
+/** 運動を合成する.ジャイロの値は前の周期からの回転の平均の角速度とする */
+static std::vector<Sample> synthesize(const Scenario& s, double seconds) {
+  const double up[3] = {0, 0, 1}, field[3] = {200, 0, -350};  // 地磁気は北向きで下に傾く
+  const double bias[3] = {8, -5, 6};                           // オフセットの残り 単位:生値
+  std::mt19937 rng(1);
+  std::normal_distribution<double> acc_noise(0, 40), gyro_noise(0, 2), mag_noise(0, 3);
+  std::vector<Sample> samples;
+  Quat prev = pose(s, -DT);
+
+  for (long k = 0; k * DT < seconds; k++) {
+    Quat q = pose(s, k * DT);
+    Quat d = mul(conj(prev), q);  // 機体座標での一周期の回転
+    double half = acos(fmin(1.0, fabs(d.w))), sign = d.w < 0 ? -1 : 1;
+    double rate = half < 1e-12 ? 2 / DT : 2 * half / sin(half) / DT * sign;
+    double a[3], m[3];
+    Sample sample;
+
+    toBody(q, up, a);
+    toBody(q, field, m);
+    sample.acc[0] = toRaw(a[0] * ACC_1G + acc_noise(rng));
+    sample.acc[1] = toRaw(a[1] * ACC_1G + acc_noise(rng));
+    sample.acc[2] = toRaw(a[2] * ACC_1G + acc_noise(rng));
+    sample.gyro[0] = toRaw(d.x * rate / AHRS_GYRO_SCALE + bias[0] + gyro_noise(rng));
+    sample.gyro[1] = toRaw(d.y * rate / AHRS_GYRO_SCALE + bias[1] + gyro_noise(rng));
+    sample.gyro[2] = toRaw(d.z * rate / AHRS_GYRO_SCALE + bias[2] + gyro_noise(rng));
+    for (int i = 0; i < 3; i++) sample.mag[i] = toRaw(m[i] + mag_noise(rng));
+    thetaFromUp(a[0], a[1], a[2], sample.theta);
+    sample.pose = q;
+    samples.push_back(sample);
+    prev = q;
+  }
+  return samples;
+}
+
+/** 軸ごとの相補フィルタ(CrlRobot::calcState(),calcTheta()と同じ計算) */
+class Complementary {
+ public:
+  float theta[3];
+  FirstOrderFilter fof[3];
+
+  void reset(const Sample& s) {
+    for (int i = 0; i < 3; i++) {
+      fof[i].setDt(DT);
+      fof[i].setT(1.0 / 25.0);
+      fof[i].setOutput(s.acc[i] * ACC_SCALE);
+    }
+    thetaFromUp(fof[0].getOutput(), fof[1].getOutput(), fof[2].getOutput(), theta);
+  }
+
+  void update(const Sample& s, uint8_t axes) {
+    float acc[3], measured[3];
+    for (int i = 0; i < 3; i++) {
+      if (axes & ~CRAWL_AXIS_BIT(i)) acc[i] = fof[i].calculate(s.acc[i] * ACC_SCALE);  // 他の軸の姿勢角度に使う
+    }
+    if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) measured[CRAWL_AXIS_Z] = M_PI / 2 - fastAtan2(acc[1], acc[0]);
+    if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) measured[CRAWL_AXIS_X] = M_PI / 2 - fastAtan2(acc[1], acc[2]);
+    if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) measured[CRAWL_AXIS_Y] = M_PI / 2 - fastAtan2(acc[2], acc[0]);
+    for (int i = 0; i < 3; i++) {
+      if (!(axes & CRAWL_AXIS_BIT(i))) continue;
+      theta[i] = theta[i] * RATE_THETA + measured[i] * (1 - RATE_THETA) + s.gyro[i] * AHRS_GYRO_SCALE * (float)DT;
+    }
+  }
+};
+
+/**
+ * 単精度浮動小数点数を整数演算だけで計算する型(計算時間の比較用).
+ * FPUのないATmega32U4では浮動小数点演算がlibgccのソフトウェア実装の呼び出しになるため,
+ * ホストでも同じく整数演算で計算した時間で整数演算だけの姿勢推定と比べる.
+ * 最近接偶数への丸めで,非正規化数は0とし,無限大とNaNは扱わない(相補フィルタの値の範囲では現れない).
+ */
+struct SoftFloat {
+  uint32_t bits;
+
+  SoftFloat() : bits(0) {}
+  SoftFloat(float f) { memcpy(&bits, &f, sizeof(bits)); }
+  explicit SoftFloat(int x) {
+    uint32_t m = x < 0 ? -(uint32_t)x : (uint32_t)x;
+    int e = 127 + 30;
+    if (m == 0) {
+      bits = 0;
+      return;
+    }
+    while (!(m & (1UL << 30))) {
+      m <<= 1;
+      e--;
+    }
+    bits = pack(x < 0, e, m);
+  }
+  operator float() const {
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+
+  /** 符号s,指数e(バイアス付き),仮数m(ビット30が最上位の1)を丸めて詰める */
+  static uint32_t pack(uint32_t s, int e, uint32_t m) {
+    uint32_t round = m & 0x7f;
+    m >>= 7;
+    if (round > 0x40 || (round == 0x40 && (m & 1))) {
+      if (++m == 0x1000000) {
+        m >>= 1;
+        e++;
+      }
+    }
+    if (e <= 0) return s << 31;  // 非正規化数は0にする
+    return (s << 31) | ((uint32_t)e << 23) | (m & 0x7fffff);
+  }
+  static int exponent(uint32_t b) { return (b >> 23) & 0xff; }
+  static uint32_t mantissa(uint32_t b) { return (b & 0x7fffff) | 0x800000; }
+
+  friend SoftFloat operator*(SoftFloat a, SoftFloat b) {
+    SoftFloat r;
+    uint32_t s = (a.bits ^ b.bits) >> 31;
+    if (exponent(a.bits) == 0 || exponent(b.bits) == 0) {
+      r.bits = s << 31;
+      return r;
+    }
+    uint64_t p = (uint64_t)mantissa(a.bits) * mantissa(b.bits);  // 最上位の1はビット46か47
+    int e = exponent(a.bits) + exponent(b.bits) - 127;
+    uint32_t m;
+    if (p & (1ULL << 47)) {
+      m = (uint32_t)(p >> 17) | ((p & 0x1ffff) != 0);
+      e++;
+    } else {
+      m = (uint32_t)(p >> 16) | ((p & 0xffff) != 0);
+    }
+    r.bits = pack(s, e, m);
+    return r;
+  }
+  friend SoftFloat operator/(SoftFloat a, SoftFloat b) {
+    SoftFloat r;
+    uint32_t s = (a.bits ^ b.bits) >> 31;
+    if (exponent(a.bits) == 0) {
+      r.bits = s << 31;
+      return r;
+    }
+    // 引き戻し法で商を1ビットずつ求める(ATmega32U4の除算と同じく除算命令を使わない)
+    uint32_t rem = mantissa(a.bits), div = mantissa(b.bits), q = 0;
+    int e = exponent(a.bits) - exponent(b.bits) + 127;
+    if (rem < div) {
+      rem <<= 1;
+      e--;
+    }
+    for (int i = 0; i < 31; i++) {
+      q <<= 1;
+      if (rem >= div) {
+        rem -= div;
+        q |= 1;
+      }
+      rem <<= 1;
+    }
+    r.bits = pack(s, e, q | (rem != 0));
+    return r;
+  }
+  friend SoftFloat operator+(SoftFloat a, SoftFloat b) {
+    if (exponent(a.bits) == 0) return b;
+    if (exponent(b.bits) == 0) return a;
+    if ((a.bits & 0x7fffffff) < (b.bits & 0x7fffffff)) std::swap(a, b);  // |a| >= |b|
+    uint32_t ma = mantissa(a.bits) << 6, mb = mantissa(b.bits) << 6;  // 最上位の1はビット29
+    int e = exponent(a.bits) + 1, d = exponent(a.bits) - exponent(b.bits);
+    mb = d > 30 ? mb != 0 : (mb >> d) | ((mb & ((1UL << d) - 1)) != 0);
+    uint32_t m = (a.bits ^ b.bits) >> 31 ? ma - mb : ma + mb;
+    SoftFloat r;
+    if (m == 0) return r;
+    while (!(m & (1UL << 30))) {
+      m <<= 1;
+      e--;
+    }
+    r.bits = pack(a.bits >> 31, e, m);
+    return r;
+  }
+  SoftFloat operator-() const {
+    SoftFloat r;
+    r.bits = bits ^ 0x80000000UL;
+    return r;
+  }
+  friend SoftFloat operator-(SoftFloat a, SoftFloat b) { return a + -b; }
+  /** 符号と絶対値の表現を,大小関係の順になる整数にする */
+  static int32_t order(SoftFloat a) {
+    return (a.bits >> 31) ? -(int32_t)(a.bits & 0x7fffffff) : (int32_t)a.bits;
+  }
+  friend bool operator<(SoftFloat a, SoftFloat b) { return order(a) < order(b); }
+  friend bool operator<=(SoftFloat a, SoftFloat b) { return order(a) <= order(b); }
+  friend bool operator==(SoftFloat a, SoftFloat b) { return order(a) == order(b); }
+};
+
+static SoftFloat fabs(SoftFloat x) {
+  x.bits &= 0x7fffffff;
+  return x;
+}
+
+/** fast_math.cppのatan2Poly()と同じ計算 */
+template <typename T>
+static T atan2PolyT(T y, T x) {
+  T ax = fabs(x), ay = fabs(y), angle, z;
+  if (ax == T(0.0f) && ay == T(0.0f)) return T(0.0f);
+  z = ay <= ax ? ay / ax : ax / ay;
+  T z2 = z * z;
+  angle = z * (T(0.9998660f) +
+               z2 * (T(-0.3302995f) + z2 * (T(0.1801410f) + z2 * (T(-0.0851330f) + z2 * T(0.0208351f)))));
+  if (!(ay <= ax)) angle = T(1.57079633f) - angle;
+  if (x < T(0.0f)) angle = T(3.14159265f) - angle;
+  if (y < T(0.0f)) angle = -angle;
+  return angle;
+}
+
+/**
+ * 相補フィルタの計算時間の比較用に,CrlRobot::calcState(),calcThetaDot(),calcTheta()と同じ演算を型Tで行う.
+ * 加速度のFirstOrderFilterは一次のLtiFilter(LtiFilter<1>::calculate())と同じ式で計算する.
+ */
+template <typename T>
+class ComplementaryCost {
+ public:
+  T theta[3], state[3], b0, b1, a0, offset[3];
+
+  ComplementaryCost() {
+    float gain = 1 - expf(-DT * 25.0f);  // FirstOrderFilter::setT(1.0 / 25.0)と同じ係数
+    b0 = T(gain);
+    b1 = T(0.0f);
+    a0 = T(gain - 1);
+    for (int i = 0; i < 3; i++) theta[i] = state[i] = offset[i] = T(0.0f);
+  }
+
+  void update(const Sample& s, uint8_t axes) {
+    T acc[3], dot[3], measured;
+    for (int i = 0; i < 3; i++) {
+      if (!(axes & ~CRAWL_AXIS_BIT(i))) continue;
+      T x = T((int)s.acc[i]) * T(ACC_SCALE);
+      acc[i] = b0 * x + state[i];
+      state[i] = b1 * x - a0 * acc[i];
+    }
+    for (int i = 0; i < 3; i++) {
+      if (axes & CRAWL_AXIS_BIT(i)) dot[i] = (T((int)s.gyro[i]) - offset[i]) * T(AHRS_GYRO_SCALE);
+    }
+    for (int i = 0; i < 3; i++) {
+      if (!(axes & CRAWL_AXIS_BIT(i))) continue;
+      if (i == CRAWL_AXIS_Z) measured = T(1.57079633f) - atan2PolyT(acc[1], acc[0]);
+      if (i == CRAWL_AXIS_X) measured = T(1.57079633f) - atan2PolyT(acc[1], acc[2]);
+      if (i == CRAWL_AXIS_Y) measured = T(1.57079633f) - atan2PolyT(acc[2], acc[0]);
+      theta[i] = theta[i] * T(RATE_THETA) + measured * (T(1.0f) - T(RATE_THETA));
+      theta[i] = theta[i] + dot[i] * T((float)DT);
+    }
+  }
+};
+
+/** 姿勢推定と,CrlRobot::calcThetaAhrs()と同じ姿勢角度の計算 */
+class Ahrs {
+ public:
+  float theta[3];
+  MahonyAhrs ahrs;
+
+  void reset(const Sample& s) {
+    ahrs.setDt(DT);
+    ahrs.setGains(CRAWL_AHRS_KP, CRAWL_AHRS_KI);
+    ahrs.reset(s.acc[0], s.acc[1], s.acc[2]);
+    calcTheta(CRAWL_AXIS_BIT(CRAWL_AXIS_X) | CRAWL_AXIS_BIT(CRAWL_AXIS_Y) | CRAWL_AXIS_BIT(CRAWL_AXIS_Z));
+  }
+
+  void update(const Sample& s, uint8_t axes, bool use_mag) {
+    ahrs.update(s.acc, s.gyro, use_mag ? s.mag : NULL);
+    calcTheta(axes);
+  }
+
+  void calcTheta(uint8_t axes) {
+    int16_t x = ahrs.getUp(CRAWL_AXIS_X), y = ahrs.getUp(CRAWL_AXIS_Y), z = ahrs.getUp(CRAWL_AXIS_Z);
+    const float scale = 1.0f / (1L << FX_ANGLE_BITS);
+    if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Z)) theta[CRAWL_AXIS_Z] = (FX_HALF_PI - fxAtan2(y, x)) * scale;
+    if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_X)) theta[CRAWL_AXIS_X] = (FX_HALF_PI - fxAtan2(y, z)) * scale;
+    if (axes & CRAWL_AXIS_BIT(CRAWL_AXIS_Y)) theta[CRAWL_AXIS_Y] = (FX_HALF_PI - fxAtan2(z, x)) * scale;
+  }
+
+  /** 真の姿勢truthに対する,推定した姿勢の鉛直軸周りの回転 単位:rad */
+  double headingError(const Quat& truth) {
+    float q[4];
+    ahrs.getQuaternion(q);
+    Quat e = mul(truth, conj({q[0], q[1], q[2], q[3]}));  // 地上座標での推定から真値への回転
+    return 2 * atan2(e.z, e.w);
+  }
+};
+
+/** 角度の誤差(比べる軸の全体の二乗平均と最大) */
+struct Error {
+  double sum2 = 0, max = 0;
+  long count = 0;
+
+  void add(double e) {
+    e = remainder(e, 2 * M_PI);  // 相補フィルタは2piを超えて積分する
+    sum2 += e * e;
+    max = fmax(max, fabs(e));
+    count++;
+  }
+  void add(const float theta[3], const float truth[3], uint8_t axes) {
+    for (int i = 0; i < 3; i++) {
+      if (axes & CRAWL_AXIS_BIT(i)) add((double)theta[i] - truth[i]);
+    }
+  }
+  double rms() const { return count ? sqrt(sum2 / count) : 0; }
+};
+
+/** 計算結果を捨てられないようにするための変数 */
+static volatile float sink;
+
+/**
+ * fを全サンプルに適用した一回あたりの時間を表示する
+ * @return 一回あたりの時間 単位:ナノ秒
+ */
+template <typename F>
+static double measure(const char* name, const std::vector<Sample>& samples, F f) {
+  const int repeat = 20;
+#ifdef HAVE_TSC
+  unsigned long long c0 = __rdtsc();
+#endif
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; r++) {
+    for (const Sample& s : samples) f(s);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double n = (double)repeat * samples.size();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+#ifdef HAVE_TSC
+  printf("%-21s: %7.1f ns/update %7.1f cycles/update\n", name, ns, (__rdtsc() - c0) / n);
+#else
+  printf("%-21s: %7.1f ns/update\n", name, ns);
+#endif
+  return ns;
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 60;
+  const uint8_t xy = CRAWL_AXIS_BIT(CRAWL_AXIS_X) | CRAWL_AXIS_BIT(CRAWL_AXIS_Y);
+  const uint8_t all = xy | CRAWL_AXIS_BIT(CRAWL_AXIS_Z);
+  // 寝かせた状態は機体のZ軸,直立した状態は機体のX軸が鉛直上向き
+  const Scenario scenarios[] = {{"lying, turning", xy, {1, 0, 0, 0}, 0.5, 0.4, 1.0},
+                                {"standing, turning", CRAWL_AXIS_BIT(CRAWL_AXIS_Z), axisAngle(0, 1, 0, -M_PI / 2),
+                                 0.3, 0.2, 1.0}};
+
+  printf("kp %.2f /s, ki %.2f /s^2, %.0f s at %.0f Hz\n", (double)CRAWL_AHRS_KP, (double)CRAWL_AHRS_KI, seconds,
+         1 / DT);
+  for (const Scenario& scenario : scenarios) {
+    std::vector<Sample> samples = synthesize(scenario, seconds);
+    Complementary complementary;
+    Ahrs ahrs, ahrs_mag;
+    Error e_complementary, e_ahrs, e_ahrs_mag, heading, heading_mag;
+
+    complementary.reset(samples[0]);
+    ahrs.reset(samples[0]);
+    ahrs_mag.reset(samples[0]);
+    for (size_t k = 1; k < samples.size(); k++) {
+      complementary.update(samples[k], all);
+      ahrs.update(samples[k], all, false);
+      ahrs_mag.update(samples[k], all, true);
+      if (k * DT < 5) continue;  // 収束を待つ
+      e_complementary.add(complementary.theta, samples[k].theta, scenario.axes);
+      e_ahrs.add(ahrs.theta, samples[k].theta, scenario.axes);
+      e_ahrs_mag.add(ahrs_mag.theta, samples[k].theta, scenario.axes);
+      heading.add(ahrs.headingError(samples[k].pose));
+      heading_mag.add(ahrs_mag.headingError(samples[k].pose));
+    }
+    printf("%s (theta %s)\n", scenario.name, scenario.axes == xy ? "x, y" : "z");
+    printf("  complementary      : rms %.4f rad, max %.4f rad\n", e_complementary.rms(), e_complementary.max);
+    printf("  ahrs               : rms %.4f rad, max %.4f rad, heading rms %.4f rad, max %.4f rad\n", e_ahrs.rms(),
+           e_ahrs.max, heading.rms(), heading.max);
+    printf("  ahrs + mag         : rms %.4f rad, max %.4f rad, heading rms %.4f rad, max %.4f rad\n", e_ahrs_mag.rms(),
+           e_ahrs_mag.max, heading_mag.rms(), heading_mag.max);
+  }
+
+  Error e_atan2;
+  for (int y = -32768; y < 32768; y += 97) {
+    for (int x = -32768; x < 32768; x += 89) e_atan2.add(ldexp(fxAtan2(y, x), -FX_ANGLE_BITS) - atan2(y, x));
+  }
+  printf("fxAtan2              : rms %.1e rad, max %.1e rad\n", e_atan2.rms(), e_atan2.max);
+
+  std::vector<Sample> samples = synthesize(scenarios[0], seconds);
+  Complementary complementary;
+  Ahrs ahrs;
+  complementary.reset(samples[0]);
+  ahrs.reset(samples[0]);
+  ComplementaryCost<SoftFloat> soft;
+  printf("host time (CRAWL_FAST_MATH %d)\n", CRAWL_FAST_MATH);
+  measure("  complementary 3 axes", samples, [&](const Sample& s) {
+    complementary.update(s, all);
+    sink = complementary.theta[0];
+  });
+  measure("  complementary z", samples, [&](const Sample& s) {
+    complementary.update(s, CRAWL_AXIS_BIT(CRAWL_AXIS_Z));
+    sink = complementary.theta[CRAWL_AXIS_Z];
+  });
+  // 以下はATmega32U4と同じく浮動小数点演算を整数演算で行った時間で,姿勢推定はこれより短いこと
+  double soft_all = measure("  soft float 3 axes", samples, [&](const Sample& s) {
+    soft.update(s, all);
+    sink = soft.theta[0];
+  });
+  double soft_z = measure("  soft float z", samples, [&](const Sample& s) {
+    soft.update(s, CRAWL_AXIS_BIT(CRAWL_AXIS_Z));
+    sink = soft.theta[CRAWL_AXIS_Z];
+  });
+  double ahrs_all = measure("  ahrs 3 axes", samples, [&](const Sample& s) {
+    ahrs.update(s, all, false);
+    sink = ahrs.theta[0];
+  });
+  double ahrs_z = measure("  ahrs z", samples, [&](const Sample& s) {
+    ahrs.update(s, CRAWL_AXIS_BIT(CRAWL_AXIS_Z), false);
+    sink = ahrs.theta[CRAWL_AXIS_Z];
+  });
+  measure("  ahrs + mag 3 axes", samples, [&](const Sample& s) {
+    ahrs.update(s, all, true);
+    sink = ahrs.theta[0];
+  });
+  // 整数演算による浮動小数点演算がfloatと同じ結果になること(同じ計算の時間を比べていること)を確かめる
+  ComplementaryCost<float> hard_check;
+  ComplementaryCost<SoftFloat> soft_check;
+  long mismatches = 0;
+  for (const Sample& s : samples) {
+    hard_check.update(s, all);
+    soft_check.update(s, all);
+    for (int i = 0; i < 3; i++) mismatches += (float)soft_check.theta[i] != hard_check.theta[i];
+  }
+  printf("soft float mismatches: %ld / %zu\n", mismatches, samples.size() * 3);
+  printf("ahrs / soft float    : 3 axes %.2f, z %.2f\n", ahrs_all / soft_all, ahrs_z / soft_z);
+  bool ok = mismatches == 0 && ahrs_all < soft_all && ahrs_z < soft_z;
+  printf("%s\n", ok ? "OK" : "NG");
+  return ok ? 0 : 1;
+}
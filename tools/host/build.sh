@@ -0,0 +1,38 @@
+#!/bin/bash
+
+##
+## build.sh --- build the library and host tools for Linux
+##
+## Usage: ./tools/host/build.sh [OUTPUT_DIR]
+##
+## The hardware abstraction layer is linked against its host backend
+## (src/util/hal_host.cpp), which emulates the I2C devices of the robot.
+##
+
+set -eu
+
+# Move the current directory to the top of git directory
+cd $(git rev-parse --show-toplevel)
+
+out=${1:-_host_build}
+cxx=${CXX:-g++}
+cxxflags=${CXXFLAGS:-"-O2 -g"}
+includes="-Itools/host/include -Isrc -Isrc/util"
+
+mkdir -p "$out/obj"
+
+objs=""
+for src in src/util/*.cpp; do
+    obj="$out/obj/$(basename "${src%.cpp}").o"
+    echo "Compiling $src..."
+    $cxx $cxxflags $includes -c "$src" -o "$obj"
+    objs="$objs $obj"
+done
+rm -f "$out/libcrawl_host.a"
+ar rcs "$out/libcrawl_host.a" $objs
+
+for src in tools/host/*.cpp; do
+    bin="$out/$(basename "${src%.cpp}")"
+    echo "Linking $bin..."
+    $cxx $cxxflags $includes "$src" "$out/libcrawl_host.a" -o "$bin" -lm -pthread
+done
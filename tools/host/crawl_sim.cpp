@@ -0,0 +1,132 @@
+/**
+ * @file crawl_sim.cpp
+ * @brief
+ * 倒立振子の物理モデル(crawl_plant.h)の上でサンプルプログラムの倒立制御を閉ループで動かす.
+ *
+ * examples/C,C++/stand,examples/advanced/stand_advanced,examples/advanced/stand_kalmanのmain()を
+ * 名前だけ置き換えてそのまま取り込み,模擬デバイスの仮想時計で実行する.物理モデルは標本化のたびに
+ * 仮想時計の時刻まで進み,init()のキャリブレーションの後(CrlPlantConfig::release)に手を放した状態から倒立を始める.
+ * crlは一度しか初期化できないため,サンプルプログラムごとに子プロセスで実行する.
+ * SECONDS秒(仮想時間)の間に倒れなかったかを調べ,手を放して2秒後からの重心の方向の傾きの二乗平均と最大値,
+ * クローラの移動量,実時間に対する速さを表示する.倒れた,または傾きの最大値がTILT_LIMITを超えた
+ * サンプルプログラムがあれば終了コード1を返すため,モデルや制御の変更の回帰テストに使える.
+ * 初期のパラメータでは3つとも倒立を続け,傾きの最大値は0.012rad以下となる.位置のフィードバックがないため
+ * ゆっくりと前進を続け(standは約0.014m/s),目標角度で重心の偏りを補正しないstand_advanced,stand_kalmanは
+ * 約0.03m/sで前進する.
+ *
+ * Usage: crawl_sim [EXAMPLE [SECONDS]]
+ *   EXAMPLE: stand, stand_advanced, stand_kalman, all (初期値)
+ */
+#include <crawl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "crawl_plant.h"
+#include "hal_host.h"
+
+// サンプルプログラムを変更せずに取り込む
+#define main standMain
+#include "../../examples/C,C++/stand/stand.ino"
+#undef main
+#define main standAdvancedMain
+#include "../../examples/advanced/stand_advanced/stand_advanced.ino"
+#undef main
+#define main standKalmanMain
+#include "../../examples/advanced/stand_kalman/stand_kalman.ino"
+#undef main
+
+/** 傾きを集計し始めるまでの,手を放してからの時間 単位:秒 */
+#define SETTLE_SECONDS 2.0
+/** 倒立を続けたとみなす重心の方向の傾きの最大値 単位:rad */
+#define TILT_LIMIT 0.05
+
+/** サンプルプログラム */
+static const struct {
+  const char* name;
+  int (*run)();
+} EXAMPLES[] = {
+    {"stand", standMain},
+    {"stand_advanced", standAdvancedMain},
+    {"stand_kalman", standKalmanMain},
+};
+
+/** 物理モデル */
+static CrlPlant plant;
+/** 終了する仮想時刻 単位:マイクロ秒 */
+static unsigned long end_us;
+/** 実行中のサンプルプログラムの名前 */
+static const char* running;
+/** 開始時の実時間 */
+static std::chrono::steady_clock::time_point wall_start;
+/** 傾きの二乗和,最大値,標本数 */
+static double tilt_sq, tilt_max;
+static long tilt_count;
+
+/** 結果を表示して子プロセスを終了する */
+static void finish() {
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  double simulated = plant.getTime();
+  bool failed = plant.isFallen() || tilt_max > TILT_LIMIT;
+  if (plant.isFallen()) {
+    printf("%-16s: fell at %.2f s (released at %.1f s)\n", running, simulated, plant.config.release);
+  } else {
+    printf("%-16s: %s %.0f s, tilt rms %.4f rad, max %.4f rad, travel %+.3f m, %.2f s wall (%.0fx)\n",
+           running, failed ? "tilt over limit" : "balanced", simulated,
+           tilt_count > 0 ? sqrt(tilt_sq / tilt_count) : 0.0, tilt_max, plant.getPosition(), wall, simulated / wall);
+  }
+  fflush(stdout);
+  _exit(failed ? 1 : 0);
+}
+
+/** 標本化のたびに模擬MPU-9250から呼ばれる */
+static void imuSource(unsigned long us) {
+  hostDrivePlant(&plant, us);
+  if (plant.getTime() >= plant.config.release + SETTLE_SECONDS) {
+    double tilt = fabs(plant.getTilt() + plant.config.com_offset);  // 重心の方向の鉛直からの傾き
+    tilt_sq += tilt * tilt;
+    tilt_max = fmax(tilt_max, tilt);
+    tilt_count++;
+  }
+  if (plant.isFallen() || (long)(us - end_us) >= 0) finish();
+}
+
+/** 子プロセスでサンプルプログラムを実行する */
+static bool run(int index, double seconds) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    hostReset();
+    plant.reset();
+    running = EXAMPLES[index].name;
+    end_us = (unsigned long)((plant.config.release + seconds) * 1e6);
+    wall_start = std::chrono::steady_clock::now();
+    hostSetMag(0, 0, 0);
+    hostSetImuSource(imuSource);
+    EXAMPLES[index].run();  // 戻らない
+    _exit(2);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char** argv) {
+  const char* name = argc > 1 ? argv[1] : "all";
+  double seconds = argc > 2 ? atof(argv[2]) : 1000;
+  int errors = 0, ran = 0;
+  fflush(stdout);
+  for (int i = 0; i < (int)(sizeof(EXAMPLES) / sizeof(EXAMPLES[0])); i++) {
+    if (strcmp(name, "all") != 0 && strcmp(name, EXAMPLES[i].name) != 0) continue;
+    if (!run(i, seconds)) errors++;
+    ran++;
+  }
+  if (ran == 0) {
+    fprintf(stderr, "unknown example: %s\n", name);
+    return 2;
+  }
+  printf("%d/%d balanced\n", ran - errors, ran);
+  return errors ? 1 : 0;
+}
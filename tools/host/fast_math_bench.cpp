@@ -0,0 +1,149 @@
+/**
+ * @file fast_math_bench.cpp
+ * @brief
+ * fast_math.hの各実装(と比較用のlibm,固定小数点演算のfxAtan2)について,
+ * 入力範囲全体を走査した最大誤差と一回あたりの計算時間を表示する.
+ *
+ * - atan2: 全周を等分した方向と,1e-3〜1e4の大きさの組み合わせ(軸上,原点を含む)
+ * - sin/cos: [-2pi, 2pi] radと[-100, 100] radをそれぞれ等分した点
+ * - 1/sqrt: [1e-3, 1e10]を対数で等分した点(fastInvSqrt()のみ,誤差は相対誤差)
+ *
+ * 誤差は倍精度のlibmとの差の最大値.計算時間はホスト上の値で,x86ではTSCのサイクル数も表示する.
+ *
+ * Usage: fast_math_bench [SAMPLES]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "fast_math.h"
+#include "fixed_point.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+static float atan2Libm(float y, float x) { return atan2f(y, x); }
+static float sinLibm(float x) { return sinf(x); }
+static float cosLibm(float x) { return cosf(x); }
+static float invSqrtLibm(float x) { return 1 / sqrtf(x); }
+static float atan2Fixed(float y, float x) {
+  return fxToFloat(fxAtan2(fxFromFloat(y, FX_VALUE_BITS), fxFromFloat(x, FX_VALUE_BITS)), FX_ANGLE_BITS);
+}
+
+/** 計算結果を捨てられないようにするための変数 */
+static volatile float sink;
+
+struct Timing {
+  double ns;
+  double cycles;
+};
+
+template <typename F>
+static Timing measure(F f, size_t n) {
+  float acc = 0;
+#ifdef HAVE_TSC
+  unsigned long long c0 = __rdtsc();
+#endif
+  auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < n; i++) acc += f(i);
+  auto t1 = std::chrono::steady_clock::now();
+  Timing t;
+#ifdef HAVE_TSC
+  t.cycles = (double)(__rdtsc() - c0) / n;
+#else
+  t.cycles = 0;
+#endif
+  sink = acc;
+  t.ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+  return t;
+}
+
+static void report(const char* name, double max_err, Timing t) {
+#ifdef HAVE_TSC
+  printf("%-14s max error %.3e  %7.2f ns/call  %7.1f cycles/call\n", name, max_err, t.ns, t.cycles);
+#else
+  printf("%-14s max error %.3e  %7.2f ns/call\n", name, max_err, t.ns);
+#endif
+}
+
+static void benchAtan2(const char* name, float (*f)(float, float), const std::vector<float>& ys,
+                       const std::vector<float>& xs) {
+  double max_err = 0;
+  for (size_t i = 0; i < xs.size(); i++) {
+    double m = fmax(fabs(xs[i]), fabs(ys[i]));
+    if (f == atan2Fixed && (m > 30000 || (m > 0 && m < 1))) continue;  // Q16.16の範囲外,分解能不足
+    double ref = atan2((double)ys[i], (double)xs[i]);
+    double err = fabs(f(ys[i], xs[i]) - ref);
+    if (err > M_PI) err = fabs(err - 2 * M_PI);  // -piとpiは同じ角度
+    if (err > max_err) max_err = err;
+  }
+  report(name, max_err, measure([&](size_t i) { return f(ys[i], xs[i]); }, xs.size()));
+}
+
+static void benchUnary(const char* name, float (*f)(float), double (*ref)(double), const std::vector<float>& xs) {
+  double max_err = 0;
+  for (size_t i = 0; i < xs.size(); i++) {
+    double err = fabs(f(xs[i]) - ref((double)xs[i]));
+    if (err > max_err) max_err = err;
+  }
+  report(name, max_err, measure([&](size_t i) { return f(xs[i]); }, xs.size()));
+}
+
+static void benchInvSqrt(const char* name, float (*f)(float), const std::vector<float>& xs) {
+  double max_err = 0;
+  for (size_t i = 0; i < xs.size(); i++) {
+    double ref = 1 / sqrt((double)xs[i]);
+    double err = fabs(f(xs[i]) - ref) / ref;
+    if (err > max_err) max_err = err;
+  }
+  report(name, max_err, measure([&](size_t i) { return f(xs[i]); }, xs.size()));
+}
+
+int main(int argc, char** argv) {
+  size_t samples = argc > 1 ? atol(argv[1]) : 1000000;
+  std::vector<float> ys, xs, angles, wide_angles, squares;
+  const float radii[] = {1e-3f, 1.0f, 9.80665f, 300.0f, 1e4f};
+
+  for (size_t i = 0; i < samples; i++) {
+    double a = -M_PI + 2 * M_PI * i / samples;
+    float r = radii[i % 5];
+    ys.push_back((float)(r * sin(a)));
+    xs.push_back((float)(r * cos(a)));
+    angles.push_back((float)(-2 * M_PI + 4 * M_PI * i / samples));
+    wide_angles.push_back((float)(-100.0 + 200.0 * i / samples));
+    squares.push_back((float)pow(10.0, -3.0 + 13.0 * i / samples));
+  }
+  // 軸上と原点
+  const float special[][2] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0}, {0, 0}};
+  for (const auto& p : special) {
+    ys.push_back(p[0]);
+    xs.push_back(p[1]);
+  }
+
+  printf("atan2 (%zu points)\n", xs.size());
+  benchAtan2("libm", atan2Libm, ys, xs);
+  benchAtan2("poly", atan2Poly, ys, xs);
+  benchAtan2("table", atan2Table, ys, xs);
+  benchAtan2("cordic", atan2Cordic, ys, xs);
+  benchAtan2("fixed (fx)", atan2Fixed, ys, xs);
+  for (int range = 0; range < 2; range++) {
+    const std::vector<float>& a = range == 0 ? angles : wide_angles;
+    const char* domain = range == 0 ? "[-2pi, 2pi]" : "[-100, 100]";
+    printf("sin %s (%zu points)\n", domain, a.size());
+    benchUnary("libm", sinLibm, sin, a);
+    benchUnary("poly", sinPoly, sin, a);
+    benchUnary("table", sinTable, sin, a);
+    benchUnary("cordic", sinCordic, sin, a);
+    printf("cos %s (%zu points)\n", domain, a.size());
+    benchUnary("libm", cosLibm, cos, a);
+    benchUnary("poly", cosPoly, cos, a);
+    benchUnary("table", cosTable, cos, a);
+    benchUnary("cordic", cosCordic, cos, a);
+  }
+  printf("1/sqrt [1e-3, 1e10] (%zu points)\n", squares.size());
+  benchInvSqrt("libm", invSqrtLibm, squares);
+  benchInvSqrt("fast", fastInvSqrt, squares);
+  return 0;
+}
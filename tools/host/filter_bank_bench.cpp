@@ -0,0 +1,129 @@
+/**
+ * @file filter_bank_bench.cpp
+ * @brief
+ * FilterBankとfirstOrderFilterBlock()について,crawl.hの各クラスとの結果の差と計算時間を表示する.
+ *
+ * - FilterBank: 一次遅れ,不完全微分,積分(制限付き)を混ぜたN個のフィルタを,各クラスのオブジェクトN個と比較する.
+ *   結果はビット単位で一致する(不一致の数が0)はず.
+ * - firstOrderFilterBlock(): 一様乱数と正弦波の入力をFirstOrderFilterに通した結果と比較する.
+ *   差は入力の最大絶対値に対する比で,FILTER_BANK_BLOCK_TOLERANCE以内であることを確認する.
+ *
+ * Usage: filter_bank_bench [SAMPLES]
+ */
+#include <crawl.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "filter_bank.h"
+
+/** 計算結果を捨てられないようにするための変数 */
+static volatile float sink;
+
+static double elapsedNs(std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1) {
+  return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+/** FilterBankと同じ設定のスカラーのフィルタ群 */
+struct ScalarFilters {
+  std::vector<FirstOrderFilter> fof;
+  std::vector<LaggedDerivative> ld;
+  std::vector<Integral> integral;
+};
+
+static int compareBank(long samples) {
+  const size_t kinds = 3, per_kind = 22, n = kinds * per_kind;  // SIMDの幅で割り切れない数にする
+  const float dt = 0.01;
+  FilterBank bank(n);
+  ScalarFilters scalar;
+  scalar.fof.resize(per_kind);
+  scalar.ld.resize(per_kind);
+  scalar.integral.resize(per_kind);
+  for (size_t k = 0; k < per_kind; k++) {
+    float T = 0.005f * (k + 1);
+    bank.setFirstOrderFilter(k, dt, T);
+    scalar.fof[k].setDt(dt);
+    scalar.fof[k].setT(T);
+    bank.setLaggedDerivative(per_kind + k, dt, T);
+    scalar.ld[k].setDt(dt);
+    scalar.ld[k].setT(T);
+    bank.setIntegral(2 * per_kind + k, dt, -0.5f - k * 0.1f, 0.5f + k * 0.1f);
+    scalar.integral[k].setDt(dt);
+    scalar.integral[k].setLimit(-0.5f - k * 0.1f, 0.5f + k * 0.1f);
+  }
+
+  std::vector<float> x(n), expected(n);
+  long mismatches = 0;
+  double scalar_ns = 0, bank_ns = 0;
+  srand(1);
+  for (long t = 0; t < samples; t++) {
+    for (size_t i = 0; i < n; i++) x[i] = (float)rand() / RAND_MAX * 2 - 1 + 0.5f * sinf(t * 0.01f + i);
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < per_kind; k++) {
+      expected[k] = scalar.fof[k].calculate(x[k]);
+      expected[per_kind + k] = scalar.ld[k].calculate(x[per_kind + k]);
+      scalar.integral[k].calculate(x[2 * per_kind + k]);
+      expected[2 * per_kind + k] = scalar.integral[k].getOutput();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    bank.calculate(x.data());
+    auto t2 = std::chrono::steady_clock::now();
+    scalar_ns += elapsedNs(t0, t1);
+    bank_ns += elapsedNs(t1, t2);
+    const float* y = bank.getOutput();
+    for (size_t i = 0; i < n; i++) {
+      if (memcmp(&y[i], &expected[i], sizeof(float)) != 0) mismatches++;
+    }
+  }
+  printf("[FilterBank] %zu filters x %ld samples, backend %s\n", n, samples, FilterBank::backend());
+  printf("scalar classes   : %.2f ns/filter/sample\n", scalar_ns / samples / n);
+  printf("FilterBank       : %.2f ns/filter/sample\n", bank_ns / samples / n);
+  printf("bit mismatches   : %ld\n", mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
+
+static int compareBlock(long samples) {
+  const float dt = 0.01;
+  const float Ts[] = {10, 1, 0.1, 0.01};
+  std::vector<float> x(samples), expected(samples), out(samples);
+  int status = 0;
+  printf("\n[firstOrderFilterBlock] %ld samples\n", samples);
+  printf("%8s %8s %14s %14s %14s\n", "dt/T", "input", "scalar ns", "block ns", "max err/|x|");
+  for (int input = 0; input < 2; input++) {
+    srand(2);
+    for (long k = 0; k < samples; k++) {
+      x[k] = input == 0 ? (float)rand() / RAND_MAX * 2 - 1 : sinf(k * 0.003f) + 0.3f * sinf(k * 0.11f);
+    }
+    float x_max = 0;
+    for (long k = 0; k < samples; k++) x_max = fmaxf(x_max, fabsf(x[k]));
+    for (float T : Ts) {
+      FirstOrderFilter fof;
+      fof.setDt(dt);
+      fof.setT(T);
+      auto t0 = std::chrono::steady_clock::now();
+      for (long k = 0; k < samples; k++) expected[k] = fof.calculate(x[k]);
+      auto t1 = std::chrono::steady_clock::now();
+      float y = 0;
+      firstOrderFilterBlock(dt, T, y, x.data(), out.data(), samples);
+      auto t2 = std::chrono::steady_clock::now();
+      sink = y;
+      double err = 0;
+      for (long k = 0; k < samples; k++) err = fmax(err, fabs(out[k] - expected[k]) / x_max);
+      if (err > FILTER_BANK_BLOCK_TOLERANCE || y != out[samples - 1]) status = 1;
+      printf("%8g %8s %14.2f %14.2f %14.3g\n", dt / T, input == 0 ? "random" : "sine", elapsedNs(t0, t1) / samples,
+             elapsedNs(t1, t2) / samples, err);
+    }
+  }
+  printf("tolerance        : %g\n", FILTER_BANK_BLOCK_TOLERANCE);
+  return status;
+}
+
+int main(int argc, char** argv) {
+  long samples = argc > 1 ? atol(argv[1]) : 1000000;
+  int status = compareBank(samples / 10);
+  status |= compareBlock(samples);
+  printf("\n%s\n", status == 0 ? "OK" : "FAILED");
+  return status;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file filter_bench.cpp
+ * @brief
+ * FirstOrderFilter,LaggedDerivative,Integral,Biquadの一サンプルあたりの計算時間と,
+ * ステップ入力に対する応答の解析解との誤差を表示する.
+ *
+ * 比較のため,以前の実装(ルンゲクッタ法による一次遅れ)も同じ条件で計測する.
+ *
+ * Usage: filter_bench [SAMPLES]
+ */
+#include <crawl.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+/** 計算結果を捨てられないようにするための変数 */
+static volatile float sink;
+
+/** 以前のFirstOrderFilter::calculate()(ルンゲクッタ法) */
+struct Rk4FirstOrderFilter {
+  float dt, T, y;
+  float calculate(float x) {
+    float k, k0, k1, k2, k3;
+    k0 = (x - y) / T;
+    k1 = (x - (y + k0 * dt * 0.5)) / T;
+    k2 = (x - (y + k1 * dt * 0.5)) / T;
+    k3 = (x - (y + k1 * dt)) / T;
+    k = (k0 + 2 * k1 + 2 * k2 + k3) / 6;
+    y = y + k * dt;
+    return y;
+  }
+};
+
+template <typename F>
+static double measure(F f, long n) {
+  float acc = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (long i = 0; i < n; i++) acc += f((i & 1023) * 0.001f);
+  auto t1 = std::chrono::steady_clock::now();
+  sink = acc;
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+}
+
+int main(int argc, char** argv) {
+  long n = argc > 1 ? atol(argv[1]) : 20000000;
+  const float dt = 0.01;
+
+  // ステップ応答 y(k dt) = 1 - exp(-k dt / T), 不完全微分は exp(-k dt / T) / T
+  printf("step response error (dt = %g, 1000 samples)\n", dt);
+  printf("%8s %14s %14s %14s\n", "T", "RK4 lag", "exact lag", "lagged deriv");
+  const float Ts[] = {1.0 / 50, 1.0 / 25, 1.0 / 15, 1.0 / 5, 1};
+  for (float T : Ts) {
+    Rk4FirstOrderFilter rk4 = {dt, T, 0};
+    FirstOrderFilter fof;
+    LaggedDerivative ld;
+    fof.setDt(dt);
+    fof.setT(T);
+    ld.setDt(dt);
+    ld.setT(T);
+    double e_rk4 = 0, e_fof = 0, e_ld = 0;
+    for (int k = 1; k <= 1000; k++) {
+      double decay = exp(-k * (double)dt / T);
+      e_rk4 = fmax(e_rk4, fabs(rk4.calculate(1) - (1 - decay)));
+      e_fof = fmax(e_fof, fabs(fof.calculate(1) - (1 - decay)));
+      e_ld = fmax(e_ld, fabs(ld.calculate(1) - decay / T) * T);  // 1/Tで正規化
+    }
+    printf("%8.4f %14.3g %14.3g %14.3g\n", T, e_rk4, e_fof, e_ld);
+  }
+
+  Rk4FirstOrderFilter rk4 = {dt, 1.0 / 25, 0};
+  FirstOrderFilter fof;
+  LaggedDerivative ld;
+  Integral integral;
+  Biquad biquad;
+  fof.setDt(dt);
+  fof.setT(1.0 / 25);
+  ld.setDt(dt);
+  ld.setT(1.0 / 25);
+  integral.setDt(dt);
+  const float b[3] = {0.0675f, 0.135f, 0.0675f}, a[2] = {-1.143f, 0.4128f};
+  biquad.setCoefficients(b, a);
+
+  printf("\nns/sample (%ld samples)\n", n);
+  printf("RK4 FirstOrderFilter : %.2f\n", measure([&](float x) { return rk4.calculate(x); }, n));
+  printf("FirstOrderFilter     : %.2f\n", measure([&](float x) { return fof.calculate(x); }, n));
+  printf("LaggedDerivative     : %.2f\n", measure([&](float x) { return ld.calculate(x); }, n));
+  auto integrate = [&](float x) {
+    integral.calculate(x);
+    return integral.getOutput();
+  };
+  printf("Integral             : %.2f\n", measure(integrate, n));
+  printf("Biquad               : %.2f\n", measure([&](float x) { return biquad.calculate(x); }, n));
+  return 0;
+}
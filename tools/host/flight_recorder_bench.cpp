@@ -0,0 +1,118 @@
+/**
+ * @file flight_recorder_bench.cpp
+ * @brief
+ * CrlRobotのフライトレコーダをホスト上で動かし,シリアル通信へ送出されたレコードを検査する.
+ *
+ * realtimeLoop()とupdateState()を仮想時計で指定周期だけ繰り返し,UARTへ送出されたテレメトリのフレームを
+ * CrlRecordとして復元する.壊れたフレーム,通し番号の飛び(捨てられたレコード数と一致すること),時刻の逆行,
+ * 記録内容を調べ,1バイトを書き換えたフレームがCRCで検出されることも確かめる.
+ * 問題がなければOKを表示する.問題があれば0以外の終了コードを返す.
+ * CRAWL_RECORDER_RECORDSを1以上にしてビルドすること: CXXFLAGS="-O2 -DCRAWL_RECORDER_RECORDS=8" ./tools/host/build.sh
+ *
+ * Usage: flight_recorder_bench [PERIODS [DT [BAUD [OUTPUT]]]]
+ *   BAUDを省略するとCRAWL_TELEMETRY_BAUD.OUTPUTを指定すると受信したバイト列を書き出す(telemetry_decodeの入力になる)
+ */
+#include <crawl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "hal_host.h"
+#include "telemetry.h"
+
+#if CRAWL_RECORDER_RECORDS == 0
+int main() {
+  printf("flight recorder is disabled (build with -DCRAWL_RECORDER_RECORDS=8)\n");
+  return 0;
+}
+#else
+int main(int argc, char** argv) {
+  long periods = argc > 1 ? atol(argv[1]) : 1000;
+  float dt = argc > 2 ? atof(argv[2]) : 0.01;
+  unsigned long baud = argc > 3 ? atol(argv[3]) : CRAWL_TELEMETRY_BAUD;
+
+  hostReset();
+  hostSetAccel(0, 16384, 0);  // 直立: 重力はセンサのY軸方向
+  hostSetGyro(0, 0, 0);
+  hostSetMag(0, 0, 0);
+
+  crl.setDt(dt);
+  crl.init();
+  crl.setRecorder(true);
+  telemetryBegin(baud);
+  hostSetMicrosTick(1);  // 待ち時間中のhalMicros()の呼び出しで仮想時計を進める
+
+  for (long i = 0; i < periods; i++) {
+    crl.realtimeLoop();
+    hostAddEncoder(1, -1);
+    crl.setMotorLeft(0.5);
+    crl.setMotorRight(-0.25);
+    crl.updateState();
+  }
+  // バッファに残っている分も送り出す
+  double frame_seconds = TELEMETRY_MAX_FRAME * 10.0 / baud;
+  for (long i = 0; i < (long)(frame_seconds / dt + 1) * CRAWL_RECORDER_RECORDS; i++) crl.realtimeLoop();
+
+  std::vector<uint8_t> out(1 << 20);
+  out.resize(hostTakeUartOutput(out.data(), out.size()));
+  if (argc > 4) {
+    FILE* file = fopen(argv[4], "wb");
+    if (file == NULL || fwrite(out.data(), 1, out.size(), file) != out.size()) perror(argv[4]);
+    if (file != NULL) fclose(file);
+  }
+
+  long received = 0, skipped = 0, errors = 0, bytes = 0;
+  long last_sequence = -1;
+  unsigned long last_time = 0;
+  size_t start = 0;
+  for (size_t end = 0; end < out.size(); end++) {
+    if (out[end] != 0) continue;
+    if (end == start) {  // telemetryBegin()が送る区切り
+      start = end + 1;
+      continue;
+    }
+    uint8_t type, payload[TELEMETRY_MAX_PAYLOAD];
+    int16_t length = telemetryDecode(&out[start], end - start, &type, payload);
+    if (received == 0) {
+      // 1バイトを書き換えたフレームは復号できないこと
+      std::vector<uint8_t> broken(&out[start], &out[end]);
+      broken[broken.size() / 2] ^= 0x10;
+      if (telemetryDecode(broken.data(), broken.size(), &type, payload) >= 0) errors++;
+    }
+    bytes = end + 1 - start;
+    start = end + 1;
+    if (length != sizeof(CrlRecord) || type != TELEMETRY_RECORD) {
+      printf("broken frame at byte %zu\n", end);
+      errors++;
+      continue;
+    }
+    CrlRecord record;
+    memcpy(&record, payload, sizeof(record));
+    if (last_sequence >= 0) {
+      skipped += (uint8_t)(record.sequence - last_sequence - 1);
+      if (record.time <= last_time) errors++;
+    }
+    if (record.motor[0] != 127 || record.motor[1] != -63) errors++;
+    // 初回はinit()直後でバックグラウンドの読み出しが済んでいない
+    if (record.sequence > 0 && (record.encoder[0] != 1 || record.encoder[1] != -1)) errors++;
+    last_sequence = record.sequence;
+    last_time = record.time;
+    received++;
+  }
+  if (start != out.size()) errors++;
+  // 最後に受け取ったレコードより後に捨てられたものも数える
+  if (last_sequence >= 0) skipped += (uint8_t)(periods - 1 - last_sequence);
+  if (skipped != crl.getRecorderDropped()) errors++;
+
+  printf("periods              : %ld\n", periods);
+  printf("record bytes         : %zu\n", sizeof(CrlRecord));
+  printf("frame bytes          : %ld\n", bytes);
+  printf("baud                 : %lu\n", baud);
+  printf("records received     : %ld\n", received);
+  printf("records dropped      : %u\n", crl.getRecorderDropped());
+  printf("sequence gaps        : %ld\n", skipped);
+  printf("theta_x (last)       : %f\n", crl.getThetaX());
+  printf("%s\n", errors ? "NG" : "OK");
+  return errors ? 1 : 0;
+}
+#endif
@@ -0,0 +1,496 @@
+/**
+ * @file gain_sweep.cpp
+ * @brief
+ * 倒立振子の物理モデル(crawl_plant.h)の上でstand_advancedの制御ゲインとカルマンフィルタの分散を探索する.
+ *
+ * 各候補(パラメータの組)をEPISODES回の閉ループのエピソード(雑音の乱数の種と手を放す時の傾きを変える)で評価し,
+ * 倒れた回数,整定時間(重心の方向の傾きが最後にSETTLE_BANDを超えた時刻),傾きの二乗平均,
+ * 制御入力の二乗平均からコストを求め,コストの小さい順に並べて表示する.
+ * 候補は格子(NAME=MIN:MAX:Nごとの等間隔,最小値が正で最大値との比が100以上なら対数で等間隔)か,
+ * --randomでの一様な乱択で作る.--refineを指定すると,乱択の後に上位の候補の平均と標準偏差から
+ * 範囲を絞って乱択を繰り返す(交差エントロピー法).
+ * エピソードは--threads本の固定したワーカーのスレッドで,ワークスティーリングにより実行する.
+ * 倒れたエピソードはすぐに終わり実行時間が大きく異なるため,各ワーカーは自分の列の先頭から取り出し,
+ * 空になると他のワーカーの列の末尾から盗む.模擬デバイスとドライバの状態はスレッドごとに持つため,
+ * 各エピソードは終わりに連続読み出しを止め(stopAcquisition()),始めにhostReset()で模擬デバイスを戻す.
+ *
+ * 探索の前に,stand_advancedのゲインの候補を同じスレッドで2回評価し,どのエピソードも倒れないこと
+ * (物理モデルがサンプルプログラムを倒立させること,tools/host/crawl_simと同じ確認)と,
+ * 2回の結果がビット単位で一致すること(エピソード間でライブラリの状態が残らないこと)を確かめる.
+ * どちらかを満たさなければ探索せずに終了コード1を返す.
+ * 最後に,各エピソードの実行に使ったCPU時間の合計を経過時間で割った並列化による速さの伸びを表示する.
+ *
+ * Usage: gain_sweep [OPTIONS] [NAME=VALUE | NAME=MIN:MAX[:N]]...
+ *   NAME: kp1, kp2, ki2, t_err2, t_err2i (stand_advancedの変数とFirstOrderFilterの時定数),
+ *         q1, q2, r1, r2 (KalmanFilterBankの分散.--kalmanの場合のみ使う).指定しない値はstand_advancedと同じ
+ *   --random COUNT   格子の代わりにCOUNT個を乱択する(NはCOUNTの指定がない場合の格子の点数,初期値5)
+ *   --refine ROUNDS  乱択の後に範囲を絞って乱択をROUNDS回繰り返す
+ *   --episodes N     候補あたりのエピソード数(初期値4)
+ *   --seconds S      手を放してから評価する時間 単位:秒(初期値10)
+ *   --threads N      ワーカーの数(初期値はstd::thread::hardware_concurrency())
+ *   --kalman         姿勢角度をカルマンフィルタで求める(stand_kalmanと同じ)
+ *   --seed N         乱択の乱数の種
+ *   --top N          表示する候補の数(初期値10)
+ *   -o FILE          全候補の順位表をCSVで書き出す
+ */
+#include <crawl.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "acquisition.h"
+#include "crawl_plant.h"
+#include "hal_host.h"
+
+/** ループ間隔 単位:秒 */
+#define DT 0.010f
+/** 整定したとみなす重心の方向の傾きの大きさ 単位:rad */
+#define SETTLE_BAND 0.02
+/** 倒れたエピソード1回のコスト(倒れなかった候補の他の項より十分大きくする) */
+#define FALL_COST 1000.0
+/** 傾きの二乗平均のコストの重み(0.01radで1秒の整定時間と同じ) 単位:秒/rad */
+#define TILT_WEIGHT 100.0
+/** 制御入力の二乗平均のコストの重み(最大出力で1秒の整定時間と同じ) 単位:秒 */
+#define EFFORT_WEIGHT 1.0
+/** --refineで次の範囲を求める上位の候補の割合 */
+#define ELITE_RATIO 0.1
+/** 格子の点数の初期値 */
+#define DEFAULT_STEPS 5
+
+/** パラメータの番号 */
+enum { KP1, KP2, KI2, T_ERR2, T_ERR2I, Q1, Q2, R1, R2, PARAMS };
+
+/** パラメータの名前と初期値(stand_advanced,KalmanFilterBankと同じ) */
+static const struct {
+  const char* name;
+  float value;
+} PARAM_INFO[PARAMS] = {
+    {"kp1", 5.0f}, {"kp2", 8.0f}, {"ki2", 40.0f}, {"t_err2", 1.0f / 15}, {"t_err2i", 1.0f / 5},
+    {"q1", 0.0001f}, {"q2", 0.001f}, {"r1", 1.0f}, {"r2", 1.0f},
+};
+
+/** 探索するパラメータの範囲 */
+struct Range {
+  /** 探索するならtrue.falseならminの値に固定する */
+  bool swept;
+  /** 最小値,最大値 */
+  double min, max;
+  /** 格子の点数 */
+  int steps;
+  /** 対数で等間隔(一様)にするならtrue */
+  bool log;
+};
+
+/** 1回のエピソードの結果 */
+struct Episode {
+  /** 倒れたらtrue */
+  bool fallen;
+  /** 整定時間(倒れた場合は倒れるまでの時間) 単位:秒 */
+  double settle;
+  /** 重心の方向の傾きの二乗平均 単位:rad */
+  double tilt_rms;
+  /** 制御入力の二乗平均 */
+  double effort;
+};
+
+/** 候補と評価の結果 */
+struct Candidate {
+  /** パラメータ */
+  float params[PARAMS];
+  /** エピソードの結果 */
+  std::vector<Episode> episodes;
+  /** 倒れた回数 */
+  int falls;
+  /** 整定時間,傾きの二乗平均,制御入力の二乗平均の平均値 */
+  double settle, tilt_rms, effort;
+  /** コスト */
+  double cost;
+};
+
+/** 探索の設定 */
+static Range ranges[PARAMS];
+static int episode_count = 4;
+static double seconds = 10;
+static bool use_kalman = false;
+
+/** 実行中のスレッドの物理モデル */
+static thread_local CrlPlant* plant;
+
+/** 標本化のたびに模擬MPU-9250から呼ばれる */
+static void imuSource(unsigned long us) { hostDrivePlant(plant, us); }
+
+/** パラメータparamsでepisode番目のエピソードを実行する */
+static Episode runEpisode(const float* params, int episode) {
+  hostEraseEeprom();
+  hostReset();
+  CrlPlant model;
+  model.config.seed = episode + 1;
+  model.config.initial_tilt = 0.05f * (episode % 3 - 1);
+  model.reset();
+  plant = &model;
+  hostSetMag(0, 0, 0);
+  hostSetImuSource(imuSource);
+
+  CrlRobot robot;
+  Integral err2i;
+  FirstOrderFilter fof_err2, fof_err2i;
+  err2i.setDt(DT);
+  err2i.setLimit(-5.0, 5.0);
+  fof_err2.setDt(DT);
+  fof_err2.setT(params[T_ERR2]);
+  fof_err2i.setDt(DT);
+  fof_err2i.setT(params[T_ERR2I]);
+  robot.init();
+  robot.setDt(DT);
+  if (use_kalman) {
+    for (uint8_t axis = 0; axis < 3; axis++) {
+#if CRAWL_KALMAN_BIAS
+      robot.kf.setProcessNoise(axis, params[Q1], params[Q2], 1e-9);
+#else
+      robot.kf.setProcessNoise(axis, params[Q1], params[Q2]);
+#endif
+      robot.kf.setObservationNoise(axis, params[R1], params[R2]);
+    }
+    robot.setKalman(true);
+  }
+
+  double settled_at = 0, tilt_sq = 0, effort_sq = 0;
+  long count = 0;
+  while (!model.isFallen() && model.getTime() < model.config.release + seconds) {
+    robot.realtimeLoop();
+    robot.updateState();
+    float theta = robot.getThetaZ();
+    float err1 = ((float)M_PI / 2 + fof_err2i.getOutput() * params[KI2]) - theta;
+    float err2 = -robot.getHeadVelocity();
+    fof_err2.calculate(err2);
+    err2i.calculate(err2);
+    fof_err2i.calculate(err2i.getOutput());
+    float u = err1 * params[KP1] + fof_err2.getOutput() * params[KP2];
+    if (theta < M_PI / 4 || 3 * M_PI / 4 < theta) u = 0;
+    robot.setMotorLeft(u);
+    robot.setMotorRight(u);
+
+    if (!model.isReleased()) continue;
+    double tilt = fabs(model.getTilt() + model.config.com_offset);  // 重心の方向の鉛直からの傾き
+    double effort = fmin(fabs(u), 1.0);
+    if (tilt > SETTLE_BAND) settled_at = model.getTime() - model.config.release;
+    tilt_sq += tilt * tilt;
+    effort_sq += effort * effort;
+    count++;
+  }
+  stopAcquisition();  // 同じスレッドの次のエピソードでstartAcquisition()から始める
+  hostSetImuSource(NULL);
+  plant = NULL;
+
+  Episode result;
+  result.fallen = model.isFallen();
+  result.settle = result.fallen ? model.getTime() - model.config.release : settled_at;
+  result.tilt_rms = count > 0 ? sqrt(tilt_sq / count) : 0;
+  result.effort = count > 0 ? sqrt(effort_sq / count) : 0;
+  return result;
+}
+
+/** 1つのワーカーの仕事の列 */
+struct WorkQueue {
+  std::mutex mutex;
+  std::deque<int> tasks;
+};
+
+/**
+ * 0〜count-1のタスクをthreads個のワーカーで実行する.
+ * タスクは連続した塊に分けて各ワーカーの列に入れ,自分の列が空になったワーカーは他の列の末尾から盗む.
+ */
+static void runTasks(int count, int threads, const std::function<void(int)>& task) {
+  std::vector<WorkQueue> queues(threads);
+  for (int i = 0; i < count; i++) queues[(long)i * threads / count].tasks.push_back(i);
+  auto take = [&](int self, int* index) {
+    for (int k = 0; k < threads; k++) {
+      WorkQueue& queue = queues[(self + k) % threads];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) continue;
+      if (k == 0) {
+        *index = queue.tasks.front();
+        queue.tasks.pop_front();
+      } else {
+        *index = queue.tasks.back();
+        queue.tasks.pop_back();
+      }
+      return true;
+    }
+    return false;  // タスクは新たに増えないため,全部の列が空なら終わり
+  };
+  std::vector<std::thread> workers;
+  for (int w = 0; w < threads; w++) {
+    workers.emplace_back([&, w]() {
+      for (int index; take(w, &index);) task(index);
+    });
+  }
+  for (std::thread& worker : workers) worker.join();
+}
+
+/** 各エピソードの実行に使ったCPU時間の合計 単位:ナノ秒 */
+static std::atomic<long long> busy_ns(0);
+
+/** 呼び出したスレッドのCPU時間 単位:ナノ秒 */
+static long long threadCpuNanos() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/** 全候補の未評価のエピソードを実行して,コストを求める */
+static void evaluate(std::vector<Candidate>* candidates, size_t first, int threads) {
+  int count = (int)(candidates->size() - first) * episode_count;
+  for (size_t i = first; i < candidates->size(); i++) (*candidates)[i].episodes.resize(episode_count);
+  runTasks(count, threads, [&](int task) {
+    Candidate& candidate = (*candidates)[first + task / episode_count];
+    int episode = task % episode_count;
+    long long start = threadCpuNanos();
+    candidate.episodes[episode] = runEpisode(candidate.params, episode);
+    busy_ns += threadCpuNanos() - start;
+  });
+  for (size_t i = first; i < candidates->size(); i++) {
+    Candidate& c = (*candidates)[i];
+    c.falls = 0;
+    c.settle = c.tilt_rms = c.effort = 0;
+    for (const Episode& e : c.episodes) {
+      c.falls += e.fallen;
+      c.settle += e.settle / episode_count;
+      c.tilt_rms += e.tilt_rms / episode_count;
+      c.effort += e.effort / episode_count;
+    }
+    c.cost = c.falls > 0 ? c.falls * FALL_COST - c.settle  // 倒れた場合は長く耐えた方を上位にする
+                         : c.settle + TILT_WEIGHT * c.tilt_rms + EFFORT_WEIGHT * c.effort;
+  }
+}
+
+/**
+ * stand_advancedのゲインでどのエピソードも倒れず,同じスレッドで2回実行した結果が一致するか調べる.
+ * 倒れた場合は物理モデルの,一致しない場合はエピソード間に残ったライブラリ(ドライバ,模擬デバイス)の状態の問題として表示する
+ * @return 満たせばtrue
+ */
+static bool validatePlant() {
+  Candidate c;
+  for (int p = 0; p < PARAMS; p++) c.params[p] = PARAM_INFO[p].value;
+  bool balanced = true, repeatable = true;
+  for (int episode = 0; episode < episode_count; episode++) {
+    Episode first = runEpisode(c.params, episode);
+    Episode second = runEpisode(c.params, episode);
+    if (first.fallen) {
+      fprintf(stderr, "plant check: stand_advanced fell at %.2f s in episode %d\n", first.settle, episode);
+      balanced = false;
+    }
+    if (first.fallen != second.fallen || first.settle != second.settle || first.tilt_rms != second.tilt_rms ||
+        first.effort != second.effort) {
+      fprintf(stderr, "state check: episode %d differs when repeated on the same thread\n", episode);
+      repeatable = false;
+    }
+  }
+  if (!repeatable) {
+    fprintf(stderr,
+            "library state leaks from one episode into the next (acquisition, driver or host HAL state not reset by "
+            "hostReset()/startAcquisition()); results would depend on the episode order\n");
+  }
+  if (!balanced) fprintf(stderr, "the plant does not balance stand_advanced; fix crawl_plant.h before sweeping\n");
+  return balanced && repeatable;
+}
+
+/** 範囲の中の位置t(0〜1)の値 */
+static double lerp(const Range& r, double t) {
+  return r.log ? exp(log(r.min) + (log(r.max) - log(r.min)) * t) : r.min + (r.max - r.min) * t;
+}
+
+/** 固定する値と初期値だけを設定した候補 */
+static Candidate baseCandidate() {
+  Candidate c;
+  for (int p = 0; p < PARAMS; p++) c.params[p] = ranges[p].swept ? PARAM_INFO[p].value : (float)ranges[p].min;
+  return c;
+}
+
+/** 格子の全候補を加える */
+static void addGrid(std::vector<Candidate>* candidates) {
+  std::vector<int> index(PARAMS, 0);
+  while (true) {
+    Candidate c = baseCandidate();
+    for (int p = 0; p < PARAMS; p++) {
+      if (ranges[p].swept) c.params[p] = lerp(ranges[p], ranges[p].steps > 1 ? index[p] / (ranges[p].steps - 1.0) : 0);
+    }
+    candidates->push_back(c);
+    int p = 0;
+    for (; p < PARAMS; p++) {
+      if (!ranges[p].swept) continue;
+      if (++index[p] < ranges[p].steps) break;
+      index[p] = 0;
+    }
+    if (p == PARAMS) return;
+  }
+}
+
+/** 範囲(対数の範囲は対数で)の一様な乱択でcount個の候補を加える */
+static void addRandom(std::vector<Candidate>* candidates, const Range* box, int count, std::mt19937* rng) {
+  std::uniform_real_distribution<double> uniform(0, 1);
+  for (int i = 0; i < count; i++) {
+    Candidate c = baseCandidate();
+    for (int p = 0; p < PARAMS; p++) {
+      if (box[p].swept) c.params[p] = lerp(box[p], uniform(*rng));
+    }
+    candidates->push_back(c);
+  }
+}
+
+/** コストの小さい順に並べる */
+static void rank(std::vector<Candidate>* candidates) {
+  std::stable_sort(candidates->begin(), candidates->end(),
+                   [](const Candidate& a, const Candidate& b) { return a.cost < b.cost; });
+}
+
+/** 上位の候補の平均±2標準偏差(元の範囲内)を次の乱択の範囲にする */
+static void refineBox(const std::vector<Candidate>& ranked, Range* box) {
+  size_t elite = std::max<size_t>(2, ranked.size() * ELITE_RATIO);
+  elite = std::min(elite, ranked.size());
+  for (int p = 0; p < PARAMS; p++) {
+    if (!ranges[p].swept) continue;
+    double sum = 0, sq = 0;
+    for (size_t i = 0; i < elite; i++) {
+      double v = ranges[p].log ? log(ranked[i].params[p]) : ranked[i].params[p];
+      sum += v;
+      sq += v * v;
+    }
+    double mean = sum / elite, sd = sqrt(fmax(sq / elite - mean * mean, 0.0));
+    double lo = ranges[p].log ? log(ranges[p].min) : ranges[p].min;
+    double hi = ranges[p].log ? log(ranges[p].max) : ranges[p].max;
+    double a = fmax(lo, mean - 2 * sd), b = fmin(hi, mean + 2 * sd);
+    box[p] = ranges[p];
+    box[p].min = ranges[p].log ? exp(a) : a;
+    box[p].max = ranges[p].log ? exp(b) : b;
+  }
+}
+
+/** NAME=VALUEまたはNAME=MIN:MAX[:N]を解釈する */
+static bool parseRange(const char* arg) {
+  const char* eq = strchr(arg, '=');
+  if (eq == NULL) return false;
+  for (int p = 0; p < PARAMS; p++) {
+    if (strncmp(arg, PARAM_INFO[p].name, eq - arg) != 0 || PARAM_INFO[p].name[eq - arg] != '\0') continue;
+    Range& r = ranges[p];
+    int steps = DEFAULT_STEPS;
+    int n = sscanf(eq + 1, "%lf:%lf:%d", &r.min, &r.max, &steps);
+    if (n < 1 || steps < 1) return false;
+    r.swept = n >= 2;
+    if (!r.swept) r.max = r.min;
+    r.steps = steps;
+    r.log = r.min > 0 && r.max / r.min >= 100;
+    return true;
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  int random_count = 0, refine_rounds = 0, top = 10;
+  int threads = (int)std::thread::hardware_concurrency();
+  unsigned seed = 1;
+  const char* output = NULL;
+  for (int p = 0; p < PARAMS; p++) ranges[p] = {false, PARAM_INFO[p].value, PARAM_INFO[p].value, 1, false};
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (strcmp(arg, "--random") == 0 && has_value) {
+      random_count = atoi(argv[++i]);
+    } else if (strcmp(arg, "--refine") == 0 && has_value) {
+      refine_rounds = atoi(argv[++i]);
+    } else if (strcmp(arg, "--episodes") == 0 && has_value) {
+      episode_count = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(arg, "--seconds") == 0 && has_value) {
+      seconds = atof(argv[++i]);
+    } else if (strcmp(arg, "--threads") == 0 && has_value) {
+      threads = atoi(argv[++i]);
+    } else if (strcmp(arg, "--seed") == 0 && has_value) {
+      seed = (unsigned)atoi(argv[++i]);
+    } else if (strcmp(arg, "--top") == 0 && has_value) {
+      top = atoi(argv[++i]);
+    } else if (strcmp(arg, "-o") == 0 && has_value) {
+      output = argv[++i];
+    } else if (strcmp(arg, "--kalman") == 0) {
+      use_kalman = true;
+    } else if (!parseRange(arg)) {
+      fprintf(stderr, "Usage: %s [OPTIONS] [NAME=VALUE | NAME=MIN:MAX[:N]]...\n", argv[0]);
+      return 2;
+    }
+  }
+  threads = std::max(1, threads);
+  if (!validatePlant()) return 1;
+
+  std::vector<Candidate> candidates;
+  std::mt19937 rng(seed);
+  auto start = std::chrono::steady_clock::now();
+  if (random_count > 0) {
+    addRandom(&candidates, ranges, random_count, &rng);
+  } else {
+    addGrid(&candidates);
+  }
+  evaluate(&candidates, 0, threads);
+  for (int round = 0; round < refine_rounds && random_count > 0; round++) {
+    Range box[PARAMS];
+    rank(&candidates);
+    refineBox(candidates, box);
+    size_t first = candidates.size();
+    addRandom(&candidates, box, random_count, &rng);
+    evaluate(&candidates, first, threads);
+  }
+  rank(&candidates);
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  long episodes = (long)candidates.size() * episode_count;
+  double simulated = 0;
+  for (const Candidate& c : candidates) {
+    for (const Episode& e : c.episodes) simulated += CrlPlant().config.release + (e.fallen ? e.settle : seconds);
+  }
+  printf("candidates           : %zu x %d episodes (%s, %.0f s after release)\n", candidates.size(), episode_count,
+         use_kalman ? "kalman" : "complementary", seconds);
+  printf("wall time            : %.2f s on %d threads, %.1f episodes/s, %.0fx real time\n", wall, threads,
+         episodes / wall, simulated / wall);
+  printf("scaling              : speedup %.2f (episode CPU time / wall time) on %d threads, %u hardware threads\n",
+         busy_ns * 1e-9 / wall, threads, std::thread::hardware_concurrency());
+  printf("%4s %9s %5s %8s %9s %7s", "rank", "cost", "falls", "settle", "tilt_rms", "effort");
+  for (int p = 0; p < PARAMS; p++) {
+    if (ranges[p].swept) printf(" %9s", PARAM_INFO[p].name);
+  }
+  printf("\n");
+  for (int i = 0; i < top && i < (int)candidates.size(); i++) {
+    const Candidate& c = candidates[i];
+    printf("%4d %9.3f %5d %8.2f %9.5f %7.3f", i + 1, c.cost, c.falls, c.settle, c.tilt_rms, c.effort);
+    for (int p = 0; p < PARAMS; p++) {
+      if (ranges[p].swept) printf(" %9.4g", c.params[p]);
+    }
+    printf("\n");
+  }
+
+  if (output != NULL) {
+    FILE* fp = fopen(output, "w");
+    if (fp == NULL) {
+      perror(output);
+      return 2;
+    }
+    fprintf(fp, "rank,cost,falls,settle,tilt_rms,effort");
+    for (int p = 0; p < PARAMS; p++) fprintf(fp, ",%s", PARAM_INFO[p].name);
+    fprintf(fp, "\n");
+    for (size_t i = 0; i < candidates.size(); i++) {
+      const Candidate& c = candidates[i];
+      fprintf(fp, "%zu,%.6g,%d,%.4f,%.6g,%.6g", i + 1, c.cost, c.falls, c.settle, c.tilt_rms, c.effort);
+      for (int p = 0; p < PARAMS; p++) fprintf(fp, ",%.6g", c.params[p]);
+      fprintf(fp, "\n");
+    }
+    fclose(fp);
+  }
+  return 0;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file imu_fifo_bench.cpp
+ * @brief
+ * 姿勢センサのFIFO読み出し(CRAWL_IMU_FIFO)をホスト上で動かし,ジャイロの積分誤差とオーバーフローの処理を確かめる.
+ *
+ * 模擬MPU-9250のZ軸ジャイロに,制御ループの周波数(100Hz)に近いFREQ_HZの振動を与える.
+ * 最新の一サンプルだけを読む場合は振動が低い周波数に折り返して角度が大きく振れるが,
+ * FIFOの全サンプルから求めた値を積分すれば,誤差が読み出し待ちの数サンプル分に収まりドリフトしないことを確かめる.
+ * その後I2Cクロックを10kHzに落としてFIFOを溢れさせ,オーバーフローが数えられること,
+ * クロックを戻すと一定値の軸が正しく平均され続けることを確かめ,問題がなければOKを表示する.
+ * 模擬MPU-9250はデジタルローパスフィルタを模擬しないため,FREQ_HZは標本化周波数の半分未満とすること.
+ * CRAWL_IMU_FIFOを1にしてビルドすること: CXXFLAGS="-O2 -DCRAWL_IMU_FIFO=1" ./tools/host/build.sh
+ *
+ * Usage: imu_fifo_bench [SECONDS [FREQ_HZ [AMPLITUDE]]]
+ */
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "acquisition.h"
+#include "attitude_sensor.h"
+#include "hal.h"
+#include "hal_host.h"
+
+#if !CRAWL_IMU_FIFO
+int main() {
+  printf("imu fifo is disabled (build with -DCRAWL_IMU_FIFO=1)\n");
+  return 0;
+}
+#else
+/** 一定値を与える軸の生値 */
+#define GYRO_X 123
+#define GYRO_Y -77
+
+/** 振動の周波数 単位:Hz */
+static double freq;
+/** 振動の振幅 単位:生値 */
+static double amplitude;
+
+/** 時刻usのZ軸ジャイロの生値 */
+static int16_t gyroZ(unsigned long us) { return (int16_t)lround(amplitude * sin(2 * M_PI * freq * us * 1e-6)); }
+
+/** 標本化のたびに模擬MPU-9250から呼ばれる */
+static void imuSource(unsigned long us) { hostSetGyro(GYRO_X, GYRO_Y, gyroZ(us)); }
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 10;
+  freq = argc > 2 ? atof(argv[2]) : 101;
+  amplitude = argc > 3 ? atof(argv[3]) : 10000;
+  const unsigned long dt_us = 10000;
+  const unsigned long sample_us = 1000000UL / CRAWL_IMU_FIFO_RATE;
+  const double dt = dt_us * 1e-6, sample_dt = sample_us * 1e-6;
+  long periods = (long)(seconds * 1e6 / dt_us);
+  int errors = 0;
+  int attitude[10] = {0};
+  short int left, right;
+
+  hostReset();
+  hostSetAccel(0, 16384, 0);
+  hostSetMag(0, 0, 0);
+  hostSetImuSource(imuSource);
+  initAttitudeSensor();
+  startAcquisition();
+  unsigned long start = halMicros();
+  takeAcquisition(attitude, &left, &right);
+
+  // 角度は生値×秒.真の角度は,標本化された値を区分的に一定とみなして積分したもの
+  double fifo_angle = 0, single_angle = 0, true_angle = 0;
+  double fifo_min = 0, fifo_max = 0, single_min = 0, single_max = 0, x_angle = 0;
+  unsigned long true_at = start - start % sample_us;
+  long updates = 0;
+  for (long i = 0; i < periods; i++) {
+    hostAdvanceMicros(dt_us);
+    unsigned long now = halMicros();
+    if (takeAcquisition(attitude, &left, &right)) updates++;
+    if (attitude[1] != 16384) errors++;
+    x_angle += attitude[4] * dt;
+    fifo_angle += attitude[6] * dt;
+    single_angle += gyroZ(now - now % sample_us) * dt;  // 最新の一サンプルを読んだ場合
+    for (; true_at + sample_us <= now; true_at += sample_us) true_angle += gyroZ(true_at) * sample_dt;
+    // 開始時の区切りによる一定の差を除くため,最初の10周期の後の誤差の変動幅を比べる
+    if (i < 10) continue;
+    fifo_min = i == 10 ? fifo_angle - true_angle : fmin(fifo_min, fifo_angle - true_angle);
+    fifo_max = i == 10 ? fifo_angle - true_angle : fmax(fifo_max, fifo_angle - true_angle);
+    single_min = i == 10 ? single_angle - true_angle : fmin(single_min, single_angle - true_angle);
+    single_max = i == 10 ? single_angle - true_angle : fmax(single_max, single_angle - true_angle);
+  }
+  uint16_t overflows = getImuFifoOverflows();
+  printf("sample rate          : %d Hz\n", CRAWL_IMU_FIFO_RATE);
+  printf("vibration            : %.1f Hz, amplitude %.0f\n", freq, amplitude);
+  printf("updates              : %ld / %ld\n", updates, periods);
+  printf("angle error range    : fifo %.3f, single sample %.3f (raw*s)\n", fifo_max - fifo_min,
+         single_max - single_min);
+  printf("error bound          : %.3f (raw*s)\n", 4 * amplitude * sample_dt);
+  printf("constant axis        : %.3f (expected %.3f)\n", x_angle, GYRO_X * periods * dt);
+  if (updates != periods || overflows != 0) errors++;
+  if (fabs(x_angle - GYRO_X * periods * dt) > GYRO_X * 0.02) errors++;  // 最初と最後の読み出しの遅れの分
+  // 誤差は読み出し待ちのサンプル(一組の周期の間に溜まる2個程度)の分だけで,ドリフトしない
+  if (fifo_max - fifo_min > 4 * amplitude * sample_dt) errors++;
+
+  // 遅いバスでFIFOを溢れさせる
+  hostSetI2cClock(10000);
+  for (long i = 0; i < 100; i++) {
+    hostAdvanceMicros(dt_us);
+    takeAcquisition(attitude, &left, &right);
+  }
+  uint16_t slow_overflows = getImuFifoOverflows() - overflows;
+  hostSetI2cClock(100000);
+  hostSetImuSource(NULL);
+  hostSetGyro(GYRO_X, GYRO_Y, -1000);
+  for (long i = 0; i < 20; i++) {  // 溢れていたFIFOが消去されるまで
+    hostAdvanceMicros(dt_us);
+    takeAcquisition(attitude, &left, &right);
+  }
+  overflows = getImuFifoOverflows();
+  long bad = 0;
+  double z_angle = 0;
+  for (long i = 0; i < 100; i++) {
+    hostAdvanceMicros(dt_us);
+    if (!takeAcquisition(attitude, &left, &right) || attitude[1] != 16384) bad++;
+    z_angle += attitude[6] * dt;
+  }
+  printf("overflows (10kHz bus): %u\n", slow_overflows);
+  printf("after recovery       : bad %ld / 100, angle %.3f (expected %.3f), overflows %u\n", bad, z_angle,
+         -1000 * 100 * dt, getImuFifoOverflows() - overflows);
+  if (slow_overflows == 0 || bad != 0 || getImuFifoOverflows() != overflows) errors++;
+  if (fabs(z_angle + 1000 * 100 * dt) > 1000 * 0.02) errors++;
+
+  printf("%s\n", errors ? "NG" : "OK");
+  return errors ? 1 : 0;
+}
+#endif
@@ -0,0 +1,114 @@
+/**
+ * @file imu_sync_bench.cpp
+ * @brief
+ * 姿勢センサのデータレディ割り込みに同期した制御ループ(CRAWL_IMU_SYNC)をホスト上で動かし,周期と遅れを確かめる.
+ *
+ * 100Hzの制御ループ(updateState()とLOAD_USマイクロ秒の処理)を回し,realtimeLoop()の戻る間隔が標本化周期に一致すること,
+ * 標本化からrealtimeLoop()が戻るまでの遅れ(一組の読み出しの時間)が一定であることを確かめる.
+ * その後,ループ内の処理を周期の2.4倍に延ばした場合と,I2Cクロックを20kHzに落とした場合について,
+ * 標本化されたサンプルの数が,ループの実行回数と数えられたサンプルの数の合計に一致し,LED2が点灯することを確かめる.
+ * 問題がなければOKを表示する.
+ * CRAWL_IMU_SYNCを1にしてビルドすること: CXXFLAGS="-O2 -DCRAWL_IMU_SYNC=1" ./tools/host/build.sh
+ *
+ * Usage: imu_sync_bench [SECONDS [LOAD_US]]
+ */
+#include <crawl.h>
+#include <cstdio>
+#include <cstdlib>
+#include "hal.h"
+#include "hal_host.h"
+
+#if !CRAWL_IMU_SYNC
+int main() {
+  printf("imu sync is disabled (build with -DCRAWL_IMU_SYNC=1)\n");
+  return 0;
+}
+#else
+/** 標本化した回数 */
+static long samples = 0;
+/** 最後に標本化した時刻 */
+static unsigned long sample_at = 0;
+
+/** 標本化のたびに模擬MPU-9250から呼ばれる */
+static void imuSource(unsigned long us) {
+  samples++;
+  sample_at = us;
+}
+
+/**
+ * 処理時間load_usのループをperiods回実行し,標本化されたサンプルがループの実行か数えられたサンプルのいずれかになったかを調べる
+ * @return 誤りの数
+ */
+static int runOverload(const char* name, long periods, unsigned long load_us) {
+  long start_samples = samples;
+  uint16_t start_missed = crl.getMissedSampleCount();
+  bool led = false;
+  long loops = 0;
+  for (long i = 0; i < periods; i++, loops++) {
+    crl.updateState();
+    hostAdvanceMicros(load_us);
+    crl.realtimeLoop();
+    if (hostGetPin(9)) led = true;
+  }
+  for (long i = 0; i < 5; i++, loops++) {  // 通常の処理時間に戻し,読み出し中のサンプルがない時点で数える
+    crl.updateState();
+    crl.realtimeLoop();
+  }
+  long missed = (uint16_t)(crl.getMissedSampleCount() - start_missed);
+  long sampled = samples - start_samples;
+  printf("%-20s : samples %ld, loops %ld, missed %ld, led2 %s\n", name, sampled, loops, missed, led ? "on" : "off");
+  return (sampled != loops + missed || missed == 0 || !led) ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 10;
+  unsigned long load_us = argc > 2 ? atol(argv[2]) : 2000;
+  const float dt = 0.01;
+  const unsigned long dt_us = 10000;
+  int errors = 0;
+
+  hostReset();
+  hostSetAccel(0, 16384, 0);  // 直立: 重力はセンサのY軸方向
+  hostSetGyro(0, 0, 0);
+  hostSetMag(0, 0, 0);
+  hostSetImuSource(imuSource);
+
+  crl.setDt(dt);
+  crl.init();
+  crl.realtimeLoop();  // 最初のサンプルに同期する
+
+  long periods = seconds / dt;
+  long start_samples = samples;
+  uint16_t start_missed = crl.getMissedSampleCount();
+  unsigned long min_period = 0xFFFFFFFF, max_period = 0, min_latency = 0xFFFFFFFF, max_latency = 0;
+  unsigned long last = halMicros();
+  bool led = false;
+  for (long i = 0; i < periods; i++) {
+    crl.updateState();
+    hostAdvanceMicros(load_us);
+    crl.realtimeLoop();
+    unsigned long now = halMicros();
+    if (now - last < min_period) min_period = now - last;
+    if (now - last > max_period) max_period = now - last;
+    if (now - sample_at < min_latency) min_latency = now - sample_at;
+    if (now - sample_at > max_latency) max_latency = now - sample_at;
+    if (hostGetPin(9)) led = true;
+    last = now;
+  }
+  printf("loop period          : min %lu us, max %lu us (sample period %lu us)\n", min_period, max_period, dt_us);
+  printf("sample latency       : min %lu us, max %lu us\n", min_latency, max_latency);
+  printf("samples / loops      : %ld / %ld, missed %u\n", samples - start_samples, periods,
+         (uint16_t)(crl.getMissedSampleCount() - start_missed));
+  if (min_period != dt_us || max_period != dt_us) errors++;
+  if (max_latency != min_latency || max_latency + load_us >= dt_us) errors++;
+  if (samples - start_samples != periods || crl.getMissedSampleCount() != start_missed || led) errors++;
+
+  errors += runOverload("overload 24ms", 20, 24000);
+  hostSetI2cClock(20000);  // 一組の読み出しが標本化周期より長くなる
+  errors += runOverload("20kHz bus", 20, load_us);
+  hostSetI2cClock(100000);
+
+  printf("%s\n", errors ? "NG" : "OK");
+  return errors ? 1 : 0;
+}
+#endif
@@ -0,0 +1,30 @@
+/**
+ * @file Arduino.h
+ * @brief
+ * ホストビルド用のArduino.h代替ヘッダ
+ *
+ * crawl.hやサンプルプログラムが使用するArduinoの関数を,ハードウェア抽象化層(hal.h)の
+ * ホスト向け実装に置き換える.ホストビルドでのみインクルードパスに追加する.
+ */
+#ifndef INCLUDED_host_Arduino_h
+#define INCLUDED_host_Arduino_h
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hal.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT HAL_PIN_INPUT
+#define OUTPUT HAL_PIN_OUTPUT
+
+inline void pinMode(uint8_t pin, uint8_t mode) { halPinMode(pin, mode); }
+inline void digitalWrite(uint8_t pin, uint8_t value) { halDigitalWrite(pin, value); }
+inline void delay(unsigned long ms) { halDelay(ms); }
+inline void delayMicroseconds(unsigned int us) { halDelayMicroseconds(us); }
+inline unsigned long micros() { return halMicros(); }
+inline unsigned long millis() { return halMicros() / 1000; }
+#endif
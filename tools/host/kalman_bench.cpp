@@ -0,0 +1,121 @@
+/**
+ * @file kalman_bench.cpp
+ * @brief
+ * KalmanFilter::update()の一回あたりの計算時間と,合成した入力に対する最終的な推定値を表示する.
+ *
+ * 入力は角度1 radの周りをゆっくり振動する加速度由来の角度と,その微分に相当するジャイロの値.
+ * 実装を変更した際には推定値が変わらないこと(または変化量)をここで確認する.
+ *
+ * - full: 毎回共分散とゲインを計算する通常のカルマンフィルタ
+ * - steady: setSteadyState(true)により,ゲインが収束した時点で状態量の更新だけに切り替えたもの
+ * - 3 x KalmanFilter / KalmanFilterBank: 3軸分の更新にかかる時間と,両者の推定値の差
+ *
+ * Usage: kalman_bench [UPDATES]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "kalmanfilter.h"
+#include "kalmanfilter_bank.h"
+
+/** 計算結果を捨てられないようにするための変数 */
+static volatile float sink;
+
+static void run(const char* name, bool steady_state, long n) {
+  KalmanFilter kf;
+  kf.setSteadyState(steady_state);
+  long converged = -1;
+  float max_error = 0;
+  KalmanFilter reference;
+  auto t0 = std::chrono::steady_clock::now();
+  for (long i = 0; i < n; i++) {
+    kf.update(1.0f + 0.01f * sinf(i * 0.01f), 0.1f * cosf(i * 0.01f), 0.0f);
+    if (converged < 0 && kf.isSteadyState()) converged = i + 1;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  sink = kf.getTheta();
+
+  // 通常のカルマンフィルタとの差(計時とは別に走らせる)
+  kf = KalmanFilter();
+  kf.setSteadyState(steady_state);
+  for (long i = 0; i < n; i++) {
+    float theta = 1.0f + 0.01f * sinf(i * 0.01f), gyro = 0.1f * cosf(i * 0.01f);
+    kf.update(theta, gyro, 0.0f);
+    reference.update(theta, gyro, 0.0f);
+    max_error = fmaxf(max_error, fabsf(kf.getTheta() - reference.getTheta()));
+  }
+
+  float gain[2][2];
+  kf.getGain(gain);
+  printf("[%s]\n", name);
+  printf("ns/update        : %.2f (including input generation)\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / n);
+  printf("gain fixed after : %ld updates\n", converged);
+  printf("gain             : {{%.8f, %.8f}, {%.8f, %.8f}}\n", gain[0][0], gain[0][1], gain[1][0], gain[1][1]);
+  printf("theta            : %.6f\n", kf.getTheta());
+  printf("theta variance   : %.8f\n", kf.getThetaVariance());
+  printf("theta dot        : %.6f\n", kf.getThetaDot());
+  printf("max |theta-full| : %.3g\n", max_error);
+}
+
+/** 軸ごとに位相と振幅をずらした入力 */
+static void input(long i, float theta[3], float gyro[3]) {
+  for (int a = 0; a < 3; a++) {
+    float w = 0.01f * (a + 1);
+    theta[a] = 1.0f + 0.01f * sinf(i * w);
+    gyro[a] = 0.1f * (a + 1) * cosf(i * w);
+  }
+}
+
+/** 計時に使う入力の周期(入力の生成時間を含めないよう事前に計算しておく) */
+#define INPUT_TABLE_SIZE 4096
+
+static void runAxes(long n) {
+  static float theta_table[INPUT_TABLE_SIZE][3], gyro_table[INPUT_TABLE_SIZE][3];
+  for (long i = 0; i < INPUT_TABLE_SIZE; i++) input(i, theta_table[i], gyro_table[i]);
+  float theta[3], gyro[3];
+  KalmanFilter kf[3];
+  KalmanFilterBank bank;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (long i = 0; i < n; i++) {
+    const float* x = theta_table[i % INPUT_TABLE_SIZE];
+    const float* g = gyro_table[i % INPUT_TABLE_SIZE];
+    for (int a = 0; a < 3; a++) kf[a].update(x[a], g[a], 0.0f);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (long i = 0; i < n; i++) bank.update(theta_table[i % INPUT_TABLE_SIZE], gyro_table[i % INPUT_TABLE_SIZE]);
+  auto t2 = std::chrono::steady_clock::now();
+  sink = kf[0].getTheta() + bank.getTheta(0);
+
+  // 同じ入力に対する推定値の差(計時とは別に走らせる)
+  KalmanFilter reference[3];
+  KalmanFilterBank check;
+  float max_error = 0;
+  for (long i = 0; i < n; i++) {
+    input(i, theta, gyro);
+    check.update(theta, gyro);
+    for (int a = 0; a < 3; a++) {
+      reference[a].update(theta[a], gyro[a], 0.0f);
+      max_error = fmaxf(max_error, fabsf(check.getTheta(a) - reference[a].getTheta()));
+    }
+  }
+
+  printf("[3 axes]\n");
+  printf("3 x KalmanFilter : %.2f ns/update\n",
+         std::chrono::duration<double, std::nano>(t1 - t0).count() / n);
+  printf("KalmanFilterBank : %.2f ns/update\n",
+         std::chrono::duration<double, std::nano>(t2 - t1).count() / n);
+  printf("max |theta-full| : %.3g\n", max_error);
+}
+
+int main(int argc, char** argv) {
+  long n = argc > 1 ? atol(argv[1]) : 10000000;
+  printf("updates          : %ld\n", n);
+  printf("sizeof(filter)   : %zu\n", sizeof(KalmanFilter));
+  run("full", false, n);
+  run("steady", true, n);
+  runAxes(n);
+  return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file kalman_bias_bench.cpp
+ * @brief
+ * ジャイロのバイアスを推定するカルマンフィルタ(BiasKalmanFilterBank)とKalmanFilterBankを,
+ * 起動後にジャイロのオフセットが温度で変化する合成データで比べる.
+ *
+ * 100Hzで,真の角度はBASE_AMPLITUDE radの正弦波,ジャイロの値はその微分にバイアスと一様な雑音を加えたもの,
+ * 加速度由来の角度は真の角度に一様な雑音を加えたもの.バイアスは起動時の0から時定数DRIFT_T秒でDRIFT_RATEに近づく.
+ * 後半の角度の二乗平均誤差,最後のバイアスの推定誤差,一回あたりの計算時間を表示し,
+ * バイアスを推定する側の角度の誤差がKalmanFilterBankの半分未満で,バイアスの推定誤差が最終値の2割未満であれば
+ * OKを表示する.
+ *
+ * Usage: kalman_bias_bench [SECONDS]
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "kalmanfilter_bank.h"
+#include "kalmanfilter_bias.h"
+
+/** ループ間隔 単位:秒 */
+#define DT 0.01
+/** 真の角度の振幅 単位:rad */
+#define BASE_AMPLITUDE 0.05
+/** 真の角度の周波数 単位:Hz */
+#define BASE_FREQ 0.2
+/** バイアスの最終値 単位:rad/s (約1.1deg/s) */
+#define DRIFT_RATE 0.02
+/** バイアスの変化の時定数 単位:秒 */
+#define DRIFT_T 120.0
+/** ジャイロの雑音の幅 単位:rad/s */
+#define GYRO_NOISE 0.01
+/** 加速度由来の角度の雑音の幅 単位:rad */
+#define ACCEL_NOISE 0.05
+
+/** 計算結果を捨てられないようにするための変数 */
+static volatile float sink;
+/** 雑音の乱数の状態 */
+static uint32_t noise_seed = 1;
+
+/** -1〜1の一様な雑音 */
+static double noise() {
+  noise_seed = noise_seed * 1103515245 + 12345;
+  return ((noise_seed >> 8) & 0xFFFF) / 32767.5 - 1;
+}
+
+/** 時刻tのバイアス */
+static double bias(double t) { return DRIFT_RATE * (1 - exp(-t / DRIFT_T)); }
+
+/** 各フィルタの一回あたりの計算時間 単位:ns */
+template <typename Bank>
+static double timeUpdate(Bank& bank, long n) {
+  float theta[3] = {0.01f, 0.02f, 0.03f}, gyro[3] = {0.001f, 0.002f, 0.003f};
+  auto t0 = std::chrono::steady_clock::now();
+  for (long i = 0; i < n; i++) {
+    theta[i % 3] = -theta[i % 3];
+    bank.update(theta, gyro);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  sink = bank.getTheta(0);
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 600;
+  long n = (long)(seconds / DT);
+  KalmanFilterBank plain;
+  BiasKalmanFilterBank biased;
+  plain.setDt(DT);
+  plain.setSteadyState(true);
+  biased.setDt(DT);
+  biased.setSteadyState(true);
+
+  double plain_sq = 0, biased_sq = 0, plain_max = 0, biased_max = 0;
+  long counted = 0, converged = -1;
+  for (long i = 0; i < n; i++) {
+    double t = i * DT, w = 2 * M_PI * BASE_FREQ;
+    double truth = BASE_AMPLITUDE * sin(w * t);
+    float theta[3], gyro[3];
+    for (int a = 0; a < 3; a++) {
+      theta[a] = truth + ACCEL_NOISE * noise();
+      gyro[a] = BASE_AMPLITUDE * w * cos(w * t) + bias(t) + GYRO_NOISE * noise();
+    }
+    plain.update(theta, gyro);
+    biased.update(theta, gyro);
+    if (converged < 0 && biased.isSteadyState()) converged = i + 1;
+    if (i < n / 2) continue;
+    double e_plain = plain.getTheta(0) - truth, e_biased = biased.getTheta(0) - truth;
+    plain_sq += e_plain * e_plain;
+    biased_sq += e_biased * e_biased;
+    plain_max = fmax(plain_max, fabs(e_plain));
+    biased_max = fmax(biased_max, fabs(e_biased));
+    counted++;
+  }
+  double plain_rms = sqrt(plain_sq / counted), biased_rms = sqrt(biased_sq / counted);
+  double final_bias = bias((n - 1) * DT), bias_error = 0;
+  for (int a = 0; a < 3; a++) bias_error = fmax(bias_error, fabs(biased.getBias(a) - final_bias));
+
+  printf("trace                : %.0f s, bias 0 -> %.4f rad/s (T = %.0f s)\n", seconds, final_bias, DRIFT_T);
+  printf("theta error (rms/max): KalmanFilterBank %.5f / %.5f rad, BiasKalmanFilterBank %.5f / %.5f rad\n",
+         plain_rms, plain_max, biased_rms, biased_max);
+  printf("bias estimate        : %.5f %.5f %.5f rad/s (error %.5f)\n", biased.getBias(0), biased.getBias(1),
+         biased.getBias(2), bias_error);
+  printf("gain fixed after     : %ld updates\n", converged);
+  printf("ns/update (3 axes)   : KalmanFilterBank %.1f, BiasKalmanFilterBank %.1f (steady state)\n",
+         timeUpdate(plain, 10000000), timeUpdate(biased, 10000000));
+
+  int errors = 0;
+  if (!(biased_rms < plain_rms / 2)) errors++;
+  if (!(bias_error < final_bias * 0.2)) errors++;
+  printf("%s\n", errors ? "NG" : "OK");
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file kalman_gain.cpp
+ * @brief
+ * KalmanFilterの定常カルマンゲインと定常状態の分散共分散行列を求め,
+ * KalmanFilter::setSteadyStateGain()に渡せるC++の定数として表示する.
+ *
+ * Usage: kalman_gain [DT [Q1 Q2 [R1 R2]]]
+ *   既定値はKalmanFilterの初期値 (dt = 0.01, q1 = 0.0001, q2 = 0.001, r1 = r2 = 1)
+ */
+#include <cstdio>
+#include <cstdlib>
+#include "kalmanfilter.h"
+
+int main(int argc, char** argv) {
+  float dt = argc > 1 ? atof(argv[1]) : 0.01;
+  float q1 = argc > 3 ? atof(argv[2]) : 0.0001, q2 = argc > 3 ? atof(argv[3]) : 0.001;
+  float r1 = argc > 5 ? atof(argv[4]) : 1, r2 = argc > 5 ? atof(argv[5]) : 1;
+
+  KalmanFilter kf;
+  kf.setDt(dt);
+  kf.setProcessNoise(q1, q2);
+  kf.setObservationNoise(r1, r2);
+  int iterations = kf.solveSteadyState();
+  if (iterations < 0) {
+    fprintf(stderr, "kalman_gain: did not converge in %d iterations\n", KALMAN_MAX_ITERATIONS);
+    return 1;
+  }
+
+  float gain[2][2];
+  kf.getGain(gain);
+  float covariance[3];
+  kf.getCovariance(covariance);
+
+  printf("// dt = %g, q1 = %g, q2 = %g, r1 = %g, r2 = %g (converged in %d iterations)\n", dt, q1, q2, r1, r2,
+         iterations);
+  printf("static const float KALMAN_GAIN[2][2] = {{%.9gf, %.9gf}, {%.9gf, %.9gf}};\n", gain[0][0], gain[0][1],
+         gain[1][0], gain[1][1]);
+  printf("static const float KALMAN_COVARIANCE[3] = {%.9gf, %.9gf, %.9gf};\n", covariance[0], covariance[1],
+         covariance[2]);
+  return 0;
+}
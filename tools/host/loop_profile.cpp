@@ -0,0 +1,107 @@
+/**
+ * @file loop_profile.cpp
+ * @brief
+ * CrlRobotのプロファイラ(profiler.h)をホスト上で動かし,フェーズごとの計測結果を表示する.
+ *
+ * realtimeLoop()とupdateState()を仮想時計で繰り返す.ループ内の処理として毎周期LOAD_USマイクロ秒,
+ * 100周期に一度は周期を超える時間だけ仮想時計を進め,超過回数が一致することを確かめる.
+ * I2C読み出しのフェーズには模擬デバイスの転送時間が,計算のフェーズにはhalMicros()の呼び出し回数分の時間が現れる.
+ * 計測結果はテレメトリ(TELEMETRY_PROFILE)でも送出し,復号した内容がgetProfile()と一致することを確かめる.
+ * CRAWL_PROFILERを1にしてビルドすること: CXXFLAGS="-O2 -DCRAWL_PROFILER=1" ./tools/host/build.sh
+ *
+ * Usage: loop_profile [PERIODS [LOAD_US [kalman]]]
+ */
+#include <crawl.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "hal_host.h"
+#include "telemetry.h"
+
+#if !CRAWL_PROFILER
+int main() {
+  printf("profiler is disabled (build with -DCRAWL_PROFILER=1)\n");
+  return 0;
+}
+#else
+static const char* const phase_names[CRAWL_PHASE_COUNT] = {
+    "imu_read", "mag_read", "encoder_read", "acquire", "motor_write", "calc_state",
+    "theta",    "head_vel", "update",       "load",    "period",
+};
+
+int main(int argc, char** argv) {
+  long periods = argc > 1 ? atol(argv[1]) : 1000;
+  unsigned long load_us = argc > 2 ? atol(argv[2]) : 2000;
+  const float dt = 0.01;
+
+  hostReset();
+  hostSetAccel(0, 16384, 0);  // 直立: 重力はセンサのY軸方向
+  hostSetGyro(0, 0, 0);
+  hostSetMag(0, 0, 0);
+
+  crl.setDt(dt);
+  crl.init();
+  if (argc > 3 && strcmp(argv[3], "kalman") == 0) crl.setKalman(true);
+  crl.realtimeLoop();
+  crl.resetProfile();
+  crl.setProfileTelemetry(true);
+
+  long expected_overruns = 0;
+  for (long i = 0; i < periods; i++) {
+    crl.realtimeLoop();
+    crl.updateState();
+    if (i % 100 == 99) {
+      hostAdvanceMicros(dt * 1.2e6);
+      expected_overruns++;
+    } else {
+      hostAdvanceMicros(load_us);
+    }
+  }
+  crl.realtimeLoop();
+
+  long errors = 0;
+  printf("%-13s %8s %7s %9s %7s  histogram (<4us, <8us, ... <1024us, >=1024us)\n", "phase", "count", "min",
+         "mean", "max");
+  for (uint8_t phase = 0; phase < CRAWL_PHASE_COUNT; phase++) {
+    CrlProfile profile;
+    crl.getProfile(phase, &profile);
+    double mean = profile.count ? (double)profile.sum / profile.count : 0;
+    printf("%-13s %8lu %7u %9.1f %7u ", phase_names[phase], (unsigned long)profile.count, profile.min, mean,
+           profile.max);
+    for (int i = 0; i < PROFILER_BUCKETS; i++) printf(" %u", profile.histogram[i]);
+    printf("\n");
+  }
+  printf("overruns      : %u (expected %ld)\n", crl.getOverrunCount(), expected_overruns);
+  if (crl.getOverrunCount() != expected_overruns) errors++;
+
+  // テレメトリで送られた計測結果は,送った時点の値なので回数は最新の値以下となる
+  std::vector<uint8_t> out(1 << 20);
+  out.resize(hostTakeUartOutput(out.data(), out.size()));
+  long frames = 0;
+  size_t start = 0;
+  for (size_t end = 0; end < out.size(); end++) {
+    if (out[end] != 0) continue;
+    uint8_t type, payload[TELEMETRY_MAX_PAYLOAD];
+    int16_t length = end > start ? telemetryDecode(&out[start], end - start, &type, payload) : -1;
+    start = end + 1;
+    if (length < 0) continue;
+    CrlProfileFrame frame;
+    CrlProfile latest;
+    memcpy(&frame, payload, sizeof(frame));
+    if (type != TELEMETRY_PROFILE || length != sizeof(frame) || frame.phase >= CRAWL_PHASE_COUNT) {
+      errors++;
+      continue;
+    }
+    crl.getProfile(frame.phase, &latest);
+    if (frame.profile.count > latest.count || frame.profile.max > latest.max) errors++;
+    frames++;
+  }
+  printf("profile frames: %ld\n", frames);
+  // 周期を超えた直後の周期は待たずに戻るため,送出しない
+  if (frames + expected_overruns < periods) errors++;
+
+  printf("%s\n", errors ? "NG" : "OK");
+  return errors ? 1 : 0;
+}
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file motor_bus_bench.cpp
+ * @brief
+ * モータ制御基板(0x39)との通信が一周期あたりに使うI2Cバスの時間を,以前の方法と比べて表示する.
+ *
+ * 以前はエンコーダのコマンドの送信と累計回転数の受信を別のトランザクションで行い,モータの指令を毎周期送っていた.
+ * 現在は指令が前回と同じなら送らない.CRAWL_ENCODER_REPEATED_STARTを1にしてビルドした場合は,
+ * エンコーダの読み出しもリピーテッドスタートで一つのトランザクションとする(既定の0では以前と同じ).
+ * 模擬デバイスの上で,それぞれのトランザクションを実際に実行して所要時間を測る.
+ * 後半はcrl.updateState()を制御周期(10ms)ごとに呼び出し,指令が一定の場合と毎周期変わる場合の
+ * 一周期あたりのバスの使用時間を表示する.センサの読み出しは一周期に一組なので,差はモータの指令の分となる.
+ *
+ * Usage: motor_bus_bench [LOOPS]
+ */
+#include <crawl.h>
+#include <cstdio>
+#include <cstdlib>
+#include "crawl_drive.h"
+#include "encoder.h"
+#include "hal.h"
+#include "hal_host.h"
+
+/** fnの実行で使ったバスの時間 単位:マイクロ秒 */
+template <typename F>
+static unsigned long busMicros(F fn) {
+  unsigned long start = hostGetI2cBusMicros();
+  fn();
+  hostAdvanceMicros(1000);  // 非同期の送信を完了させる
+  return hostGetI2cBusMicros() - start;
+}
+
+/** crl.updateState()をloops回呼び出し,一周期あたりのバスの使用時間を返す */
+static double loopMicros(long loops, bool vary) {
+  unsigned long start = hostGetI2cBusMicros();
+  for (long i = 0; i < loops; i++) {
+    hostAdvanceMicros(10000);
+    crl.updateState();
+    float u = vary ? 0.2f + 0.1f * (i % 2) : 0.2f;
+    crl.setMotorLeft(u);
+    crl.setMotorRight(-u);
+  }
+  return (double)(hostGetI2cBusMicros() - start) / loops;
+}
+
+int main(int argc, char** argv) {
+  long loops = argc > 1 ? atol(argv[1]) : 1000;
+  short int left, right;
+
+  hostReset();
+  initMotor();
+  const uint8_t command = 0x12;
+  uint8_t buf[4];
+  unsigned long separate = busMicros([&]() {
+    halI2cWrite(HAL_ADDR_MOTOR, &command, 1);
+    halI2cRead(HAL_ADDR_MOTOR, buf, sizeof(buf));
+  });
+  unsigned long fused = busMicros([&]() {
+    HalI2cTransaction transaction = {HAL_ADDR_MOTOR, &command, 1, buf, sizeof(buf), NULL, HAL_I2C_DONE, NULL};
+    halI2cSubmit(&transaction);
+    halI2cWait(&transaction);
+  });
+  unsigned long library = busMicros([&]() { getResetEncoder(&left, &right); });
+  unsigned long changed = busMicros([]() { setMoterPower(50, -50); });
+  unsigned long same = busMicros([]() { setMoterPower(50, -50); });
+
+  printf("encoder read         : separate %lu us, repeated start %lu us, library %lu us (%s)\n", separate, fused,
+         library, CRAWL_ENCODER_REPEATED_START ? "CRAWL_ENCODER_REPEATED_START=1" : "CRAWL_ENCODER_REPEATED_START=0");
+  printf("motor command        : changed %lu us, unchanged %lu us\n", changed, same);
+  printf("per cycle (previous) : %lu us\n", separate + changed);
+  printf("per cycle (now)      : %lu us (unchanged command), %lu us (changed command)\n", library + same,
+         library + changed);
+
+  hostReset();
+  hostSetAccel(0, 16384, 0);  // 直立: 重力はセンサのY軸方向
+  hostSetGyro(0, 0, 0);
+  hostSetMag(0, 0, 0);
+  crl.setDt(0.01);
+  crl.init();
+  double hold = loopMicros(loops, false);
+  double vary = loopMicros(loops, true);
+  printf("bus us/loop          : %.1f (unchanged command), %.1f (changed every loop)\n", hold, vary);
+  return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file multi_robot_bench.cpp
+ * @brief
+ * 一つのプロセスの複数のスレッドでロボット(CrlRobot)と物理モデル(crawl_plant.h)を1台ずつ動かし,
+ * スレッド数に対する処理速度の伸びを測る.
+ *
+ * 各スレッドは自分の模擬デバイスと仮想時計(hal_host.h)を持ち,standと同じP制御で倒立させる.
+ * ロボットごとに雑音の乱数の種と初期の傾きを変え,まず1台ずつ順に実行して基準の結果を得た後,
+ * THREADS本のスレッドで同時に実行し,どのロボットの結果(姿勢角度,移動量,倒れたか)も基準と
+ * ビット単位で一致すること(スレッド間で状態を共有していないこと)を確かめる.
+ * 一致しない,または倒れたロボットがあれば終了コード1を返す.
+ *
+ * Usage: multi_robot_bench [ROBOTS [SECONDS [THREADS]]]
+ *   THREADSの初期値はstd::thread::hardware_concurrency()
+ */
+#include <crawl.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "crawl_plant.h"
+#include "hal_host.h"
+
+/** 角度制御比例ゲイン(standと同じ) */
+#define KP1 12.0f
+/** 上端速度制御比例ゲイン(standと同じ) */
+#define KP2 3.0f
+/** ループ間隔 単位:秒 */
+#define DT 0.010f
+
+/** 1台のロボットの結果 */
+struct Result {
+  /** 最後の姿勢角度 単位:rad */
+  float theta;
+  /** 最後の上端速度 単位:m/s */
+  float head_velocity;
+  /** クローラの移動量 単位:m */
+  float position;
+  /** 倒れたらtrue */
+  bool fallen;
+};
+
+/** 結果がビット単位で一致すればtrue */
+static bool same(const Result& a, const Result& b) {
+  return memcmp(&a.theta, &b.theta, sizeof(float)) == 0 &&
+         memcmp(&a.head_velocity, &b.head_velocity, sizeof(float)) == 0 &&
+         memcmp(&a.position, &b.position, sizeof(float)) == 0 && a.fallen == b.fallen;
+}
+
+/** 実行中のスレッドの物理モデル */
+static thread_local CrlPlant* plant;
+
+/** 標本化のたびに模擬MPU-9250から呼ばれる */
+static void imuSource(unsigned long us) { hostDrivePlant(plant, us); }
+
+/** index番目のロボットをseconds秒(手を放してから,仮想時間)動かす */
+static Result runRobot(int index, double seconds) {
+  hostEraseEeprom();
+  hostReset();
+  CrlPlant model;
+  model.config.seed = index + 1;
+  model.config.initial_tilt = 0.01f * (index % 5 - 2);
+  model.reset();
+  plant = &model;
+  hostSetMag(0, 0, 0);
+  hostSetImuSource(imuSource);
+
+  CrlRobot robot;
+  robot.init();
+  robot.setDt(DT);
+  while (!model.isFallen() && model.getTime() < model.config.release + seconds) {
+    robot.realtimeLoop();
+    robot.updateState();
+    float theta = robot.getThetaZ();
+    float u = ((float)M_PI / 2 + 0.036f - theta) * KP1 - robot.getHeadVelocity() * KP2;
+    if (theta < M_PI / 4 || 3 * M_PI / 4 < theta) u = 0;
+    robot.setMotorLeft(u);
+    robot.setMotorRight(u);
+  }
+  hostSetImuSource(NULL);
+  plant = NULL;
+
+  Result result;
+  result.theta = robot.getThetaZ();
+  result.head_velocity = robot.getHeadVelocity();
+  result.position = model.getPosition();
+  result.fallen = model.isFallen();
+  return result;
+}
+
+/**
+ * 同時にthreads台ずつ全ロボットを実行し,経過した実時間[秒]を返す.
+ * ドライバの状態(初期化済みかなど)はスレッドが終わるまで残るため,ロボットごとに新しいスレッドで実行する.
+ */
+static double runAll(std::vector<Result>* results, double seconds, int threads) {
+  std::atomic<int> next(0);
+  auto worker = [&]() {
+    for (int i; (i = next++) < (int)results->size();) {
+      std::thread([&, i]() { (*results)[i] = runRobot(i, seconds); }).join();
+    }
+  };
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> pool;
+  for (int i = 0; i < threads; i++) pool.emplace_back(worker);
+  for (std::thread& thread : pool) thread.join();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  int robots = argc > 1 ? atoi(argv[1]) : 16;
+  double seconds = argc > 2 ? atof(argv[2]) : 20;
+  int threads = argc > 3 ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+  threads = std::max(1, std::min(threads, robots));
+
+  std::vector<Result> reference(robots), parallel(robots);
+  double serial_wall = runAll(&reference, seconds, 1);
+  double parallel_wall = runAll(&parallel, seconds, threads);
+
+  int mismatches = 0, fallen = 0;
+  for (int i = 0; i < robots; i++) {
+    if (!same(reference[i], parallel[i])) {
+      printf("robot %-3d: mismatch theta %.6f/%.6f, position %+.6f/%+.6f\n", i, reference[i].theta,
+             parallel[i].theta, reference[i].position, parallel[i].position);
+      mismatches++;
+    }
+    if (reference[i].fallen) fallen++;
+  }
+  double simulated = robots * (CrlPlant().config.release + seconds);
+  printf("robots               : %d x %.0f s (virtual)\n", robots, seconds);
+  printf("1 thread             : %.2f s wall (%.0fx real time)\n", serial_wall, simulated / serial_wall);
+  char label[32];
+  snprintf(label, sizeof(label), "%d threads", threads);
+  printf("%-21s: %.2f s wall (%.0fx real time), speedup %.2f\n", label, parallel_wall, simulated / parallel_wall,
+         serial_wall / parallel_wall);
+  printf("results              : %d mismatched, %d fallen\n", mismatches, fallen);
+  printf("%s\n", mismatches == 0 && fallen == 0 ? "OK" : "NG");
+  return mismatches == 0 && fallen == 0 ? 0 : 1;
+}
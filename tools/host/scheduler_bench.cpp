@@ -0,0 +1,122 @@
+/**
+ * @file scheduler_bench.cpp
+ * @brief
+ * realtimeLoop()のスケジューラ(scheduler.h)をホスト上で動かし,タスクの実行状況と休止時間を表示する.
+ *
+ * 100Hzの制御ループ(updateState()とLOAD_USマイクロ秒の処理)に加えて,FAST_HZ(既定1000Hz),20Hz,10Hzのタスクを追加し,
+ * 各タスクの処理時間だけ仮想時計を進める.FAST_HZのタスクは割り込みタスク(SCHEDULER_INTERRUPT_PRIORITY)とし,
+ * ループ内の処理の実行中もタイマ割り込みの中で実行する.
+ * 制御ループの周期が境界どおり(境界の割り込みタスクの有無による揺らぎを除く)であること,
+ * 各タスクの実行回数と実行されなかった回数の合計が解放の回数と一致すること,
+ * 割り込みタスクと,周期がループ内の処理と全タスクの処理時間の合計より長いタスクは,
+ * 実行されなかった回数と期限を過ぎた回数が0であることを確かめ,問題がなければOKを表示する.
+ * CRAWL_SCHEDULERを1にしてビルドすること: CXXFLAGS="-O2 -DCRAWL_SCHEDULER=1" ./tools/host/build.sh
+ *
+ * Usage: scheduler_bench [SECONDS [LOAD_US [FAST_HZ]]]
+ */
+#include <crawl.h>
+#include <cstdio>
+#include <cstdlib>
+#include "hal_host.h"
+
+#if !CRAWL_SCHEDULER
+int main() {
+  printf("scheduler is disabled (build with -DCRAWL_SCHEDULER=1)\n");
+  return 0;
+}
+#else
+/** FAST_HZのタスクの処理時間 単位:マイクロ秒 */
+#define GYRO_TASK_US 60
+/** 20Hzのタスクの処理時間 単位:マイクロ秒 */
+#define TELEMETRY_TASK_US 300
+/** 10Hzのタスクの処理時間 単位:マイクロ秒 */
+#define MAG_TASK_US 500
+
+/** FAST_HZのタスク: ジャイロの積分を想定 */
+static void gyroTask() { hostAdvanceMicros(GYRO_TASK_US); }
+/** 20Hzのタスク: テレメトリの送出を想定 */
+static void telemetryTask() { hostAdvanceMicros(TELEMETRY_TASK_US); }
+/** 10Hzのタスク: 地磁気の処理を想定 */
+static void magTask() { hostAdvanceMicros(MAG_TASK_US); }
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 10;
+  unsigned long load_us = argc > 2 ? atol(argv[2]) : 2000;
+  double fast_hz = argc > 3 ? atof(argv[3]) : 1000;
+  const float dt = 0.01;
+
+  hostReset();
+  hostSetAccel(0, 16384, 0);  // 直立: 重力はセンサのY軸方向
+  hostSetGyro(0, 0, 0);
+  hostSetMag(0, 0, 0);
+
+  crl.setDt(dt);
+  crl.init();
+  struct {
+    const char* name;
+    int8_t id;
+    double rate;
+    bool interrupt;
+  } tasks[] = {
+      {"loop 100Hz", SCHEDULER_LOOP_TASK, 100, false},
+      {"gyro (isr)", crl.addTask(gyroTask, 1 / fast_hz, SCHEDULER_INTERRUPT_PRIORITY), fast_hz, true},
+      {"telemetry 20Hz", crl.addTask(telemetryTask, 0.05, 1), 20, false},
+      {"mag 10Hz", crl.addTask(magTask, 0.1, 2), 10, false},
+  };
+  crl.realtimeLoop();
+  CrlTaskStats before[4];
+  for (int i = 0; i < 4; i++) crl.getTaskStats(tasks[i].id, &before[i]);
+
+  long periods = seconds / dt;
+  long errors = 0;
+  unsigned long start = halMicros();
+  unsigned long sleep_start = hostGetSleepMicros();
+  unsigned long min_period = 0xFFFFFFFF, max_period = 0;
+  unsigned long last = start;
+  for (long i = 0; i < periods; i++) {
+    crl.updateState();
+    hostAdvanceMicros(load_us);
+    crl.realtimeLoop();
+    unsigned long now = halMicros();
+    if (now - last < min_period) min_period = now - last;
+    if (now - last > max_period) max_period = now - last;
+    last = now;
+  }
+  double elapsed = halMicros() - start;
+
+  // 割り込みタスクは常に,それ以外はループ内の処理(解放から完了まで)と全タスクの処理の後でも間に合う周期なら,
+  // 捨てられず期限も過ぎない
+  CrlTaskStats loop;
+  crl.getTaskStats(SCHEDULER_LOOP_TASK, &loop);
+  double busy_us = loop.max_response + GYRO_TASK_US + TELEMETRY_TASK_US + MAG_TASK_US;
+
+  printf("%-15s %8s %8s %8s %12s\n", "task", "runs", "skipped", "missed", "max resp us");
+  for (int i = 0; i < 4; i++) {
+    CrlTaskStats stats;
+    if (tasks[i].id == SCHEDULER_NO_TASK) {
+      errors++;
+      continue;
+    }
+    crl.getTaskStats(tasks[i].id, &stats);
+    unsigned long runs = stats.runs - before[i].runs;
+    unsigned long skipped = stats.skipped - before[i].skipped;
+    unsigned missed = stats.missed - before[i].missed;
+    printf("%-15s %8lu %8lu %8u %12lu\n", tasks[i].name, runs, skipped, missed, (unsigned long)stats.max_response);
+    if ((tasks[i].interrupt || 1e6 / tasks[i].rate > busy_us) && (skipped != 0 || missed != 0)) errors++;
+    // 解放の回数(計測の開始と終了の時点で実行待ちのものがあるため,1回の誤差を許す)
+    double releases = elapsed * 1e-6 * tasks[i].rate;
+    if (runs + skipped < releases - 1 || runs + skipped > releases + 1) errors++;
+  }
+  // CRAWL_SCHEDULER_TASKSを超えては追加できない
+  int added = 3;
+  while (added <= CRAWL_SCHEDULER_TASKS && crl.addTask(gyroTask, 1, 0) != SCHEDULER_NO_TASK) added++;
+  if (added != CRAWL_SCHEDULER_TASKS) errors++;
+
+  printf("loop period us  : min %lu, max %lu\n", min_period, max_period);
+  printf("cpu idle        : %.1f %%\n", 100.0 * (hostGetSleepMicros() - sleep_start) / elapsed);
+  // 境界で割り込みタスクが実行されるかどうかで,戻る時刻がその処理時間だけ揺らぐ
+  if (min_period < 10000 - GYRO_TASK_US || max_period > 10000 + GYRO_TASK_US) errors++;
+  printf("%s\n", errors ? "NG" : "OK");
+  return errors ? 1 : 0;
+}
+#endif
@@ -0,0 +1,102 @@
+/**
+ * @file telemetry_decode.cpp
+ * @brief
+ * UARTで受信したテレメトリ(telemetry.h)のバイト列を,列ごとの値を並べたCSVに変換する.
+ *
+ * TELEMETRY_RECORDのフレームを一行ずつ出力し,姿勢角度と上端速度は物理量に戻す.
+ * PROFILE_CSVを指定すると,TELEMETRY_PROFILE(プロファイラの計測結果)のフレームを一行ずつそのファイルに書き出す.
+ * 壊れたフレーム(COBS,CRC,バージョンの不一致)と未知の種類のフレームは読み飛ばし,その数を標準エラー出力に表示する.
+ * 最初の区切り(0x00)までは途中から受信したフレームとみなして捨てる.
+ *
+ * Usage: telemetry_decode [FILE [PROFILE_CSV]]
+ *   FILEを省略するか-を指定すると標準入力から読む.例: telemetry_decode /dev/ttyUSB0 > log.csv
+ */
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "flight_recorder.h"
+#include "profiler.h"
+#include "telemetry.h"
+
+static void printHeader() {
+  printf("sequence,time_us,period_us,acc_x_raw,acc_y_raw,acc_z_raw,temp_raw,gyro_x_raw,gyro_y_raw,gyro_z_raw,"
+         "mag_x_raw,mag_y_raw,mag_z_raw,encoder_left,encoder_right,motor_left,motor_right,theta_x,theta_y,theta_z,"
+         "head_velocity\n");
+}
+
+static void printRecord(const CrlRecord& record) {
+  printf("%u,%lu,%u", record.sequence, (unsigned long)record.time, record.period);
+  for (int i = 0; i < 10; i++) printf(",%d", record.attitude[i]);
+  printf(",%d,%d,%d,%d", record.encoder[0], record.encoder[1], record.motor[0], record.motor[1]);
+  for (int i = 0; i < 3; i++) printf(",%.6f", record.theta[i] / RECORDER_ANGLE_SCALE);
+  printf(",%.6f\n", record.head_velocity / RECORDER_VELOCITY_SCALE);
+}
+
+static void printProfileHeader(FILE* out) {
+  fprintf(out, "phase,overruns,count,sum_us,min_us,max_us");
+  for (int i = 0; i < PROFILER_BUCKETS; i++) fprintf(out, ",bucket%d", i);
+  fprintf(out, "\n");
+}
+
+static void printProfile(FILE* out, const CrlProfileFrame& frame) {
+  fprintf(out, "%u,%u,%lu,%lu,%u,%u", frame.phase, frame.overruns, (unsigned long)frame.profile.count,
+          (unsigned long)frame.profile.sum, frame.profile.min, frame.profile.max);
+  for (int i = 0; i < PROFILER_BUCKETS; i++) fprintf(out, ",%u", frame.profile.histogram[i]);
+  fprintf(out, "\n");
+}
+
+int main(int argc, char** argv) {
+  FILE* in = argc > 1 && strcmp(argv[1], "-") != 0 ? fopen(argv[1], "rb") : stdin;
+  if (in == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+  FILE* profile_out = NULL;
+  if (argc > 2) {
+    profile_out = fopen(argv[2], "w");
+    if (profile_out == NULL) {
+      perror(argv[2]);
+      return 1;
+    }
+    printProfileHeader(profile_out);
+  }
+
+  std::vector<uint8_t> frame;
+  bool synced = false;
+  long records = 0, profiles = 0, broken = 0, unknown = 0;
+  printHeader();
+  for (int c; (c = fgetc(in)) != EOF;) {
+    if (c != 0) {
+      frame.push_back(c);
+      continue;
+    }
+    if (synced && !frame.empty()) {
+      uint8_t type, payload[TELEMETRY_MAX_PAYLOAD];
+      int16_t length = frame.size() <= TELEMETRY_MAX_FRAME ? telemetryDecode(frame.data(), frame.size(), &type, payload)
+                                                           : TELEMETRY_ERROR_FRAME;
+      if (length < 0) {
+        broken++;
+      } else if (type == TELEMETRY_RECORD && length == sizeof(CrlRecord)) {
+        CrlRecord record;
+        memcpy(&record, payload, sizeof(record));
+        printRecord(record);
+        records++;
+      } else if (type == TELEMETRY_PROFILE && length == sizeof(CrlProfileFrame)) {
+        CrlProfileFrame frame;
+        memcpy(&frame, payload, sizeof(frame));
+        if (profile_out != NULL) printProfile(profile_out, frame);
+        profiles++;
+      } else {
+        unknown++;
+      }
+    }
+    synced = true;
+    frame.clear();
+  }
+  if (in != stdin) fclose(in);
+  if (profile_out != NULL) fclose(profile_out);
+
+  fprintf(stderr, "records: %ld, profiles: %ld, broken frames: %ld, unknown frames: %ld\n", records, profiles, broken,
+          unknown);
+  return 0;
+}
@@ -0,0 +1,233 @@
+/**
+ * @file trace_replay.cpp
+ * @brief
+ * 記録したセンサの生値の列(トレース)をCrlRobotに与え直し,センサヒュージョンの計算時間と出力の変化を調べる.
+ *
+ * トレースはtelemetry_decodeが出力するCSV(フライトレコーダのレコード)と同じ形式で,
+ * 各行の姿勢センサの生値とエンコーダの増分を模擬デバイス(hal_host.cpp)に設定し,記録された周期だけ仮想時計を進めて
+ * updateState()を呼び出す.モータ指令値も記録どおりに与える.init()中のキャリブレーションには最初の行の値を使う.
+ *
+ * 得られたtheta_x,theta_y,theta_z,head_velocityを基準出力(ゴールデン)と比べ,列ごとの二乗平均と最大の差を表示する.
+ * 最大の差がTOLERANCEを超えた場合はNGとして終了コード1を返す.updateState()一回あたりの計算時間(ホストの実時間)と,
+ * 模擬デバイスの処理を含めた一秒あたりの処理レコード数も表示する.時間の計測にはトレースをREPEAT回繰り返す.
+ * 基準出力はトレースと同じ場所に置き,計算方法を意図して変えた場合だけ--updateで作り直す.
+ * 基準出力は既定の設定(浮動小数点演算)で作ったもので,CRAWL_FIXED_POINTなど設定を変えてビルドした場合の差は
+ * --toleranceで許容値を与えて確かめる(CRAWL_FIXED_POINTでは3e-5.fixed_point.hを参照).
+ *
+ * tools/host/traces/sway_drive.csvは,直立静止(2秒),前後の揺動(4秒),旋回しながらの走行(4秒)の10秒間を
+ * 100Hzで,ジャイロのオフセットとセンサの雑音を含めて合成したトレース.
+ *
+ * Usage: trace_replay [--kalman] [--update] [--repeat REPEAT] [--tolerance TOLERANCE] [TRACE [GOLDEN]]
+ *   TRACEの初期値はtools/host/traces/sway_drive.csv(リポジトリの最上位から実行する)
+ *   GOLDENの初期値はTRACEの.csvを.golden.csv(--kalmanの場合は.kalman.golden.csv)に置き換えたもの
+ *   --kalman    全軸の姿勢角度をカルマンフィルタで計算する
+ *   --update    比較せずに基準出力を書き出す
+ */
+#include <crawl.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "hal.h"
+#include "hal_host.h"
+
+/** 比較する出力の数 */
+#define REPLAY_OUTPUTS 4
+/** 最大の差の許容値の初期値 (rad, m/s) */
+#define REPLAY_TOLERANCE 1e-4
+
+/** トレースの一行 */
+struct TraceRow {
+  /** 直前の周期の長さ 単位:マイクロ秒 */
+  unsigned long period;
+  /** 姿勢センサの生値(加速度3軸,温度,ジャイロ3軸,地磁気3軸) */
+  int16_t attitude[10];
+  /** エンコーダの増分(左,右) */
+  int16_t encoder[2];
+  /** モータ指令値(左,右) [-255, 255] */
+  int16_t motor[2];
+};
+
+/** 出力の列名 */
+static const char* const OUTPUT_NAMES[REPLAY_OUTPUTS] = {"theta_x", "theta_y", "theta_z", "head_velocity"};
+
+/** telemetry_decodeの形式のCSVを読み込む */
+static bool loadTrace(const char* path, std::vector<TraceRow>* rows) {
+  FILE* in = fopen(path, "r");
+  if (in == NULL) {
+    perror(path);
+    return false;
+  }
+  char line[512];
+  long number = 0;
+  while (fgets(line, sizeof(line), in) != NULL) {
+    number++;
+    if (number == 1 || line[0] == '#' || line[0] == '\n') continue;  // 見出し行
+    // sequence,time_us,period_us,生値10個,エンコーダ2個,モータ2個,(記録時の出力)
+    long v[17];
+    char* p = line;
+    int n = 0;
+    for (; n < 17; n++) {
+      char* end;
+      v[n] = strtol(p, &end, 10);
+      if (end == p || (*end != ',' && n < 16)) break;
+      p = end + 1;
+    }
+    if (n < 17) {
+      fprintf(stderr, "%s:%ld: malformed row\n", path, number);
+      fclose(in);
+      return false;
+    }
+    TraceRow row;
+    row.period = v[2];
+    for (int i = 0; i < 10; i++) row.attitude[i] = v[3 + i];
+    row.encoder[0] = v[13];
+    row.encoder[1] = v[14];
+    row.motor[0] = v[15];
+    row.motor[1] = v[16];
+    rows->push_back(row);
+  }
+  fclose(in);
+  return !rows->empty();
+}
+
+/** 模擬デバイスに一行分の生値を設定する */
+static void setSensors(const TraceRow& row) {
+  hostSetAccel(row.attitude[0], row.attitude[1], row.attitude[2]);
+  hostSetTemperature(row.attitude[3]);
+  hostSetGyro(row.attitude[4], row.attitude[5], row.attitude[6]);
+  hostSetMag(row.attitude[7], row.attitude[8], row.attitude[9]);
+}
+
+int main(int argc, char** argv) {
+  bool kalman = false, update = false;
+  long repeat = 100;
+  double tolerance = REPLAY_TOLERANCE;
+  const char* paths[2] = {"tools/host/traces/sway_drive.csv", NULL};
+  int positional = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--kalman") == 0) {
+      kalman = true;
+    } else if (strcmp(argv[i], "--update") == 0) {
+      update = true;
+    } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = atol(argv[++i]);
+    } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      tolerance = atof(argv[++i]);
+    } else if (argv[i][0] != '-' && positional < 2) {
+      paths[positional++] = argv[i];
+    } else {
+      fprintf(stderr, "Usage: %s [--kalman] [--update] [--repeat N] [--tolerance X] [TRACE [GOLDEN]]\n", argv[0]);
+      return 2;
+    }
+  }
+  std::string golden_path;
+  if (paths[1] != NULL) {
+    golden_path = paths[1];
+  } else {
+    golden_path = paths[0];
+    if (golden_path.size() > 4 && golden_path.compare(golden_path.size() - 4, 4, ".csv") == 0) {
+      golden_path.resize(golden_path.size() - 4);
+    }
+    golden_path += kalman ? ".kalman.golden.csv" : ".golden.csv";
+  }
+
+  std::vector<TraceRow> rows;
+  if (!loadTrace(paths[0], &rows)) return 2;
+  if (repeat < 1) repeat = 1;
+
+  hostReset();
+  setSensors(rows[0]);
+  crl.setDt(0.01);
+  crl.init();
+  if (kalman) crl.setKalman(true);
+
+  hostSetMicrosTick(0);  // 計測のための時刻取得で仮想時計を進めない
+  std::vector<float> outputs(rows.size() * REPLAY_OUTPUTS);
+  double update_ns = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (long r = 0; r < repeat; r++) {
+    for (size_t i = 0; i < rows.size(); i++) {
+      const TraceRow& row = rows[i];
+      setSensors(row);
+      hostAddEncoder(row.encoder[0], row.encoder[1]);
+      crl.setMotorLeft(row.motor[0] / 255.0);
+      crl.setMotorRight(row.motor[1] / 255.0);
+      hostAdvanceMicros(row.period);
+      auto t0 = std::chrono::steady_clock::now();
+      crl.updateState();
+      auto t1 = std::chrono::steady_clock::now();
+      update_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+      if (r > 0) continue;  // 比較するのは最初の一回だけ
+      float* out = &outputs[i * REPLAY_OUTPUTS];
+      out[0] = crl.getThetaX();
+      out[1] = crl.getThetaY();
+      out[2] = crl.getThetaZ();
+      out[3] = crl.getHeadVelocity();
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  long updates = (long)rows.size() * repeat;
+
+  printf("trace                : %s (%zu records)\n", paths[0], rows.size());
+  printf("fusion               : %s\n", kalman ? "kalman" : "complementary");
+  printf("host ns/updateState  : %.1f\n", update_ns / updates);
+  printf("throughput           : %.0f samples/s (including device emulation)\n", updates / seconds);
+
+  if (update) {
+    FILE* out = fopen(golden_path.c_str(), "w");
+    if (out == NULL) {
+      perror(golden_path.c_str());
+      return 2;
+    }
+    fprintf(out, "%s,%s,%s,%s\n", OUTPUT_NAMES[0], OUTPUT_NAMES[1], OUTPUT_NAMES[2], OUTPUT_NAMES[3]);
+    for (size_t i = 0; i < rows.size(); i++) {
+      const float* o = &outputs[i * REPLAY_OUTPUTS];
+      fprintf(out, "%.9g,%.9g,%.9g,%.9g\n", o[0], o[1], o[2], o[3]);
+    }
+    fclose(out);
+    printf("golden               : %s written\n", golden_path.c_str());
+    return 0;
+  }
+
+  FILE* in = fopen(golden_path.c_str(), "r");
+  if (in == NULL) {
+    perror(golden_path.c_str());
+    return 2;
+  }
+  char line[256];
+  double sum_sq[REPLAY_OUTPUTS] = {0}, max_diff[REPLAY_OUTPUTS] = {0};
+  size_t count = 0;
+  bool header = true;
+  while (fgets(line, sizeof(line), in) != NULL && count < rows.size()) {
+    if (header) {
+      header = false;
+      continue;
+    }
+    float golden[REPLAY_OUTPUTS];  // %.9gで書き出したfloatは元の値に戻る
+    if (sscanf(line, "%f,%f,%f,%f", &golden[0], &golden[1], &golden[2], &golden[3]) != REPLAY_OUTPUTS) break;
+    for (int j = 0; j < REPLAY_OUTPUTS; j++) {
+      double d = (double)outputs[count * REPLAY_OUTPUTS + j] - golden[j];
+      sum_sq[j] += d * d;
+      max_diff[j] = fmax(max_diff[j], fabs(d));
+    }
+    count++;
+  }
+  fclose(in);
+  if (count != rows.size()) {
+    fprintf(stderr, "%s: %zu rows for %zu records\n", golden_path.c_str(), count, rows.size());
+    return 2;
+  }
+
+  int errors = 0;
+  printf("golden               : %s\n", golden_path.c_str());
+  for (int j = 0; j < REPLAY_OUTPUTS; j++) {
+    printf("%-20s : rms %.3g, max %.3g\n", OUTPUT_NAMES[j], sqrt(sum_sq[j] / count), max_diff[j]);
+    if (!(max_diff[j] <= tolerance)) errors++;
+  }
+  printf("%s\n", errors ? "NG" : "OK");
+  return errors ? 1 : 0;
+}
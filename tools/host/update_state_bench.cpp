@@ -0,0 +1,64 @@
+/**
+ * @file update_state_bench.cpp
+ * @brief
+ * CrlRobot::updateState()をホスト上で実行し,一回あたりの実行時間を計測する.
+ *
+ * I2Cデバイスはhal_host.cppで模擬される.直立静止状態のセンサ値を与え,
+ * 計算時間(ホストの実時間)と,updateState()がI2C通信を待った時間(仮想時間)を表示する.
+ * 呼び出しの間には制御周期(10ms)ぶん仮想時計を進め,その間にバックグラウンドの通信が進む.
+ * 上端速度などは取得時に計算されるため,計算時間には制御ループと同じくgetThetaZ()とgetHeadVelocity()を含める.
+ *
+ * Usage: update_state_bench [ITERATIONS [kalman] [stand]]
+ *   kalmanを指定すると全軸の姿勢角度をカルマンフィルタで計算する
+ *   standを指定するとstand.inoが使うZ軸の姿勢角度と上端速度だけを計算する(CrlRobot::setOutputs())
+ */
+#include <crawl.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include "hal_host.h"
+
+/** 計算結果を捨てられないようにするための変数 */
+static volatile float sink;
+
+int main(int argc, char** argv) {
+  long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+
+  hostReset();
+  hostSetAccel(0, 16384, 0);  // 直立: 重力はセンサのY軸方向
+  hostSetGyro(0, 0, 0);
+  hostSetMag(0, 0, 0);
+
+  crl.setDt(0.01);
+  crl.init();
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "kalman") == 0) crl.setKalman(true);
+    if (strcmp(argv[i], "stand") == 0) crl.setOutputs(CRAWL_OUTPUT_THETA_Z | CRAWL_OUTPUT_HEAD_VELOCITY);
+  }
+
+  hostSetMicrosTick(0);  // 計測のための時刻取得で仮想時計を進めない
+  unsigned long bus_start = hostGetI2cBusMicros();
+  unsigned long blocked_us = 0;
+  double ns = 0;
+  for (long i = 0; i < iterations; i++) {
+    hostAdvanceMicros(10000);
+    hostAddEncoder(1, 1);
+    unsigned long t0 = halMicros();
+    auto start = std::chrono::steady_clock::now();
+    crl.updateState();
+    sink = crl.getThetaZ() + crl.getHeadVelocity();
+    auto end = std::chrono::steady_clock::now();
+    blocked_us += halMicros() - t0;
+    ns += std::chrono::duration<double, std::nano>(end - start).count();
+  }
+
+  printf("iterations           : %ld\n", iterations);
+  printf("host ns/updateState  : %.1f\n", ns / iterations);
+  printf("blocked us/update    : %.1f\n", (double)blocked_us / iterations);
+  printf("bus us/period        : %.1f\n", (double)(hostGetI2cBusMicros() - bus_start) / iterations);
+  printf("theta_x              : %f\n", crl.getThetaX());
+  printf("theta_y              : %f\n", crl.getThetaY());
+  printf("theta_z              : %f\n", crl.getThetaZ());
+  printf("head_velocity        : %f\n", crl.getHeadVelocity());
+  return 0;
+}
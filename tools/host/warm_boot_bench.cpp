@@ -0,0 +1,202 @@
+/**
+ * @file warm_boot_bench.cpp
+ * @brief
+ * キャリブレーションの保存とウォームブート(CRAWL_WARM_BOOT),静止中のオフセットの補正をホスト上で確かめる.
+ *
+ * 模擬EEPROMは再起動(hostReset())をまたいで残るが,crlは一度しか初期化できないため,起動ごとに子プロセスで
+ * init()を実行し,EEPROMの内容と結果を親プロセスへ返す.ジャイロにはオフセットと一様な雑音を与える.
+ * - 消去されたEEPROMからの起動はキャリブレーションを行い,結果を保存すること
+ * - 同じ条件での起動はウォームブートとなり,init()が短く,姿勢角度がキャリブレーションした場合と一致すること
+ * - 温度,ジャイロのオフセットが変わった場合,EEPROMが壊れた場合はキャリブレーションに戻ること
+ * - 起動後にオフセットが変わっても,静止していれば補正され,モータを回している間は補正されないこと
+ * を確かめ,問題がなければOKを表示する.
+ *
+ * CRAWL_WARM_BOOTは既定で0のため,-DCRAWL_WARM_BOOT=1(オフセットの補正も確かめる場合は-DCRAWL_GYRO_REFINE_SHIFT=10)で
+ * ビルドする.
+ *
+ * Usage: warm_boot_bench
+ */
+#include <crawl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "hal.h"
+#include "hal_host.h"
+
+#if !CRAWL_WARM_BOOT
+int main() {
+  printf("warm boot is disabled (build with -DCRAWL_WARM_BOOT=1)\n");
+  return 0;
+}
+#else
+/** ジャイロのオフセット(X,Y,Z) 単位:生値 */
+static const int16_t GYRO_BIAS[3] = {37, -52, 18};
+/** 温度の生値(約27℃) */
+#define TEMPERATURE 2000
+/** 生値から[rad/s]への換算係数 */
+#define GYRO_SCALE 0.00013316
+
+/** 起動の条件 */
+struct Boot {
+  /** 起動前のEEPROMの内容 */
+  uint8_t eeprom[HAL_EEPROM_SIZE];
+  /** ジャイロのオフセットに加える値(X軸) */
+  int16_t bias_shift;
+  /** 温度の生値 */
+  int16_t temperature;
+  /** 起動後,X軸のオフセットに加える値 */
+  int16_t drift;
+  /** 起動後にモータを回すか */
+  bool motor;
+};
+
+/** 起動の結果 */
+struct Result {
+  /** 起動後のEEPROMの内容 */
+  uint8_t eeprom[HAL_EEPROM_SIZE];
+  /** init()の所要時間 単位:マイクロ秒 */
+  unsigned long init_us;
+  /** ウォームブートしたか */
+  bool warm;
+  /** 1秒後の姿勢角度 */
+  float theta[3];
+  /** 最後の10秒間のZ軸周りの角速度(センサのX軸)の平均 単位:生値 */
+  double rate_z;
+};
+
+/** ジャイロのX軸のオフセット */
+static int16_t bias_x;
+/** 雑音の乱数の状態 */
+static uint32_t noise_seed = 1;
+
+/** -10〜10の一様な雑音 */
+static int16_t noise() {
+  noise_seed = noise_seed * 1103515245 + 12345;
+  return (int16_t)((noise_seed >> 16) % 21) - 10;
+}
+
+/** 標本化のたびに模擬MPU-9250から呼ばれる */
+static void imuSource(unsigned long) {
+  hostSetGyro(bias_x + noise(), GYRO_BIAS[1] + noise(), GYRO_BIAS[2] + noise());
+}
+
+/** 子プロセスで起動し,結果を返す */
+static void boot(const Boot* condition, Result* result) {
+  hostReset();
+  hostEraseEeprom();
+  halEepromWrite(0, condition->eeprom, HAL_EEPROM_SIZE);
+  hostReset();  // EEPROMは残る
+  hostSetAccel(0, 16384, 0);  // 直立: 重力はセンサのY軸方向
+  hostSetMag(0, 0, 0);
+  hostSetTemperature(condition->temperature);
+  bias_x = GYRO_BIAS[0] + condition->bias_shift;
+  hostSetImuSource(imuSource);
+
+  crl.setDt(0.01);
+  unsigned long start = halMicros();
+  crl.init();
+  result->init_us = halMicros() - start;
+  result->warm = crl.isWarmBoot();
+  for (int i = 0; i < 100; i++) {
+    crl.updateState();
+    crl.realtimeLoop();
+  }
+  result->theta[0] = crl.getThetaX();
+  result->theta[1] = crl.getThetaY();
+  result->theta[2] = crl.getThetaZ();
+
+  bias_x += condition->drift;
+  if (condition->motor) {
+    crl.setMotorLeft(0.3);
+    crl.setMotorRight(0.3);
+  }
+  double sum = 0;
+  for (int i = 0; i < 6000; i++) {  // 60秒
+    crl.updateState();
+    crl.realtimeLoop();
+    if (i >= 5000) sum += crl.getThetaDotZ() / GYRO_SCALE;
+  }
+  result->rate_z = sum / 1000;
+  halEepromRead(0, result->eeprom, HAL_EEPROM_SIZE);
+}
+
+/** 子プロセスで起動する */
+static bool run(const Boot* condition, Result* result) {
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    boot(condition, result);
+    bool ok = write(fds[1], result, sizeof(*result)) == (ssize_t)sizeof(*result);
+    _exit(ok ? 0 : 1);
+  }
+  close(fds[1]);
+  size_t got = 0;
+  while (got < sizeof(*result)) {
+    ssize_t n = read(fds[0], (uint8_t*)result + got, sizeof(*result) - got);
+    if (n <= 0) break;
+    got += n;
+  }
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return got == sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main() {
+  static Boot condition;
+  static Result cold, result;
+  int errors = 0;
+
+  memset(&condition, 0, sizeof(condition));
+  memset(condition.eeprom, 0xFF, sizeof(condition.eeprom));
+  condition.temperature = TEMPERATURE;
+  if (!run(&condition, &cold)) return 1;
+  printf("%-24s: %s, init %7.1f ms, rate %6.2f\n", "erased eeprom", cold.warm ? "warm" : "cold", cold.init_us / 1e3,
+         cold.rate_z);
+  if (cold.warm || !memcmp(cold.eeprom, condition.eeprom, HAL_EEPROM_SIZE)) errors++;
+
+  struct {
+    const char* name;
+    int16_t bias_shift;
+    int16_t temperature;
+    int16_t drift;
+    bool motor;
+    bool corrupt;
+    bool expect_warm;
+  } cases[] = {
+      {"same conditions", 0, TEMPERATURE, 0, false, false, true},
+      {"temperature +5C", 0, TEMPERATURE + 1669, 0, false, false, false},
+      {"gyro bias +100", 100, TEMPERATURE, 0, false, false, false},
+      {"corrupted eeprom", 0, TEMPERATURE, 0, false, true, false},
+      {"drift +12, stationary", 0, TEMPERATURE, 12, false, false, true},
+      {"drift +12, motor on", 0, TEMPERATURE, 12, true, false, true},
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    memcpy(condition.eeprom, cold.eeprom, HAL_EEPROM_SIZE);
+    if (cases[i].corrupt) condition.eeprom[CRAWL_CALIBRATION_ADDRESS + 5] ^= 0x01;
+    condition.bias_shift = cases[i].bias_shift;
+    condition.temperature = cases[i].temperature;
+    condition.drift = cases[i].drift;
+    condition.motor = cases[i].motor;
+    if (!run(&condition, &result)) return 1;
+    double theta_error = 0;
+    for (int j = 0; j < 3; j++) theta_error = fmax(theta_error, fabs(result.theta[j] - cold.theta[j]));
+    printf("%-24s: %s, init %7.1f ms, theta error %.4f rad, rate %6.2f\n", cases[i].name,
+           result.warm ? "warm" : "cold", result.init_us / 1e3, theta_error, result.rate_z);
+    if (result.warm != cases[i].expect_warm) errors++;
+    if (result.warm && (result.init_us > 150000 || theta_error > 0.01)) errors++;
+    if (!result.warm && result.init_us < 1000000) errors++;
+    // 静止していればオフセットが補正され,モータを回していれば補正されない
+    double expected_rate = cases[i].motor || CRAWL_GYRO_REFINE_SHIFT == 0 ? cases[i].drift : 0;
+    if (fabs(result.rate_z - expected_rate) > 1.5) errors++;  // キャリブレーションの雑音の分
+  }
+
+  printf("%s\n", errors ? "NG" : "OK");
+  return errors ? 1 : 0;
+}
+#endif